@@ -0,0 +1,262 @@
+#include "balance_file.hpp"
+
+#include <boost/filesystem.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace eosio {
+
+namespace bip = boost::interprocess;
+namespace bfs = boost::filesystem;
+
+static constexpr uint64_t balance_file_magic = 0x31304c414247444cull;   // "LDGBAL01"
+static constexpr uint64_t journal_magic      = 0x31304c4e524a444cull;   // "LDJRNL01"
+static constexpr uint64_t balance_file_version = 1;
+
+static inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static uint64_t next_pow2(uint64_t v) {
+    uint64_t p = 1024;
+    while (p < v) p <<= 1;
+    return p;
+}
+
+size_t balance_file::key_hash::operator()(const key& k) const {
+    return mix64(k.account ^ mix64(k.contract ^ mix64(k.symbol_code)));
+}
+
+balance_file::balance_file(const std::string& path, uint64_t initial_capacity) :
+_path(path), _journal_path(path + ".journal")
+{
+    if (!bfs::exists(_path) || bfs::file_size(_path) < header_size) {
+        const uint64_t capacity = next_pow2(initial_capacity);
+        { std::FILE* f = std::fopen(_path.c_str(), "wb"); if (f) std::fclose(f); }
+        bfs::resize_file(_path, header_size + capacity * sizeof(slot));
+        map_file(capacity);
+
+        std::memset(hdr(), 0, sizeof(header));
+        hdr()->magic = balance_file_magic;
+        hdr()->version = balance_file_version;
+        hdr()->capacity = capacity;
+        sync();
+    } else {
+        // header 를 먼저 읽어 capacity 를 알아낸다.
+        bip::file_mapping mapping(_path.c_str(), bip::read_only);
+        bip::mapped_region region(mapping, bip::read_only, 0, sizeof(header));
+        const header h = *reinterpret_cast<const header*>(region.get_address());
+        if (h.magic != balance_file_magic || h.version != balance_file_version)
+            throw std::runtime_error("invalid balance file " + _path);
+        if (bfs::file_size(_path) < header_size + h.capacity * sizeof(slot))
+            throw std::runtime_error("truncated balance file " + _path);
+        map_file(h.capacity);
+    }
+
+    replay_journal();
+}
+
+balance_file::~balance_file()
+{
+
+}
+
+void balance_file::map_file(const uint64_t capacity) {
+    _region.reset();
+    _mapping = std::make_unique<bip::file_mapping>(_path.c_str(), bip::read_write);
+    _region = std::make_unique<bip::mapped_region>(*_mapping, bip::read_write, 0, header_size + capacity * sizeof(slot));
+}
+
+uint64_t balance_file::global_sequence() const {
+    return hdr()->global_sequence;
+}
+
+uint64_t balance_file::size() const {
+    return hdr()->count;
+}
+
+void balance_file::put(const uint64_t account, const uint64_t contract, const uint64_t symbol, const int64_t amount) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _pending[key{account, contract, symbol >> 8}] = slot{account, contract, symbol, amount};
+}
+
+void balance_file::checkpoint(const uint64_t global_sequence) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    for (auto& c : _pending) {
+        _staged[c.first] = c.second;
+    }
+    _pending.clear();
+    _staged_global_sequence = global_sequence;
+}
+
+void balance_file::flush() {
+    std::lock_guard<std::mutex> flush_lock(_flush_mtx);
+
+    change_map changes;
+    uint64_t gs = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        changes.swap(_staged);
+        gs = _staged_global_sequence;
+    }
+    if (changes.empty() && gs <= hdr()->global_sequence) return;
+
+    write_journal(changes, gs);
+
+    grow(hdr()->count + changes.size());
+    apply(changes);
+    sync();
+
+    hdr()->global_sequence = gs;
+    hdr()->commit_count++;
+    sync();
+
+    ::unlink(_journal_path.c_str());
+}
+
+static balance_file::slot& find_in(balance_file::slot* s, const uint64_t capacity, 
+        const uint64_t account, const uint64_t contract, const uint64_t symbol_code, const size_t hash) {
+    const uint64_t mask = capacity - 1;
+    uint64_t i = hash & mask;
+    while (s[i].contract != 0) {
+        if (s[i].account == account && s[i].contract == contract && (s[i].symbol >> 8) == symbol_code)
+            break;
+        i = (i + 1) & mask;
+    }
+    return s[i];
+}
+
+balance_file::slot& balance_file::find_slot(const key& k) const {
+    return find_in(slots(), hdr()->capacity, k.account, k.contract, k.symbol_code, key_hash()(k));
+}
+
+void balance_file::apply(const change_map& changes) {
+    for (const auto& c : changes) {
+        slot& s = find_slot(c.first);
+        if (s.contract == 0) hdr()->count++;
+        s = c.second;
+    }
+}
+
+// load factor 0.7 을 넘기 전에 두배 크기 파일로 다시 만든다. 
+void balance_file::grow(const uint64_t min_count) {
+    uint64_t capacity = hdr()->capacity;
+    while (min_count * 10 > capacity * 7) capacity <<= 1;
+    if (capacity == hdr()->capacity) return;
+
+    std::vector<slot> live;
+    live.reserve(hdr()->count);
+    for_each([&](const slot& s) { live.push_back(s); });
+    const header old = *hdr();
+
+    // 새 파일을 완성하고 sync 한 뒤에 rename. 도중에 죽어도 원본과 journal 은 그대로 남는다.
+    const std::string grow_path = _path + ".grow";
+    { std::FILE* f = std::fopen(grow_path.c_str(), "wb"); if (f) std::fclose(f); }
+    bfs::resize_file(grow_path, header_size + capacity * sizeof(slot));
+    {
+        bip::file_mapping mapping(grow_path.c_str(), bip::read_write);
+        bip::mapped_region region(mapping, bip::read_write, 0, header_size + capacity * sizeof(slot));
+        header* h = reinterpret_cast<header*>(region.get_address());
+        slot* s = reinterpret_cast<slot*>(static_cast<char*>(region.get_address()) + header_size);
+
+        *h = old;
+        h->capacity = capacity;
+        h->count = 0;
+        for (const auto& l : live) {
+            const key k{l.account, l.contract, l.symbol >> 8};
+            slot& dst = find_in(s, capacity, k.account, k.contract, k.symbol_code, key_hash()(k));
+            if (dst.contract == 0) h->count++;
+            dst = l;
+        }
+        region.flush(0, 0, false);
+    }
+
+    _region.reset();
+    _mapping.reset();
+    bfs::rename(grow_path, _path);
+    map_file(capacity);
+}
+
+void balance_file::sync() {
+    _region->flush(0, 0, false);
+}
+
+void balance_file::for_each(const std::function<void(const slot&)>& f) const {
+    const slot* s = slots();
+    const uint64_t capacity = hdr()->capacity;
+    for (uint64_t i = 0; i < capacity; i++) {
+        if (s[i].contract != 0) f(s[i]);
+    }
+}
+
+static uint64_t journal_checksum(const std::vector<balance_file::slot>& entries, const uint64_t global_sequence) {
+    uint64_t sum = mix64(global_sequence);
+    for (const auto& e : entries) {
+        sum = mix64(sum ^ e.account) ^ mix64(e.contract ^ e.symbol) ^ static_cast<uint64_t>(e.amount);
+    }
+    return sum;
+}
+
+void balance_file::write_journal(const change_map& changes, const uint64_t global_sequence) {
+    std::vector<slot> entries;
+    entries.reserve(changes.size());
+    for (const auto& c : changes) entries.push_back(c.second);
+
+    const uint64_t head[3] = { journal_magic, global_sequence, entries.size() };
+    const uint64_t checksum = journal_checksum(entries, global_sequence);
+
+    const std::string tmp_path = _journal_path + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("unable to create balance journal " + tmp_path);
+
+    bool ok = ::write(fd, head, sizeof(head)) == sizeof(head);
+    const size_t bytes = entries.size() * sizeof(slot);
+    ok = ok && (bytes == 0 || ::write(fd, entries.data(), bytes) == static_cast<ssize_t>(bytes));
+    ok = ok && ::write(fd, &checksum, sizeof(checksum)) == sizeof(checksum);
+    ok = ok && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok || ::rename(tmp_path.c_str(), _journal_path.c_str()) != 0) 
+        throw std::runtime_error("unable to write balance journal " + _journal_path);
+}
+
+// journal 이 온전하면 다시 반영. 깨져 있으면 slot 은 아직 손대지 않은 상태이므로 버린다.
+bool balance_file::replay_journal() {
+    int fd = ::open(_journal_path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    uint64_t head[3] = {0, 0, 0};
+    bool ok = ::read(fd, head, sizeof(head)) == sizeof(head) && head[0] == journal_magic;
+    std::vector<slot> entries;
+    if (ok) {
+        entries.resize(head[2]);
+        const size_t bytes = entries.size() * sizeof(slot);
+        uint64_t checksum = 0;
+        ok = (bytes == 0 || ::read(fd, entries.data(), bytes) == static_cast<ssize_t>(bytes))
+            && ::read(fd, &checksum, sizeof(checksum)) == sizeof(checksum)
+            && checksum == journal_checksum(entries, head[1]);
+    }
+    ::close(fd);
+
+    if (ok) {
+        change_map changes;
+        for (const auto& e : entries) changes[key{e.account, e.contract, e.symbol >> 8}] = e;
+        grow(hdr()->count + changes.size());
+        apply(changes);
+        sync();
+        hdr()->global_sequence = head[1];
+        hdr()->commit_count++;
+        sync();
+    }
+    ::unlink(_journal_path.c_str());
+    return ok;
+}
+
+}
@@ -0,0 +1,98 @@
+#ifndef BALANCE_FILE_H
+#define BALANCE_FILE_H
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace eosio {
+    // balance 와 마지막 반영 global_sequence 를 담는 memory-mapped 고정 slot hash table 파일.
+    // 재시작 시 파일을 map 하기만 하면 바로 사용할 수 있다.
+    //
+    // 커밋 순서 (crash consistent):
+    //   1. 변경된 slot 의 최종값을 <path>.journal.tmp 에 쓰고 fsync, .journal 로 rename
+    //   2. slot 에 반영하고 msync
+    //   3. header 의 global_sequence 갱신, msync
+    //   4. journal 삭제
+    // 열 때 journal 이 남아 있으면 (절대값이므로 멱등) 다시 반영한다.
+    class balance_file {
+        public:
+            struct slot {
+                uint64_t account  = 0;
+                uint64_t contract = 0;   // 0 이면 빈 slot
+                uint64_t symbol   = 0;   // precision 포함
+                int64_t  amount   = 0;
+            };
+
+            balance_file(const std::string& path, uint64_t initial_capacity);
+            ~balance_file();
+
+            uint64_t global_sequence() const;
+            uint64_t size() const;
+
+            // 다음 commit 에 반영될 값. symbol 은 precision 제외 code 로 구분.
+            void put(const uint64_t account, const uint64_t contract, const uint64_t symbol, const int64_t amount);
+
+            // put 된 값을 global_sequence 시점으로 묶는다. 짧게 끝나므로 trace 처리를 멈춘 상태에서 호출.
+            void checkpoint(const uint64_t global_sequence);
+            // 묶인 값을 파일에 반영. I/O 는 여기서만.
+            void flush();
+
+            void for_each(const std::function<void(const slot&)>& f) const;
+
+        private:
+            struct header {
+                uint64_t magic;
+                uint64_t version;
+                uint64_t capacity;
+                uint64_t count;
+                uint64_t global_sequence;
+                uint64_t commit_count;
+            };
+            struct key {
+                uint64_t account;
+                uint64_t contract;
+                uint64_t symbol_code;
+                bool operator==(const key& k) const {
+                    return account == k.account && contract == k.contract && symbol_code == k.symbol_code;
+                }
+            };
+            struct key_hash {
+                size_t operator()(const key& k) const;
+            };
+            using change_map = std::unordered_map<key, slot, key_hash>;
+
+            void map_file(const uint64_t capacity);
+            void grow(const uint64_t min_count);
+            void apply(const change_map& changes);
+            void sync();
+
+            void write_journal(const change_map& changes, const uint64_t global_sequence);
+            bool replay_journal();
+
+            header* hdr() const { return reinterpret_cast<header*>(_region->get_address()); }
+            slot* slots() const { return reinterpret_cast<slot*>(static_cast<char*>(_region->get_address()) + header_size); }
+            slot& find_slot(const key& k) const;
+
+            static constexpr uint64_t header_size = 4096;
+
+            std::string _path;
+            std::string _journal_path;
+            std::unique_ptr<boost::interprocess::file_mapping> _mapping;
+            std::unique_ptr<boost::interprocess::mapped_region> _region;
+
+            std::mutex _mtx;                    // _pending, _staged
+            change_map _pending;
+            change_map _staged;
+            uint64_t _staged_global_sequence = 0;
+
+            std::mutex _flush_mtx;              // 파일 I/O 는 한번에 하나
+    };
+}
+#endif
@@ -0,0 +1,105 @@
+#include "balance_store.hpp"
+
+namespace eosio {
+
+balance_store::balance_store(uint32_t shard_count) :
+_shard_count(shard_count ? shard_count : 1), _shards(new shard[_shard_count])
+{
+
+}
+
+balance_store::~balance_store()
+{
+
+}
+
+balance_store::shard& balance_store::shard_for(const uint64_t account) const {
+    // name 하위 비트는 '.' 이 많으므로 섞어서 나눈다. 
+    return _shards[(account * 0x9e3779b97f4a7c15ull >> 32) % _shard_count];
+}
+
+// 한 계정의 토큰 수는 적으므로 선형 탐색. symbol 은 precision 제외 code 로 비교 (tokens PK 와 동일).
+balance_store::entry& balance_store::find_or_add(shard& s, const uint64_t account, const uint64_t contract, const uint64_t symbol) {
+    auto& balances = s.accounts[account];
+    for (auto& b : balances) {
+        if (b.contract == contract && (b.symbol >> 8) == (symbol >> 8)) return b;
+    }
+    balances.push_back(entry{contract, symbol, 0});
+    s.balances++;
+    return balances.back();
+}
+
+void balance_store::attach_file(std::shared_ptr<balance_file> file) {
+    _file = file;
+}
+
+void balance_store::load_file() {
+    _file->for_each([this](const balance_file::slot& b) {
+        auto& s = shard_for(b.account);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        auto& e = find_or_add(s, b.account, b.contract, b.symbol);
+        e.symbol = b.symbol;
+        e.amount = b.amount;
+    });
+    _applied_floor = _file->global_sequence();
+    _file_loaded = true;
+}
+
+void balance_store::on_ledger_event(const ledger_event& e) {
+    if (e.action_id <= _applied_floor) return;
+    const uint8_t replayed = _file_loaded ? 0 : e.replayed;
+    if (e.from && !(replayed & ledger_event::replayed_from)) apply(e.from, e.contract, e.symbol, -e.amount);
+    if (e.to && !(replayed & ledger_event::replayed_to)) apply(e.to, e.contract, e.symbol, e.amount);
+}
+
+void balance_store::apply(const uint64_t account, const uint64_t contract, const uint64_t symbol, const int64_t delta) {
+    auto& s = shard_for(account);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    auto& b = find_or_add(s, account, contract, symbol);
+    b.amount += delta;
+    if (_file) _file->put(account, b.contract, b.symbol, b.amount);
+}
+
+void balance_store::set(const uint64_t account, const uint64_t contract, const uint64_t symbol, const int64_t amount) {
+    auto& s = shard_for(account);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    auto& b = find_or_add(s, account, contract, symbol);
+    b.symbol = symbol;
+    b.amount = amount;
+    if (_file) _file->put(account, b.contract, b.symbol, b.amount);
+}
+
+void balance_store::lookup(const std::vector<uint64_t>& accounts, const uint64_t contract, const uint64_t symbol_code,
+        std::vector<result>& out) const {
+    for (const auto account : accounts) {
+        auto& s = shard_for(account);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        auto itr = s.accounts.find(account);
+        if (itr == s.accounts.end()) continue;
+        for (const auto& b : itr->second) {
+            if (contract && b.contract != contract) continue;
+            if (symbol_code && (b.symbol >> 8) != symbol_code) continue;
+            out.push_back(result{account, b});
+        }
+    }
+}
+
+size_t balance_store::account_count() const {
+    size_t count = 0;
+    for (uint32_t i = 0; i < _shard_count; i++) {
+        std::lock_guard<std::mutex> lock(_shards[i].mtx);
+        count += _shards[i].accounts.size();
+    }
+    return count;
+}
+
+size_t balance_store::balance_count() const {
+    size_t count = 0;
+    for (uint32_t i = 0; i < _shard_count; i++) {
+        std::lock_guard<std::mutex> lock(_shards[i].mtx);
+        count += _shards[i].balances;
+    }
+    return count;
+}
+
+}
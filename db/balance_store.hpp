@@ -0,0 +1,65 @@
+#ifndef BALANCE_STORE_H
+#define BALANCE_STORE_H
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "balance_file.hpp"
+#include "ledger_event.hpp"
+
+namespace eosio {
+    // (account, contract, symbol) -> balance 를 메모리에 유지. tokens 테이블과 같은 값.
+    // account 기준으로 shard 를 나눠 lock 경합을 줄인다.
+    class balance_store : public ledger_event_sink {
+        public:
+            struct entry {
+                uint64_t contract = 0;
+                uint64_t symbol   = 0;   // precision 포함
+                int64_t  amount   = 0;
+            };
+            struct result {
+                uint64_t account = 0;
+                entry    balance;
+            };
+
+            explicit balance_store(uint32_t shard_count = 64);
+            virtual ~balance_store();
+
+            virtual void on_ledger_event(const ledger_event& e) override;
+
+            void apply(const uint64_t account, const uint64_t contract, const uint64_t symbol, const int64_t delta);
+            void set(const uint64_t account, const uint64_t contract, const uint64_t symbol, const int64_t amount);
+
+            // 변경을 파일에도 기록. 파일 내용으로 채우고 그 global_sequence 이하 이벤트는 무시한다.
+            // 파일로 채우지 않았으면 (tokens 에서 읽었으면) tokens 에 이미 있던 쪽 (replayed) 을 무시한다.
+            void attach_file(std::shared_ptr<balance_file> file);
+            void load_file();
+
+            // 여러 계정 일괄 조회. contract / symbol_code 가 0 이면 해당 조건 없음.
+            void lookup(const std::vector<uint64_t>& accounts, const uint64_t contract, const uint64_t symbol_code,
+                std::vector<result>& out) const;
+
+            size_t account_count() const;
+            size_t balance_count() const;
+
+        private:
+            struct shard {
+                mutable std::mutex mtx;
+                std::unordered_map<uint64_t, std::vector<entry>> accounts;
+                size_t balances = 0;
+            };
+
+            shard& shard_for(const uint64_t account) const;
+            entry& find_or_add(shard& s, const uint64_t account, const uint64_t contract, const uint64_t symbol);
+
+            uint32_t _shard_count;
+            std::unique_ptr<shard[]> _shards;
+
+            std::shared_ptr<balance_file> _file;
+            uint64_t _applied_floor = 0;
+            bool _file_loaded = false;
+    };
+}
+#endif
@@ -0,0 +1,424 @@
+#include "balance_verifier.hpp"
+#include "ledger_schema.hpp"
+#include "mysqlconn.h"
+#include "token_bootstrap.hpp"
+
+#include <eosio/chain/account_object.hpp>
+#include <eosio/chain/asset.hpp>
+#include <eosio/chain/contract_table_objects.hpp>
+
+#include <fc/io/datastream.hpp>
+#include <fc/io/raw.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+
+namespace eosio {
+
+static const std::string TOKENS_CORRECT_STR = schema::tokens.insert_sql();
+static const std::string TOKENS_CORRECT_UPDATE_STR =
+    " ON DUPLICATE KEY UPDATE amount = VALUES(amount), `precision` = VALUES(`precision`);\n";
+
+namespace {
+    struct balance_key {
+        uint64_t account;
+        uint64_t contract;
+        uint64_t code;      // precision 을 뺀 symbol
+        bool operator==(const balance_key& o) const { return account == o.account && contract == o.contract && code == o.code; }
+    };
+    struct balance_key_hash {
+        size_t operator()(const balance_key& k) const {
+            return std::hash<uint64_t>()((k.account * 0x9e3779b97f4a7c15ull ^ k.contract) * 0x9e3779b97f4a7c15ull ^ k.code);
+        }
+    };
+}
+
+balance_verifier::balance_verifier(std::shared_ptr<shard_router> router, const config& c, caught_up_fn caught_up, busy_fn busy) :
+m_router(router), _config(c), _caught_up(std::move(caught_up)), _busy(std::move(busy))
+{
+    if (!_config.threads) _config.threads = 1;
+    if (!_config.chunk_accounts) _config.chunk_accounts = 1;
+    if (!_config.page_rows) _config.page_rows = 1;
+}
+
+balance_verifier::~balance_verifier()
+{
+    stop();
+}
+
+void balance_verifier::on_ledger_event(const ledger_event& e) {
+    if (!_tracking || e.block_num <= _snapshot_block) return;
+    std::lock_guard<std::mutex> lock(_changed_mtx);
+    if (e.from) _changed.insert(e.from);
+    if (e.to) _changed.insert(e.to);
+}
+
+bool balance_verifier::changed(const uint64_t account) {
+    std::lock_guard<std::mutex> lock(_changed_mtx);
+    return _changed.count(account) > 0;
+}
+
+bool balance_verifier::start(const chain::controller& chain, const bool resume) {
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_status.state == "waiting" || _status.state == "running") return false;
+    }
+    stop();
+    _stop = false;
+
+    const std::string resume_account = resume ? read_resume() : std::string();
+    const uint64_t from_account = resume_account.empty() ? 0 : chain::name(resume_account).value;
+
+    // 기준 block 을 먼저 세워 두어야 scan 뒤에 들어오는 event 를 놓치지 않는다. (main thread 라 scan 중에는 block 이 없다)
+    _snapshot_block = chain.head_block_num();
+    {
+        std::lock_guard<std::mutex> lock(_changed_mtx);
+        _changed.clear();
+    }
+    _tracking = true;
+
+    const auto start_time = std::chrono::steady_clock::now();
+    scan(chain, from_account);
+    make_chunks(from_account);
+    ilog("balance verifier: ${n} balances at block ${b} from '${a}', ${c} chunks, scanned in ${t} ms",
+        ("n", _balances.size())("b", _snapshot_block.load())("a", resume_account)("c", _chunks.size())
+        ("t", std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count()));
+
+    _done.assign(_chunks.size(), false);
+    _contiguous = 0;
+    _next = 0;
+    _corrections.clear();
+    _corrections.resize(m_router->size());
+    _append_corrections = !resume_account.empty();
+    _next_slot = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _status = status();
+        _status.state = "waiting";
+        _status.snapshot_block = _snapshot_block;
+        _status.start_account = resume_account;
+        _status.resume_account = resume_account;
+        _status.balances = _balances.size();
+        _status.chunks = _chunks.size();
+    }
+
+    _active = _config.threads;
+    for (uint32_t i = 0; i < _config.threads; i++) {
+        _threads.emplace_back([this] { run(); });
+    }
+    return true;
+}
+
+void balance_verifier::stop() {
+    _stop = true;
+    for (auto& t : _threads) t.join();
+    _threads.clear();
+}
+
+balance_verifier::status balance_verifier::get_status() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _status;
+}
+
+// token_bootstrap 과 같은 contract 들의 accounts 테이블. scope 가 account.
+void balance_verifier::scan(const chain::controller& chain, const uint64_t from_account) {
+    _balances.clear();
+    const auto& db = chain.db();
+    const auto& table_idx = db.get_index<chain::table_id_multi_index, chain::by_code_scope_table>();
+    const auto& kv_idx = db.get_index<chain::key_value_index, chain::by_scope_primary>();
+
+    for (auto c_itr = table_idx.begin(); c_itr != table_idx.end(); ) {
+        const chain::account_name code = c_itr->code;
+        c_itr = table_idx.upper_bound(boost::make_tuple(code));
+
+        try {
+            const auto* account = db.find<chain::account_object, chain::by_name>(code);
+            if (!account || account->abi.size() == 0) continue;
+            if (!token_bootstrap::is_standard_token_abi(account->get_abi())) continue;
+
+            auto t_itr = table_idx.lower_bound(boost::make_tuple(code, chain::name(from_account)));
+            for (; t_itr != table_idx.end() && t_itr->code == code; ++t_itr) {
+                if (t_itr->table != N(accounts)) continue;
+
+                auto itr = kv_idx.lower_bound(boost::make_tuple(t_itr->id));
+                auto end = kv_idx.upper_bound(boost::make_tuple(t_itr->id));
+                for (; itr != end; ++itr) {
+                    fc::datastream<const char*> ds(itr->value.data(), itr->value.size());
+                    chain::asset amount;
+                    fc::raw::unpack(ds, amount);
+
+                    balance b;
+                    b.account = t_itr->scope.value;
+                    b.contract = code.value;
+                    b.symbol = amount.get_symbol().value();
+                    b.amount = amount.get_amount();
+                    _balances.push_back(b);
+                }
+            }
+        } catch (fc::exception& e) {
+            wlog("balance verifier skip ${c}: ${e}", ("c", code)("e", e.to_string()));
+        } catch (std::exception& e) {
+            wlog("balance verifier skip ${c}: ${e}", ("c", code)("e", e.what()));
+        }
+    }
+
+    std::sort(_balances.begin(), _balances.end(), [](const balance& a, const balance& b) {
+        if (a.account != b.account) return a.account < b.account;
+        if (a.contract != b.contract) return a.contract < b.contract;
+        return (a.symbol >> 8) < (b.symbol >> 8);
+    });
+}
+
+// account 가 chunk_accounts 개 모일 때마다 끊는다. 한 account 는 한 chunk 에만.
+void balance_verifier::make_chunks(const uint64_t from_account) {
+    _chunks.clear();
+    chunk c;
+    c.lo = from_account;
+    uint32_t accounts = 0;
+    for (size_t i = 0; i < _balances.size(); i++) {
+        if (i && _balances[i].account == _balances[i - 1].account) continue;
+        if (accounts == _config.chunk_accounts) {
+            c.last = i;
+            c.hi = _balances[i].account;
+            _chunks.push_back(c);
+            c = chunk();
+            c.first = i;
+            c.lo = _balances[i].account;
+            accounts = 0;
+        }
+        accounts++;
+    }
+    c.last = _balances.size();
+    c.hi = 0;
+    _chunks.push_back(c);
+}
+
+bool balance_verifier::wait_caught_up() {
+    auto logged = std::chrono::steady_clock::now();
+    while (!_stop) {
+        if (_caught_up(_snapshot_block)) return true;
+        if (std::chrono::steady_clock::now() - logged > std::chrono::seconds(10)) {
+            ilog("balance verifier waiting for block ${b}", ("b", _snapshot_block.load()));
+            logged = std::chrono::steady_clock::now();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    return false;
+}
+
+void balance_verifier::run() {
+    if (wait_caught_up()) {
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            if (_status.state == "waiting") _status.state = "running";
+        }
+        while (!_stop) {
+            const size_t index = _next++;
+            if (index >= _chunks.size()) break;
+            verify_chunk(index);
+        }
+    }
+
+    // 마지막으로 끝나는 thread 가 정리한다.
+    if (--_active) return;
+    _tracking = false;
+    for (auto& f : _corrections) if (f) f->flush();
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    _status.state = _status.chunks_done == _status.chunks ? "done" : "stopped";
+    ilog("balance verifier ${s} at '${a}': ${r} rows compared, ${m} mismatched, ${x} missing, ${e} extra, ${c} changed, ${f} failed queries",
+        ("s", _status.state)("a", _status.resume_account)("r", _status.rows_compared)("m", _status.mismatched)
+        ("x", _status.missing)("e", _status.extra)("c", _status.changed)("f", _status.failed_queries));
+}
+
+void balance_verifier::verify_chunk(const size_t index) {
+    const auto& c = _chunks[index];
+    std::vector<std::vector<const balance*>> expected(m_router->size());
+    for (size_t i = c.first; i < c.last; i++) {
+        expected[m_router->account_shard(_balances[i].account)].push_back(&_balances[i]);
+    }
+    // query 가 실패한 chunk 는 끝난 것으로 치지 않는다. resume 이 그 앞에 머문다.
+    bool ok = true;
+    for (uint32_t shard = 0; shard < m_router->size() && !_stop; shard++) {
+        ok = verify_shard(c, shard, expected[shard]) && ok;
+    }
+    if (ok && !_stop) chunk_done(index);
+}
+
+bool balance_verifier::verify_shard(const chunk& c, const uint32_t shard, const std::vector<const balance*>& expected) {
+    std::unordered_map<balance_key, const balance*, balance_key_hash> remaining;
+    remaining.reserve(expected.size());
+    for (const auto* b : expected) remaining.emplace(balance_key{ b->account, b->contract, b->symbol >> 8 }, b);
+
+    // 다르게 보인 것. ledger_table 은 tokens 를 실행한 뒤 event 를 내므로 changed 는 chunk 를 다 읽은 뒤에 본다.
+    struct difference {
+        uint64_t account, contract, symbol;
+        int64_t db_amount;
+        int64_t chain_amount;
+        bool on_chain;
+    };
+    std::vector<difference> differences;
+
+    std::string range = "account >= '" + chain::name(c.lo).to_string() + "'";
+    if (c.hi) range += " AND account < '" + chain::name(c.hi).to_string() + "'";
+    std::string after;      // keyset: 마지막으로 읽은 (account, contract_owner, symbol)
+    uint64_t compared = 0;
+    bool failed = false;
+
+    const auto& pool = m_router->pool(shard);
+    while (!_stop) {
+        while (!_stop && _busy && _busy()) std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        const std::string sql = "SELECT account, contract_owner, symbol, amount, `precision` FROM tokens WHERE " + range +
+            (after.empty() ? "" : " AND (account, contract_owner, symbol) > " + after) +
+            " ORDER BY account, contract_owner, symbol LIMIT " + std::to_string(_config.page_rows);
+
+        uint32_t rows = 0;
+        shared_ptr<MysqlConnection> con = pool->get_connection();
+        assert(con);
+        bool ok = false;
+        try {
+            ok = con->scan(sql, [&](const MysqlRowView& row) {
+                rows++;
+                after = "('" + row.get_value(0) + "', '" + row.get_value(1) + "', '" + row.get_value(2) + "')";
+                try {
+                    const uint64_t account = chain::name(row.get_data(0)).value;
+                    const uint64_t contract = chain::name(row.get_data(1)).value;
+                    const auto symbol = chain::symbol(static_cast<uint8_t>(row.get_uint(4)), row.get_data(2)).value();
+                    const int64_t amount = row.get_int(3);
+
+                    auto itr = remaining.find(balance_key{ account, contract, symbol >> 8 });
+                    if (itr == remaining.end()) {
+                        if (amount) differences.push_back({ account, contract, symbol, amount, 0, false });
+                    } else {
+                        const auto* b = itr->second;
+                        if (b->amount != amount || b->symbol != symbol)
+                            differences.push_back({ account, contract, b->symbol, amount, b->amount, true });
+                        remaining.erase(itr);
+                    }
+                } catch (...) {
+                    wlog("balance verifier skip invalid tokens row ${a} ${s}", ("a", row.get_value(0))("s", row.get_value(2)));
+                }
+                return true;
+            }, MysqlData::Mode::Store);
+            if (!ok) elog("balance verifier query failed: ${e}", ("e", con->lastError()));
+        } catch (...) {
+            ok = false;
+        }
+        pool->release_connection(*con);
+
+        if (!ok) {
+            failed = true;
+            break;
+        }
+        compared += rows;
+        throttle(rows);
+        if (rows < _config.page_rows) break;
+    }
+    if (_stop) return false;
+
+    // 끝까지 읽지 못했으면 tokens 에 없는 것은 알 수 없다.
+    if (!failed) {
+        for (const auto& r : remaining) {
+            const auto* b = r.second;
+            if (b->amount) differences.push_back({ b->account, b->contract, b->symbol, 0, b->amount, true });
+        }
+    }
+
+    uint64_t mismatched = 0, missing = 0, extra = 0, skipped = 0, corrections = 0;
+    for (const auto& d : differences) {
+        if (changed(d.account)) {
+            skipped++;
+            continue;
+        }
+        if (!d.on_chain) extra++;
+        else if (d.db_amount == 0 && d.chain_amount != 0) missing++;
+        else mismatched++;
+        correct(shard, d.account, d.contract, d.symbol, d.chain_amount);
+        corrections++;
+    }
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    _status.rows_compared += compared;
+    _status.mismatched += mismatched;
+    _status.missing += missing;
+    _status.extra += extra;
+    _status.changed += skipped;
+    _status.corrections += corrections;
+    if (failed) _status.failed_queries++;
+    return !failed;
+}
+
+// 시간 slot 을 나눠 가진다. 남는 시간이 있으면 그만큼 쉰다.
+void balance_verifier::throttle(const uint64_t rows) {
+    if (!_config.rows_per_sec || !rows) return;
+    std::chrono::steady_clock::time_point until;
+    {
+        std::lock_guard<std::mutex> lock(_rate_mtx);
+        const auto now = std::chrono::steady_clock::now();
+        if (_next_slot < now) _next_slot = now;
+        _next_slot += std::chrono::microseconds(rows * 1000000 / _config.rows_per_sec);
+        until = _next_slot;
+    }
+    while (!_stop && std::chrono::steady_clock::now() < until) {
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(until - std::chrono::steady_clock::now(), std::chrono::milliseconds(200)));
+    }
+}
+
+// 앞에서부터 이어서 끝난 chunk 까지만 resume 에 남긴다. 뒤쪽이 먼저 끝난 것은 다음에 다시 본다.
+void balance_verifier::chunk_done(const size_t index) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _done[index] = true;
+    _status.chunks_done++;
+    const size_t before = _contiguous;
+    while (_contiguous < _done.size() && _done[_contiguous]) _contiguous++;
+    if (_contiguous == before) return;
+
+    for (auto& f : _corrections) if (f) f->flush();
+    _status.resume_account = _contiguous < _chunks.size() ? chain::name(_chunks[_contiguous].lo).to_string() : std::string();
+    write_resume(_status.resume_account);
+}
+
+void balance_verifier::correct(const uint32_t shard, const uint64_t account, const uint64_t contract, const uint64_t symbol, const int64_t amount) {
+    const chain::symbol sym(symbol);
+    std::string sql = TOKENS_CORRECT_STR;
+    schema::tokens.append_row(sql, account, contract, sym.name(), amount, sym.decimals());
+    sql += TOKENS_CORRECT_UPDATE_STR;
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& f = _corrections[shard];
+    if (!f) {
+        const auto path = m_router->size() == 1 ? _config.corrections_path : _config.corrections_path + "." + std::to_string(shard);
+        f = std::make_unique<std::ofstream>(path, _append_corrections ? std::ios::app : std::ios::trunc);
+        if (!*f) elog("unable to open ${p}", ("p", path));
+    }
+    *f << sql;
+}
+
+std::string balance_verifier::read_resume() const {
+    std::ifstream in(_config.resume_path);
+    std::string account;
+    in >> account;
+    return account;
+}
+
+// 끝났으면 파일을 지운다. 다음 start(resume) 는 처음부터.
+void balance_verifier::write_resume(const std::string& account) {
+    if (account.empty()) {
+        std::remove(_config.resume_path.c_str());
+        return;
+    }
+    const auto tmp_path = _config.resume_path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::trunc);
+        out << account << "\n";
+        if (!out) {
+            elog("unable to write ${p}", ("p", tmp_path));
+            return;
+        }
+    }
+    std::rename(tmp_path.c_str(), _config.resume_path.c_str());
+}
+
+}
@@ -0,0 +1,130 @@
+#ifndef BALANCE_VERIFIER_H
+#define BALANCE_VERIFIER_H
+
+#include <eosio/chain/controller.hpp>
+#include <eosio/chain/types.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "ledger_event.hpp"
+#include "shard_router.hpp"
+
+namespace eosio {
+    // chainbase 의 accounts 테이블과 tokens 를 비교한다. (replay, crash, fork 뒤 점검용)
+    //
+    //  - start() 를 부른 thread (main thread) 에서 chainbase 를 한번에 읽어 정렬해 둔다. 그 block 이 기준.
+    //  - ingest 가 기준 block 까지 반영하면 account 구간 (chunk) 을 여러 thread 가 나눠 가져가
+    //    shard 마다 keyset pagination 으로 tokens 를 읽어 비교한다.
+    //  - 초당 row 수 상한. ingest 가 밀리는 동안 (busy) 은 쉰다.
+    //  - 앞에서부터 끝난 chunk 까지를 resume 파일에. start(resume) 는 그 account 부터.
+    //  - 다른 값은 tokens 를 chain 값으로 맞추는 statement 로 corrections 파일에 쓴다. 실행은 하지 않는다.
+    //
+    // 기준 block 뒤에 바뀐 account 는 ledger_event 로 표시해 두고 비교에서 뺀다.
+    // name 의 uint64 순서는 문자열 순서와 같으므로 chunk 경계를 그대로 SQL 범위로 쓴다.
+    class balance_verifier : public ledger_event_sink {
+        public:
+            struct config {
+                uint32_t threads = 2;
+                uint32_t chunk_accounts = 10000;
+                uint32_t page_rows = 1000;
+                uint32_t rows_per_sec = 20000;      // 0 은 제한 없음
+                std::string resume_path;
+                std::string corrections_path;       // shard 가 여럿이면 <path>.<shard>
+            };
+            struct status {
+                std::string state = "idle";         // idle, waiting, running, done, stopped
+                uint32_t snapshot_block = 0;
+                std::string start_account;
+                std::string resume_account;         // 다음 start(resume) 의 시작. 끝났으면 빈 문자열
+                uint64_t balances = 0;              // snapshot row 수
+                uint32_t chunks = 0;
+                uint32_t chunks_done = 0;
+                uint64_t rows_compared = 0;         // tokens 에서 읽은 row
+                uint64_t mismatched = 0;            // 값이 다름
+                uint64_t missing = 0;               // chain 에만 있음
+                uint64_t extra = 0;                 // tokens 에만 있음 (0 이 아닌 것)
+                uint64_t changed = 0;               // 기준 block 뒤에 바뀌어 건너뜀
+                uint64_t corrections = 0;
+                uint64_t failed_queries = 0;
+            };
+            // 기준 block 까지 tokens 에 반영되었는지
+            using caught_up_fn = std::function<bool(const uint32_t block_num)>;
+            using busy_fn = std::function<bool()>;
+
+            balance_verifier(std::shared_ptr<shard_router> router, const config& c, caught_up_fn caught_up, busy_fn busy);
+            virtual ~balance_verifier();
+
+            virtual void on_ledger_event(const ledger_event& e) override;
+
+            // main thread 에서. 이미 돌고 있으면 false
+            bool start(const chain::controller& chain, const bool resume);
+            void stop();
+            status get_status() const;
+
+        private:
+            struct balance {
+                uint64_t account = 0;
+                uint64_t contract = 0;
+                uint64_t symbol = 0;                // precision 포함
+                int64_t  amount = 0;
+            };
+            struct chunk {
+                size_t   first = 0;                 // _balances 범위
+                size_t   last = 0;
+                uint64_t lo = 0;                    // account 범위 [lo, hi). hi 0 은 끝까지
+                uint64_t hi = 0;
+            };
+
+            void scan(const chain::controller& chain, const uint64_t from_account);
+            void make_chunks(const uint64_t from_account);
+            void run();
+            bool wait_caught_up();
+            void verify_chunk(const size_t index);
+            // 끝까지 읽었으면 true
+            bool verify_shard(const chunk& c, const uint32_t shard, const std::vector<const balance*>& expected);
+            void throttle(const uint64_t rows);
+            void chunk_done(const size_t index);
+            void correct(const uint32_t shard, const uint64_t account, const uint64_t contract, const uint64_t symbol, const int64_t amount);
+            bool changed(const uint64_t account);
+            std::string read_resume() const;
+            void write_resume(const std::string& account);
+
+            std::shared_ptr<shard_router> m_router;
+            config _config;
+            caught_up_fn _caught_up;
+            busy_fn _busy;
+
+            std::vector<balance> _balances;
+            std::vector<chunk> _chunks;
+            std::vector<bool> _done;
+            size_t _contiguous = 0;                 // 여기 전까지는 모두 끝남
+            std::atomic<size_t> _next{0};
+            std::atomic<uint32_t> _active{0};
+            std::vector<std::thread> _threads;
+            std::atomic<bool> _stop{false};
+
+            std::atomic<bool> _tracking{false};
+            std::atomic<uint32_t> _snapshot_block{0};
+            std::unordered_set<uint64_t> _changed;
+            std::mutex _changed_mtx;
+
+            std::vector<std::unique_ptr<std::ofstream>> _corrections;   // shard 마다, 처음 쓸 때 연다
+            bool _append_corrections = false;
+
+            std::chrono::steady_clock::time_point _next_slot;
+            std::mutex _rate_mtx;
+
+            status _status;
+            mutable std::mutex _mtx;
+    };
+}
+#endif
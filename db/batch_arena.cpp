@@ -0,0 +1,46 @@
+#include "batch_arena.hpp"
+
+#include <algorithm>
+
+namespace eosio {
+
+batch_arena::batch_arena(const size_t chunk_size) :
+_chunk_size(chunk_size ? chunk_size : 4096)
+{
+    add_chunk(_chunk_size);
+}
+
+void batch_arena::add_chunk(const size_t size) {
+    _chunks.emplace_back(new char[size]);
+    _chunk_sizes.push_back(size);
+    _begin = _cur = _chunks.back().get();
+    _end = _begin + size;
+    _stats.capacity += size;
+    _stats.growths++;
+}
+
+void* batch_arena::grow(const size_t size, const size_t align) {
+    _used += static_cast<size_t>(_cur - _begin);
+    // 큰 요청도 한 chunk 에 들어가도록
+    add_chunk(std::max(_chunk_size, size + align));
+    _stats.allocations--;
+    return allocate(size, align);
+}
+
+void batch_arena::reset() {
+    _stats.peak = std::max<uint64_t>(_stats.peak, used());
+    _stats.resets++;
+
+    if (_chunks.size() > 1) {
+        size_t total = 0;
+        for (const auto s : _chunk_sizes) total += s;
+        _chunks.clear();
+        _chunk_sizes.clear();
+        _stats.capacity = 0;
+        add_chunk(total);
+    }
+    _cur = _begin;
+    _used = 0;
+}
+
+}
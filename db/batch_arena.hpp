@@ -0,0 +1,84 @@
+#ifndef BATCH_ARENA_H
+#define BATCH_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace eosio {
+    // trace batch 하나 동안 쓰고 버리는 임시 메모리. worker 마다 하나, 한 thread 만 쓴다.
+    //
+    //  - 앞으로만 잘라 주고 개별 해제는 없다. batch 가 끝나면 reset() 으로 한꺼번에 되돌린다.
+    //  - chunk 가 모자라면 힙에서 더 받고, reset 때 여러 chunk 를 합친 크기 하나로 바꾼다.
+    //    batch 크기가 비슷하면 몇 번 뒤에는 힙 할당이 없어진다.
+    class batch_arena {
+        public:
+            struct stats {
+                uint64_t capacity = 0;          // 지금 잡고 있는 chunk 합
+                uint64_t peak = 0;              // batch 하나에서 가장 많이 쓴 byte
+                uint64_t allocations = 0;       // arena 에서 잘라 준 횟수
+                uint64_t growths = 0;           // chunk 를 힙에서 받은 횟수 (처음 chunk 포함)
+                uint64_t resets = 0;
+            };
+
+            explicit batch_arena(const size_t chunk_size = 64 * 1024);
+            batch_arena(const batch_arena&) = delete;
+            batch_arena& operator=(const batch_arena&) = delete;
+
+            void* allocate(const size_t size, const size_t align = alignof(std::max_align_t)) {
+                _stats.allocations++;
+                uintptr_t p = (reinterpret_cast<uintptr_t>(_cur) + align - 1) & ~(uintptr_t(align) - 1);
+                if (p + size > reinterpret_cast<uintptr_t>(_end)) return grow(size, align);
+                _cur = reinterpret_cast<char*>(p + size);
+                return reinterpret_cast<void*>(p);
+            }
+
+            void reset();
+
+            // 지금 batch 에서 쓴 byte
+            size_t used() const { return _used + static_cast<size_t>(_cur - _begin); }
+            const stats& get_stats() const { return _stats; }
+
+        private:
+            void* grow(const size_t size, const size_t align);
+            void add_chunk(const size_t size);
+
+            size_t _chunk_size;
+            std::vector<std::unique_ptr<char[]>> _chunks;
+            std::vector<size_t> _chunk_sizes;
+            char* _begin = nullptr;
+            char* _cur = nullptr;
+            char* _end = nullptr;
+            size_t _used = 0;                   // 현재 chunk 이전 chunk 들에서 쓴 byte
+            stats _stats;
+    };
+
+    // std 컨테이너용. deallocate 는 아무것도 하지 않는다. arena 보다 오래 살면 안 된다.
+    template<typename T>
+    class arena_allocator {
+        public:
+            using value_type = T;
+
+            explicit arena_allocator(batch_arena& arena) : _arena(&arena) {}
+            template<typename U>
+            arena_allocator(const arena_allocator<U>& other) : _arena(other.arena()) {}
+
+            T* allocate(const size_t n) { return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T))); }
+            void deallocate(T*, size_t) {}
+
+            batch_arena* arena() const { return _arena; }
+
+            template<typename U>
+            bool operator==(const arena_allocator<U>& other) const { return _arena == other.arena(); }
+            template<typename U>
+            bool operator!=(const arena_allocator<U>& other) const { return _arena != other.arena(); }
+
+        private:
+            batch_arena* _arena;
+    };
+
+    using arena_string = std::basic_string<char, std::char_traits<char>, arena_allocator<char>>;
+}
+#endif
@@ -5,6 +5,7 @@
 #include <fc/log/logger.hpp>
 #include "connection_pool.h"
 #include "mysqlconn.h"
+#include "span_tracer.hpp"
 
 #define BSIZE 2048
 
@@ -35,10 +36,19 @@ namespace eosio {
     }
 
     shared_ptr<MysqlConnection> connection_pool::get_connection() {
+        span_tracer::scope span("pool_checkout");
         return m_pool.lockConnection();
     }
 
     void connection_pool::release_connection(MysqlConnection& con) {
         con.unlock(_do_closeconn_on_unlock);
     }
+
+    void connection_pool::set_timeout(const uint32_t seconds) {
+        m_pool.setTimeout(seconds);
+    }
+
+    void connection_pool::abort_reconnect() {
+        m_pool.abortReconnect();
+    }
 }
\ No newline at end of file
@@ -16,6 +16,11 @@ class connection_pool
         shared_ptr<MysqlConnection> get_connection();
         void release_connection(MysqlConnection& con);
 
+        // 쿼리 하나가 DB 를 기다리는 시한 (초). 0 은 무제한. 연결을 만들기 전에.
+        void set_timeout(const uint32_t seconds);
+        // 종료 시한이 지났을 때. DB 가 없어도 get_connection 이 더 기다리지 않는다.
+        void abort_reconnect();
+
     private:
         MysqlConnPool m_pool;
 
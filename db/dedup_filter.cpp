@@ -0,0 +1,42 @@
+#include "dedup_filter.hpp"
+
+#include <cstring>
+
+namespace eosio {
+
+dedup_filter::dedup_filter(uint32_t window) :
+_shard_window((window + shard_count - 1) / shard_count), _shards(new shard[shard_count])
+{
+    for (uint32_t i = 0; i < shard_count; i++) _shards[i].current.reserve(_shard_window);
+}
+
+dedup_filter::~dedup_filter()
+{
+
+}
+
+bool dedup_filter::is_duplicate(const void* transaction_id, const void* block_id) {
+    if (!_shard_window) return false;
+
+    // block id 의 앞 4 byte 는 block 번호이므로 그 뒤를 쓴다.
+    uint64_t key, block;
+    std::memcpy(&key, transaction_id, sizeof(key));
+    std::memcpy(&block, static_cast<const char*>(block_id) + 8, sizeof(block));
+    key ^= block * 0x9e3779b97f4a7c15ull;
+    auto& s = _shards[(key >> 56) % shard_count];
+
+    std::lock_guard<std::mutex> lock(s.mtx);
+    if (s.current.count(key) || s.previous.count(key)) {
+        _skipped++;
+        return true;
+    }
+
+    if (s.current.size() >= _shard_window) {
+        std::swap(s.current, s.previous);
+        s.current.clear();
+    }
+    s.current.insert(key);
+    return false;
+}
+
+}
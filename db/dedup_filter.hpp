@@ -0,0 +1,46 @@
+#ifndef DEDUP_FILTER_H
+#define DEDUP_FILTER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+
+namespace eosio {
+    // ABI decode / SQL 생성 전에 이번 실행에서 이미 queue 에 넣은 (transaction, block) 을 걸러낸다.
+    // (fork 를 오가며 같은 block 이 다시 accept 된 것)
+    //
+    //  - plugin 은 accept 된 block 의 trace 만 넘긴다. speculative / pending block 의 trace 나 버려진 fork 의 것은
+    //    여기까지 오지 않는다. 다른 block 에서 다시 적용된 transaction 은 새 block 의 것이므로 거르지 않는다.
+    //  - key 는 transaction id 와 block id 의 앞 8 byte 를 섞은 64 bit. 정확한 집합이 아니라 
+    //    서로 다른 것이 같은 key 가 될 확률 (대략 window / 2^64) 만큼 처음 보는 trace 를 버릴 수 있다.
+    //  - key 로 shard 를 나눠 shard 마다 lock. 최근 window ~ 2*window 개를 기억.
+    //
+    // 재시작 겹침은 여기가 아니라 shard checkpoint (ledger_state 의 committed_block) 로 거른다.
+    class dedup_filter {
+        public:
+            explicit dedup_filter(uint32_t window);
+            ~dedup_filter();
+
+            // 중복이면 true. 아니면 기록하고 false. window 0 이면 항상 false.
+            bool is_duplicate(const void* transaction_id, const void* block_id);
+
+            uint64_t skipped() const { return _skipped; }
+
+        private:
+            static constexpr uint32_t shard_count = 16;
+
+            struct shard {
+                std::mutex mtx;
+                // window 만큼 차면 current 를 previous 로 돌린다.
+                std::unordered_set<uint64_t> current;
+                std::unordered_set<uint64_t> previous;
+            };
+
+            uint32_t _shard_window;
+            std::unique_ptr<shard[]> _shards;
+            std::atomic<uint64_t> _skipped{0};
+    };
+}
+#endif
@@ -0,0 +1,207 @@
+#include "event_stream.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+namespace eosio {
+
+namespace bip = boost::interprocess;
+using namespace event_stream_format;
+
+event_stream::event_stream(const std::string& name, uint64_t capacity) :
+_name(name)
+{
+    if (!capacity) capacity = 1;
+
+    if (reopen(capacity)) return;
+
+    // 처음이거나 layout 이 다르면 새로 만든다. 순번과 epoch 는 이전 segment 에서 이어 받는다.
+    uint64_t seq = 0;
+    uint64_t epoch = 0;
+    if (_header) {
+        seq = _header->write_seq.load(std::memory_order_acquire);
+        epoch = _header->epoch.load(std::memory_order_acquire);
+        // 옛 mapping 을 보는 consumer 가 다시 열도록
+        _header->epoch.store(epoch + 1, std::memory_order_release);
+        _header = nullptr;
+    }
+    _region.reset();
+    _shm.reset();
+    bip::shared_memory_object::remove(_name.c_str());
+    _shm = std::make_unique<bip::shared_memory_object>(bip::create_only, _name.c_str(), bip::read_write);
+    _shm->truncate(sizeof(stream_header) + capacity * sizeof(event_record));
+    _region = std::make_unique<bip::mapped_region>(*_shm, bip::read_write);
+
+    _header = new (_region->get_address()) stream_header();
+    _records = reinterpret_cast<event_record*>(static_cast<char*>(_region->get_address()) + sizeof(stream_header));
+    for (uint64_t i = 0; i < capacity; i++) {
+        new (&_records[i]) event_record();
+        _records[i].seq.store(invalid_seq, std::memory_order_relaxed);
+    }
+
+    _header->capacity = capacity;
+    _header->record_size = sizeof(event_record);
+    _header->version = version;
+    _header->write_seq.store(seq, std::memory_order_relaxed);
+    _header->epoch.store(epoch + 1, std::memory_order_relaxed);
+    _header->first_seq = seq;
+    std::atomic_thread_fence(std::memory_order_release);
+    _header->magic = magic;
+}
+
+// 이전 segment 가 있으면 열어 둔다. (layout 이 달라도 순번을 이어 받도록)
+bool event_stream::reopen(const uint64_t capacity) {
+    try {
+        _shm = std::make_unique<bip::shared_memory_object>(bip::open_only, _name.c_str(), bip::read_write);
+        _region = std::make_unique<bip::mapped_region>(*_shm, bip::read_write);
+    } catch (const bip::interprocess_exception&) {
+        _region.reset();
+        _shm.reset();
+        return false;
+    }
+    if (_region->get_size() < sizeof(stream_header)) return false;
+    auto* header = static_cast<stream_header*>(_region->get_address());
+    if (header->magic != magic) return false;
+    _header = header;
+
+    if (header->version != version || header->record_size != sizeof(event_record) || header->capacity != capacity
+        || _region->get_size() < sizeof(stream_header) + capacity * sizeof(event_record)) 
+        return false;
+
+    // 기록 중에 죽은 record 는 invalid_seq 로 남아 consumer 가 lost 로 센다.
+    _records = reinterpret_cast<event_record*>(static_cast<char*>(_region->get_address()) + sizeof(stream_header));
+    header->epoch.fetch_add(1, std::memory_order_acq_rel);
+    return true;
+}
+
+// segment 는 남겨 둔다. 다음 시작이 순번을 이어 가고, consumer 는 그 사이에도 남은 것을 읽는다.
+event_stream::~event_stream() {
+    _region.reset();
+    _shm.reset();
+}
+
+uint64_t event_stream::published() const {
+    return _header->write_seq.load(std::memory_order_acquire);
+}
+
+uint64_t event_stream::epoch() const {
+    return _header->epoch.load(std::memory_order_acquire);
+}
+
+void event_stream::on_ledger_event(const ledger_event& e) {
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    const uint64_t seq = _header->write_seq.load(std::memory_order_relaxed);
+    event_record& r = _records[seq % _header->capacity];
+
+    r.seq.store(invalid_seq, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    r.action_id  = e.action_id;
+    r.block_num  = e.block_num;
+    r.block_time = e.block_time;
+    r.contract   = e.contract;
+    r.action     = e.action;
+    r.from       = e.from;
+    r.to         = e.to;
+    r.receiver   = e.receiver;
+    r.amount     = e.amount;
+    r.symbol     = e.symbol;
+
+    r.seq.store(seq, std::memory_order_release);
+    _header->write_seq.store(seq + 1, std::memory_order_release);
+}
+
+//----------------
+
+event_stream_reader::event_stream_reader(const std::string& name, bool from_oldest) {
+    _shm = std::make_unique<bip::shared_memory_object>(bip::open_only, name.c_str(), bip::read_only);
+    _region = std::make_unique<bip::mapped_region>(*_shm, bip::read_only);
+
+    _header = static_cast<const stream_header*>(_region->get_address());
+    if (_header->magic != magic || _header->version != version || _header->record_size != sizeof(event_record))
+        throw std::runtime_error("incompatible ledger event stream " + name);
+
+    _records = reinterpret_cast<const event_record*>(static_cast<const char*>(_region->get_address()) + sizeof(stream_header));
+    _capacity = _header->capacity;
+
+    const uint64_t head = _header->write_seq.load(std::memory_order_acquire);
+    _cursor = head;
+    if (from_oldest) 
+        _cursor = std::max(_header->first_seq, head > _capacity ? head - _capacity : 0);
+}
+
+event_stream_reader::~event_stream_reader()
+{
+
+}
+
+uint64_t event_stream_reader::head() const {
+    return _header->write_seq.load(std::memory_order_acquire);
+}
+
+uint64_t event_stream_reader::epoch() const {
+    return _header->epoch.load(std::memory_order_acquire);
+}
+
+bool event_stream_reader::next(ledger_event& e, uint64_t& lost) {
+    while (true) {
+        const uint64_t head = _header->write_seq.load(std::memory_order_acquire);
+        if (_cursor >= head) return false;
+
+        // 한 바퀴 이상 뒤쳐졌으면 남아있는 가장 오래된 것부터.
+        if (head - _cursor > _capacity) {
+            lost += head - _capacity - _cursor;
+            _cursor = head - _capacity;
+        }
+        // 새로 만든 segment 에는 그 앞의 순번이 없다.
+        if (_cursor < _header->first_seq) {
+            lost += _header->first_seq - _cursor;
+            _cursor = _header->first_seq;
+            continue;
+        }
+
+        const event_record& r = _records[_cursor % _capacity];
+        if (r.seq.load(std::memory_order_acquire) != _cursor) {
+            // 읽기 직전에 덮어쓰이는 중. 다시 계산.
+            lost++;
+            _cursor++;
+            continue;
+        }
+
+        e.action_id  = r.action_id;
+        e.block_num  = r.block_num;
+        e.block_time = r.block_time;
+        e.contract   = r.contract;
+        e.action     = r.action;
+        e.from       = r.from;
+        e.to         = r.to;
+        e.receiver   = r.receiver;
+        e.amount     = r.amount;
+        e.symbol     = r.symbol;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (r.seq.load(std::memory_order_relaxed) != _cursor) {
+            lost++;
+            _cursor++;
+            continue;
+        }
+
+        _cursor++;
+        return true;
+    }
+}
+
+bool event_stream_reader::wait_next(ledger_event& e, uint64_t& lost, const uint64_t timeout_us) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_us);
+    uint32_t spins = 0;
+    while (!next(e, lost)) {
+        if (std::chrono::steady_clock::now() >= deadline) return false;
+        if (++spins > 1000) std::this_thread::yield();
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,108 @@
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "ledger_event.hpp"
+
+namespace eosio {
+    // shared memory 위의 single producer / multi consumer ring buffer.
+    // producer 는 consumer 를 기다리지 않는다. 느린 consumer 는 덮어쓰인 것을 감지하고 건너뛴다.
+    //
+    // 레이아웃: [stream_header (64 bytes)] [event_record x capacity]
+    // record 의 seq 는 기록 중 invalid_seq, 기록이 끝나면 자신의 순번. (seqlock)
+    //
+    // 순번은 producer 가 다시 시작해도 이어진다. 같은 layout 이면 segment 를 그대로 쓰고, 
+    // 아니면 write_seq 만 가져와 새로 만든다. 시작할 때마다 epoch 가 오르며 (옛 segment 에도 쓴다)
+    // 재시작 뒤에는 checkpoint 부터 다시 받으므로 같은 action_id 가 다시 나올 수 있다.
+    namespace event_stream_format {
+        static constexpr uint64_t magic       = 0x314d5254534c444cull;   // "LDLSTRM1"
+        static constexpr uint64_t version     = 1;
+        static constexpr uint64_t invalid_seq = ~uint64_t(0);
+
+        struct stream_header {
+            uint64_t magic;
+            uint64_t version;
+            uint64_t capacity;
+            uint64_t record_size;
+            std::atomic<uint64_t> write_seq;   // 다음에 쓸 순번 = 지금까지 쓴 개수
+            std::atomic<uint64_t> epoch;       // producer 가 시작한 횟수
+            uint64_t first_seq;                // 이 segment 에 처음 쓴 순번. 그 앞은 없다
+            uint64_t reserved[1];
+        };
+
+        struct event_record {
+            std::atomic<uint64_t> seq;
+            uint64_t action_id;
+            uint32_t block_num;
+            uint32_t block_time;
+            uint64_t contract;
+            uint64_t action;
+            uint64_t from;
+            uint64_t to;
+            uint64_t receiver;
+            int64_t  amount;
+            uint64_t symbol;
+        };
+
+        static_assert(sizeof(stream_header) == 64, "stream_header layout");
+        static_assert(sizeof(event_record) == 80, "event_record layout");
+    }
+
+    class event_stream : public ledger_event_sink {
+        public:
+            event_stream(const std::string& name, uint64_t capacity);
+            virtual ~event_stream();
+
+            virtual void on_ledger_event(const ledger_event& e) override;
+
+            uint64_t published() const;
+            uint64_t epoch() const;
+
+        private:
+            // 이전 실행의 segment 를 그대로 쓸 수 있으면 true
+            bool reopen(const uint64_t capacity);
+
+            std::string _name;
+            std::unique_ptr<boost::interprocess::shared_memory_object> _shm;
+            std::unique_ptr<boost::interprocess::mapped_region> _region;
+            event_stream_format::stream_header* _header = nullptr;
+            event_stream_format::event_record* _records = nullptr;
+
+            std::mutex _mtx;   // trace thread 가 여럿이라 producer 를 하나로 묶는다.
+    };
+
+    // consumer 쪽. 각자 cursor 를 가지며, 필요하면 cursor() 를 저장해 두었다가 seek 으로 이어 읽는다.
+    class event_stream_reader {
+        public:
+            explicit event_stream_reader(const std::string& name, bool from_oldest = false);
+            ~event_stream_reader();
+
+            // 다음 이벤트가 있으면 true. 덮어쓰여 건너뛴 개수는 lost 에 더한다.
+            bool next(ledger_event& e, uint64_t& lost);
+            // 최대 timeout_us 동안 기다린다. 짧게 spin 한 뒤 yield.
+            bool wait_next(ledger_event& e, uint64_t& lost, const uint64_t timeout_us);
+
+            uint64_t cursor() const { return _cursor; }
+            void seek(const uint64_t cursor) { _cursor = cursor; }
+            uint64_t head() const;
+            // producer 의 epoch. 연 뒤에 바뀌었으면 producer 가 다시 시작한 것 (이전 action_id 가 다시 올 수 있다).
+            // segment 를 새로 만들었으면 이 mapping 에는 더 쓰지 않으므로 다시 열고 cursor 로 seek 한다.
+            uint64_t epoch() const;
+
+        private:
+            std::unique_ptr<boost::interprocess::shared_memory_object> _shm;
+            std::unique_ptr<boost::interprocess::mapped_region> _region;
+            const event_stream_format::stream_header* _header = nullptr;
+            const event_stream_format::event_record* _records = nullptr;
+            uint64_t _capacity = 0;
+            uint64_t _cursor = 0;
+    };
+}
+#endif
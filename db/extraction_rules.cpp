@@ -0,0 +1,162 @@
+#include "extraction_rules.hpp"
+
+#include <fc/exception/exception.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace eosio {
+
+extraction_rules::extraction_rules(const std::vector<extraction_rule>& rules) {
+    // 같은 key 는 뒤의 것이 이긴다. (기본 규칙을 설정으로 덮어쓰기)
+    for (const auto& r : rules) {
+        auto itr = std::find_if(_rules.begin(), _rules.end(), [&](const extraction_rule& e) {
+            return e.contract == r.contract && e.action == r.action;
+        });
+        if (itr != _rules.end()) *itr = r;
+        else _rules.push_back(r);
+    }
+
+    size_t capacity = 8;
+    while (capacity < _rules.size() * 2) capacity <<= 1;
+    _slots.resize(capacity);
+    _mask = capacity - 1;
+
+    for (size_t i = 0; i < _rules.size(); i++) {
+        uint64_t pos = hash(_rules[i].contract, _rules[i].action) & _mask;
+        while (_slots[pos].rule >= 0) pos = (pos + 1) & _mask;
+        _slots[pos].contract = _rules[i].contract;
+        _slots[pos].action = _rules[i].action;
+        _slots[pos].rule = static_cast<int32_t>(i);
+    }
+}
+
+static uint64_t parse_name(const std::string& s, const std::string& spec) {
+    try {
+        return chain::name(s).value;
+    } catch (const fc::exception&) {
+        throw std::invalid_argument("invalid name '" + s + "' in extraction rule: " + spec);
+    }
+}
+
+extraction_rule extraction_rules::parse(const std::string& spec) {
+    std::istringstream in(spec);
+    std::string contract, action, kind;
+    if (!(in >> contract >> action >> kind))
+        throw std::invalid_argument("extraction rule needs <contract|*> <action> <kind>: " + spec);
+
+    extraction_rule r;
+    r.contract = contract == "*" ? 0 : parse_name(contract, spec);
+    r.action = parse_name(action, spec);
+
+    if (kind == "transfer") {
+        r.kind = extraction_kind::transfer;
+        r.from_field = "from";
+        r.to_field = "to";
+        r.quantity_field = "quantity";
+    } else if (kind == "create") {
+        r.kind = extraction_kind::create;
+        r.to_field = "issuer";
+        r.quantity_field = "maximum_supply";
+    } else if (kind == "record") {
+        r.kind = extraction_kind::record;
+    } else {
+        throw std::invalid_argument("unknown extraction kind '" + kind + "': " + spec);
+    }
+
+    std::string field;
+    while (in >> field) {
+        const auto eq = field.find('=');
+        if (eq == std::string::npos) throw std::invalid_argument("expected <role>=<field>: " + spec);
+        const auto role = field.substr(0, eq);
+        const auto value = field.substr(eq + 1);
+        if (role == "from") r.from_field = value;
+        else if (role == "to") r.to_field = value;
+        else if (role == "quantity") r.quantity_field = value;
+        else throw std::invalid_argument("unknown field role '" + role + "': " + spec);
+    }
+
+    if (r.kind != extraction_kind::record && (r.to_field.empty() || r.quantity_field.empty() ||
+            (r.kind == extraction_kind::transfer && r.from_field.empty())))
+        throw std::invalid_argument("extraction rule is missing a field: " + spec);
+    return r;
+}
+
+std::vector<extraction_rule> extraction_rules::defaults() {
+    return { parse("* transfer transfer"), parse("* create create") };
+}
+
+// typedef 를 따라간 기본 타입의 크기. 가변 길이면 -1.
+static int32_t fixed_size(const std::string& type) {
+    if (type == "name" || type == "account_name" || type == "permission_name" || type == "action_name" ||
+        type == "table_name" || type == "scope_name" || type == "uint64" || type == "int64" ||
+        type == "symbol" || type == "symbol_code" || type == "time_point" || type == "float64") return 8;
+    if (type == "asset") return 16;
+    if (type == "uint32" || type == "int32" || type == "float32" || type == "time_point_sec" ||
+        type == "block_timestamp_type") return 4;
+    if (type == "uint16" || type == "int16") return 2;
+    if (type == "uint8" || type == "int8" || type == "bool") return 1;
+    if (type == "uint128" || type == "int128" || type == "float128") return 16;
+    if (type == "checksum160") return 20;
+    if (type == "checksum256") return 32;
+    if (type == "checksum512") return 64;
+    return -1;
+}
+
+static std::string resolve_type(const chain::abi_def& abi, std::string type) {
+    for (int depth = 0; depth < 8; depth++) {
+        auto itr = std::find_if(abi.types.begin(), abi.types.end(), [&](const chain::type_def& t) {
+            return t.new_type_name == type;
+        });
+        if (itr == abi.types.end()) break;
+        type = itr->type;
+    }
+    return type;
+}
+
+static bool flatten_fields(const chain::abi_def& abi, const std::string& type, std::vector<chain::field_def>& out, int depth = 0) {
+    if (depth > 8) return false;
+    auto itr = std::find_if(abi.structs.begin(), abi.structs.end(), [&](const chain::struct_def& s) {
+        return s.name == type;
+    });
+    if (itr == abi.structs.end()) return false;
+    if (!itr->base.empty() && !flatten_fields(abi, resolve_type(abi, itr->base), out, depth + 1)) return false;
+    out.insert(out.end(), itr->fields.begin(), itr->fields.end());
+    return true;
+}
+
+extraction_layout extraction_rules::layout_for(const chain::abi_def& abi, const chain::action_name& action, const extraction_rule& rule) {
+    extraction_layout layout;
+
+    auto act = std::find_if(abi.actions.begin(), abi.actions.end(), [&](const chain::action_def& a) {
+        return a.name == action;
+    });
+    if (act == abi.actions.end()) return layout;
+
+    std::vector<chain::field_def> fields;
+    if (!flatten_fields(abi, resolve_type(abi, act->type), fields)) return layout;
+
+    uint32_t offset = 0;
+    for (const auto& f : fields) {
+        const auto type = resolve_type(abi, f.type);
+        const int32_t size = fixed_size(type);
+        if (size < 0) break;
+
+        const bool is_name = size == 8 && (type == "name" || type == "account_name");
+        if (f.name == rule.from_field && is_name) layout.from = offset;
+        if (f.name == rule.to_field && is_name) layout.to = offset;
+        if (f.name == rule.quantity_field && type == "asset") layout.quantity = offset;
+        offset += size;
+    }
+
+    layout.fixed = (rule.from_field.empty() || layout.from >= 0) &&
+                   (rule.to_field.empty() || layout.to >= 0) &&
+                   (rule.quantity_field.empty() || layout.quantity >= 0);
+    if (layout.from >= 0) layout.min_size = std::max<uint32_t>(layout.min_size, layout.from + 8);
+    if (layout.to >= 0) layout.min_size = std::max<uint32_t>(layout.min_size, layout.to + 8);
+    if (layout.quantity >= 0) layout.min_size = std::max<uint32_t>(layout.min_size, layout.quantity + 16);
+    return layout;
+}
+
+}
@@ -0,0 +1,87 @@
+#ifndef EXTRACTION_RULES_H
+#define EXTRACTION_RULES_H
+
+#include <eosio/chain/abi_def.hpp>
+#include <eosio/chain/types.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace eosio {
+    // 어떤 (contract, action) 을 ledger 로 가져올지와 필드 이름. 설정 문자열에서 만든다.
+    //
+    //   "<contract|*> <action> <kind> [from=<field>] [to=<field>] [quantity=<field>]"
+    //
+    //  - transfer : from -> to 이동. tokens 갱신, ledger row, sink 이벤트. (from == receiver 인 trace 만)
+    //  - create   : to (issuer) 에 quantity (maximum_supply) 가산, tokenlist 등록. ledger row 없음.
+    //  - record   : ledger row 만. 잔액은 건드리지 않는다. (issue, retire, open, close 등)
+    enum class extraction_kind : uint8_t { transfer, create, record };
+
+    struct extraction_rule {
+        uint64_t contract = 0;          // 0 이면 모든 contract
+        uint64_t action = 0;
+        extraction_kind kind = extraction_kind::record;
+        std::string from_field;         // 비어있으면 없음
+        std::string to_field;
+        std::string quantity_field;
+    };
+
+    // action data 앞부분이 고정 크기 필드뿐이면 ABI 없이 바로 읽을 offset.
+    struct extraction_layout {
+        bool fixed = false;
+        int32_t from = -1;              // name
+        int32_t to = -1;                // name
+        int32_t quantity = -1;          // asset (int64 amount, uint64 symbol)
+        uint32_t min_size = 0;
+    };
+
+    // 시작할 때 한 번 만들어 여러 thread 에서 읽기만 한다.
+    // (contract, action) 을 key 로 하는 open addressing 테이블. 정확한 contract 가 먼저, 없으면 * 규칙.
+    class extraction_rules {
+        public:
+            explicit extraction_rules(const std::vector<extraction_rule>& rules);
+
+            // 잘못된 형식이면 std::invalid_argument
+            static extraction_rule parse(const std::string& spec);
+            // * transfer, * create
+            static std::vector<extraction_rule> defaults();
+
+            // 규칙의 필드가 모두 고정 크기 필드 구간에 있으면 fixed.
+            static extraction_layout layout_for(const chain::abi_def& abi, const chain::action_name& action, const extraction_rule& rule);
+
+            const extraction_rule* find(const uint64_t contract, const uint64_t action) const {
+                if (auto r = probe(contract, action)) return r;
+                return probe(0, action);
+            }
+
+            const std::vector<extraction_rule>& rules() const { return _rules; }
+
+        private:
+            struct slot {
+                uint64_t contract = 0;
+                uint64_t action = 0;
+                int32_t  rule = -1;
+            };
+
+            static uint64_t hash(const uint64_t contract, const uint64_t action) {
+                uint64_t h = contract * 0x9e3779b97f4a7c15ull ^ action;
+                h ^= h >> 29;
+                h *= 0xbf58476d1ce4e5b9ull;
+                return h ^ (h >> 32);
+            }
+
+            const extraction_rule* probe(const uint64_t contract, const uint64_t action) const {
+                for (uint64_t i = hash(contract, action) & _mask; _slots[i].rule >= 0; i = (i + 1) & _mask) {
+                    const auto& s = _slots[i];
+                    if (s.contract == contract && s.action == action) return &_rules[s.rule];
+                }
+                return nullptr;
+            }
+
+            std::vector<extraction_rule> _rules;
+            std::vector<slot> _slots;
+            uint64_t _mask = 0;
+    };
+}
+#endif
@@ -0,0 +1,172 @@
+#ifndef FAST_ENCODE_H
+#define FAST_ENCODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FAST_ENCODE_X86 1
+#include <immintrin.h>
+#endif
+
+// 핫패스용 인코더. 힙 할당 없이 출력 버퍼에 바로 쓴다. append_* 는 std::string 과 arena_string 모두.
+//  - name: chain::name::to_string() 과 같은 결과 (뒤쪽 '.' 제거)
+//  - hex : fc::sha256::str() 과 같은 소문자 hex. AVX2 / SSE2 / scalar 를 런타임에 선택.
+namespace eosio { namespace fast_encode {
+
+    static constexpr size_t name_max_chars = 13;
+    static constexpr size_t uint64_max_chars = 20;
+
+    namespace detail {
+        static constexpr char name_charmap[] = ".12345abcdefghijklmnopqrstuvwxyz";
+        static constexpr char hex_digits[] = "0123456789abcdef";
+
+        // 10 bit -> name 문자 2개. 64bit name 의 상위 60bit 를 6번의 lookup 으로.
+        struct name_pair_table {
+            char pairs[1024][2];
+            constexpr name_pair_table() : pairs() {
+                for (int i = 0; i < 1024; i++) {
+                    pairs[i][0] = name_charmap[i >> 5];
+                    pairs[i][1] = name_charmap[i & 0x1f];
+                }
+            }
+        };
+        static constexpr name_pair_table name_pairs{};
+
+        inline void hex_scalar(const unsigned char* in, size_t n, char* out) {
+            for (size_t i = 0; i < n; i++) {
+                out[i*2]     = hex_digits[in[i] >> 4];
+                out[i*2 + 1] = hex_digits[in[i] & 0x0f];
+            }
+        }
+
+#ifdef FAST_ENCODE_X86
+        inline __m128i nibbles_to_hex_sse2(const __m128i n) {
+            const __m128i gt9 = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+            const __m128i digits = _mm_add_epi8(n, _mm_set1_epi8('0'));
+            return _mm_add_epi8(digits, _mm_and_si128(gt9, _mm_set1_epi8('a' - '0' - 10)));
+        }
+
+        inline size_t hex_sse2(const unsigned char* in, size_t n, char* out) {
+            const __m128i mask = _mm_set1_epi8(0x0f);
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16) {
+                const __m128i x  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+                const __m128i lo = nibbles_to_hex_sse2(_mm_and_si128(x, mask));
+                const __m128i hi = nibbles_to_hex_sse2(_mm_and_si128(_mm_srli_epi16(x, 4), mask));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i*2),      _mm_unpacklo_epi8(hi, lo));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i*2 + 16), _mm_unpackhi_epi8(hi, lo));
+            }
+            return i;
+        }
+
+        __attribute__((target("avx2")))
+        inline size_t hex_avx2(const unsigned char* in, size_t n, char* out) {
+            const __m256i mask = _mm256_set1_epi8(0x0f);
+            const __m256i lut = _mm256_setr_epi8(
+                '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f',
+                '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f');
+            size_t i = 0;
+            for (; i + 32 <= n; i += 32) {
+                const __m256i x  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+                const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(x, mask));
+                const __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), mask));
+                // unpack 은 128bit lane 단위라 lane 을 다시 맞춘다.
+                const __m256i a = _mm256_unpacklo_epi8(hi, lo);
+                const __m256i b = _mm256_unpackhi_epi8(hi, lo);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i*2),      _mm256_permute2x128_si256(a, b, 0x20));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i*2 + 32), _mm256_permute2x128_si256(a, b, 0x31));
+            }
+            return i;
+        }
+
+        inline bool has_avx2() {
+            static const bool avx2 = __builtin_cpu_supports("avx2");
+            return avx2;
+        }
+#endif
+    }
+
+    // out 은 최소 name_max_chars 바이트. 리턴은 유효 길이.
+    inline size_t name_to_chars(const uint64_t value, char* out) {
+        uint64_t v = value;
+        for (int i = 0; i < 6; i++) {
+            const auto& p = detail::name_pairs.pairs[(v >> 54) & 0x3ff];
+            out[i*2]     = p[0];
+            out[i*2 + 1] = p[1];
+            v <<= 10;
+        }
+        out[12] = detail::name_charmap[value & 0x0f];
+
+        size_t len = name_max_chars;
+        while (len > 0 && out[len - 1] == '.') len--;
+        return len;
+    }
+
+    // out 은 최소 n*2 바이트.
+    inline void hex_encode(const void* data, const size_t n, char* out) {
+        const auto* in = static_cast<const unsigned char*>(data);
+        size_t done = 0;
+#ifdef FAST_ENCODE_X86
+        if (detail::has_avx2())
+            done = detail::hex_avx2(in, n, out);
+        done += detail::hex_sse2(in + done, n - done, out + done*2);
+#endif
+        detail::hex_scalar(in + done, n - done, out + done*2);
+    }
+
+    inline size_t uint_to_chars(uint64_t value, char* out) {
+        char buf[uint64_max_chars];
+        size_t len = 0;
+        do {
+            buf[len++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value);
+        for (size_t i = 0; i < len; i++) out[i] = buf[len - 1 - i];
+        return len;
+    }
+
+    template<typename String>
+    inline void append_name(String& out, const uint64_t value) {
+        char buf[name_max_chars];
+        out.append(buf, name_to_chars(value, buf));
+    }
+
+    template<typename String>
+    inline void append_hex(String& out, const void* data, const size_t n) {
+        const size_t pos = out.size();
+        out.resize(pos + n*2);
+        hex_encode(data, n, &out[pos]);
+    }
+
+    template<typename String>
+    inline void append_uint(String& out, const uint64_t value) {
+        char buf[uint64_max_chars];
+        out.append(buf, uint_to_chars(value, buf));
+    }
+
+    template<typename String>
+    inline void append_int(String& out, const int64_t value) {
+        if (value < 0) {
+            out.push_back('-');
+            append_uint(out, ~static_cast<uint64_t>(value) + 1);
+        } else {
+            append_uint(out, static_cast<uint64_t>(value));
+        }
+    }
+
+    template<typename String>
+    inline void append_u128(String& out, unsigned __int128 value) {
+        char buf[40];
+        size_t len = 0;
+        do {
+            buf[len++] = static_cast<char>('0' + static_cast<int>(value % 10));
+            value /= 10;
+        } while (value);
+        while (len) out.push_back(buf[--len]);
+    }
+} }
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef HYPERLOGLOG_H
+#define HYPERLOGLOG_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace eosio {
+    // 고유 account 수 추정용 HyperLogLog. register 2^P 개 (P=12 면 4KB, 오차 약 1.6%).
+    // register 를 그대로 저장/병합할 수 있도록 byte 배열로 둔다.
+    template <uint32_t P>
+    class hyperloglog {
+        public:
+            static constexpr uint32_t register_count = 1u << P;
+
+            hyperloglog() { clear(); }
+
+            void clear() { std::memset(_registers, 0, sizeof(_registers)); }
+
+            void add(const uint64_t value) {
+                const uint64_t h = mix64(value);
+                const uint32_t index = static_cast<uint32_t>(h >> (64 - P));
+                const uint64_t rest = (h << P) | (uint64_t(1) << (P - 1));   // 0 방지
+                const uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+                if (rank > _registers[index]) _registers[index] = rank;
+            }
+
+            void merge(const hyperloglog& other) {
+                for (uint32_t i = 0; i < register_count; i++) {
+                    if (other._registers[i] > _registers[i]) _registers[i] = other._registers[i];
+                }
+            }
+
+            // 저장된 register 와 병합. 크기가 다르면 무시.
+            bool merge_raw(const void* data, const size_t size) {
+                if (size != register_count) return false;
+                const auto* r = static_cast<const uint8_t*>(data);
+                for (uint32_t i = 0; i < register_count; i++) {
+                    if (r[i] > _registers[i]) _registers[i] = r[i];
+                }
+                return true;
+            }
+
+            uint64_t estimate() const {
+                const double m = register_count;
+                double sum = 0;
+                uint32_t zeros = 0;
+                for (uint32_t i = 0; i < register_count; i++) {
+                    sum += std::ldexp(1.0, -_registers[i]);
+                    if (!_registers[i]) zeros++;
+                }
+                const double alpha = 0.7213 / (1.0 + 1.079 / m);
+                double e = alpha * m * m / sum;
+                if (e <= 2.5 * m && zeros)
+                    e = m * std::log(m / zeros);   // small range: linear counting
+                return static_cast<uint64_t>(e + 0.5);
+            }
+
+            const uint8_t* data() const { return _registers; }
+            static constexpr size_t size() { return register_count; }
+
+        private:
+            static uint64_t mix64(uint64_t x) {
+                x += 0x9e3779b97f4a7c15ull;
+                x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+                x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+                return x ^ (x >> 31);
+            }
+
+            uint8_t _registers[register_count];
+    };
+}
+#endif
@@ -0,0 +1,87 @@
+#include "ingest_watermarks.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace eosio {
+
+static const size_t MAX_APPLIED_HISTORY = 1 << 20;
+
+void ingest_watermarks::enter(inflight& m, const uint32_t block_num) {
+    m[block_num]++;
+}
+
+void ingest_watermarks::leave(inflight& m, const uint32_t block_num) {
+    auto itr = m.find(block_num);
+    if (itr == m.end()) return;
+    if (--itr->second == 0) m.erase(itr);
+}
+
+void ingest_watermarks::advance(watermark& w, const uint32_t block_num, const int64_t now_ms) {
+    if (block_num <= w.block_num) return;
+    w.block_num = block_num;
+    w.updated_ms = now_ms;
+}
+
+void ingest_watermarks::applied(const uint32_t block_num, const int64_t now_ms) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (block_num <= _snapshot.applied.block_num) return;
+    advance(_snapshot.applied, block_num, now_ms);
+    _applied_at.emplace_back(block_num, now_ms);
+    if (_applied_at.size() > MAX_APPLIED_HISTORY) _applied_at.pop_front();
+}
+
+void ingest_watermarks::accepted(const uint32_t block_num) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (block_num > _accepted) _accepted = block_num;
+}
+
+void ingest_watermarks::extract_begin(const uint32_t block_num) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    enter(_extracting, block_num);
+}
+
+void ingest_watermarks::extract_end(const uint32_t block_num) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    leave(_extracting, block_num);
+}
+
+void ingest_watermarks::statement_queued(const uint32_t block_num) {
+    if (!block_num) return;
+    std::lock_guard<std::mutex> lock(_mtx);
+    enter(_statements, block_num);
+}
+
+void ingest_watermarks::statement_committed(const uint32_t block_num) {
+    if (!block_num) return;
+    std::lock_guard<std::mutex> lock(_mtx);
+    leave(_statements, block_num);
+}
+
+void ingest_watermarks::update(const uint32_t buffered_block, const int64_t now_ms) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& s = _snapshot;
+
+    uint32_t extracted = std::min(_accepted, s.applied.block_num);
+    if (!_extracting.empty()) extracted = std::min(extracted, _extracting.begin()->first - 1);
+    advance(s.extracted, extracted, now_ms);
+
+    uint32_t queued = s.extracted.block_num;
+    if (buffered_block) queued = std::min(queued, buffered_block - 1);
+    advance(s.queued, queued, now_ms);
+
+    uint32_t committed = s.queued.block_num;
+    if (!_statements.empty()) committed = std::min(committed, _statements.begin()->first - 1);
+    advance(s.committed, committed, now_ms);
+
+    while (!_applied_at.empty() && _applied_at.front().first <= s.committed.block_num) _applied_at.pop_front();
+    s.lag_blocks = s.applied.block_num - s.committed.block_num;
+    s.lag_ms = _applied_at.empty() ? 0 : now_ms - _applied_at.front().second;
+}
+
+ingest_watermarks::snapshot ingest_watermarks::get() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _snapshot;
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef INGEST_WATERMARKS_H
+#define INGEST_WATERMARKS_H
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+
+namespace eosio {
+    // chain 에서 DB 까지 단계별로 "이 block 까지는 모두 지나갔다" 는 block 번호와 그 시각.
+    //
+    //  - applied   : applied_transaction 으로 받은 가장 높은 block
+    //  - extracted : trace 처리가 끝난 block (accept 된 block 까지, 처리 중인 trace 의 가장 낮은 block - 1)
+    //                applied 는 아직 trace 가 더 올 수 있는 block 이므로 넘지 않는다.
+    //  - queued    : row 가 모두 query queue 로 넘어간 block (table 버퍼에 남은 가장 낮은 block - 1)
+    //  - committed : 실행까지 끝난 block (실행 전 statement 의 가장 낮은 block - 1)
+    //
+    // statement 는 담긴 row 중 가장 낮은 block 으로 태그한다. 태그 0 은 추적하지 않는다.
+    // lag 은 committed 다음 block 을 받은 시각부터 지금까지.
+    class ingest_watermarks {
+        public:
+            struct watermark {
+                uint32_t block_num = 0;
+                int64_t  updated_ms = 0;        // 마지막으로 움직인 시각
+            };
+            struct snapshot {
+                watermark applied;
+                watermark extracted;
+                watermark queued;
+                watermark committed;
+                uint32_t  lag_blocks = 0;
+                int64_t   lag_ms = 0;
+            };
+
+            void applied(const uint32_t block_num, const int64_t now_ms);
+            // 이 block 의 trace 는 모두 queue 에 들어갔다.
+            void accepted(const uint32_t block_num);
+
+            void extract_begin(const uint32_t block_num);
+            void extract_end(const uint32_t block_num);
+
+            void statement_queued(const uint32_t block_num);
+            void statement_committed(const uint32_t block_num);
+
+            // tick 마다. buffered_block 은 table 버퍼에 남은 가장 낮은 block (없으면 0).
+            void update(const uint32_t buffered_block, const int64_t now_ms);
+
+            snapshot get() const;
+
+        private:
+            using inflight = std::map<uint32_t, uint32_t>;     // block -> 개수
+
+            static void enter(inflight& m, const uint32_t block_num);
+            static void leave(inflight& m, const uint32_t block_num);
+            static void advance(watermark& w, const uint32_t block_num, const int64_t now_ms);
+
+            mutable std::mutex _mtx;
+            inflight _extracting;
+            inflight _statements;
+            std::deque<std::pair<uint32_t, int64_t>> _applied_at;   // block 을 처음 받은 시각
+            snapshot _snapshot;
+            uint32_t _accepted = 0;
+    };
+}
+#endif
@@ -0,0 +1,43 @@
+#ifndef LEDGER_EVENT_H
+#define LEDGER_EVENT_H
+
+#include <cstdint>
+
+namespace eosio {
+    // add_ledger 에서 추출한 잔액 변화 하나. name / symbol 은 raw uint64 그대로.
+    //  - transfer: from -> to 로 amount 이동
+    //  - create  : to (issuer) 에 maximum_supply 가산 (tokens 테이블과 같은 규칙)
+    struct ledger_event {
+        uint64_t action_id  = 0;   // global_sequence
+        uint32_t block_num  = 0;
+        uint32_t block_time = 0;   // unix seconds
+        uint64_t contract   = 0;
+        uint64_t action     = 0;
+        uint64_t from       = 0;
+        uint64_t to         = 0;
+        uint64_t receiver   = 0;
+        int64_t  amount     = 0;
+        uint64_t symbol     = 0;   // precision 포함 symbol value
+        uint8_t  transaction_id[32] = {};
+        // 재시작 뒤 다시 처리된 action 에서 tokens 에 이미 반영되어 있던 쪽. (tokens_applied)
+        uint8_t  replayed   = 0;   // replayed_to | replayed_from
+
+        static constexpr uint8_t replayed_to = 1;
+        static constexpr uint8_t replayed_from = 2;
+
+        uint64_t symbol_code() const { return symbol >> 8; }
+        uint8_t precision() const { return static_cast<uint8_t>(symbol & 0xff); }
+    };
+
+    // ledger_table 이 추출한 이벤트를 받는 쪽. 여러 trace thread 에서 동시에 호출된다.
+    class ledger_event_sink {
+        public:
+            virtual ~ledger_event_sink() {}
+
+            virtual void on_ledger_event(const ledger_event& e) = 0;
+
+            // plugin 의 1초 tick. flush 등 주기 작업.
+            virtual void tick(const int64_t) {}
+    };
+}
+#endif
@@ -0,0 +1,100 @@
+#ifndef LEDGER_SCHEMA_H
+#define LEDGER_SCHEMA_H
+
+#include "table_schema.hpp"
+
+// plugin 이 쓰는 테이블. DDL, INSERT 컬럼 목록, row 인코더 모두 여기서 나온다.
+namespace eosio { namespace schema {
+
+    // ledger 는 block_number 순서로만 들어오므로 PK 를 (block_number, action_id) 로 두어
+    // 항상 마지막 partition 의 오른쪽 끝에 append 되도록 한다.
+    // partition key 는 모든 unique key 에 포함되어야 하므로 action_id 는 보조 인덱스.
+    static constexpr table<u64, hex<32>, u32, datetime, name, name, name, i64, u8, symbol, name, name, now> ledger {
+        "ledger",
+        "PRIMARY KEY (`block_number`, `action_id`), "
+        "KEY `idx_action_id` (`action_id`), "
+        "KEY `idx_from_account` (`from_account`, `block_number`), "
+        "KEY `idx_to_account` (`to_account`, `block_number`) ",
+        {"action_id",       "NOT NULL"},
+        {"transaction_id",  "NOT NULL"},
+        {"block_number",    "NOT NULL"},
+        {"timestamp",       "NOT NULL"},
+        {"contract_owner",  "NOT NULL"},
+        {"from_account",    "NOT NULL"},
+        {"to_account",      "NOT NULL"},
+        {"amount",          "NOT NULL"},
+        {"precision",       "NOT NULL"},
+        {"symbol",          "NOT NULL"},
+        {"receiver",        "NOT NULL"},
+        {"action_name",     "NOT NULL"},
+        {"created_at",      "NOT NULL DEFAULT CURRENT_TIMESTAMP"}
+    };
+
+    static constexpr table<u64, name, name> actions_accounts {
+        "actions_accounts",
+        "PRIMARY KEY (`action_id`, `actor`, `permission`), "
+        "KEY `idx_actor` (`actor`, `action_id`) ",
+        {"action_id",       "NOT NULL"},
+        {"actor",           "NOT NULL"},
+        {"permission",      "NOT NULL"}
+    };
+
+    static constexpr table<name, name, symbol, i64, u8> tokens {
+        "tokens",
+        "PRIMARY KEY (`account`, `contract_owner`, `symbol`) ",
+        {"account",         "NOT NULL"},
+        {"contract_owner",  "NOT NULL"},
+        {"symbol",          "NOT NULL"},
+        {"amount",          "NOT NULL DEFAULT 0"},
+        {"precision",       "NOT NULL"}
+    };
+
+    // tokens 는 가산이라 같은 statement 를 두 번 실행하면 두 번 더해진다. tokens statement 는 같은 트랜잭션에서
+    // 여기에 (transaction, action 순번) 을 먼저 넣으므로, 이미 반영된 action 은 duplicate key 로 통째로 rollback 된다.
+    // (재시작 뒤 checkpoint 부터 다시 처리하거나 spill 을 다시 실행할 때) global_sequence 는 fork 가 바뀌면 
+    // 다른 action 에 다시 쓰이므로 key 로 쓰지 않는다. checkpoint 아래는 plugin 이 지운다.
+    static constexpr table<hex<32>, u32, u32> tokens_applied {
+        "tokens_applied",
+        "PRIMARY KEY (`transaction_id`, `action_index`), "
+        "KEY `idx_block_number` (`block_number`) ",
+        {"transaction_id",  "NOT NULL"},
+        {"action_index",    "NOT NULL"},
+        {"block_number",    "NOT NULL"}
+    };
+
+    static constexpr table<name, symbol, name, u8, i64> tokenlist {
+        "tokenlist",
+        "PRIMARY KEY (`contract_owner`, `symbol`) ",
+        {"contract_owner",  "NOT NULL"},
+        {"symbol",          "NOT NULL"},
+        {"issuer",          "NOT NULL"},
+        {"precision",       "NOT NULL"},
+        {"maximum_supply",  "NOT NULL"}
+    };
+
+    // 대시보드용 token 별 시간 bucket 집계. token_aggregates sink 가 절대값으로 upsert.
+    static constexpr table<name, symbol, u32, datetime, u8, u128, u64, u64, blob, u32> token_aggregates {
+        "token_aggregates",
+        "PRIMARY KEY (`contract_owner`, `symbol`, `bucket_seconds`, `bucket_start`), "
+        "KEY `idx_bucket` (`bucket_seconds`, `bucket_start`) ",
+        {"contract_owner",  "NOT NULL"},
+        {"symbol",          "NOT NULL"},
+        {"bucket_seconds",  "NOT NULL"},
+        {"bucket_start",    "NOT NULL"},
+        {"precision",       "NOT NULL"},
+        {"volume",          "NOT NULL DEFAULT 0"},
+        {"transfers",       "NOT NULL DEFAULT 0"},
+        {"unique_senders",  "NOT NULL DEFAULT 0"},
+        {"sender_sketch",   "NOT NULL"},
+        {"last_block",      "NOT NULL DEFAULT 0"}
+    };
+
+    static constexpr table<key, u64> ledger_state {
+        "ledger_state",
+        "PRIMARY KEY (`name`) ",
+        {"name",            "NOT NULL"},
+        {"value",           "NOT NULL"}
+    };
+} }
+
+#endif
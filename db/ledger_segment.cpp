@@ -0,0 +1,448 @@
+#include "ledger_segment.hpp"
+
+#include <boost/filesystem.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace eosio {
+
+namespace bip = boost::interprocess;
+namespace bfs = boost::filesystem;
+using namespace ledger_segment_format;
+
+static inline void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+static inline uint64_t get_varint(const uint8_t*& p, const uint8_t* end) {
+    uint64_t v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        const uint8_t b = *p++;
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    throw std::runtime_error("corrupt ledger segment varint");
+}
+
+static inline uint64_t zigzag(const int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+static inline int64_t unzigzag(const uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+static uint64_t checksum(const uint8_t* p, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ull;   // FNV-1a
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static std::string segment_name(const uint32_t start, const uint32_t end, const uint32_t part) {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "ledger-%010u-%010u.%u.seg", start, end, part);
+    return buf;
+}
+
+static uint64_t dict_value(const ledger_event& e, const column c) {
+    switch (c) {
+        case col_contract: return e.contract;
+        case col_action:   return e.action;
+        case col_from:     return e.from;
+        case col_to:       return e.to;
+        case col_receiver: return e.receiver;
+        case col_symbol:   return e.symbol;
+        default:           return 0;
+    }
+}
+
+static const column dict_columns[] = { col_contract, col_action, col_from, col_to, col_receiver, col_symbol };
+
+ledger_segment_writer::ledger_segment_writer(const std::string& dir, uint32_t blocks_per_segment, uint32_t max_rows) :
+_dir(dir), _blocks_per_segment(blocks_per_segment ? blocks_per_segment : 1), _max_rows(max_rows ? max_rows : 1)
+{
+    bfs::create_directories(_dir);
+    _thread = std::thread([this] { run(); });
+}
+
+ledger_segment_writer::~ledger_segment_writer() {
+    seal_all();
+}
+
+void ledger_segment_writer::skip_written(const uint32_t resume_block) {
+    _written.clear();
+    _floor_block = 0;
+    for (const auto& path : ledger_segment_reader::list(_dir, resume_block + 1, std::numeric_limits<uint32_t>::max())) {
+        try {
+            ledger_segment_reader seg(path);
+            if (seg.header().max_block <= resume_block) continue;
+            std::vector<uint64_t> ids, blocks;
+            seg.read_column(col_action_id, ids);
+            seg.read_column(col_block_num, blocks);
+            for (size_t i = 0; i < ids.size(); i++) {
+                if (blocks[i] <= resume_block) continue;
+                _written.insert(ids[i]);
+                _floor_block = std::max(_floor_block, static_cast<uint32_t>(blocks[i]));
+            }
+        } catch (const std::exception& e) {
+            // 읽을 수 없는 파일은 reader 도 읽지 못한다. 그 row 는 다시 쓴다.
+            std::cerr << "ledger segment: " << e.what() << std::endl;
+        }
+    }
+}
+
+void ledger_segment_writer::on_ledger_event(const ledger_event& e) {
+    if (!e.from) return;   // create
+    if (e.block_num <= _floor_block && _written.count(e.action_id)) {
+        _skipped++;
+        return;
+    }
+
+    const uint32_t index = e.block_num / _blocks_per_segment;
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& seg = _open[index];
+    seg.rows.push_back(e);
+    seg.touched = true;
+    _pending_rows++;
+    if (index > _max_index) _max_index = index;
+    if (seg.rows.size() >= _max_rows) {
+        _sealing.push_back(sealing_segment{index, std::move(seg.rows)});
+        seg.rows.clear();
+        _cond.notify_one();
+    }
+}
+
+void ledger_segment_writer::tick(const int64_t) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    bool sealed = false;
+    for (auto it = _open.begin(); it != _open.end(); ) {
+        // 최신 segment 는 계속 채워지는 중이라 건드리지 않는다.
+        if (it->first < _max_index && !it->second.touched) {
+            if (!it->second.rows.empty()) {
+                _sealing.push_back(sealing_segment{it->first, std::move(it->second.rows)});
+                sealed = true;
+            }
+            it = _open.erase(it);
+        } else {
+            it->second.touched = false;
+            ++it;
+        }
+    }
+    if (sealed) _cond.notify_one();
+}
+
+void ledger_segment_writer::seal_all() {
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        for (auto& s : _open) {
+            if (!s.second.rows.empty()) _sealing.push_back(sealing_segment{s.first, std::move(s.second.rows)});
+        }
+        _open.clear();
+        _stop = true;
+    }
+    _cond.notify_one();
+    if (_thread.joinable()) _thread.join();
+}
+
+void ledger_segment_writer::run() {
+    std::unique_lock<std::mutex> lock(_mtx);
+    while (true) {
+        _cond.wait(lock, [this] { return _stop || !_sealing.empty(); });
+        if (_sealing.empty()) break;
+
+        auto seg = std::move(_sealing.front());
+        _sealing.pop_front();
+        lock.unlock();
+        const bool ok = write_segment(seg.index, seg.rows);
+        lock.lock();
+        if (ok) continue;
+
+        _failed++;
+        // 종료 중이면 한 번 더만. 디스크가 찬 경우 등은 바로 다시 해도 같으므로 잠시 쉰다.
+        if (_stop && ++seg.attempts > 1) {
+            std::cerr << "ledger segment: dropping " << seg.rows.size() << " rows of block range "
+                      << seg.index * _blocks_per_segment << std::endl;
+            _pending_rows -= seg.rows.size();
+            continue;
+        }
+        _sealing.push_back(std::move(seg));
+        if (!_stop) _cond.wait_for(lock, std::chrono::seconds(1), [this] { return _stop; });
+    }
+}
+
+bool ledger_segment_writer::write_segment(const uint32_t index, std::vector<ledger_event>& rows) {
+    if (rows.empty()) return true;
+    try {
+        write_file(index, rows);
+    } catch (const std::exception& e) {
+        std::cerr << "ledger segment: " << e.what() << std::endl;
+        return false;
+    }
+    _sealed++;
+    _pending_rows -= rows.size();
+    rows.clear();
+    return true;
+}
+
+void ledger_segment_writer::write_file(const uint32_t index, std::vector<ledger_event>& rows) {
+
+    std::sort(rows.begin(), rows.end(), [](const ledger_event& a, const ledger_event& b) {
+        return a.action_id < b.action_id;
+    });
+
+    segment_header h;
+    std::memset(&h, 0, sizeof(h));
+    h.magic = magic;
+    h.version = version;
+    h.column_count = column_count;
+    h.row_count = rows.size();
+    h.block_start = index * _blocks_per_segment;
+    h.block_end = h.block_start + _blocks_per_segment;
+    h.min_block = h.max_block = rows.front().block_num;
+    h.min_time = h.max_time = rows.front().block_time;
+    h.min_action_id = rows.front().action_id;
+    h.max_action_id = rows.back().action_id;
+    h.min_amount = h.max_amount = rows.front().amount;
+
+    // dictionary: 모든 name / symbol 값을 정렬해서 하나로.
+    std::vector<uint64_t> dict;
+    dict.reserve(rows.size() * 2);
+    for (const auto& r : rows) {
+        for (const auto c : dict_columns) dict.push_back(dict_value(r, c));
+        h.min_block  = std::min(h.min_block, r.block_num);
+        h.max_block  = std::max(h.max_block, r.block_num);
+        h.min_time   = std::min(h.min_time, r.block_time);
+        h.max_time   = std::max(h.max_time, r.block_time);
+        h.min_amount = std::min(h.min_amount, r.amount);
+        h.max_amount = std::max(h.max_amount, r.amount);
+    }
+    std::sort(dict.begin(), dict.end());
+    dict.erase(std::unique(dict.begin(), dict.end()), dict.end());
+    h.dictionary_count = dict.size();
+
+    std::unordered_map<uint64_t, uint32_t> dict_index;
+    dict_index.reserve(dict.size());
+    for (uint32_t i = 0; i < dict.size(); i++) dict_index[dict[i]] = i;
+
+    std::vector<std::string> columns(column_count);
+    std::vector<uint32_t> encodings(column_count, enc_dictionary);
+    encodings[col_action_id] = encodings[col_block_num] = encodings[col_block_time] = enc_delta;
+    encodings[col_amount] = enc_zigzag;
+    encodings[col_transaction_id] = enc_raw32;
+
+    uint64_t prev_action_id = 0;
+    int64_t prev_block = 0;
+    int64_t prev_time = 0;
+    for (const auto& r : rows) {
+        put_varint(columns[col_action_id], r.action_id - prev_action_id);
+        put_varint(columns[col_block_num], zigzag(static_cast<int64_t>(r.block_num) - prev_block));
+        put_varint(columns[col_block_time], zigzag(static_cast<int64_t>(r.block_time) - prev_time));
+        prev_action_id = r.action_id;
+        prev_block = r.block_num;
+        prev_time = r.block_time;
+
+        columns[col_transaction_id].append(reinterpret_cast<const char*>(r.transaction_id), sizeof(r.transaction_id));
+        put_varint(columns[col_amount], zigzag(r.amount));
+        for (const auto c : dict_columns) put_varint(columns[c], dict_index[dict_value(r, c)]);
+    }
+
+    // header 뒤 body 를 한 버퍼로 만든 뒤 checksum.
+    std::string body;
+    body.append(reinterpret_cast<const char*>(dict.data()), dict.size() * sizeof(uint64_t));
+    std::vector<column_entry> entries(column_count);
+    uint64_t offset = sizeof(segment_header) + body.size() + column_count * sizeof(column_entry);
+    for (uint32_t c = 0; c < column_count; c++) {
+        entries[c].id = c;
+        entries[c].encoding = encodings[c];
+        entries[c].offset = offset;
+        entries[c].size = columns[c].size();
+        offset += columns[c].size();
+    }
+    body.append(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(column_entry));
+    for (const auto& col : columns) body += col;
+    h.checksum = checksum(reinterpret_cast<const uint8_t*>(body.data()), body.size());
+
+    uint32_t part = 0;
+    while (bfs::exists(bfs::path(_dir) / segment_name(h.block_start, h.block_end, part))) part++;
+    const std::string path = (bfs::path(_dir) / segment_name(h.block_start, h.block_end, part)).string();
+    const std::string tmp_path = path + ".tmp";
+
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("unable to create ledger segment " + tmp_path);
+    bool ok = ::write(fd, &h, sizeof(h)) == sizeof(h);
+    ok = ok && ::write(fd, body.data(), body.size()) == static_cast<ssize_t>(body.size());
+    ok = ok && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok || ::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp_path.c_str());
+        throw std::runtime_error("unable to write ledger segment " + path);
+    }
+}
+
+//----------------
+
+ledger_segment_reader::ledger_segment_reader(const std::string& path) {
+    if (!bfs::exists(path) || bfs::file_size(path) < sizeof(segment_header))
+        throw std::runtime_error("invalid ledger segment " + path);
+
+    _mapping = std::make_unique<bip::file_mapping>(path.c_str(), bip::read_only);
+    _region = std::make_unique<bip::mapped_region>(*_mapping, bip::read_only);
+
+    const auto* base = static_cast<const uint8_t*>(_region->get_address());
+    const size_t file_size = _region->get_size();
+    _header = reinterpret_cast<const segment_header*>(base);
+    if (_header->magic != magic || _header->version != version || _header->column_count != column_count)
+        throw std::runtime_error("incompatible ledger segment " + path);
+
+    const size_t body_size = file_size - sizeof(segment_header);
+    if (_header->dictionary_count * sizeof(uint64_t) + column_count * sizeof(column_entry) > body_size
+        || checksum(base + sizeof(segment_header), body_size) != _header->checksum)
+        throw std::runtime_error("corrupt ledger segment " + path);
+
+    _dictionary = reinterpret_cast<const uint64_t*>(base + sizeof(segment_header));
+    _columns = reinterpret_cast<const column_entry*>(_dictionary + _header->dictionary_count);
+    for (uint32_t c = 0; c < column_count; c++) {
+        if (_columns[c].offset + _columns[c].size > file_size)
+            throw std::runtime_error("corrupt ledger segment " + path);
+    }
+}
+
+ledger_segment_reader::~ledger_segment_reader()
+{
+
+}
+
+bool ledger_segment_reader::overlaps_blocks(const uint32_t from, const uint32_t to) const {
+    return _header->min_block < to && from <= _header->max_block;
+}
+
+bool ledger_segment_reader::overlaps_time(const uint32_t from, const uint32_t to) const {
+    return _header->min_time < to && from <= _header->max_time;
+}
+
+bool ledger_segment_reader::has_value(const uint64_t name_or_symbol) const {
+    return std::binary_search(_dictionary, _dictionary + _header->dictionary_count, name_or_symbol);
+}
+
+const column_entry& ledger_segment_reader::entry(const column c) const {
+    if (c >= column_count) throw std::out_of_range("ledger segment column");
+    return _columns[c];
+}
+
+const uint8_t* ledger_segment_reader::data(const column_entry& e) const {
+    return static_cast<const uint8_t*>(_region->get_address()) + e.offset;
+}
+
+void ledger_segment_reader::read_column(const column c, std::vector<uint64_t>& out) const {
+    const auto& e = entry(c);
+    const uint8_t* p = data(e);
+    const uint8_t* end = p + e.size;
+    const uint64_t rows = _header->row_count;
+    out.resize(rows);
+
+    switch (e.encoding) {
+        case enc_delta: {
+            uint64_t prev = 0;
+            for (uint64_t i = 0; i < rows; i++) {
+                const uint64_t v = get_varint(p, end);
+                prev = c == col_action_id ? prev + v : static_cast<uint64_t>(static_cast<int64_t>(prev) + unzigzag(v));
+                out[i] = prev;
+            }
+            break;
+        }
+        case enc_dictionary:
+            for (uint64_t i = 0; i < rows; i++) {
+                const uint64_t idx = get_varint(p, end);
+                if (idx >= _header->dictionary_count) throw std::runtime_error("corrupt ledger segment dictionary index");
+                out[i] = _dictionary[idx];
+            }
+            break;
+        case enc_zigzag:
+            for (uint64_t i = 0; i < rows; i++) out[i] = static_cast<uint64_t>(unzigzag(get_varint(p, end)));
+            break;
+        default:
+            throw std::runtime_error("ledger segment column is not numeric");
+    }
+}
+
+void ledger_segment_reader::read_amounts(std::vector<int64_t>& out) const {
+    const auto& e = entry(col_amount);
+    const uint8_t* p = data(e);
+    const uint8_t* end = p + e.size;
+    out.resize(_header->row_count);
+    for (auto& v : out) v = unzigzag(get_varint(p, end));
+}
+
+void ledger_segment_reader::read_dictionary_index(const column c, std::vector<uint32_t>& out) const {
+    const auto& e = entry(c);
+    if (e.encoding != enc_dictionary) throw std::runtime_error("ledger segment column is not dictionary encoded");
+    const uint8_t* p = data(e);
+    const uint8_t* end = p + e.size;
+    out.resize(_header->row_count);
+    for (auto& v : out) v = static_cast<uint32_t>(get_varint(p, end));
+}
+
+const uint8_t* ledger_segment_reader::transaction_id(const uint64_t row) const {
+    if (row >= _header->row_count) throw std::out_of_range("ledger segment row");
+    return data(entry(col_transaction_id)) + row * 32;
+}
+
+void ledger_segment_reader::for_each(const std::function<void(const ledger_event&)>& f) const {
+    std::vector<uint64_t> cols[column_count];
+    for (uint32_t c = 0; c < column_count; c++) {
+        if (c != col_transaction_id && c != col_amount) read_column(static_cast<column>(c), cols[c]);
+    }
+    std::vector<int64_t> amounts;
+    read_amounts(amounts);
+
+    ledger_event e;
+    for (uint64_t i = 0; i < _header->row_count; i++) {
+        e.action_id  = cols[col_action_id][i];
+        e.block_num  = static_cast<uint32_t>(cols[col_block_num][i]);
+        e.block_time = static_cast<uint32_t>(cols[col_block_time][i]);
+        e.contract   = cols[col_contract][i];
+        e.action     = cols[col_action][i];
+        e.from       = cols[col_from][i];
+        e.to         = cols[col_to][i];
+        e.receiver   = cols[col_receiver][i];
+        e.amount     = amounts[i];
+        e.symbol     = cols[col_symbol][i];
+        std::memcpy(e.transaction_id, transaction_id(i), sizeof(e.transaction_id));
+        f(e);
+    }
+}
+
+std::vector<std::string> ledger_segment_reader::list(const std::string& dir, const uint32_t from, const uint32_t to) {
+    std::vector<std::string> files;
+    if (!bfs::is_directory(dir)) return files;
+
+    for (bfs::directory_iterator it(dir), end; it != end; ++it) {
+        const std::string name = it->path().filename().string();
+        unsigned start = 0, stop = 0, part = 0;
+        if (name.size() < 4 || name.compare(name.size() - 4, 4, ".seg") != 0
+            || std::sscanf(name.c_str(), "ledger-%u-%u.%u.seg", &start, &stop, &part) != 3)
+            continue;
+        if (start < to && from < stop) files.push_back(it->path().string());
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+}
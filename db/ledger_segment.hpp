@@ -0,0 +1,193 @@
+#ifndef LEDGER_SEGMENT_H
+#define LEDGER_SEGMENT_H
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "ledger_event.hpp"
+
+namespace eosio {
+    // ledger row 를 block range 단위의 불변 columnar 파일로 남긴다. 분석용 scan 이 MySQL 을 건드리지 않도록.
+    //
+    // 파일: ledger-<block_start>-<block_end>.<part>.seg  ([block_start, block_end) 구간, 늦게 온 row 는 다음 part)
+    //   [segment_header] [dictionary: uint64 x dictionary_count, 오름차순] [column_entry x column_count] [column data]
+    // row 는 action_id 순. 인코딩:
+    //   - action_id, block_num, block_time : 이전 row 와의 차이를 zigzag varint
+    //   - contract, action, from, to, receiver, symbol : dictionary index varint
+    //   - amount : zigzag varint
+    //   - transaction_id : 32 bytes 그대로
+    namespace ledger_segment_format {
+        static constexpr uint64_t magic   = 0x3130474553444c4cull;   // "LLDSEG01"
+        static constexpr uint32_t version = 1;
+
+        enum column : uint32_t {
+            col_action_id = 0,
+            col_transaction_id,
+            col_block_num,
+            col_block_time,
+            col_contract,
+            col_action,
+            col_from,
+            col_to,
+            col_receiver,
+            col_amount,
+            col_symbol,
+            column_count
+        };
+
+        enum encoding : uint32_t {
+            enc_delta      = 0,
+            enc_dictionary = 1,
+            enc_zigzag     = 2,
+            enc_raw32      = 3
+        };
+
+        struct segment_header {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t column_count;
+            uint64_t row_count;
+            uint32_t block_start;
+            uint32_t block_end;
+            // per-segment 통계. reader 가 파일을 열지 않고도 걸러낼 수 있게.
+            uint32_t min_block;
+            uint32_t max_block;
+            uint32_t min_time;
+            uint32_t max_time;
+            uint64_t min_action_id;
+            uint64_t max_action_id;
+            int64_t  min_amount;
+            int64_t  max_amount;
+            uint64_t dictionary_count;
+            uint64_t checksum;   // header 이후 전체
+        };
+
+        struct column_entry {
+            uint32_t id;
+            uint32_t encoding;
+            uint64_t offset;     // 파일 처음부터
+            uint64_t size;
+        };
+    }
+
+    // ledger_table 의 sink. transfer row 만 받는다 (create 는 ledger row 가 없다).
+    // 마지막 block 이 지나간 뒤 한 tick 동안 row 가 없으면 segment 를 닫는다.
+    // 정렬과 파일 쓰기 (fsync) 는 전용 thread 에서. trace thread 는 row 를 넘기기만 하고 예외도 받지 않는다.
+    // 쓰기에 실패한 segment 는 row 를 가진 채 1 초 뒤 다시 시도한다.
+    // 재시작하면 checkpoint 다음 block 부터 다시 받으므로 skip_written 으로 이미 파일에 있는 row 를 거른다.
+    class ledger_segment_writer : public ledger_event_sink {
+        public:
+            ledger_segment_writer(const std::string& dir, uint32_t blocks_per_segment, uint32_t max_rows);
+            virtual ~ledger_segment_writer();
+
+            // 이벤트를 받기 전에. resume_block 다음부터 다시 받는다.
+            // 그 위로 이미 쓴 row 의 action_id 를 읽어두고, 그 중 가장 높은 block (floor) 이하에서 같은 row 는 버린다.
+            // 파일 사이에서 순서가 섞여 있을 수 있으므로 block 만으로 자르지 않는다. (아직 못 쓴 row 가 floor 아래에 있을 수 있다)
+            void skip_written(const uint32_t resume_block);
+            uint32_t floor_block() const { return _floor_block; }
+            uint64_t skipped_count() const { return _skipped; }
+
+            virtual void on_ledger_event(const ledger_event& e) override;
+            virtual void tick(const int64_t tick) override;
+
+            // 열려있는 segment 를 모두 닫고 다 쓸 때까지 기다린다. 종료 시.
+            // 이때도 실패한 segment 는 한 번 더 시도한 뒤 버린다. (ledger 테이블에는 남아 있다)
+            void seal_all();
+
+            uint64_t sealed_count() const { return _sealed; }
+            uint64_t failed_count() const { return _failed; }
+            // 아직 파일로 쓰지 못한 row (열린 segment 포함)
+            uint64_t pending_rows() const { return _pending_rows; }
+
+        private:
+            struct open_segment {
+                std::vector<ledger_event> rows;
+                bool touched = false;
+            };
+            struct sealing_segment {
+                uint32_t index = 0;
+                std::vector<ledger_event> rows;
+                uint32_t attempts = 0;
+            };
+
+            void run();
+            // 실패하면 false. rows 는 그대로 둔다.
+            bool write_segment(const uint32_t index, std::vector<ledger_event>& rows);
+            void write_file(const uint32_t index, std::vector<ledger_event>& rows);
+
+            std::string _dir;
+            uint32_t _blocks_per_segment;
+            uint32_t _max_rows;
+
+            std::mutex _mtx;                        // _open, _max_index, _sealing, _stop
+            std::condition_variable _cond;
+            std::map<uint32_t, open_segment> _open;
+            uint32_t _max_index = 0;
+            std::deque<sealing_segment> _sealing;   // 쓰기를 기다리는 segment. 실패한 것은 뒤로
+            bool _stop = false;
+            std::thread _thread;
+
+            // skip_written 이 채운 뒤로는 읽기만 한다.
+            uint32_t _floor_block = 0;
+            std::unordered_set<uint64_t> _written;
+            std::atomic<uint64_t> _skipped{0};
+
+            std::atomic<uint64_t> _sealed{0};
+            std::atomic<uint64_t> _failed{0};
+            std::atomic<uint64_t> _pending_rows{0};
+    };
+
+    // segment 파일 하나를 map 해서 column 단위로 풀어준다.
+    class ledger_segment_reader {
+        public:
+            explicit ledger_segment_reader(const std::string& path);
+            ~ledger_segment_reader();
+
+            const ledger_segment_format::segment_header& header() const { return *_header; }
+            uint64_t size() const { return _header->row_count; }
+
+            // 통계로 거르기
+            bool overlaps_blocks(const uint32_t from, const uint32_t to) const;
+            bool overlaps_time(const uint32_t from, const uint32_t to) const;
+            bool has_value(const uint64_t name_or_symbol) const;
+
+            const uint64_t* dictionary() const { return _dictionary; }
+            uint64_t dictionary_size() const { return _header->dictionary_count; }
+
+            // action_id, block_num, block_time, amount 과 dictionary column 을 값으로
+            void read_column(const ledger_segment_format::column c, std::vector<uint64_t>& out) const;
+            void read_amounts(std::vector<int64_t>& out) const;
+            // dictionary column 을 index 로. group by 는 이쪽이 빠르다.
+            void read_dictionary_index(const ledger_segment_format::column c, std::vector<uint32_t>& out) const;
+            const uint8_t* transaction_id(const uint64_t row) const;
+
+            void for_each(const std::function<void(const ledger_event&)>& f) const;
+
+            // dir 안에서 [from, to) block 구간과 겹치는 segment 파일들.
+            static std::vector<std::string> list(const std::string& dir, const uint32_t from, const uint32_t to);
+
+        private:
+            const ledger_segment_format::column_entry& entry(const ledger_segment_format::column c) const;
+            const uint8_t* data(const ledger_segment_format::column_entry& e) const;
+
+            std::unique_ptr<boost::interprocess::file_mapping> _mapping;
+            std::unique_ptr<boost::interprocess::mapped_region> _region;
+            const ledger_segment_format::segment_header* _header = nullptr;
+            const uint64_t* _dictionary = nullptr;
+            const ledger_segment_format::column_entry* _columns = nullptr;
+    };
+}
+#endif
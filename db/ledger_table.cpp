@@ -1,5 +1,7 @@
 #include "ledger_table.hpp"
+#include "ledger_schema.hpp"
 #include "mysqlconn.h"
+#include "span_tracer.hpp"
 
 #include <eosio/chain/eosio_contract.hpp>
 #include <eosio/chain/config.hpp>
@@ -8,183 +10,300 @@
 #include <eosio/chain/types.hpp>
 #include <eosio/chain/block_timestamp.hpp>
 
-#include <eosio/chain_plugin/chain_plugin.hpp>
+#include <eosio/chain/abi_serializer.hpp>
 
 #include <boost/chrono.hpp>
-#include <boost/format.hpp>
 
 #include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
 #include <fc/utf8.hpp>
 #include <fc/variant.hpp>
 
+#include <mysqld_error.h>
+
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <future>
 
 namespace eosio {
 
-extern void post_query_str_to_queue(const std::string query_str);
+extern void post_query_str_to_queue(const std::string query_str, const uint32_t block_num = 0, const uint32_t shard = 0);
 extern const int64_t get_now_tick();
 
-static const std::string LEDGER_INSERT_STR =
-    "INSERT IGNORE INTO ledger(`action_id`, `transaction_id`, `block_number`, `timestamp`, `contract_owner`, `from_account`, `to_account`, `amount`, `precision`, `symbol`, `receiver`, `action_name`, `created_at` ) VALUES ";
-static const std::string ACTIONS_ACCOUNT_INSERT_STR = 
-    "INSERT INTO actions_accounts(action_id, actor, permission) VALUES ";
+static const std::string LEDGER_INSERT_STR = schema::ledger.insert_sql("INSERT IGNORE");
+static const std::string ACTIONS_ACCOUNT_INSERT_STR = schema::actions_accounts.insert_sql("INSERT IGNORE");
+static const std::string TOKENLIST_INSERT_STR = schema::tokenlist.insert_sql("INSERT IGNORE");
+static const std::string TOKENS_ADD_STR = schema::tokens.insert_sql();
+static const std::string TOKENS_ADD_UPDATE_STR = " ON DUPLICATE KEY UPDATE `amount` = `amount` + VALUES(`amount`)";
+static const std::string TOKENS_APPLIED_INSERT_STR = schema::tokens_applied.insert_sql();
 
 ledger_table::ledger_table(std::shared_ptr<connection_pool> pool, uint32_t raw_bulk_max_count, uint32_t account_bulk_max_count) :
-m_pool(pool), _raw_bulk_max_count(raw_bulk_max_count), _account_bulk_max_count(account_bulk_max_count)
+m_router(std::make_shared<shard_router>(pool)), 
+_raw_bulk_max_count(raw_bulk_max_count), _account_bulk_max_count(account_bulk_max_count),
+str_account_bulk_sql(1)
 {
 
 }
 
 ledger_table::~ledger_table()
 {
+    stop_partition();
+    if (_memory) {
+        _memory->adjust(memory_governor::component::sql_buffers, _reported_sql_bytes, 0);
+        _memory->adjust(memory_governor::component::abi_cache, _reported_abi_bytes, 0);
+    }
+}
+
+void ledger_table::set_router(std::shared_ptr<shard_router> router) {
+    m_router = router;
+    str_account_bulk_sql.assign(router->size(), std::string());
+}
+
+void ledger_table::set_resume_blocks(std::vector<uint32_t> blocks) {
+    _resume_blocks = std::move(blocks);
+}
+
+void ledger_table::set_abi_resolver(abi_resolver resolver) {
+    _abi_resolver = std::move(resolver);
+}
+
+void ledger_table::set_abi_sequence_resolver(abi_sequence_resolver resolver) {
+    _abi_sequence_resolver = std::move(resolver);
+}
+
+void ledger_table::add_sink(std::shared_ptr<ledger_event_sink> sink) {
+    _sinks.push_back(sink);
+}
+
+void ledger_table::set_memory_governor(std::shared_ptr<memory_governor> memory) {
+    _memory = memory;
+}
+
+void ledger_table::request_trim() {
+    _trim_requested = true;
+}
+
+void ledger_table::trim() {
+    post_raw_query();
+    post_acc_query();
+    std::string().swap(str_raw_bulk_sql);
+    for (auto& sql : str_account_bulk_sql) std::string().swap(sql);
+    _layouts.clear();
+    _abi_bytes = 0;
+}
+
+void ledger_table::report_memory() {
+    if (_trim_requested.exchange(false)) trim();
+    if (!_memory) return;
+
+    uint64_t sql_bytes = str_raw_bulk_sql.capacity();
+    for (const auto& sql : str_account_bulk_sql) sql_bytes += sql.capacity();
+    sql_bytes += _tokens_retry_bytes;
+    _memory->adjust(memory_governor::component::sql_buffers, _reported_sql_bytes, sql_bytes);
+    _memory->adjust(memory_governor::component::abi_cache, _reported_abi_bytes, _abi_bytes);
+}
+
+// sink 의 실패가 ledger row 를 막지 않도록 여기서 끊는다.
+void ledger_table::publish(const ledger_event& e) {
+    for (const auto& sink : _sinks) {
+        try {
+            sink->on_ledger_event(e);
+        } catch (const std::exception& ex) {
+            wlog("ledger event sink failed: ${e}", ("e", ex.what()));
+        }
+    }
+}
+
+// ABI 를 매번 풀지 않도록 (contract, action) 마다 layout 을 abi_sequence 와 함께 기억한다. 
+// 고정 offset 으로 읽을 수 있으면 바로 읽고, 아니면 기억해 둔 abi_serializer 로 variant 변환. 
+bool ledger_table::extract(const chain::action& action, const extraction_rule& rule, extracted_fields& out)
+{
+    const uint64_t abi_sequence = _abi_sequence_resolver ? _abi_sequence_resolver(action.account) : 0;
+    auto& cached = _layouts[layout_key{action.account.value, action.name.value}];
+    if (!cached.resolved || cached.abi_sequence != abi_sequence) {
+        _abi_bytes -= cached.bytes;
+        cached = cached_layout();
+        cached.resolved = true;
+        cached.abi_sequence = abi_sequence;
+
+        EOS_ASSERT( _abi_resolver, chain::missing_chain_plugin_exception, ""  );
+        auto abi_chain = [&] { span_tracer::scope span("abi_lookup"); return _abi_resolver(action.account); }();
+        if (!abi_chain || abi_chain->version.empty()) return false;
+
+        cached.layout = extraction_rules::layout_for(*abi_chain, action.name, rule);
+        if (!cached.layout.fixed) {
+            static const fc::microseconds abi_serializer_max_time(1000000); // 1 second
+            span_tracer::scope span("set_abi");
+            cached.serializer = std::make_shared<chain::abi_serializer>(*abi_chain, abi_serializer_max_time);
+            // serializer 는 type 마다 map 을 여러 개 가지므로 packed ABI 의 몇 배. 정확할 필요는 없다.
+            cached.bytes = fc::raw::pack_size(*abi_chain) * 8;
+        }
+        cached.bytes += sizeof(cached_layout) + sizeof(layout_key);
+        _abi_bytes += cached.bytes;
+    }
 
+    const auto& layout = cached.layout;
+    if (layout.fixed && action.data.size() >= layout.min_size) {
+        const char* data = action.data.data();
+        auto read_u64 = [data](const int32_t offset) {
+            uint64_t v;
+            std::memcpy(&v, data + offset, sizeof(v));
+            return v;
+        };
+        if (layout.from >= 0) out.from = chain::name(read_u64(layout.from));
+        if (layout.to >= 0) out.to = chain::name(read_u64(layout.to));
+        if (layout.quantity >= 0) {
+            out.quantity = chain::asset(static_cast<int64_t>(read_u64(layout.quantity)), chain::symbol(read_u64(layout.quantity + 8)));
+            out.has_quantity = true;
+        }
+        return true;
+    }
+    if (!cached.serializer) return false;
+
+    _decode_fallbacks++;
+    static const fc::microseconds abi_serializer_max_time(1000000); // 1 second
+    auto abi_data = [&] {
+        span_tracer::scope span("binary_to_variant");
+        return cached.serializer->binary_to_variant(cached.serializer->get_action_type(action.name), action.data, abi_serializer_max_time);
+    }();
+    if (!rule.from_field.empty()) out.from = abi_data[rule.from_field].as<chain::name>();
+    if (!rule.to_field.empty()) out.to = abi_data[rule.to_field].as<chain::name>();
+    if (!rule.quantity_field.empty()) {
+        out.quantity = abi_data[rule.quantity_field].as<chain::asset>();
+        out.has_quantity = true;
+    }
+    return true;
 }
 
-void ledger_table::add_ledger(uint64_t action_id, chain::transaction_id_type transaction_id, uint64_t block_number, chain::block_timestamp_type block_time, std::string receiver, chain::action action) 
+void ledger_table::add_ledger(uint64_t action_id, uint32_t action_index, const chain::transaction_id_type& transaction_id, uint64_t block_number, chain::block_timestamp_type block_time, const chain::account_name& receiver, const chain::action& action, const extraction_rule& rule) 
 {
-    chain::abi_def abi;
-    std::string abi_def_account;
-    chain::abi_serializer abis;
-    
-    const auto transaction_id_str = transaction_id.str();
     const auto block_num = block_number;
     const auto block_timestamp = std::chrono::seconds{block_time.operator fc::time_point().sec_since_epoch()}.count();
-    string action_account_name = action.account.to_string();
+    const uint64_t contract = action.account.value;
+    _actions++;
 
-    string from_name;
-    string to_name;
-    int64_t asset_qty;
-    int64_t precision;
+    uint64_t from = 0;
+    uint64_t to = 0;
+    int64_t asset_qty = 0;
+    int64_t precision = 0;
     string symbol;
 
     try {
         try {  
-            if (action.name == N(transfer)) {
-                // get abi definition from chain
-                chain_plugin* chain_plug = app().find_plugin<chain_plugin>();
-                EOS_ASSERT( chain_plug, chain::missing_chain_plugin_exception, ""  );
-                auto& db = chain_plug->chain();
-                chain::abi_def abi_chain = db.db().find<chain::account_object, chain::by_name>(action.account)->get_abi();    
-
-                if(!abi_chain.version.empty()){
-                    abi = abi_chain;
-                    string abi_json = fc::json::to_string(abi);
-
-                    static const fc::microseconds abi_serializer_max_time(1000000); // 1 second
-                    abis.set_abi(abi, abi_serializer_max_time);
-                    auto abi_data = abis.binary_to_variant(abis.get_action_type(action.name), action.data, abi_serializer_max_time);
-
-                    from_name = abi_data["from"].as<chain::name>().to_string();
-                    to_name = abi_data["to"].as<chain::name>().to_string();
-                    
-                    if(from_name != receiver) return;
-
-                    auto asset_quantity = abi_data["quantity"].as<chain::asset>();
-                    asset_qty = asset_quantity.get_amount();
-                    precision = asset_quantity.precision();
-
-                    // ilog("amount : ${a}, precision : ${p}",("a",asset_qty)("p",precision));
-
-                    // asset_qty = asset_quantity.to_real();
-
-                    symbol = asset_quantity.get_symbol().name();
-
-                    std::ostringstream raw_bulk_sql_add;
-                    std::ostringstream raw_bulk_sql_sub;
-
-                    raw_bulk_sql_add << boost::format("INSERT INTO tokens (`account`, `amount`, `symbol`, `precision`, `contract_owner`) VALUES ('%1%', %2%, '%3%', '%4%', '%5%') ON DUPLICATE KEY UPDATE amount = amount + %2% ;")
-                    % to_name
-                    % asset_qty
-                    % symbol
-                    % precision
-                    % action_account_name;
-
-                    raw_bulk_sql_sub << boost::format("INSERT INTO tokens (`account`, `amount`, `symbol`, `precision`, `contract_owner`) VALUES ('%1%', %2% * (-1), '%3%', '%4%', '%5%') ON DUPLICATE KEY UPDATE amount = amount - %2% ;")
-                    % from_name
-                    % asset_qty
-                    % symbol
-                    % precision
-                    % action_account_name;
-
-                    shared_ptr<MysqlConnection> con = m_pool->get_connection();
-                    assert(con);
-                    try{
-                            con->execute(raw_bulk_sql_add.str(), true);
-                            con->execute(raw_bulk_sql_sub.str(), true);
-
-                            m_pool->release_connection(*con);
-                    } catch (...) {
-                        // ilog("ERROR WHEN insert add token ${s} ",("s",raw_bulk_sql_add.str()));
-                        // ilog("ERROR WHEN insert sub token ${s} ",("s",raw_bulk_sql_add.str()));
-                        m_pool->release_connection(*con);
-                    }                    
-                } else if (action.account == chain::config::system_account_name) {
-                    abi = chain::eosio_contract_abi(abi); 
-                } else {
-                    return;         // no ABI no party. Should we still store it?
+            extracted_fields fields;
+            if (!extract(action, rule, fields)) return;    // no ABI no party. Should we still store it?
+
+            if (rule.kind == extraction_kind::transfer) {
+                if(fields.from != receiver) return;
+
+                from = fields.from.value;
+                to = fields.to.value;
+
+                const auto& asset_quantity = fields.quantity;
+                asset_qty = asset_quantity.get_amount();
+                precision = asset_quantity.precision();
+
+                symbol = asset_quantity.get_symbol().name();
+
+                // 받는 쪽 +, 보내는 쪽 - 를 한 statement 로. 같은 계정이면 두 row 가 차례로 적용되어 0.
+                // 두 계정이 다른 shard 면 shard 마다 하나씩. 이미 커밋된 shard 쪽은 보내지 않는다.
+                const uint32_t to_shard = m_router->account_shard(to);
+                const uint32_t from_shard = m_router->account_shard(from);
+                arena_string rows{arena_allocator<char>(_arena)};
+                rows.reserve(128);
+                tokens_result to_result = tokens_result::replayed;
+                tokens_result from_result = tokens_result::replayed;
+                schema::tokens.append_row(rows, to, contract, symbol, asset_qty, precision);
+                if (to_shard != from_shard) {
+                    if (!tokens_done(to_shard, block_num))
+                        to_result = execute_tokens(tokens_sql(rows, transaction_id, action_index, block_num), block_num, to_shard);
+                    rows.clear();
                 }
-            
-            } else if (action.name == N(create)) {
-                // get abi definition from chain
-                chain_plugin* chain_plug = app().find_plugin<chain_plugin>();
-                EOS_ASSERT( chain_plug, chain::missing_chain_plugin_exception, ""  );
-                auto& db = chain_plug->chain();
-                chain::abi_def abi_chain = db.db().find<chain::account_object, chain::by_name>(action.account)->get_abi();    
-
-                if(!abi_chain.version.empty()){
-                    abi = abi_chain;
-                    string abi_json = fc::json::to_string(abi);
-
-                    static const fc::microseconds abi_serializer_max_time(1000000); // 1 second
-                    abis.set_abi(abi, abi_serializer_max_time);
-                    auto abi_data = abis.binary_to_variant(abis.get_action_type(action.name), action.data, abi_serializer_max_time);
-
-                    auto issuer = abi_data["issuer"].as<chain::name>().to_string();
-                    auto max_supply = abi_data["maximum_supply"].as<chain::asset>();
-
-                    auto asset_qty = max_supply.get_amount();
-                    auto precision = max_supply.precision();
-
-                    // ilog("amount : ${a}, precision : ${p}",("a",asset_qty)("p",precision));
-
-                    // asset_qty = asset_quantity.to_real();
-
-                    auto symbol = max_supply.get_symbol().name();
-
-                    std::ostringstream tokenlist_add;
-                    std::ostringstream raw_bulk_sql_add;
-
-                    tokenlist_add << boost::format("INSERT IGNORE INTO tokenlist (`contract_owner`, `issuer`, `symbol`, `precision`, `maximum_supply`) VALUES ('%1%', '%2%', '%3%', '%4%', '%5%');")
-                    % action_account_name
-                    % issuer
-                    % symbol
-                    % precision
-                    % asset_qty;
-
-                    raw_bulk_sql_add << boost::format("INSERT INTO tokens (`account`, `amount`, `symbol`, `precision`, `contract_owner`) VALUES ('%1%', %2%, '%3%', '%4%', '%5%') ON DUPLICATE KEY UPDATE amount = amount + %2% ;")
-                    % issuer
-                    % asset_qty
-                    % symbol
-                    % precision
-                    % action_account_name;
-
-                    shared_ptr<MysqlConnection> con = m_pool->get_connection();
-                    assert(con);
-                    try{
-                            con->execute(tokenlist_add.str(), true);
-                            con->execute(raw_bulk_sql_add.str(), true);
-
-                            m_pool->release_connection(*con);
-                    } catch (...) {
-                        m_pool->release_connection(*con);
-                    }                    
+                schema::tokens.append_row(rows, from, contract, symbol, -asset_qty, precision);
+                if (!tokens_done(from_shard, block_num))
+                    from_result = execute_tokens(tokens_sql(rows, transaction_id, action_index, block_num), block_num, from_shard);
+                if (to_shard == from_shard) to_result = from_result;
+
+                // 한쪽만 반영된 transfer. 실패한 쪽은 retry 에 남아 있고 그 shard 의 checkpoint 도 그 아래에 묶인다.
+                if ((to_result == tokens_result::failed) != (from_result == tokens_result::failed)) {
+                    _tokens_half_applied++;
+                    wlog("transfer ${t}:${i} applied on shard ${a} only; shard ${f} is retried", 
+                        ("t", transaction_id)("i", action_index)
+                        ("a", to_result == tokens_result::failed ? from_shard : to_shard)
+                        ("f", to_result == tokens_result::failed ? to_shard : from_shard));
                 }
+
+                uint8_t replayed = 0;
+                if (to_result == tokens_result::replayed) replayed |= ledger_event::replayed_to;
+                if (from_result == tokens_result::replayed) replayed |= ledger_event::replayed_from;
+
+                ledger_event e;
+                e.action_id  = action_id;
+                e.block_num  = block_num;
+                e.block_time = block_timestamp;
+                e.contract   = contract;
+                e.action     = action.name.value;
+                e.from       = from;
+                e.to         = to;
+                e.receiver   = receiver.value;
+                e.amount     = asset_qty;
+                e.symbol     = asset_quantity.get_symbol().value();
+                std::memcpy(e.transaction_id, transaction_id.data(), sizeof(e.transaction_id));
+                e.replayed   = replayed;
+                publish(e);
+            } else if (rule.kind == extraction_kind::create) {
+                const auto issuer = fields.to.value;
+                const auto& max_supply = fields.quantity;
+
+                auto asset_qty = max_supply.get_amount();
+                auto precision = max_supply.precision();
+
+                // ilog("amount : ${a}, precision : ${p}",("a",asset_qty)("p",precision));
+
+                auto symbol = max_supply.get_symbol().name();
+
+                const arena_allocator<char> alloc(_arena);
+                arena_string tokenlist_rows(alloc);
+                schema::tokenlist.append_row(tokenlist_rows, contract, symbol, issuer, precision, asset_qty);
+                arena_string tokenlist_sql(TOKENLIST_INSERT_STR.data(), TOKENLIST_INSERT_STR.size(), alloc);
+                tokenlist_sql += tokenlist_rows;
+
+                arena_string token_rows(alloc);
+                schema::tokens.append_row(token_rows, issuer, contract, symbol, asset_qty, precision);
+
+                if (!tokens_done(0, block_num))
+                    execute_tokens(tokenlist_sql, block_num, 0);
+                const uint32_t issuer_shard = m_router->account_shard(issuer);
+                const auto result = tokens_done(issuer_shard, block_num) ? tokens_result::replayed :
+                    execute_tokens(tokens_sql(token_rows, transaction_id, action_index, block_num), block_num, issuer_shard);
+
+                ledger_event e;
+                e.action_id  = action_id;
+                e.block_num  = block_num;
+                e.block_time = block_timestamp;
+                e.contract   = contract;
+                e.action     = action.name.value;
+                e.to         = issuer;
+                e.receiver   = receiver.value;
+                e.amount     = asset_qty;
+                e.symbol     = max_supply.get_symbol().value();
+                std::memcpy(e.transaction_id, transaction_id.data(), sizeof(e.transaction_id));
+                if (result == tokens_result::replayed) e.replayed = ledger_event::replayed_to;
+                publish(e);
                 return;
             } else {
-                return;
+                // notification 으로 여러 번 오므로 contract 자신이 실행한 trace 만.
+                if (receiver != action.account) return;
+
+                from = fields.from.value;
+                to = fields.to.value;
+                if (fields.has_quantity) {
+                    asset_qty = fields.quantity.get_amount();
+                    precision = fields.quantity.precision();
+                    symbol = fields.quantity.get_symbol().name();
+                }
             }
-                
         } catch( std::exception& e ) {
             // ilog( "Unable to convert action.data to ABI: ${s}::${n}, std what: ${e}",
             //       ("s", action.account)( "n", action.name )( "e", e.what()));
@@ -201,54 +320,44 @@ void ledger_table::add_ledger(uint64_t action_id, chain::transaction_id_type tra
             return;
         }
 
-        // ledger 테이블 인서트. 
-        {
-            // if (raw_bulk_count > 0) {
-            //     raw_bulk_sql << ", ";
-            // }
-
-            raw_bulk_sql.str(""); raw_bulk_sql.clear(); 
-            raw_bulk_sql << boost::format("('%1%', '%2%', '%3%', FROM_UNIXTIME('%4%'), '%5%', '%6%', '%7%', '%8%', '%9%', '%10%', '%11%', '%12%', CURRENT_TIMESTAMP),")
-                % action_id
-                % transaction_id_str
-                % block_num
-                % block_timestamp
-                % action_account_name
-                % from_name
-                % to_name
-                % asset_qty
-                % precision
-                % symbol
-                % receiver
-                % action.name.to_string();
-
-            str_raw_bulk_sql += raw_bulk_sql.str();
+        // ledger 테이블 인서트. block 구간이 다른 shard 로 넘어가면 쌓인 것을 먼저 보낸다.
+        const uint32_t ledger_shard = m_router->block_shard(block_num);
+        if (!committed_on(ledger_shard, block_num)) {
+            span_tracer::scope span("sql_format");
+            if (raw_bulk_count && ledger_shard != raw_bulk_shard)
+                post_raw_query();
+            raw_bulk_shard = ledger_shard;
+            schema::ledger.append_row(str_raw_bulk_sql, action_id, transaction_id.data(), block_num, block_timestamp,
+                contract, from, to, asset_qty, precision, symbol, receiver.value, action.name.value);
 
             raw_bulk_count++;
 
             if (!raw_bulk_insert_tick)
                 raw_bulk_insert_tick = get_now_tick();
-            if (raw_bulk_count >= _raw_bulk_max_count)
+            if (!raw_bulk_first_block)
+                raw_bulk_first_block = block_num;
+            if (raw_bulk_count >= _raw_bulk_max_count * _batch_scale)
                 post_raw_query();
         }
 
+        if (_skip_accounts) {
+            _skipped_accounts += action.authorization.size();
+            return;
+        }
+
         // action_account 테이블 인서트
         for (const auto& auth : action.authorization) {
-            // if (account_bulk_count > 0) {
-            //     account_bulk_sql << ", ";
-            // }
-            account_bulk_sql.str(""); account_bulk_sql.clear(); 
-            account_bulk_sql << boost::format("('%1%','%2%','%3%'),") 
-                % action_id 
-                % auth.actor.to_string()
-                % auth.permission.to_string();
-
-            str_account_bulk_sql += account_bulk_sql.str();
+            const uint32_t shard = m_router->account_shard(auth.actor.value);
+            if (committed_on(shard, block_num)) continue;
+            schema::actions_accounts.append_row(str_account_bulk_sql[shard], 
+                action_id, auth.actor.value, auth.permission.value);
 
             account_bulk_count++;
             if (!account_bulk_insert_tick)
                 account_bulk_insert_tick = get_now_tick(); 
-            if (account_bulk_count >= _account_bulk_max_count) 
+            if (!account_bulk_first_block)
+                account_bulk_first_block = block_num;
+            if (account_bulk_count >= _account_bulk_max_count * _batch_scale) 
                 post_acc_query();
 
         }
@@ -259,13 +368,115 @@ void ledger_table::add_ledger(uint64_t action_id, chain::transaction_id_type tra
 
 }
 
+arena_string ledger_table::tokens_sql(const arena_string& rows, const chain::transaction_id_type& transaction_id, 
+        const uint32_t action_index, const uint32_t block_num) {
+    const arena_allocator<char> alloc(_arena);
+    arena_string guard(alloc);
+    schema::tokens_applied.append_row(guard, transaction_id.data(), action_index, block_num);
+
+    arena_string sql(alloc);
+    sql.reserve(TOKENS_APPLIED_INSERT_STR.size() + guard.size() + 1 + TOKENS_ADD_STR.size() + rows.size() + TOKENS_ADD_UPDATE_STR.size());
+    sql.append(TOKENS_APPLIED_INSERT_STR.data(), TOKENS_APPLIED_INSERT_STR.size());
+    sql += guard;
+    sql += ';';
+    sql.append(TOKENS_ADD_STR.data(), TOKENS_ADD_STR.size());
+    sql += rows;
+    sql.append(TOKENS_ADD_UPDATE_STR.data(), TOKENS_ADD_UPDATE_STR.size());
+    return sql;
+}
+
+// tokens 는 가산이라 순서와 상관없다. defer 면 queue 로 넘겨 다른 statement 와 같이 (종료 중 spill 포함) 처리.
+// defer 는 spill 과 함께 켜지므로 pipeline 으로 가지 않는다. (두 statement 가 한 트랜잭션이어야 한다)
+ledger_table::tokens_result ledger_table::execute_tokens(const arena_string& sql, const uint32_t block_num, const uint32_t shard) {
+    if (_defer_tokens) {
+        post_query_str_to_queue(std::string(sql.data(), sql.size()), block_num, shard);
+        return tokens_result::applied;
+    }
+
+    const auto result = run_tokens(sql.data(), sql.size(), shard);
+    if (result == tokens_result::failed) {
+        // 버리지 않고 남겨 두었다가 tick 에서 다시. 그때까지 이 shard 의 checkpoint 는 이 block 아래에 머문다.
+        _tokens_failed++;
+        m_router->statement_queued(shard, block_num);
+        _tokens_retry.push_back(pending_tokens{std::string(sql.data(), sql.size()), block_num, shard});
+        _tokens_retry_bytes += sql.size();
+    }
+    return result;
+}
+
+ledger_table::tokens_result ledger_table::run_tokens(const char* sql, const size_t len, const uint32_t shard) {
+    const auto& pool = m_router->pool(shard);
+    shared_ptr<MysqlConnection> con = pool->get_connection();
+    assert(con);
+    tokens_result result = tokens_result::failed;
+    try{
+            span_tracer::scope span("mysql_roundtrip");
+            if (con->executeText(sql, len, true)) 
+                result = tokens_result::applied;
+            else if (con->lastErrno() == ER_DUP_ENTRY)      // tokens_applied 에 이미 있다
+                result = tokens_result::replayed;
+
+            pool->release_connection(*con);
+    } catch (...) {
+        pool->release_connection(*con);
+    }
+    return result;
+}
+
+void ledger_table::retry_tokens() {
+    while (!_tokens_retry.empty()) {
+        auto& p = _tokens_retry.front();
+        if (_defer_tokens) {
+            post_query_str_to_queue(p.sql, p.block_num, p.shard);
+        } else if (run_tokens(p.sql.data(), p.sql.size(), p.shard) == tokens_result::failed) {
+            break;
+        }
+        m_router->statement_committed(p.shard, p.block_num);
+        _tokens_retry_bytes -= p.sql.size();
+        _tokens_retry.pop_front();
+    }
+}
+
+void ledger_table::set_defer_tokens(const bool defer) {
+    _defer_tokens = defer;
+}
+
+void ledger_table::end_batch() {
+    _arena.reset();
+    report_memory();
+
+    const auto& st = _arena.get_stats();
+    _published_actions = _actions;
+    _published_capacity = st.capacity;
+    _published_peak = st.peak;
+    _published_arena_growths = st.growths;
+    _published_decode_fallbacks = _decode_fallbacks;
+}
+
+ledger_table::arena_usage ledger_table::get_arena_usage() const {
+    arena_usage u;
+    u.actions = _published_actions;
+    u.capacity = _published_capacity;
+    u.peak = _published_peak;
+    u.arena_growths = _published_arena_growths;
+    u.decode_fallbacks = _published_decode_fallbacks;
+    return u;
+}
+
+// 여기서도 반영하지 못한 tokens 는 checkpoint 를 잡아 둔 채로 남기므로 다음 시작이 그 block 부터 다시 반영한다.
 void ledger_table::finalize() {
     post_raw_query();
     post_acc_query();
+    retry_tokens();
+    if (!_tokens_retry.empty())
+        elog("${n} tokens statements not applied; shard checkpoints stay below block ${b}", 
+            ("n", _tokens_retry.size())("b", _tokens_retry.front().block_num));
 }
 
 void ledger_table::tick(const int64_t tick) {
-    if (raw_bulk_insert_tick && ((tick - raw_bulk_insert_tick) > 5000 )) {
+    const int64_t interval = 5000 * static_cast<int64_t>(_batch_scale);
+
+    if (raw_bulk_insert_tick && ((tick - raw_bulk_insert_tick) > interval )) {
         /*
         std::cout << "action table tick ans save " 
             << tick << ", " 
@@ -275,7 +486,7 @@ void ledger_table::tick(const int64_t tick) {
         post_raw_query(); 
     }
 
-    if (account_bulk_insert_tick && ((tick - account_bulk_insert_tick) > 5000 )) {
+    if (account_bulk_insert_tick && ((tick - account_bulk_insert_tick) > interval )) {
         /*
         std::cout << "action acc table tick ans save " 
             << tick << ", " 
@@ -285,38 +496,357 @@ void ledger_table::tick(const int64_t tick) {
         post_acc_query(); 
     }
 
+    if (!_tokens_retry.empty() && tick - _tokens_retry_tick > 1000) {
+        _tokens_retry_tick = tick;
+        retry_tokens();
+    }
+
+    report_memory();
 }
 
 void ledger_table::post_raw_query() {
     if (raw_bulk_count) {
-        str_raw_bulk_sql.pop_back();
-
         post_query_str_to_queue(
             LEDGER_INSERT_STR +
-            str_raw_bulk_sql
+            str_raw_bulk_sql,
+            raw_bulk_first_block,
+            raw_bulk_shard
         ); 
         
         str_raw_bulk_sql = "";
         raw_bulk_count = 0;
         raw_bulk_insert_tick = 0; 
+        raw_bulk_first_block = 0;
     }
 
 }
 
 void ledger_table::post_acc_query() {
     if (account_bulk_count) {
-        str_account_bulk_sql.pop_back();
-
-        post_query_str_to_queue(
-            ACTIONS_ACCOUNT_INSERT_STR +
-            str_account_bulk_sql
-        ); 
-        
-        str_account_bulk_sql = "";
+        for (uint32_t shard = 0; shard < str_account_bulk_sql.size(); shard++) {
+            auto& sql = str_account_bulk_sql[shard];
+            if (sql.empty()) continue;
+            post_query_str_to_queue(
+                ACTIONS_ACCOUNT_INSERT_STR +
+                sql,
+                account_bulk_first_block,
+                shard
+            ); 
+            sql = "";
+        }
 
         account_bulk_count = 0; 
         account_bulk_insert_tick = 0;
+        account_bulk_first_block = 0;
+    }
+}
+
+void ledger_table::set_batch_scale(const uint32_t scale) {
+    _batch_scale = scale ? scale : 1;
+}
+
+void ledger_table::set_skip_accounts(const bool skip) {
+    _skip_accounts = skip;
+}
+
+uint32_t ledger_table::buffered_block() const {
+    const uint32_t raw = raw_bulk_first_block;
+    const uint32_t acc = account_bulk_first_block;
+    if (!raw) return acc;
+    if (!acc) return raw;
+    return std::min(raw, acc);
+}
+
+void ledger_table::create(const uint32_t partition_blocks) {
+    _partition_blocks = partition_blocks;
+
+    std::string partition;
+    if (_partition_blocks) {
+        // 빈 pmax 를 항상 남겨두고 ensure_partition 에서 앞서 분할한다. 
+        const auto high = std::to_string(_partition_blocks);
+        partition = " PARTITION BY RANGE (`block_number`) ("
+            "PARTITION p" + high + " VALUES LESS THAN (" + high + "), "
+            "PARTITION pmax VALUES LESS THAN MAXVALUE)";
+    }
+
+    execute_ddl(schema::ledger.create_sql(partition));
+    execute_ddl(schema::actions_accounts.create_sql());
+    execute_ddl(schema::tokens.create_sql());
+    execute_ddl(schema::tokens_applied.create_sql());
+    execute_ddl(schema::tokenlist.create_sql());
+    execute_ddl(schema::ledger_state.create_sql());
+    execute_ddl(schema::token_aggregates.create_sql());
+
+    if (_partition_blocks) 
+        load_partition_highs();
+}
+
+void ledger_table::drop() {
+    execute_ddl(schema::ledger.drop_sql());
+    execute_ddl(schema::actions_accounts.drop_sql());
+    execute_ddl(schema::tokens.drop_sql());
+    execute_ddl(schema::tokens_applied.drop_sql());
+    execute_ddl(schema::tokenlist.drop_sql());
+    execute_ddl(schema::ledger_state.drop_sql());
+    execute_ddl(schema::token_aggregates.drop_sql());
+
+    std::lock_guard<std::mutex> lock(_partition_mtx);
+    _partitions.clear();
+}
+
+void ledger_table::truncate_from(const uint32_t block_num) {
+    // actions_accounts 는 account 로 나뉘므로 ledger 가 있는 shard 와 다를 수 있다. 전체에서 가장 낮은 것부터.
+    uint64_t first_action_id = 0;
+    for (uint32_t shard = 0; shard < m_router->size(); shard++) {
+        const auto id = query_uint(
+            "SELECT IFNULL(MIN(action_id), 0) FROM ledger WHERE block_number >= " + std::to_string(block_num), shard );
+        if (id && (!first_action_id || id < first_action_id)) first_action_id = id;
+    }
+
+    // 설정값 (_partition_blocks) 이 테이블을 만들 때와 다를 수 있으므로 shard 마다 실제 partition 을 읽는다.
+    const std::string where = " WHERE block_number >= " + std::to_string(block_num);
+    for (uint32_t shard = 0; shard < m_router->size(); shard++) {
+        const auto partitions = get_partitions(shard);
+        if (partitions.empty()) {
+            execute_on(shard, "DELETE FROM ledger" + where);
+            continue;
+        }
+
+        // block_num 이상으로만 이루어진 partition 은 TRUNCATE (O(1)), 
+        // block_num 을 포함하는 partition 하나만 범위 DELETE. 
+        std::string full_partitions;
+        uint32_t lower = 0;
+        for (const auto& p : partitions) {
+            if (lower >= block_num) {
+                if (!full_partitions.empty()) full_partitions += ",";
+                full_partitions += p.name;
+            } else if (!p.upper || p.upper > block_num) {
+                execute_on(shard, "DELETE FROM ledger PARTITION (" + p.name + ")" + where);
+            }
+            lower = p.upper;
+            if (!lower) break;
+        }
+        if (!full_partitions.empty())
+            execute_on(shard, "ALTER TABLE ledger TRUNCATE PARTITION " + full_partitions);
     }
+
+    if (first_action_id) {
+        execute_ddl( "DELETE FROM actions_accounts WHERE action_id >= " + std::to_string(first_action_id) );
+    }
+    // tokens 는 누적 잔액이라 블록 단위로 되돌릴 수 없다. token_aggregates 도 마찬가지.
+    // tokens_applied 는 남겨두므로 아직 지워지지 않은 (checkpoint 근처) 구간은 다시 더해지지 않는다.
+    wlog("ledger truncated from block ${b}; tokens balances and token_aggregates are not rolled back", ("b", block_num));
 }
 
-}
\ No newline at end of file
+void ledger_table::ensure_partition(const uint32_t block_num, const int64_t tick) {
+    if (!_partition_blocks) return;
+    std::lock_guard<std::mutex> lock(_partition_mtx);
+
+    // 마지막 bounded partition 에 들어서면 다음 partition 을 미리 만든다. pmax 는 비어있으므로 분할은 메타데이터 작업. 
+    for (uint32_t shard = 0; shard < _partitions.size(); shard++) {
+        auto& p = _partitions[shard];
+        if (!p.high) continue;
+        if (tick < p.retry_tick) continue;
+
+        while (block_num + _partition_blocks >= p.high) {
+            const uint32_t next_high = p.high + _partition_blocks;
+            const auto high = std::to_string(next_high);
+            const bool ok = execute_on(shard,
+                "ALTER TABLE ledger REORGANIZE PARTITION pmax INTO ("
+                "PARTITION p" + high + " VALUES LESS THAN (" + high + "), "
+                "PARTITION pmax VALUES LESS THAN MAXVALUE)" );
+            if (!ok) {
+                // 연결이 끊긴 경우 등 실제로는 반영됐을 수 있으므로 다시 읽어둔다. 같은 이름으로 다시 보내지 않도록.
+                for (const auto& info : get_partitions(shard)) 
+                    p.high = std::max(p.high, info.upper);
+
+                // 1 초부터 두 배씩, 최대 5 분. 그동안 이 shard 의 row 는 pmax 로 들어간다.
+                p.backoff_ms = std::min<int64_t>(std::max<int64_t>(p.backoff_ms * 2, 1000), 300000);
+                p.retry_tick = tick + p.backoff_ms;
+                wlog("ledger partition p${p} failed on shard ${n}, retry in ${ms} ms", ("p", next_high)("n", shard)("ms", p.backoff_ms));
+                break;
+            }
+            p.high = next_high;
+            p.backoff_ms = 0;
+            ilog("ledger partition p${p} added on shard ${n}", ("p", next_high)("n", shard));
+        }
+    }
+}
+
+void ledger_table::request_partition(const uint32_t block_num) {
+    if (!_partition_blocks) return;
+    std::lock_guard<std::mutex> lock(_partition_thread_mtx);
+    if (_partition_stop) return;
+    _partition_request = std::max(_partition_request, block_num);
+    if (!_partition_thread.joinable())
+        _partition_thread = std::thread([this]() { run_partition(); });
+    _partition_cond.notify_one();
+}
+
+void ledger_table::run_partition() {
+    uint32_t done = 0;
+    int64_t retry_tick = 0;
+    std::unique_lock<std::mutex> lock(_partition_thread_mtx);
+    while (!_partition_stop) {
+        // 새 block 이 없어도 실패한 shard 는 다시 시도해야 하므로 1 초마다 깬다.
+        _partition_cond.wait_for(lock, std::chrono::seconds(1));
+        if (_partition_stop) break;
+        const uint32_t block_num = _partition_request;
+        const int64_t tick = get_now_tick();
+        if (block_num == done && tick < retry_tick) continue;
+
+        lock.unlock();
+        ensure_partition(block_num, tick);
+        lock.lock();
+
+        done = block_num;
+        retry_tick = tick + 1000;
+    }
+}
+
+void ledger_table::stop_partition() {
+    {
+        std::lock_guard<std::mutex> lock(_partition_thread_mtx);
+        _partition_stop = true;
+    }
+    _partition_cond.notify_all();
+    // 기다리는 중인 ALTER 가 있으면 그것이 끝날 때까지.
+    if (_partition_thread.joinable()) _partition_thread.join();
+}
+
+void ledger_table::load_partition_highs() {
+    // truncate_from 처럼 shard 마다 실제 partition 을 읽는다. 이전 실행에서 일부 shard 만 분할됐을 수 있다.
+    std::vector<shard_partition> partitions(m_router->size());
+    bool any = false;
+    for (uint32_t shard = 0; shard < partitions.size(); shard++) {
+        for (const auto& info : get_partitions(shard)) 
+            partitions[shard].high = std::max(partitions[shard].high, info.upper);
+
+        // 기존에 partition 없이 만들어진 테이블.
+        if (!partitions[shard].high) 
+            wlog("ledger table on shard ${n} is not partitioned, partition maintenance disabled there", ("n", shard));
+        else
+            any = true;
+    }
+
+    std::lock_guard<std::mutex> lock(_partition_mtx);
+    _partitions = std::move(partitions);
+    if (!any) _partition_blocks = 0;
+}
+
+std::vector<ledger_table::partition_info> ledger_table::get_partitions(const uint32_t shard) {
+    std::vector<partition_info> ret;
+    const auto& pool = m_router->pool(shard);
+    shared_ptr<MysqlConnection> con = pool->get_connection();
+    assert(con);
+    try {
+        con->scan(
+            "SELECT PARTITION_NAME, PARTITION_DESCRIPTION FROM information_schema.PARTITIONS "
+            "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = 'ledger' AND PARTITION_NAME IS NOT NULL "
+            "ORDER BY PARTITION_ORDINAL_POSITION",
+            [&](const MysqlRowView& row) {
+                partition_info p;
+                p.name = row.get_value(0);
+                p.upper = static_cast<uint32_t>(row.get_uint(1));     // MAXVALUE 는 숫자가 아니라 0
+                ret.push_back(p);
+                return true;
+            }, MysqlData::Mode::Store);
+    } catch (...) {
+        ret.clear();
+    }
+    pool->release_connection(*con);
+    return ret;
+}
+
+uint64_t ledger_table::get_state(const std::string& name, const uint32_t shard) {
+    return query_uint( "SELECT IFNULL(MAX(value), 0) FROM ledger_state WHERE name = '" + name + "'", shard );
+}
+
+bool ledger_table::set_state(const std::string& name, const uint64_t value, const uint32_t shard) {
+    return execute_on( shard, state_sql(name, value) );
+}
+
+std::string ledger_table::state_sql(const std::string& name, const uint64_t value) {
+    std::string row;
+    schema::ledger_state.append_row(row, name, value);
+    return schema::ledger_state.insert_sql() + row + " ON DUPLICATE KEY UPDATE `value` = VALUES(`value`)";
+}
+
+std::string ledger_table::prune_tokens_applied_sql(const uint32_t upto) {
+    return "DELETE FROM tokens_applied WHERE block_number <= LEAST(" + std::to_string(upto) + 
+        ", (SELECT IFNULL(MAX(value), 0) FROM ledger_state WHERE name = 'committed_block'))"
+        " AND block_number >= (SELECT IFNULL(MAX(value), 0) FROM ledger_state WHERE name = 'live_start_block')";
+}
+
+std::vector<std::pair<std::string, uint64_t>> ledger_table::get_states(const std::string& prefix, const uint32_t shard) {
+    std::vector<std::pair<std::string, uint64_t>> ret;
+    const auto& pool = m_router->pool(shard);
+    shared_ptr<MysqlConnection> con = pool->get_connection();
+    assert(con);
+    try {
+        con->scan(
+            "SELECT name, value FROM ledger_state WHERE LEFT(name, " + std::to_string(prefix.size()) + ") = '" + prefix + "' ORDER BY name",
+            [&](const MysqlRowView& row) {
+                ret.emplace_back(row.get_value(0), row.get_uint(1));
+                return true;
+            }, MysqlData::Mode::Store);
+    } catch (...) {
+        ret.clear();
+    }
+    pool->release_connection(*con);
+    return ret;
+}
+
+uint64_t ledger_table::get_max_action_id() {
+    uint64_t ret = 0;
+    for (uint32_t shard = 0; shard < m_router->size(); shard++) {
+        ret = std::max(ret, query_uint("SELECT IFNULL(MAX(action_id), 0) FROM ledger", shard));
+    }
+    return ret;
+}
+
+uint32_t ledger_table::get_max_block_number() {
+    uint64_t ret = 0;
+    for (uint32_t shard = 0; shard < m_router->size(); shard++) {
+        ret = std::max(ret, query_uint("SELECT IFNULL(MAX(block_number), 0) FROM ledger", shard));
+    }
+    return static_cast<uint32_t>(ret);
+}
+
+bool ledger_table::execute_ddl(const std::string& sql) {
+    bool ret = true;
+    for (uint32_t shard = 0; shard < m_router->size(); shard++) {
+        if (!execute_on(shard, sql)) ret = false;
+    }
+    return ret;
+}
+
+bool ledger_table::execute_on(const uint32_t shard, const std::string& sql) {
+    const auto& pool = m_router->pool(shard);
+    shared_ptr<MysqlConnection> con = pool->get_connection();
+    assert(con);
+    bool ret = con->exec(sql, true);
+    if (!ret) 
+        elog("ledger ddl failed on shard ${n}: ${e}, sql = ${s}", ("n", shard)("e", con->lastError())("s", sql));
+    pool->release_connection(*con);
+    return ret;
+}
+
+uint64_t ledger_table::query_uint(const std::string& sql, const uint32_t shard) {
+    uint64_t ret = 0;
+    const auto& pool = m_router->pool(shard);
+    shared_ptr<MysqlConnection> con = pool->get_connection();
+    assert(con);
+    try {
+        con->scan(sql, [&](const MysqlRowView& row) {
+            ret = row.get_uint(0);
+            return false;
+        }, MysqlData::Mode::Store);
+    } catch (...) {
+        ret = 0;
+    }
+    pool->release_connection(*con);
+    return ret;
+}
+
+}
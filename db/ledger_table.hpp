@@ -8,37 +8,241 @@
 #include <eosio/chain/types.hpp>
 #include <eosio/chain/block_timestamp.hpp>
 
+#include <eosio/chain/abi_def.hpp>
+#include <eosio/chain/abi_serializer.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "batch_arena.hpp"
 #include "connection_pool.h"
+#include "extraction_rules.hpp"
+#include "ledger_event.hpp"
+#include "memory_governor.hpp"
+#include "shard_router.hpp"
 
 namespace eosio {
+    // contract 의 ABI 를 찾아주는 함수. nodeos 안에서는 chainbase, 오프라인 도구에서는 파일 등.
+    using abi_resolver = std::function<fc::optional<chain::abi_def>(const chain::account_name&)>;
+    // ABI 가 바뀌면 달라지는 값 (account_sequence_object::abi_sequence). 없으면 ABI 는 바뀌지 않는 것으로 본다.
+    using abi_sequence_resolver = std::function<uint64_t(const chain::account_name&)>;
+
     class ledger_table {
         public:
             ledger_table(std::shared_ptr<connection_pool> pool, uint32_t raw_bulk_max_count, uint32_t account_bulk_max_count);
             ~ledger_table();
 
-            void add_ledger(uint64_t action_id, chain::transaction_id_type transaction_id, uint64_t block_number, chain::block_timestamp_type block_time, std::string receiver, chain::action action);
+            // 여러 DB 에 나눠 쓸 때. 없으면 생성자의 pool 하나. worker 를 시작하기 전에.
+            void set_router(std::shared_ptr<shard_router> router);
+            void set_abi_resolver(abi_resolver resolver);
+            void set_abi_sequence_resolver(abi_sequence_resolver resolver);
+            void add_sink(std::shared_ptr<ledger_event_sink> sink);
+            // SQL 버퍼와 ABI cache 크기를 batch 끝과 tick 마다 알린다.
+            void set_memory_governor(std::shared_ptr<memory_governor> memory);
+            // shard 마다 이미 커밋된 block (ledger_state 의 committed_block). 그 이하로 그 shard 에 가는 row 는 쓰지 않는다.
+            // 재시작 때 가장 낮은 checkpoint 부터 다시 받아도 앞선 shard 에 다시 쓰지 않도록. worker 를 시작하기 전에.
+            void set_resume_blocks(std::vector<uint32_t> blocks);
+
+            // action_index 는 transaction 안에서 action 의 순번 (trace 를 도는 순서). tokens_applied 의 key.
+            void add_ledger(uint64_t action_id, uint32_t action_index, const chain::transaction_id_type& transaction_id, uint64_t block_number, chain::block_timestamp_type block_time, const chain::account_name& receiver, const chain::action& action, const extraction_rule& rule);
 
             void finalize();
 
             void tick(const int64_t tick);
+
+            // trace batch 하나를 끝냈을 때. 임시 메모리를 되돌리고 통계를 갱신한다. (이 table 의 worker 에서)
+            void end_batch();
+
+            struct arena_usage {
+                uint64_t actions = 0;
+                uint64_t capacity = 0;
+                uint64_t peak = 0;
+                uint64_t arena_growths = 0;     // arena chunk 를 힙에서 받은 횟수. action 의 힙 할당 수가 아니다
+                uint64_t decode_fallbacks = 0;  // 고정 layout 이 아니라 variant 로 푼 action (힙 할당 있음)
+            };
+            arena_usage get_arena_usage() const;
+
+            // 부하가 높을 때 덜 중요한 일을 줄인다. 다른 thread 에서 바꿔도 된다.
+            // scale 배 만큼 bulk 를 크게, flush 간격도 길게. skip 이면 actions_accounts 를 쓰지 않는다.
+            void set_batch_scale(const uint32_t scale);
+            void set_skip_accounts(const bool skip);
+            // tokens statement 를 바로 실행하지 않고 query queue 로. (종료 시한이 지나 spill 할 때)
+            void set_defer_tokens(const bool defer);
+            // tokens / tokenlist 를 쓰지 않는다. (이미 bootstrap 으로 채운 구간을 ledger_ingest 로 채울 때)
+            void set_skip_tokens(const bool skip) { _skip_tokens = skip; }
+            // 메모리가 모자랄 때. 다음 batch 끝이나 tick 에 (이 table 의 worker 에서) 버퍼를 queue 로 넘기고
+            // 버퍼 capacity 와 ABI cache 를 놓는다. 다른 thread 에서 불러도 된다.
+            void request_trim();
+            uint64_t skipped_accounts() const { return _skipped_accounts; }
+            // 실행에 실패한 tokens statement (다시 시도해서 반영된 것 포함) 와 
+            // 그 중 다른 shard 의 반대쪽은 반영된 transfer.
+            uint64_t tokens_failed() const { return _tokens_failed; }
+            uint64_t tokens_half_applied() const { return _tokens_half_applied; }
+
+            // 아직 queue 로 넘기지 않은 row 중 가장 낮은 block. 없으면 0.
+            uint32_t buffered_block() const;
+
+            // schema 관리. ledger 는 block_number 로 range partition. 모든 shard 에.
+            void create(const uint32_t partition_blocks);
+            void drop();
+            // 테이블에 실제로 있는 partition 경계 (information_schema) 로 자른다.
+            void truncate_from(const uint32_t block_num);
+            // block_num 뒤로 partition 하나 이상이 남도록 shard 마다 미리 분할한다. 부른 thread 에서 DDL 을 실행한다.
+            // shard 마다 실패하면 간격을 늘려가며 다시 시도한다. (DDL 을 매번 다시 보내지 않도록)
+            void ensure_partition(const uint32_t block_num, const int64_t tick);
+            // ensure_partition 을 별도 thread 에서. ALTER 는 metadata lock 을 기다릴 수 있으므로 tick 에서는 이것을.
+            // 처음 부를 때 thread 를 시작한다.
+            void request_partition(const uint32_t block_num);
+
+            // ledger_state key/value. 재시작 지점 등 plugin 상태 기록용. 기본은 primary (shard 0).
+            uint64_t get_state(const std::string& name, const uint32_t shard = 0);
+            bool set_state(const std::string& name, const uint64_t value, const uint32_t shard = 0);
+            static std::string state_sql(const std::string& name, const uint64_t value);
+            // prefix 로 시작하는 key 모두
+            std::vector<std::pair<std::string, uint64_t>> get_states(const std::string& prefix, const uint32_t shard = 0);
+            // upto 와 이 shard 의 committed_block 중 낮은 것 이하의 tokens_applied 를 지운다.
+            // checkpoint 가 실제로 커밋된 뒤에만 지워지도록 committed_block 은 DB 에서 읽는다.
+            // live_start_block (plugin 이 처음 받은 block) 아래는 ledger_ingest 의 것이므로 남긴다.
+            static std::string prune_tokens_applied_sql(const uint32_t upto);
+
+            // 커밋된 ledger 의 최대 action_id (global_sequence). shard 전체에서.
+            uint64_t get_max_action_id();
+            // 커밋된 ledger 의 최대 block. shard 전체에서. (checkpoint 가 없던 DB 의 재시작 지점)
+            uint32_t get_max_block_number();
         private:
+            struct extracted_fields {
+                chain::name from;
+                chain::name to;
+                chain::asset quantity;
+                bool has_quantity = false;
+            };
+            struct cached_layout {
+                bool resolved = false;
+                uint64_t abi_sequence = 0;
+                extraction_layout layout;
+                std::shared_ptr<chain::abi_serializer> serializer;   // layout 이 fixed 가 아닐 때만
+                uint64_t bytes = 0;                                   // 대략의 크기 (memory_governor)
+            };
+            using layout_key = std::pair<uint64_t, uint64_t>;       // contract, action
+            struct layout_key_hash {
+                size_t operator()(const layout_key& k) const { return std::hash<uint64_t>()(k.first * 0x9e3779b97f4a7c15ull ^ k.second); }
+            };
+
+            enum class tokens_result { applied, replayed, failed };
+
+            bool extract(const chain::action& action, const extraction_rule& rule, extracted_fields& out);
+            void publish(const ledger_event& e);
+            // tokens_applied 에 (transaction, action_index) 를 넣는 statement 를 앞에 붙인다.
+            arena_string tokens_sql(const arena_string& rows, const chain::transaction_id_type& transaction_id, 
+                const uint32_t action_index, const uint32_t block_num);
+            tokens_result execute_tokens(const arena_string& sql, const uint32_t block_num, const uint32_t shard);
+            tokens_result run_tokens(const char* sql, const size_t len, const uint32_t shard);
+            // 실패한 tokens statement 를 순서대로 다시. 실패하면 거기서 멈춘다.
+            void retry_tokens();
+            // 이 shard 에 이미 커밋된 block 인지 (재시작 겹침)
+            bool committed_on(const uint32_t shard, const uint32_t block_num) const {
+                return shard < _resume_blocks.size() && block_num <= _resume_blocks[shard];
+            }
+            bool tokens_done(const uint32_t shard, const uint32_t block_num) const {
+                return _skip_tokens || committed_on(shard, block_num);
+            }
+
             void post_raw_query();
             void post_acc_query();
+            void trim();
+            void report_memory();
 
-            std::shared_ptr<connection_pool> m_pool;
+            // 모든 shard 에. 하나라도 실패하면 false
+            bool execute_ddl(const std::string& sql);
+            bool execute_on(const uint32_t shard, const std::string& sql);
+            uint64_t query_uint(const std::string& sql, const uint32_t shard = 0);
+            void load_partition_highs();
+            void run_partition();
+            void stop_partition();
+
+            struct partition_info {
+                std::string name;
+                uint32_t upper = 0;         // VALUES LESS THAN. MAXVALUE 면 0
+            };
+            // 순서대로. partition 이 없는 테이블이면 비어 있다.
+            std::vector<partition_info> get_partitions(const uint32_t shard);
+
+            std::shared_ptr<shard_router> m_router;
+            abi_resolver _abi_resolver;
+            abi_sequence_resolver _abi_sequence_resolver;
+            std::unordered_map<layout_key, cached_layout, layout_key_hash> _layouts;   // table 마다. worker 하나만 쓴다.
+            std::vector<std::shared_ptr<ledger_event_sink>> _sinks;
 
             uint32_t _raw_bulk_max_count;
             uint32_t _account_bulk_max_count;
 
             uint32_t raw_bulk_count = 0;
             int64_t raw_bulk_insert_tick = 0;
-            std::ostringstream raw_bulk_sql;
             std::string str_raw_bulk_sql;
+            uint32_t raw_bulk_shard = 0;
+            std::atomic<uint32_t> raw_bulk_first_block{0};
 
             uint32_t account_bulk_count = 0;
             int64_t account_bulk_insert_tick = 0;
-            std::ostringstream account_bulk_sql;
-            std::string str_account_bulk_sql;
+            std::vector<std::string> str_account_bulk_sql;     // shard 마다
+            std::atomic<uint32_t> account_bulk_first_block{0};
+
+            // token statement 등 action 마다 만들고 버리는 문자열. batch 끝에 reset.
+            batch_arena _arena;
+            uint64_t _actions = 0;
+            uint64_t _decode_fallbacks = 0;
+            std::atomic<uint64_t> _published_actions{0};
+            std::atomic<uint64_t> _published_capacity{0};
+            std::atomic<uint64_t> _published_peak{0};
+            std::atomic<uint64_t> _published_arena_growths{0};
+            std::atomic<uint64_t> _published_decode_fallbacks{0};
+
+            std::atomic<uint32_t> _batch_scale{1};
+            std::atomic<bool> _skip_accounts{false};
+            std::atomic<bool> _defer_tokens{false};
+            std::atomic<bool> _skip_tokens{false};
+            std::atomic<uint64_t> _skipped_accounts{0};
+
+            std::vector<uint32_t> _resume_blocks;
+            // 실패한 tokens statement. 다시 반영될 때까지 router 에 실행 전으로 남겨 그 shard 의 checkpoint 를 잡아 둔다.
+            // (그 사이에 종료하면 다음 시작이 그 block 부터 tokens_applied 를 거쳐 다시 반영한다)
+            struct pending_tokens {
+                std::string sql;
+                uint32_t block_num = 0;
+                uint32_t shard = 0;
+            };
+            std::deque<pending_tokens> _tokens_retry;
+            uint64_t _tokens_retry_bytes = 0;
+            int64_t _tokens_retry_tick = 0;
+            std::atomic<uint64_t> _tokens_failed{0};
+            std::atomic<uint64_t> _tokens_half_applied{0};
+
+            std::shared_ptr<memory_governor> _memory;
+            uint64_t _abi_bytes = 0;
+            uint64_t _reported_sql_bytes = 0;
+            uint64_t _reported_abi_bytes = 0;
+            std::atomic<bool> _trim_requested{false};
+
+            // ledger partition 상태. shard 마다 DDL 이 따로 성공/실패하므로 shard 마다 둔다.
+            struct shard_partition {
+                uint32_t high = 0;              // 마지막 bounded partition 의 상한 (pmax 제외). 0 이면 partition 없는 테이블
+                int64_t retry_tick = 0;         // 실패 뒤 이 시각까지는 시도하지 않는다
+                int64_t backoff_ms = 0;
+            };
+            uint32_t _partition_blocks = 0;
+            std::vector<shard_partition> _partitions;
+            std::mutex _partition_mtx;          // _partitions. DDL 중에도 잡는다
+
+            std::mutex _partition_thread_mtx;
+            std::condition_variable _partition_cond;
+            uint32_t _partition_request = 0;    // 아직 처리하지 않은 가장 높은 block
+            bool _partition_stop = false;
+            std::thread _partition_thread;
     };
 }
 #endif
\ No newline at end of file
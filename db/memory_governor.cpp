@@ -0,0 +1,85 @@
+#include "memory_governor.hpp"
+
+namespace eosio {
+
+constexpr uint32_t memory_governor::flush_percent;
+constexpr uint32_t memory_governor::spill_percent;
+constexpr uint32_t memory_governor::throttle_percent;
+
+memory_governor::memory_governor(const uint64_t budget_bytes) :
+_budget(budget_bytes)
+{
+    for (size_t i = 0; i < static_cast<size_t>(component::count); i++) {
+        _bytes[i] = 0;
+        _peaks[i] = 0;
+    }
+}
+
+void memory_governor::raise_peak(std::atomic<uint64_t>& peak, const uint64_t value) {
+    uint64_t current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+void memory_governor::reserve(const component c, const uint64_t bytes) {
+    if (!bytes) return;
+    const auto i = static_cast<size_t>(c);
+    raise_peak(_peaks[i], _bytes[i].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    raise_peak(_peak, _total.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+void memory_governor::release(const component c, const uint64_t bytes) {
+    if (!bytes) return;
+    _bytes[static_cast<size_t>(c)].fetch_sub(bytes, std::memory_order_relaxed);
+    _total.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void memory_governor::adjust(const component c, uint64_t& reported, const uint64_t bytes) {
+    if (bytes > reported) reserve(c, bytes - reported);
+    else release(c, reported - bytes);
+    reported = bytes;
+}
+
+memory_governor::level memory_governor::get_level() const {
+    if (!_budget) return level::normal;
+    const uint64_t percent = _total.load(std::memory_order_relaxed) * 100 / _budget;
+    if (percent >= throttle_percent) return level::throttle;
+    if (percent >= spill_percent) return level::spill;
+    if (percent >= flush_percent) return level::flush;
+    return level::normal;
+}
+
+memory_governor::usage memory_governor::get_usage() const {
+    usage u;
+    u.budget = _budget;
+    u.total = _total;
+    u.peak = _peak;
+    u.current = get_level();
+    for (size_t i = 0; i < static_cast<size_t>(component::count); i++) {
+        u.components[i].bytes = _bytes[i];
+        u.components[i].peak = _peaks[i];
+    }
+    return u;
+}
+
+const char* memory_governor::component_name(const component c) {
+    switch (c) {
+        case component::trace_queue: return "trace_queue";
+        case component::query_queue: return "query_queue";
+        case component::sql_buffers: return "sql_buffers";
+        case component::abi_cache: return "abi_cache";
+        case component::count: break;
+    }
+    return "unknown";
+}
+
+const char* memory_governor::level_name(const level l) {
+    switch (l) {
+        case level::normal: return "normal";
+        case level::flush: return "flush";
+        case level::spill: return "spill";
+        case level::throttle: return "throttle";
+    }
+    return "unknown";
+}
+
+}
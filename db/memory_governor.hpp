@@ -0,0 +1,66 @@
+#ifndef MEMORY_GOVERNOR_H
+#define MEMORY_GOVERNOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace eosio {
+    // plugin 버퍼 전체의 byte 예산. 각 component 는 쓰는 만큼 reserve, 놓을 때 release 한다.
+    // 개수 상한 (queue size) 만으로는 statement 길이나 trace 크기를 모르므로 DB 가 멈추면 메모리가 끝없이 는다.
+    //
+    // 예산 대비 사용량으로 단계를 정하고, 단계에 따른 대응은 plugin 이 한다.
+    //
+    //  - flush    : table 버퍼를 바로 queue 로 넘기고 capacity 와 ABI cache 를 놓는다
+    //  - spill    : 새 statement 를 메모리 대신 overflow 파일로
+    //  - throttle : chain thread 를 재운다 (queue() 의 backpressure)
+    //
+    // 예산 0 은 집계만 한다. reserve 는 실패하지 않는다. (이미 만든 것을 버릴 수는 없으므로)
+    class memory_governor {
+        public:
+            enum class component : uint8_t { trace_queue, query_queue, sql_buffers, abi_cache, count };
+            enum class level : uint8_t { normal, flush, spill, throttle };
+
+            struct component_usage {
+                uint64_t bytes = 0;
+                uint64_t peak = 0;
+            };
+            struct usage {
+                uint64_t budget = 0;
+                uint64_t total = 0;
+                uint64_t peak = 0;
+                level    current = level::normal;
+                component_usage components[static_cast<size_t>(component::count)];
+            };
+
+            explicit memory_governor(const uint64_t budget_bytes);
+
+            void reserve(const component c, const uint64_t bytes);
+            void release(const component c, const uint64_t bytes);
+            // 크기를 직접 세는 곳 (table 버퍼 등) 에서. 지난번 값과의 차이만큼 reserve/release.
+            void adjust(const component c, uint64_t& reported, const uint64_t bytes);
+
+            level get_level() const;
+            bool at_least(const level l) const { return get_level() >= l; }
+            uint64_t budget() const { return _budget; }
+            usage get_usage() const;
+
+            static const char* component_name(const component c);
+            static const char* level_name(const level l);
+
+            // 예산 대비 단계 경계 (%)
+            static constexpr uint32_t flush_percent = 60;
+            static constexpr uint32_t spill_percent = 80;
+            static constexpr uint32_t throttle_percent = 95;
+
+        private:
+            static void raise_peak(std::atomic<uint64_t>& peak, const uint64_t value);
+
+            const uint64_t _budget;
+            std::atomic<uint64_t> _total{0};
+            std::atomic<uint64_t> _peak{0};
+            std::atomic<uint64_t> _bytes[static_cast<size_t>(component::count)];
+            std::atomic<uint64_t> _peaks[static_cast<size_t>(component::count)];
+    };
+}
+#endif
@@ -0,0 +1,190 @@
+#include "recent_history.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace eosio {
+
+constexpr size_t recent_history::event_bytes;
+constexpr uint32_t recent_history::npos;
+
+recent_history::recent_history(const uint32_t depth, const uint64_t memory_bytes, const uint32_t shard_count) :
+_depth(depth ? depth : 1), _shard_count(shard_count ? shard_count : 1), _shards(new shard[_shard_count])
+{
+    // slot 하나 = ring + meta + map 항목 (대략)
+    const uint64_t slot_bytes = uint64_t(_depth) * event_bytes + sizeof(slot_meta) + 32;
+    const uint64_t slots = memory_bytes / slot_bytes;
+    _slots_per_shard = static_cast<uint32_t>(std::max<uint64_t>(1, std::min<uint64_t>(slots / _shard_count, npos - 1)));
+}
+
+recent_history::~recent_history()
+{
+
+}
+
+recent_history::shard& recent_history::shard_for(const uint64_t account) const {
+    // name 하위 비트는 '.' 이 많으므로 섞어서 나눈다.
+    return _shards[(account * 0x9e3779b97f4a7c15ull >> 32) % _shard_count];
+}
+
+// 처음부터 상한만큼 잡지 않고 두 배씩. reserve 로 정확히 잡아 상한을 넘지 않게.
+void recent_history::grow(shard& s, const uint32_t slots) {
+    const uint32_t allocated = static_cast<uint32_t>(s.action_id.size() / _depth);
+    if (slots <= allocated) return;
+    const uint32_t cap = std::min<uint32_t>(_slots_per_shard, std::max<uint32_t>(slots, std::max<uint32_t>(16, allocated * 2)));
+    const size_t cells = size_t(cap) * _depth;
+    auto resize = [](auto& v, const size_t n) {
+        v.reserve(n);
+        v.resize(n);
+    };
+    s.meta.reserve(cap);
+    resize(s.action_id, cells);
+    resize(s.block_num, cells);
+    resize(s.block_time, cells);
+    resize(s.contract, cells);
+    resize(s.counterparty, cells);
+    resize(s.amount, cells);
+    resize(s.symbol, cells);
+    resize(s.transaction_id, cells * 32);
+}
+
+void recent_history::unlink(shard& s, const uint32_t slot) {
+    auto& m = s.meta[slot];
+    if (m.prev != npos) s.meta[m.prev].next = m.next;
+    else if (s.lru_head == slot) s.lru_head = m.next;
+    if (m.next != npos) s.meta[m.next].prev = m.prev;
+    else if (s.lru_tail == slot) s.lru_tail = m.prev;
+    m.prev = m.next = npos;
+}
+
+void recent_history::touch(shard& s, const uint32_t slot) {
+    if (s.lru_head == slot) return;
+    unlink(s, slot);
+    auto& m = s.meta[slot];
+    m.next = s.lru_head;
+    if (s.lru_head != npos) s.meta[s.lru_head].prev = slot;
+    s.lru_head = slot;
+    if (s.lru_tail == npos) s.lru_tail = slot;
+}
+
+uint32_t recent_history::slot_for(shard& s, const uint64_t account) {
+    auto itr = s.slots.find(account);
+    if (itr != s.slots.end()) {
+        touch(s, itr->second);
+        return itr->second;
+    }
+
+    uint32_t slot;
+    if (s.meta.size() < _slots_per_shard) {
+        slot = static_cast<uint32_t>(s.meta.size());
+        grow(s, slot + 1);
+        s.meta.emplace_back();
+    } else {
+        slot = s.lru_tail;
+        unlink(s, slot);
+        s.slots.erase(s.meta[slot].account);
+        s.evictions++;
+    }
+
+    auto& m = s.meta[slot];
+    m = slot_meta();
+    m.account = account;
+    s.slots.emplace(account, slot);
+    touch(s, slot);
+    return slot;
+}
+
+void recent_history::record(const uint64_t account, const uint64_t counterparty, const int64_t amount, const ledger_event& e) {
+    auto& s = shard_for(account);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    const uint32_t slot = slot_for(s, account);
+    auto& m = s.meta[slot];
+
+    const size_t base = size_t(slot) * _depth;
+    size_t i = base + m.count;
+    if (m.count == _depth) {
+        // 가장 작은 action_id 를 내보낸다. 그보다도 작으면 DB 에서 이어 읽을 범위이므로 넣지 않는다.
+        i = base;
+        for (size_t k = base + 1; k < base + _depth; k++) {
+            if (s.action_id[k] < s.action_id[i]) i = k;
+        }
+        if (e.action_id < s.action_id[i]) return;
+    }
+    s.action_id[i] = e.action_id;
+    s.block_num[i] = e.block_num;
+    s.block_time[i] = e.block_time;
+    s.contract[i] = e.contract;
+    s.counterparty[i] = counterparty;
+    s.amount[i] = amount;
+    s.symbol[i] = e.symbol;
+    std::memcpy(&s.transaction_id[i * 32], e.transaction_id, 32);
+
+    if (m.count < _depth) m.count++;
+    s.events++;
+}
+
+void recent_history::on_ledger_event(const ledger_event& e) {
+    // create 는 transfer 가 아니다. (from 없음)
+    if (!e.from) return;
+    if (e.from != e.to) record(e.from, e.to, -e.amount, e);
+    record(e.to, e.from, e.amount, e);
+}
+
+// trace thread 들이 나눠 처리하므로 ring 안의 순서는 action_id 순이 아닐 수 있다. 고른 뒤 정렬.
+void recent_history::lookup(const uint64_t account, const uint64_t before, const uint32_t limit,
+        std::vector<entry>& out, uint64_t& db_before) {
+    const uint64_t below = before ? before : std::numeric_limits<uint64_t>::max();
+    db_before = below;
+
+    auto& s = shard_for(account);
+    std::lock_guard<std::mutex> lock(s.mtx);
+    auto itr = s.slots.find(account);
+    if (itr == s.slots.end()) return;
+    const uint32_t slot = itr->second;
+    touch(s, slot);
+
+    const auto& m = s.meta[slot];
+    const size_t base = size_t(slot) * _depth;
+    uint64_t lowest = std::numeric_limits<uint64_t>::max();
+    std::vector<size_t> picked;
+    picked.reserve(m.count);
+    for (uint32_t k = 0; k < m.count; k++) {
+        const uint64_t id = s.action_id[base + k];
+        lowest = std::min(lowest, id);
+        if (id < below) picked.push_back(base + k);
+    }
+    db_before = std::min(below, lowest);
+
+    std::sort(picked.begin(), picked.end(), [&](const size_t a, const size_t b) { return s.action_id[a] > s.action_id[b]; });
+    if (picked.size() > limit) picked.resize(limit);
+
+    for (const auto i : picked) {
+        entry r;
+        r.action_id = s.action_id[i];
+        r.block_num = s.block_num[i];
+        r.block_time = s.block_time[i];
+        r.contract = s.contract[i];
+        r.counterparty = s.counterparty[i];
+        r.amount = s.amount[i];
+        r.symbol = s.symbol[i];
+        std::memcpy(r.transaction_id, &s.transaction_id[i * 32], 32);
+        out.push_back(r);
+    }
+}
+
+recent_history::stats recent_history::get_stats() const {
+    stats st;
+    st.max_accounts = uint64_t(_slots_per_shard) * _shard_count;
+    for (uint32_t i = 0; i < _shard_count; i++) {
+        const auto& s = _shards[i];
+        std::lock_guard<std::mutex> lock(s.mtx);
+        st.accounts += s.slots.size();
+        st.events += s.events;
+        st.evictions += s.evictions;
+        st.bytes += s.action_id.capacity() * event_bytes + s.meta.capacity() * sizeof(slot_meta) + s.slots.size() * 32;
+    }
+    return st;
+}
+
+}
@@ -0,0 +1,104 @@
+#ifndef RECENT_HISTORY_H
+#define RECENT_HISTORY_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "ledger_event.hpp"
+
+namespace eosio {
+    // account 별 최근 transfer 를 depth 개씩 메모리에. "account X 의 최근 N 건" 을 DB 없이 답한다.
+    //
+    //  - account 하나 = slot 하나 = depth 칸. 칸의 필드는 column 마다 따로 (struct-of-arrays) 두어
+    //    조회 때 action_id column 만 훑는다.
+    //  - 칸이 차면 가장 먼저 온 것이 아니라 action_id 가 가장 작은 칸을 바꾼다. trace 가 순서 없이 와도
+    //    slot 에 남은 가장 작은 action_id 위로는 빠진 것이 없어야 db_before 로 이어 읽을 수 있다.
+    //  - 전체 메모리 상한에서 slot 수가 정해지고, 모자라면 가장 오래 안 쓴 (기록, 조회) account 를 내보낸다.
+    //  - slot 은 만들어진 뒤의 transfer 만 가진다. 그보다 오래된 것은 DB 에서 (lookup 의 db_before).
+    //
+    // balance_store 처럼 account 로 shard 를 나눠 lock 을 잡는다. 각 shard 가 상한을 나눠 가진다.
+    class recent_history : public ledger_event_sink {
+        public:
+            // 조회 결과 한 건. amount 는 이 account 기준 (보냈으면 음수).
+            struct entry {
+                uint64_t action_id = 0;
+                uint32_t block_num = 0;
+                uint32_t block_time = 0;
+                uint64_t contract = 0;
+                uint64_t counterparty = 0;
+                int64_t  amount = 0;
+                uint64_t symbol = 0;
+                uint8_t  transaction_id[32] = {};
+            };
+            struct stats {
+                uint64_t accounts = 0;
+                uint64_t max_accounts = 0;
+                uint64_t events = 0;
+                uint64_t evictions = 0;
+                uint64_t bytes = 0;
+            };
+
+            recent_history(const uint32_t depth, const uint64_t memory_bytes, const uint32_t shard_count = 64);
+            virtual ~recent_history();
+
+            virtual void on_ledger_event(const ledger_event& e) override;
+
+            // before 보다 작은 action_id 를 최신부터 limit 개까지 (before 0 은 제한 없음).
+            // 모자라면 db_before 보다 작은 action_id 를 DB 에서 이어 읽으면 된다.
+            void lookup(const uint64_t account, const uint64_t before, const uint32_t limit,
+                std::vector<entry>& out, uint64_t& db_before);
+
+            uint32_t depth() const { return _depth; }
+            stats get_stats() const;
+
+            // 칸 하나 크기. slot 수 계산용.
+            static constexpr size_t event_bytes = 8 + 4 + 4 + 8 + 8 + 8 + 8 + 32;
+
+        private:
+            static constexpr uint32_t npos = 0xffffffff;
+
+            struct slot_meta {
+                uint64_t account = 0;
+                uint32_t count = 0;             // 찬 칸. 다 차기 전에는 다음에 쓸 칸
+                uint32_t prev = npos;           // LRU. head 쪽이 최근
+                uint32_t next = npos;
+            };
+
+            struct shard {
+                mutable std::mutex mtx;
+                std::unordered_map<uint64_t, uint32_t> slots;   // account -> slot
+                std::vector<slot_meta> meta;
+                uint32_t lru_head = npos;
+                uint32_t lru_tail = npos;
+
+                // slot * depth + 칸
+                std::vector<uint64_t> action_id;
+                std::vector<uint32_t> block_num;
+                std::vector<uint32_t> block_time;
+                std::vector<uint64_t> contract;
+                std::vector<uint64_t> counterparty;
+                std::vector<int64_t>  amount;
+                std::vector<uint64_t> symbol;
+                std::vector<uint8_t>  transaction_id;   // 32 바이트씩
+
+                uint64_t events = 0;
+                uint64_t evictions = 0;
+            };
+
+            shard& shard_for(const uint64_t account) const;
+            uint32_t slot_for(shard& s, const uint64_t account);
+            void grow(shard& s, const uint32_t slots);
+            void touch(shard& s, const uint32_t slot);
+            void unlink(shard& s, const uint32_t slot);
+            void record(const uint64_t account, const uint64_t counterparty, const int64_t amount, const ledger_event& e);
+
+            uint32_t _depth;
+            uint32_t _slots_per_shard;
+            uint32_t _shard_count;
+            std::unique_ptr<shard[]> _shards;
+    };
+}
+#endif
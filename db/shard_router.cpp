@@ -0,0 +1,95 @@
+#include "shard_router.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace eosio {
+
+shard_router::shard_router(std::shared_ptr<connection_pool> primary) :
+_range_blocks(1),
+_inflight(1),
+_failed(1, 0)
+{
+    shard s;
+    s.pool = primary;
+    _shards.push_back(s);
+}
+
+shard_router::shard_router(std::vector<shard> shards, const uint32_t range_blocks) :
+_shards(std::move(shards)),
+_range_blocks(range_blocks ? range_blocks : 1),
+_inflight(_shards.size()),
+_failed(_shards.size(), 0)
+{
+    if (_shards.empty()) throw std::invalid_argument("shard_router needs at least one shard");
+}
+
+// name 값은 하위 bit 가 몰려 있으므로 먼저 섞는다. (splitmix64 finalizer)
+uint32_t shard_router::jump_hash(uint64_t key, const uint32_t buckets) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+
+    int64_t b = -1, j = 0;
+    while (j < static_cast<int64_t>(buckets)) {
+        b = j;
+        key = key * 2862933555777941757ull + 1;
+        j = static_cast<int64_t>((b + 1) * (double(1ll << 31) / double((key >> 33) + 1)));
+    }
+    return static_cast<uint32_t>(b);
+}
+
+std::pair<std::string, uint16_t> shard_router::parse_target(const std::string& target, const uint16_t default_port) {
+    const auto colon = target.rfind(':');
+    if (colon == std::string::npos) {
+        if (target.empty()) throw std::invalid_argument("empty shard host");
+        return { target, default_port };
+    }
+    const auto host = target.substr(0, colon);
+    const auto port = target.substr(colon + 1);
+    if (host.empty() || port.empty() || port.find_first_not_of("0123456789") != std::string::npos || std::stoul(port) > 65535)
+        throw std::invalid_argument("invalid shard target '" + target + "', expected host[:port]");
+    return { host, static_cast<uint16_t>(std::stoul(port)) };
+}
+
+void shard_router::statement_queued(const uint32_t shard, const uint32_t block_num) {
+    if (!block_num) return;
+    std::lock_guard<std::mutex> lock(_mtx);
+    _inflight[shard][block_num]++;
+}
+
+void shard_router::statement_committed(const uint32_t shard, const uint32_t block_num) {
+    if (!block_num) return;
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& m = _inflight[shard];
+    auto itr = m.find(block_num);
+    if (itr == m.end()) return;
+    if (--itr->second == 0) m.erase(itr);
+}
+
+void shard_router::statement_failed(const uint32_t shard, const uint32_t block_num) {
+    if (!block_num) return;
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& m = _inflight[shard];
+    auto itr = m.find(block_num);
+    if (itr != m.end() && --itr->second == 0) m.erase(itr);
+    if (!_failed[shard] || block_num < _failed[shard]) _failed[shard] = block_num;
+}
+
+uint32_t shard_router::committed_block(const uint32_t shard, const uint32_t queued_block) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    const auto& m = _inflight[shard];
+    uint32_t committed = queued_block;
+    if (!m.empty()) committed = std::min(committed, m.begin()->first - 1);
+    if (_failed[shard]) committed = std::min(committed, _failed[shard] - 1);
+    return committed;
+}
+
+uint32_t shard_router::failed_block(const uint32_t shard) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _failed[shard];
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef SHARD_ROUTER_H
+#define SHARD_ROUTER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "connection_pool.h"
+
+namespace eosio {
+    // 여러 MySQL 에 나눠 쓰기. shard 마다 connection_pool 하나, shard 0 은 --ledger-db-host (primary).
+    //
+    //  - tokens, actions_accounts : account 의 jump consistent hash (Lamping & Veach)
+    //  - ledger                   : block_number / range_blocks 를 shard 수로 나눈 나머지
+    //  - tokenlist, ledger_state, token_aggregates : primary
+    //
+    // shard 수가 바뀌면 tokens row 의 위치가 바뀌므로 같은 DB 로는 shard 수를 바꿀 수 없다. (plugin 에서 검사)
+    class shard_router {
+        public:
+            struct shard {
+                std::string host;
+                uint16_t port = 0;
+                std::shared_ptr<connection_pool> pool;
+            };
+
+            // shard 하나. (기존 단일 DB 설정, 오프라인 도구)
+            explicit shard_router(std::shared_ptr<connection_pool> primary);
+            shard_router(std::vector<shard> shards, const uint32_t range_blocks);
+
+            uint32_t size() const { return static_cast<uint32_t>(_shards.size()); }
+            const shard& get(const uint32_t index) const { return _shards[index]; }
+            const std::shared_ptr<connection_pool>& pool(const uint32_t index) const { return _shards[index].pool; }
+            uint32_t range_blocks() const { return _range_blocks; }
+
+            uint32_t account_shard(const uint64_t account) const {
+                return _shards.size() == 1 ? 0 : jump_hash(account, size());
+            }
+            uint32_t block_shard(const uint32_t block_num) const {
+                return _shards.size() == 1 ? 0 : (block_num / _range_blocks) % size();
+            }
+
+            static uint32_t jump_hash(uint64_t key, const uint32_t buckets);
+            // "host[:port]". 잘못된 형식이면 std::invalid_argument
+            static std::pair<std::string, uint16_t> parse_target(const std::string& target, const uint16_t default_port);
+
+            // shard 별 checkpoint. ingest_watermarks 와 같이 statement 는 담긴 row 중 가장 낮은 block 으로 태그 (0 은 추적하지 않음).
+            void statement_queued(const uint32_t shard, const uint32_t block_num);
+            void statement_committed(const uint32_t shard, const uint32_t block_num);
+            // 실행에 실패해 버린 statement. 재시작 때 그 block 부터 다시 만들도록 이 shard 의 checkpoint 를 그 아래에 묶어 둔다.
+            void statement_failed(const uint32_t shard, const uint32_t block_num);
+            // queued_block (모든 row 가 queue 로 넘어간 block) 까지 중 이 shard 에 실행 전 statement 가 없는 block
+            uint32_t committed_block(const uint32_t shard, const uint32_t queued_block) const;
+            // 실패한 statement 중 가장 낮은 block. 없으면 0.
+            uint32_t failed_block(const uint32_t shard) const;
+
+        private:
+            std::vector<shard> _shards;
+            uint32_t _range_blocks = 1;
+
+            std::vector<std::map<uint32_t, uint32_t>> _inflight;    // shard 마다 block -> 개수
+            std::vector<uint32_t> _failed;                          // shard 마다. 0 은 없음
+            mutable std::mutex _mtx;
+    };
+}
+#endif
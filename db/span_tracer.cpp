@@ -0,0 +1,125 @@
+#include "span_tracer.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace eosio { namespace span_tracer {
+
+namespace detail {
+    std::atomic<uint32_t> sample_rate{0};
+    thread_local bool active = false;
+    thread_local uint32_t block_num = 0;
+    thread_local uint64_t global_sequence = 0;
+}
+
+namespace {
+    struct thread_ring {
+        std::mutex mtx;                 // 쓰는 thread 와 dump 만. 거의 경합 없음.
+        std::vector<span> spans;
+        size_t next = 0;
+        bool wrapped = false;
+        uint32_t tid = 0;
+    };
+
+    std::mutex registry_mtx;
+    std::vector<std::shared_ptr<thread_ring>> registry;
+    std::atomic<uint32_t> ring_size{65536};
+    std::atomic<uint32_t> next_tid{1};
+
+    thread_local std::shared_ptr<thread_ring> t_ring;
+    thread_local uint32_t t_counter = 0;
+
+    thread_ring& ring() {
+        if (!t_ring) {
+            t_ring = std::make_shared<thread_ring>();
+            t_ring->spans.resize(ring_size.load());
+            t_ring->tid = next_tid++;
+            std::lock_guard<std::mutex> lock(registry_mtx);
+            registry.push_back(t_ring);
+        }
+        return *t_ring;
+    }
+}
+
+void detail::push(const span& s) {
+    auto& r = ring();
+    std::lock_guard<std::mutex> lock(r.mtx);
+    if (r.spans.empty()) return;
+    r.spans[r.next] = s;
+    if (++r.next == r.spans.size()) {
+        r.next = 0;
+        r.wrapped = true;
+    }
+}
+
+void configure(const uint32_t rate, const uint32_t size) {
+    ring_size = size ? size : 1;
+    detail::sample_rate = rate;
+}
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+sample_scope::sample_scope(const uint32_t block_num) {
+    const uint32_t rate = detail::sample_rate.load(std::memory_order_relaxed);
+    if (!rate || detail::active) return;
+    if (++t_counter < rate) return;
+    t_counter = 0;
+
+    _sampled = true;
+    detail::active = true;
+    detail::block_num = block_num;
+    detail::global_sequence = 0;
+}
+
+sample_scope::~sample_scope() {
+    if (!_sampled) return;
+    detail::active = false;
+    detail::block_num = 0;
+    detail::global_sequence = 0;
+}
+
+size_t dump(const std::string& path) {
+    std::vector<std::shared_ptr<thread_ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(registry_mtx);
+        rings = registry;
+    }
+
+    const std::string tmp_path = path + ".tmp";
+    std::FILE* f = std::fopen(tmp_path.c_str(), "w");
+    if (!f) throw std::runtime_error("unable to create trace file " + tmp_path);
+
+    size_t count = 0;
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+    for (const auto& r : rings) {
+        std::vector<span> spans;
+        {
+            std::lock_guard<std::mutex> lock(r->mtx);
+            if (r->wrapped) spans.insert(spans.end(), r->spans.begin() + r->next, r->spans.end());
+            spans.insert(spans.end(), r->spans.begin(), r->spans.begin() + r->next);
+        }
+        for (const auto& s : spans) {
+            if (!s.name) continue;
+            std::fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"ledger\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"block\":%u,\"global_sequence\":%llu}}",
+                count ? ",\n" : "\n", s.name, r->tid,
+                s.begin_ns / 1000.0, (s.end_ns - s.begin_ns) / 1000.0,
+                s.block_num, static_cast<unsigned long long>(s.global_sequence));
+            count++;
+        }
+    }
+    std::fputs("\n]}\n", f);
+    const bool ok = std::fclose(f) == 0;
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("unable to write trace file " + path);
+    return count;
+}
+
+} }
@@ -0,0 +1,88 @@
+#ifndef SPAN_TRACER_H
+#define SPAN_TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace eosio { namespace span_tracer {
+    // 처리 단계별 시간을 thread 마다 ring buffer 에 남기고, 요청 시 Chrome trace (chrome://tracing, Perfetto) JSON 으로 쓴다.
+    //
+    //  - sample_scope 가 N 개 중 하나를 골라 그 동안 thread 의 span 을 기록한다. (transaction 단위)
+    //  - scope 는 sample 중이 아니면 thread_local bool 하나만 확인한다.
+    //  - sample rate 0 이면 sample_scope 도 atomic load 하나로 끝난다.
+
+    struct span {
+        const char* name = nullptr;    // 문자열 상수만
+        uint64_t begin_ns = 0;
+        uint64_t end_ns = 0;
+        uint64_t global_sequence = 0;
+        uint32_t block_num = 0;
+    };
+
+    namespace detail {
+        extern std::atomic<uint32_t> sample_rate;
+        extern thread_local bool active;
+        extern thread_local uint32_t block_num;
+        extern thread_local uint64_t global_sequence;
+        void push(const span& s);
+    }
+
+    // rate 0 이면 끔. ring_size 는 thread 당 span 수.
+    void configure(const uint32_t rate, const uint32_t ring_size);
+    inline bool enabled() { return detail::sample_rate.load(std::memory_order_relaxed) != 0; }
+
+    uint64_t now_ns();
+
+    // 모든 thread 의 span 을 path 에 쓴다. 쓴 span 수.
+    size_t dump(const std::string& path);
+
+    class sample_scope {
+        public:
+            explicit sample_scope(const uint32_t block_num);
+            ~sample_scope();
+            bool sampled() const { return _sampled; }
+        private:
+            bool _sampled = false;
+    };
+
+    // sample 중인 transaction 안에서 현재 action 표시.
+    inline void set_global_sequence(const uint64_t global_sequence) {
+        if (detail::active) detail::global_sequence = global_sequence;
+    }
+
+    class scope {
+        public:
+            explicit scope(const char* name) {
+                if (detail::active) {
+                    _name = name;
+                    _global_sequence = detail::global_sequence;
+                    _begin = now_ns();
+                }
+            }
+            ~scope() {
+                if (_name) record(_name, _begin, now_ns(), _global_sequence);
+            }
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+
+            static void record(const char* name, const uint64_t begin_ns, const uint64_t end_ns) {
+                record(name, begin_ns, end_ns, detail::global_sequence);
+            }
+            static void record(const char* name, const uint64_t begin_ns, const uint64_t end_ns, const uint64_t global_sequence) {
+                span s;
+                s.name = name;
+                s.begin_ns = begin_ns;
+                s.end_ns = end_ns;
+                s.block_num = detail::block_num;
+                s.global_sequence = global_sequence;
+                detail::push(s);
+            }
+
+        private:
+            const char* _name = nullptr;
+            uint64_t _begin = 0;
+            uint64_t _global_sequence = 0;
+    };
+} }
+#endif
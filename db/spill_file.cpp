@@ -0,0 +1,99 @@
+#include "spill_file.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace eosio {
+
+spill_file::spill_file(const std::string& path) :
+_path(path)
+{
+
+}
+
+spill_file::~spill_file() {
+    sync();
+    if (_file) std::fclose(_file);
+}
+
+bool spill_file::append(const uint32_t block_num, const uint32_t shard, const char* sql, const size_t length) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (!_file) {
+        _file = std::fopen(_path.c_str(), "ab");
+        if (!_file) return false;
+    }
+    const uint32_t header[3] = { block_num, shard, static_cast<uint32_t>(length) };
+    const bool ok = std::fwrite(header, sizeof(header), 1, _file) == 1 &&
+                    (length == 0 || std::fwrite(sql, length, 1, _file) == 1);
+    if (ok) _count++;
+    return ok;
+}
+
+bool spill_file::sync() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (!_file) return true;
+    return std::fflush(_file) == 0 && ::fsync(::fileno(_file)) == 0;
+}
+
+bool spill_file::flush() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return !_file || std::fflush(_file) == 0;
+}
+
+bool spill_file::reset() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_file) std::fclose(_file);
+    _file = nullptr;
+    _count = 0;
+    return remove(_path);
+}
+
+uint64_t spill_file::read_chunk(const std::string& path, const uint64_t offset, const size_t max_bytes, std::vector<record>& records) {
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return offset;
+    if (offset && ::fseeko(f, static_cast<off_t>(offset), SEEK_SET) != 0) {
+        std::fclose(f);
+        return offset;
+    }
+
+    uint64_t next = offset;
+    size_t bytes = 0;
+    uint32_t header[3];
+    while (bytes < max_bytes && std::fread(header, sizeof(header), 1, f) == 1) {
+        record r;
+        r.block_num = header[0];
+        r.shard = header[1];
+        r.sql.resize(header[2]);
+        if (header[2] && std::fread(&r.sql[0], header[2], 1, f) != 1) break;   // 잘린 마지막 record
+        next += sizeof(header) + header[2];
+        bytes += header[2];
+        records.push_back(std::move(r));
+    }
+    std::fclose(f);
+    return next;
+}
+
+uint64_t spill_file::read_offset(const std::string& path) {
+    uint64_t offset = 0;
+    const int fd = ::open((path + ".offset").c_str(), O_RDONLY);
+    if (fd < 0) return 0;
+    if (::pread(fd, &offset, sizeof(offset), 0) != sizeof(offset)) offset = 0;
+    ::close(fd);
+    return offset;
+}
+
+bool spill_file::write_offset(const std::string& path, const uint64_t offset) {
+    const int fd = ::open((path + ".offset").c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) return false;
+    const bool ok = ::pwrite(fd, &offset, sizeof(offset), 0) == sizeof(offset) && ::fdatasync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+bool spill_file::remove(const std::string& path) {
+    const auto gone = [](const std::string& p) { return std::remove(p.c_str()) == 0 || ::access(p.c_str(), F_OK) != 0; };
+    // offset 이 먼저. 사이에 죽으면 처음부터 다시 실행한다. (tokens 는 tokens_applied 로 한 번만)
+    return gone(path + ".offset") && gone(path);
+}
+
+}
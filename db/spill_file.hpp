@@ -0,0 +1,58 @@
+#ifndef SPILL_FILE_H
+#define SPILL_FILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace eosio {
+    // 종료 시한 안에 DB 에 반영하지 못한 statement 를 순서대로 남기는 파일. 다음 시작 때 먼저 실행한다.
+    //
+    //   record = uint32 block_num, uint32 shard, uint32 length, length 바이트 SQL
+    //
+    // 쓰는 도중 죽어 잘린 마지막 record 는 읽을 때 버린다. (close 에서 fsync 하기 전의 것)
+    //
+    // 메모리가 모자랄 때 statement 를 잠시 내려두는 overflow 파일도 같은 형식. 쓰는 동안 앞에서부터 read_chunk 로 다시 읽는다.
+    class spill_file {
+        public:
+            struct record {
+                uint32_t block_num = 0;
+                uint32_t shard = 0;
+                std::string sql;
+            };
+
+            explicit spill_file(const std::string& path);
+            ~spill_file();
+
+            // 여러 thread 에서 불러도 된다. 처음 부를 때 파일을 만든다 (기존 내용 뒤에 이어서).
+            bool append(const uint32_t block_num, const uint32_t shard, const char* sql, const size_t length);
+            // fflush + fsync
+            bool sync();
+            // fflush 만. 같은 process 에서 다시 읽기 전에.
+            bool flush();
+            // 닫고 파일을 지운다. 다음 append 때 새로 만든다.
+            bool reset();
+            uint64_t count() const { return _count; }
+
+            // offset 부터 max_bytes 쯤까지 (적어도 한 record). 다음 offset 을 돌려준다.
+            static uint64_t read_chunk(const std::string& path, const uint64_t offset, const size_t max_bytes, std::vector<record>& records);
+            static uint64_t record_size(const record& r) { return 3 * sizeof(uint32_t) + r.sql.size(); }
+
+            // 어디까지 실행했는지. <path>.offset 에 쓰고 바로 fsync 한다. 실행 중에 죽어도 다음에는 그 뒤부터.
+            // 없으면 0.
+            static uint64_t read_offset(const std::string& path);
+            static bool write_offset(const std::string& path, const uint64_t offset);
+            // 파일과 offset 을 함께 지운다.
+            static bool remove(const std::string& path);
+
+        private:
+            std::string _path;
+            std::FILE* _file = nullptr;
+            uint64_t _count = 0;
+            std::mutex _mtx;
+    };
+}
+#endif
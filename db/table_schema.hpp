@@ -0,0 +1,236 @@
+#ifndef TABLE_SCHEMA_H
+#define TABLE_SCHEMA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "fast_encode.hpp"
+
+// 테이블을 컬럼 타입 목록으로 한 번만 적고, DDL / INSERT 머리 / row 인코더를 거기서 만든다.
+//  - 컬럼 타입이 SQL 타입과 값 -> literal 인코딩을 같이 갖는다. row 인코더는 타입별 append 를 펼친 것.
+//  - append_row 의 인자 개수는 컴파일 타임에 검사한다. 형식 문자열 파싱 없음.
+//  - 값이 없는 컬럼 (DEFAULT CURRENT_TIMESTAMP 등) 은 맨 뒤에만 두고 INSERT 에서 빠진다.
+namespace eosio { namespace schema {
+
+    struct u64 {
+        static constexpr bool insertable = true;
+        static constexpr const char* sql() { return "BIGINT UNSIGNED"; }
+        template<typename String>
+        static void append(String& out, const uint64_t v) { fast_encode::append_uint(out, v); }
+    };
+    struct u32 {
+        static constexpr bool insertable = true;
+        static constexpr const char* sql() { return "INT UNSIGNED"; }
+        template<typename String>
+        static void append(String& out, const uint64_t v) { fast_encode::append_uint(out, v); }
+    };
+    struct u8 {
+        static constexpr bool insertable = true;
+        static constexpr const char* sql() { return "TINYINT UNSIGNED"; }
+        template<typename String>
+        static void append(String& out, const uint64_t v) { fast_encode::append_uint(out, v); }
+    };
+    struct i64 {
+        static constexpr bool insertable = true;
+        static constexpr const char* sql() { return "BIGINT"; }
+        template<typename String>
+        static void append(String& out, const int64_t v) { fast_encode::append_int(out, v); }
+    };
+    struct u128 {
+        static constexpr bool insertable = true;
+        static constexpr const char* sql() { return "DECIMAL(39,0) UNSIGNED"; }
+        template<typename String>
+        static void append(String& out, const unsigned __int128 v) { fast_encode::append_u128(out, v); }
+    };
+    // raw name value
+    struct name {
+        static constexpr bool insertable = true;
+        static constexpr const char* sql() { return "VARCHAR(13)"; }
+        template<typename String>
+        static void append(String& out, const uint64_t v) {
+            out += '\'';
+            fast_encode::append_name(out, v);
+            out += '\'';
+        }
+    };
+    // symbol 이름 (A-Z 만이라 escape 불필요)
+    struct symbol {
+        static constexpr bool insertable = true;
+        static constexpr const char* sql() { return "VARCHAR(7)"; }
+        template<typename String>
+        static void append(String& out, const std::string& v) {
+            out += '\'';
+            out.append(v.data(), v.size());
+            out += '\'';
+        }
+    };
+    // plugin 내부 상수 key. 외부 입력을 넣지 않는다.
+    struct key {
+        static constexpr bool insertable = true;
+        static constexpr const char* sql() { return "VARCHAR(32)"; }
+        template<typename String>
+        static void append(String& out, const std::string& v) {
+            out += '\'';
+            out.append(v.data(), v.size());
+            out += '\'';
+        }
+    };
+    // unix seconds
+    struct datetime {
+        static constexpr bool insertable = true;
+        static constexpr const char* sql() { return "DATETIME"; }
+        template<typename String>
+        static void append(String& out, const int64_t v) {
+            out += "FROM_UNIXTIME(";
+            fast_encode::append_int(out, v);
+            out += ')';
+        }
+    };
+    // N 바이트를 소문자 hex 문자열로 (transaction id 등)
+    template<size_t N>
+    struct hex {
+        static constexpr bool insertable = true;
+        static constexpr const char* sql() { return N == 32 ? "CHAR(64)" : N == 20 ? "CHAR(40)" : "VARCHAR(255)"; }
+        template<typename String>
+        static void append(String& out, const void* v) {
+            out += '\'';
+            fast_encode::append_hex(out, v, N);
+            out += '\'';
+        }
+    };
+    struct bytes {
+        const void* data;
+        size_t size;
+    };
+    struct blob {
+        static constexpr bool insertable = true;
+        static constexpr const char* sql() { return "BLOB"; }
+        template<typename String>
+        static void append(String& out, const bytes& v) {
+            out += "X'";
+            fast_encode::append_hex(out, v.data, v.size);
+            out += '\'';
+        }
+    };
+    // DB 가 채우는 시각. 값 없음.
+    struct now {
+        static constexpr bool insertable = false;
+        static constexpr const char* sql() { return "TIMESTAMP"; }
+    };
+
+    template<typename Type>
+    struct column {
+        const char* name;
+        const char* constraint;
+    };
+
+    namespace detail {
+        template<typename... Types> struct value_columns;
+        template<> struct value_columns<> {
+            static constexpr size_t count = 0;
+            static constexpr bool trailing = true;
+        };
+        template<typename Head, typename... Tail> struct value_columns<Head, Tail...> {
+            static constexpr size_t count = (Head::insertable ? 1 : 0) + value_columns<Tail...>::count;
+            static constexpr bool trailing = Head::insertable ? value_columns<Tail...>::trailing : value_columns<Tail...>::count == 0;
+        };
+
+        inline void append_quoted(std::string& out, const char* name) {
+            out += '`';
+            out += name;
+            out += '`';
+        }
+    }
+
+    template<typename... Types>
+    class table {
+        public:
+            static constexpr size_t value_count = detail::value_columns<Types...>::count;
+            static_assert(detail::value_columns<Types...>::trailing, "columns without a value must come last");
+
+            constexpr table(const char* name, const char* keys, column<Types>... columns) :
+                _name(name), _keys(keys), _columns(columns...) {}
+
+            constexpr const char* name() const { return _name; }
+
+            // suffix 는 ENGINE 뒤 (PARTITION BY ...)
+            std::string create_sql(const std::string& suffix = std::string()) const {
+                std::string out = "CREATE TABLE IF NOT EXISTS ";
+                detail::append_quoted(out, _name);
+                out += " (";
+                append_definitions(out, std::index_sequence_for<Types...>());
+                out += _keys;
+                out += ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4";
+                out += suffix;
+                return out;
+            }
+
+            std::string drop_sql() const {
+                std::string out = "DROP TABLE IF EXISTS ";
+                detail::append_quoted(out, _name);
+                return out;
+            }
+
+            // "INSERT IGNORE INTO `t` (`a`, `b`) VALUES "
+            std::string insert_sql(const char* verb = "INSERT") const {
+                std::string out = verb;
+                out += " INTO ";
+                detail::append_quoted(out, _name);
+                out += " (";
+                append_names(out, std::make_index_sequence<value_count>());
+                out += ") VALUES ";
+                return out;
+            }
+
+            // rows 뒤에 "(v1, v2, ...)" 를 붙인다. 비어있지 않으면 앞에 ','.
+            template<typename String, typename... Values>
+            void append_row(String& rows, const Values&... values) const {
+                static_assert(sizeof...(Values) == value_count, "value count does not match the table columns");
+                if (!rows.empty()) rows += ',';
+                rows += '(';
+                append_values(rows, std::index_sequence_for<Values...>(), values...);
+                rows += ')';
+            }
+
+        private:
+            template<size_t I>
+            using type_at = typename std::tuple_element<I, std::tuple<Types...>>::type;
+
+            template<size_t... I>
+            void append_definitions(std::string& out, std::index_sequence<I...>) const {
+                int expand[] = { 0, (append_definition<I>(out), 0)... };
+                (void)expand;
+            }
+            template<size_t I>
+            void append_definition(std::string& out) const {
+                const auto& c = std::get<I>(_columns);
+                detail::append_quoted(out, c.name);
+                out += ' ';
+                out += type_at<I>::sql();
+                out += ' ';
+                out += c.constraint;
+                out += ", ";
+            }
+
+            template<size_t... I>
+            void append_names(std::string& out, std::index_sequence<I...>) const {
+                int expand[] = { 0, ((I ? out += ", " : out), detail::append_quoted(out, std::get<I>(_columns).name), 0)... };
+                (void)expand;
+            }
+
+            template<typename String, size_t... I, typename... Values>
+            void append_values(String& out, std::index_sequence<I...>, const Values&... values) const {
+                int expand[] = { 0, ((I ? out += ", " : out), type_at<I>::append(out, values), 0)... };
+                (void)expand;
+            }
+
+            const char* _name;
+            const char* _keys;
+            std::tuple<column<Types>...> _columns;
+    };
+} }
+
+#endif
@@ -0,0 +1,217 @@
+#include "token_aggregates.hpp"
+#include "fast_encode.hpp"
+#include "ledger_schema.hpp"
+#include "ledger_table.hpp"
+
+#include <eosio/chain/symbol.hpp>
+
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace eosio {
+
+extern void post_query_str_to_queue(const std::string query_str, const uint32_t block_num = 0, const uint32_t shard = 0);
+
+static const std::string AGGREGATES_UPSERT_STR = schema::token_aggregates.insert_sql();
+static const std::string AGGREGATES_UPDATE_STR =
+    " ON DUPLICATE KEY UPDATE `precision` = VALUES(`precision`), `volume` = VALUES(`volume`), "
+    "`transfers` = VALUES(`transfers`), `unique_senders` = VALUES(`unique_senders`), "
+    "`sender_sketch` = VALUES(`sender_sketch`), `last_block` = VALUES(`last_block`)";
+
+static inline std::string symbol_string(const uint64_t symbol_code) {
+    return chain::symbol(symbol_code << 8).name();
+}
+
+token_aggregates::token_aggregates(std::shared_ptr<connection_pool> pool, uint32_t bucket_seconds, uint32_t flush_seconds) :
+m_pool(pool), _bucket_seconds(bucket_seconds ? bucket_seconds : 86400), _flush_seconds(flush_seconds ? flush_seconds : 1)
+{
+    _loader = std::thread([this] { run(); });
+}
+
+token_aggregates::~token_aggregates()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _stop = true;
+    }
+    _load_cond.notify_all();
+    if (_loader.joinable()) _loader.join();
+}
+
+// trace thread. 부분합에 더하기만 하고 DB 는 읽지 않는다.
+void token_aggregates::on_ledger_event(const ledger_event& e) {
+    if (!e.from) return;   // create
+
+    const uint32_t start = e.block_time - e.block_time % _bucket_seconds;
+    const bucket_key key{e.contract, e.symbol_code(), start};
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (start > _newest_start) _newest_start = start;
+    auto& slot = _buckets[key];
+    if (!slot) {
+        slot.reset(new bucket());
+        _loads.push_back(key);
+        _load_cond.notify_one();
+    }
+    auto& b = *slot;
+    if (b.loaded && e.block_num <= b.last_block) return;
+
+    auto& p = b.partials[e.block_num];
+    p.precision = e.precision();
+    p.volume += static_cast<uint64_t>(e.amount);
+    p.transfers++;
+    p.senders.push_back(e.from);
+}
+
+void token_aggregates::run() {
+    std::unique_lock<std::mutex> lock(_mtx);
+    while (!_stop) {
+        if (_loads.empty()) {
+            _load_cond.wait(lock);
+            continue;
+        }
+        const bucket_key key = _loads.front();
+        _loads.pop_front();
+        lock.unlock();
+
+        bucket row;
+        const bool ok = load(key, row);
+
+        lock.lock();
+        auto itr = _buckets.find(key);
+        if (itr == _buckets.end()) continue;
+        if (!ok) {
+            // DB 가 돌아올 때까지 그 bucket 은 부분합으로만 쌓인다.
+            _loads.push_back(key);
+            _load_cond.wait_for(lock, std::chrono::seconds(1));
+            continue;
+        }
+        auto& b = *itr->second;
+        b.loaded = true;
+        b.precision = row.precision;
+        b.volume = row.volume;
+        b.transfers = row.transfers;
+        b.senders = row.senders;
+        b.last_block = row.last_block;
+        b.partials.erase(b.partials.begin(), b.partials.upper_bound(b.last_block));
+    }
+}
+
+bool token_aggregates::load(const bucket_key& key, bucket& b) {
+    std::string sql = "SELECT `precision`, `volume`, `transfers`, `sender_sketch`, `last_block` FROM token_aggregates WHERE `contract_owner` = '";
+    fast_encode::append_name(sql, std::get<0>(key));
+    sql += "' AND `symbol` = '";
+    sql += symbol_string(std::get<1>(key));
+    sql += "' AND `bucket_seconds` = ";
+    fast_encode::append_uint(sql, _bucket_seconds);
+    sql += " AND `bucket_start` = FROM_UNIXTIME(";
+    fast_encode::append_uint(sql, std::get<2>(key));
+    sql += ")";
+
+    bool ok = true;
+    shared_ptr<MysqlConnection> con = m_pool->get_connection();
+    assert(con);
+    try {
+        con->scan(sql, [&](const MysqlRowView& row) {
+            b.precision = static_cast<uint8_t>(row.get_uint(0));
+            b.volume = row.get_uint128(1);
+            b.transfers = row.get_uint(2);
+            b.senders.merge_raw(row.get_data(3), row.get_length(3));
+            b.last_block = static_cast<uint32_t>(row.get_uint(4));
+            return false;
+        }, MysqlData::Mode::Store);
+    } catch (...) {
+        elog("unable to load token aggregate, sql = ${s}", ("s", sql));
+        ok = false;
+    }
+    m_pool->release_connection(*con);
+    return ok;
+}
+
+void token_aggregates::tick(const int64_t) {
+    {
+        // 미루는 동안에도 부분합은 합쳐 둔다. (sender 목록이 쌓이지 않도록)
+        std::lock_guard<std::mutex> lock(_mtx);
+        merge(_extracted);
+    }
+    if (++_ticks < _flush_seconds || _deferred) return;
+    _ticks = 0;
+    flush();
+}
+
+void token_aggregates::merge(const uint32_t upto) {
+    for (auto& itr : _buckets) {
+        auto& b = *itr.second;
+        if (!b.loaded) continue;
+        const auto last = b.partials.upper_bound(upto);
+        for (auto p = b.partials.begin(); p != last; ++p) {
+            b.precision = p->second.precision;
+            b.volume += p->second.volume;
+            b.transfers += p->second.transfers;
+            for (const auto sender : p->second.senders) b.senders.add(sender);
+            b.dirty = true;
+            if (!_merged_from || p->first < _merged_from) _merged_from = p->first;
+        }
+        b.partials.erase(b.partials.begin(), last);
+        if (upto > b.last_block) b.last_block = upto;
+    }
+}
+
+void token_aggregates::flush() {
+    const uint32_t upto = _extracted;
+    std::string rows;
+    uint32_t complete = upto;
+    uint32_t merged_from = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        merge(upto);
+        for (auto& itr : _buckets) {
+            auto& b = *itr.second;
+            // 읽는 중인 bucket 의 부분합은 아직 어디에도 없다.
+            if (!b.loaded) {
+                if (!b.partials.empty()) complete = std::min(complete, b.partials.begin()->first - 1);
+                continue;
+            }
+            if (!b.dirty) continue;
+            b.dirty = false;
+
+            schema::token_aggregates.append_row(rows, std::get<0>(itr.first), symbol_string(std::get<1>(itr.first)),
+                _bucket_seconds, std::get<2>(itr.first), b.precision, b.volume, b.transfers, b.senders.estimate(),
+                schema::bytes{b.senders.data(), b.senders.size()}, b.last_block);
+        }
+        evict(_newest_start);
+
+        if (rows.empty() && complete <= _recorded_block) return;
+        if (complete > _recorded_block) _recorded_block = complete;
+        if (!rows.empty()) merged_from = _merged_from;
+        _merged_from = 0;
+    }
+
+    // 합친 가장 낮은 block 으로 태그한다. 실패하면 shard 0 의 checkpoint 가 그 아래에 머물러 다음 시작이 다시 받는다.
+    std::string sql = ledger_table::state_sql("aggregates_block", complete);
+    if (!rows.empty()) sql = AGGREGATES_UPSERT_STR + rows + AGGREGATES_UPDATE_STR + "; " + sql;
+    post_query_str_to_queue(sql, merged_from, 0);
+}
+
+// 지난 bucket 은 더 이상 바뀌지 않으므로 기록한 뒤 메모리에서 뺀다. 
+void token_aggregates::evict(const uint32_t newest_start) {
+    for (auto itr = _buckets.begin(); itr != _buckets.end(); ) {
+        const uint32_t start = std::get<2>(itr->first);
+        const auto& b = *itr->second;
+        if (b.loaded && !b.dirty && b.partials.empty() && start + 2 * static_cast<uint64_t>(_bucket_seconds) <= newest_start)
+            itr = _buckets.erase(itr);
+        else
+            ++itr;
+    }
+}
+
+size_t token_aggregates::bucket_count() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _buckets.size();
+}
+
+}
@@ -0,0 +1,94 @@
+#ifndef TOKEN_AGGREGATES_H
+#define TOKEN_AGGREGATES_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "connection_pool.h"
+#include "hyperloglog.hpp"
+#include "ledger_event.hpp"
+
+namespace eosio {
+    // (contract, symbol, 시간 bucket) 별 transfer volume / count / 고유 sender 수를 메모리에서 누적하고
+    // 주기적으로 token_aggregates 테이블에 절대값으로 upsert 한다. 대시보드가 ledger 를 GROUP BY 하지 않도록.
+    //
+    //  - worker 마다 이벤트가 순서 없이 오므로 bucket 마다 block 별 부분합으로 받아 두고
+    //    extracted watermark 이하만 합친다. 저장된 last_block 은 그 block 까지의 이벤트가 모두 들어 있다는 뜻.
+    //  - 처음 만지는 bucket 의 기존 값 (sketch 포함) 은 별도 thread 가 읽는다. 그 동안 이벤트는 부분합에 쌓인다.
+    //    읽어온 last_block 이하는 이미 반영된 것으로 보고 버린다 (재시작 / replay).
+    //  - upsert 와 같은 statement 로 ledger_state 의 aggregates_block (모든 bucket 이 반영된 block) 을 쓴다.
+    //    재시작은 shard checkpoint 와 이것 중 낮은 곳부터.
+    class token_aggregates : public ledger_event_sink {
+        public:
+            token_aggregates(std::shared_ptr<connection_pool> pool, uint32_t bucket_seconds, uint32_t flush_seconds);
+            virtual ~token_aggregates();
+
+            virtual void on_ledger_event(const ledger_event& e) override;
+            virtual void tick(const int64_t tick) override;
+
+            // tick 전에. 이 block 까지의 이벤트는 모두 받았다. (ingest_watermarks 의 extracted)
+            void set_extracted(const uint32_t block_num) { _extracted = block_num; }
+
+            // 바뀐 bucket 을 모두 queue 에 올린다. 아직 읽는 중인 bucket 은 다음에.
+            void flush();
+
+            // 부하가 높을 때 주기적인 upsert 를 미룬다. 누적은 계속하고, 풀리면 절대값으로 한 번에 쓴다.
+            void set_deferred(const bool deferred) { _deferred = deferred; }
+
+            size_t bucket_count() const;
+
+        private:
+            using bucket_key = std::tuple<uint64_t, uint64_t, uint32_t>;   // contract, symbol code, bucket start
+
+            struct partial {
+                uint8_t  precision = 0;
+                unsigned __int128 volume = 0;
+                uint64_t transfers = 0;
+                std::vector<uint64_t> senders;
+            };
+
+            struct bucket {
+                bool     loaded = false;
+                uint8_t  precision = 0;
+                unsigned __int128 volume = 0;
+                uint64_t transfers = 0;
+                uint32_t last_block = 0;     // 이 block 까지 합쳤다
+                hyperloglog<12> senders;
+                bool dirty = false;
+                std::map<uint32_t, partial> partials;   // block ->, last_block 위의 것만
+            };
+
+            void run();
+            bool load(const bucket_key& key, bucket& b);
+            // _mtx 를 잡고. upto 이하 부분합을 합친다.
+            void merge(const uint32_t upto);
+            void evict(const uint32_t newest_start);
+
+            std::shared_ptr<connection_pool> m_pool;
+            uint32_t _bucket_seconds;
+            uint32_t _flush_seconds;
+            uint32_t _ticks = 0;
+            std::atomic<bool> _deferred{false};
+            std::atomic<uint32_t> _extracted{0};
+            uint32_t _recorded_block = 0;       // 마지막으로 queue 에 올린 aggregates_block
+            uint32_t _merged_from = 0;          // 지난 flush 뒤 합친 가장 낮은 block
+
+            mutable std::mutex _mtx;
+            std::map<bucket_key, std::unique_ptr<bucket>> _buckets;
+            uint32_t _newest_start = 0;
+
+            // 읽을 bucket. 실패하면 뒤로 다시.
+            std::deque<bucket_key> _loads;
+            std::condition_variable _load_cond;
+            bool _stop = false;
+            std::thread _loader;
+    };
+}
+#endif
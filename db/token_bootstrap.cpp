@@ -0,0 +1,215 @@
+#include "token_bootstrap.hpp"
+#include "ledger_schema.hpp"
+#include "mysqlconn.h"
+
+#include <eosio/chain/account_object.hpp>
+#include <eosio/chain/asset.hpp>
+#include <eosio/chain/contract_table_objects.hpp>
+
+#include <fc/io/datastream.hpp>
+#include <fc/io/raw.hpp>
+
+namespace eosio {
+
+static const std::string TOKENS_BOOTSTRAP_STR = schema::tokens.insert_sql();
+static const std::string TOKENS_BOOTSTRAP_UPDATE_STR =
+    " ON DUPLICATE KEY UPDATE amount = VALUES(amount), `precision` = VALUES(`precision`)";
+static const std::string TOKENLIST_BOOTSTRAP_STR = schema::tokenlist.insert_sql();
+static const std::string TOKENLIST_BOOTSTRAP_UPDATE_STR =
+    " ON DUPLICATE KEY UPDATE issuer = VALUES(issuer), maximum_supply = VALUES(maximum_supply)";
+
+token_bootstrap::token_bootstrap(std::shared_ptr<shard_router> router, std::shared_ptr<balance_store> balances, 
+        uint32_t thread_count, uint32_t batch_rows) :
+m_router(router), m_balances(balances), _thread_count(thread_count ? thread_count : 1), _batch_rows(batch_rows ? batch_rows : 1),
+balance_sql(router->size()), balance_count(router->size(), 0)
+{
+
+}
+
+token_bootstrap::~token_bootstrap()
+{
+
+}
+
+uint32_t token_bootstrap::run(const chain::controller& chain) {
+    const uint32_t block_num = chain.head_block_num();
+    ilog("bootstrap tokens from chain state at block ${b}", ("b", block_num));
+
+    for (uint32_t i = 0; i < _thread_count; i++) {
+        _threads.emplace_back([this] { consume_batches(); });
+    }
+
+    const auto& table_idx = chain.db().get_index<chain::table_id_multi_index, chain::by_code_scope_table>();
+
+    // (code, scope, table) 순서이므로 contract 단위로 건너뛰며 한번만 ABI 를 검사한다. 
+    for (auto itr = table_idx.begin(); itr != table_idx.end(); ) {
+        const chain::account_name code = itr->code;
+        try {
+            scan_contract(chain, code);
+        } catch (fc::exception& e) {
+            wlog("bootstrap skip ${c}: ${e}", ("c", code)("e", e.to_string()));
+        } catch (std::exception& e) {
+            wlog("bootstrap skip ${c}: ${e}", ("c", code)("e", e.what()));
+        }
+        itr = table_idx.upper_bound(boost::make_tuple(code));
+    }
+
+    for (uint32_t shard = 0; shard < m_router->size(); shard++) post_balance_batch(shard);
+    post_tokenlist_batch();
+
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _done = true;
+    }
+    _cond.notify_all();
+    for (auto& t : _threads) t.join();
+    _threads.clear();
+
+    ilog("bootstrap done. balances: ${b}, tokens: ${t}, failed batches: ${f}",
+        ("b", total_balances)("t", total_tokens)("f", failed_batches));
+    EOS_ASSERT( failed_batches == 0, chain::plugin_exception, "token bootstrap failed to load ${f} batches", ("f", failed_batches) );
+
+    return block_num;
+}
+
+void token_bootstrap::scan_contract(const chain::controller& chain, const chain::account_name& code) {
+    const auto& db = chain.db();
+
+    const auto* account = db.find<chain::account_object, chain::by_name>(code);
+    if (!account || account->abi.size() == 0) return;
+    if (!is_standard_token_abi(account->get_abi())) return;
+
+    const auto& table_idx = db.get_index<chain::table_id_multi_index, chain::by_code_scope_table>();
+    const auto& kv_idx = db.get_index<chain::key_value_index, chain::by_scope_primary>();
+
+    auto t_itr = table_idx.lower_bound(boost::make_tuple(code));
+    for (; t_itr != table_idx.end() && t_itr->code == code; ++t_itr) {
+        const bool is_accounts = t_itr->table == N(accounts);
+        const bool is_stat = t_itr->table == N(stat);
+        if (!is_accounts && !is_stat) continue;
+
+        auto itr = kv_idx.lower_bound(boost::make_tuple(t_itr->id));
+        auto end = kv_idx.upper_bound(boost::make_tuple(t_itr->id));
+        for (; itr != end; ++itr) {
+            fc::datastream<const char*> ds(itr->value.data(), itr->value.size());
+
+            if (is_accounts) {
+                chain::asset balance;
+                fc::raw::unpack(ds, balance);
+                if (m_balances) 
+                    m_balances->set(t_itr->scope.value, code.value, balance.get_symbol().value(), balance.get_amount());
+
+                add_balance_row(t_itr->scope.value, code.value, balance);
+            } else {
+                chain::asset supply;
+                chain::asset max_supply;
+                chain::account_name issuer;
+                fc::raw::unpack(ds, supply);
+                fc::raw::unpack(ds, max_supply);
+                fc::raw::unpack(ds, issuer);
+
+                add_tokenlist_row(code.value, issuer.value, max_supply);
+            }
+        }
+    }
+}
+
+// eosio.token 과 같은 레이아웃인지. accounts: {balance:asset}, stat: {supply:asset, max_supply:asset, issuer:name}
+bool token_bootstrap::is_standard_token_abi(const chain::abi_def& abi) {
+    auto find_struct = [&](const chain::table_name& table) -> const chain::struct_def* {
+        for (const auto& t : abi.tables) {
+            if (t.name != table) continue;
+            for (const auto& s : abi.structs) {
+                if (s.name == t.type && s.base.empty()) return &s;
+            }
+        }
+        return nullptr;
+    };
+    auto is_name = [](const chain::type_name& type) {
+        return type == "name" || type == "account_name";
+    };
+
+    const auto* account = find_struct(N(accounts));
+    if (!account || account->fields.size() != 1 || account->fields[0].type != "asset") 
+        return false;
+
+    const auto* stat = find_struct(N(stat));
+    if (!stat || stat->fields.size() != 3 
+            || stat->fields[0].type != "asset" 
+            || stat->fields[1].type != "asset" 
+            || !is_name(stat->fields[2].type)) 
+        return false;
+
+    return true;
+}
+
+void token_bootstrap::add_balance_row(const uint64_t account, const uint64_t contract, const chain::asset& balance) {
+    const uint32_t shard = m_router->account_shard(account);
+    schema::tokens.append_row(balance_sql[shard], account, contract, balance.get_symbol().name(), balance.get_amount(), balance.decimals());
+    total_balances++;
+    if (++balance_count[shard] >= _batch_rows) 
+        post_balance_batch(shard);
+}
+
+void token_bootstrap::add_tokenlist_row(const uint64_t contract, const uint64_t issuer, const chain::asset& max_supply) {
+    schema::tokenlist.append_row(tokenlist_sql, contract, max_supply.get_symbol().name(), issuer, max_supply.decimals(), max_supply.get_amount());
+    total_tokens++;
+    if (++tokenlist_count >= _batch_rows) 
+        post_tokenlist_batch();
+}
+
+void token_bootstrap::post_balance_batch(const uint32_t shard) {
+    if (!balance_count[shard]) return;
+    post_batch(shard, TOKENS_BOOTSTRAP_STR + balance_sql[shard] + TOKENS_BOOTSTRAP_UPDATE_STR);
+    balance_sql[shard].clear();
+    balance_count[shard] = 0;
+}
+
+void token_bootstrap::post_tokenlist_batch() {
+    if (!tokenlist_count) return;
+    post_batch(0, TOKENLIST_BOOTSTRAP_STR + tokenlist_sql + TOKENLIST_BOOTSTRAP_UPDATE_STR);
+    tokenlist_sql.clear();
+    tokenlist_count = 0;
+}
+
+void token_bootstrap::post_batch(const uint32_t shard, std::string sql) {
+    std::unique_lock<std::mutex> lock(_mtx);
+    // 스캔이 적재보다 빠르므로 메모리가 무한정 늘지 않도록 대기. 
+    _cond.wait(lock, [this] { return _batches.size() < _thread_count * 4; });
+    _batches.emplace_back(shard, std::move(sql));
+    lock.unlock();
+    _cond.notify_all();
+}
+
+void token_bootstrap::consume_batches() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(_mtx);
+        _cond.wait(lock, [this] { return !_batches.empty() || _done; });
+        if (_batches.empty()) break;
+
+        const uint32_t shard = _batches.front().first;
+        std::string sql = std::move(_batches.front().second);
+        _batches.pop_front();
+        lock.unlock();
+        _cond.notify_all();
+
+        const auto& pool = m_router->pool(shard);
+        shared_ptr<MysqlConnection> con = pool->get_connection();
+        assert(con);
+        bool ok = false;
+        try {
+            ok = con->execute(sql, true);
+            if (!ok) elog("bootstrap batch failed: ${e}", ("e", con->lastError()));
+        } catch (...) {
+            ok = false;
+        }
+        pool->release_connection(*con);
+
+        if (!ok) {
+            std::lock_guard<std::mutex> fail_lock(_mtx);
+            failed_batches++;
+        }
+    }
+}
+
+}
@@ -0,0 +1,66 @@
+#ifndef TOKEN_BOOTSTRAP_H
+#define TOKEN_BOOTSTRAP_H
+
+#include <eosio/chain/asset.hpp>
+#include <eosio/chain/controller.hpp>
+#include <eosio/chain/types.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "balance_store.hpp"
+#include "shard_router.hpp"
+
+namespace eosio {
+    // chainbase 의 accounts / stat 테이블을 스캔해서 tokens, tokenlist 를 한번에 채운다.
+    // 스캔은 main thread (일관된 블록) 에서, 적재는 worker thread 들이 병렬로.
+    // tokens 는 account 의 shard 로, tokenlist 는 primary 로.
+    class token_bootstrap {
+        public:
+            token_bootstrap(std::shared_ptr<shard_router> router, std::shared_ptr<balance_store> balances, 
+                uint32_t thread_count, uint32_t batch_rows);
+            ~token_bootstrap();
+
+            // 스캔한 블록 번호를 리턴. 
+            uint32_t run(const chain::controller& chain);
+
+            // eosio.token 과 같은 accounts / stat 레이아웃인지. (balance_verifier 도 같은 contract 만 본다)
+            static bool is_standard_token_abi(const chain::abi_def& abi);
+
+        private:
+            void scan_contract(const chain::controller& chain, const chain::account_name& code);
+
+            void add_balance_row(const uint64_t account, const uint64_t contract, const chain::asset& balance);
+            void add_tokenlist_row(const uint64_t contract, const uint64_t issuer, const chain::asset& max_supply);
+            void post_balance_batch(const uint32_t shard);
+            void post_tokenlist_batch();
+
+            void post_batch(const uint32_t shard, std::string sql);
+            void consume_batches();
+
+            std::shared_ptr<shard_router> m_router;
+            std::shared_ptr<balance_store> m_balances;
+
+            uint32_t _thread_count;
+            uint32_t _batch_rows;
+
+            std::vector<std::string> balance_sql;      // shard 마다
+            std::vector<uint32_t> balance_count;
+            std::string tokenlist_sql;
+            uint32_t tokenlist_count = 0;
+
+            uint64_t total_balances = 0;
+            uint64_t total_tokens = 0;
+            uint64_t failed_batches = 0;
+
+            std::mutex _mtx;
+            std::condition_variable _cond;
+            std::deque<std::pair<uint32_t, std::string>> _batches;     // shard, sql
+            std::vector<std::thread> _threads;
+            bool _done = false;
+    };
+}
+#endif
@@ -0,0 +1,179 @@
+#include "worker_pool.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+namespace eosio {
+
+static uint64_t steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+worker_pool::worker_pool()
+{
+
+}
+
+worker_pool::~worker_pool() {
+    stop();
+}
+
+void worker_pool::add_stage(const std::string& name, const uint32_t threads, step_fn step) {
+    stage s;
+    s.name = name;
+    s.threads = threads;
+    s.step = std::move(step);
+    _stages.push_back(std::move(s));
+}
+
+uint32_t worker_pool::worker_count() const {
+    uint32_t count = 0;
+    for (const auto& s : _stages) count += s.threads;
+    return count;
+}
+
+void worker_pool::start() {
+    _start_ns = steady_ns();
+
+    uint32_t index = 0;
+    for (uint32_t s = 0; s < _stages.size(); s++) {
+        for (uint32_t i = 0; i < _stages[s].threads; i++) {
+            auto w = std::make_unique<worker>();
+            w->index = index;
+            w->home = s;
+            if (!_cpus.empty()) w->cpu = _cpus[index % _cpus.size()];
+            _workers.push_back(std::move(w));
+            index++;
+        }
+    }
+    _running = static_cast<uint32_t>(_workers.size());
+    for (auto& w : _workers) {
+        worker* p = w.get();
+        p->thread = std::thread([this, p] { run(*p); _running--; });
+    }
+}
+
+void worker_pool::notify() {
+    _cv.notify_one();
+}
+
+void worker_pool::stop() {
+    request_stop();
+    join();
+}
+
+void worker_pool::request_stop() {
+    _stopping = true;
+    _cv.notify_all();
+}
+
+void worker_pool::join() {
+    for (auto& w : _workers) {
+        if (w->thread.joinable()) w->thread.join();
+    }
+}
+
+// 자기 stage 먼저, 그 다음 우선순위 순으로 다른 stage.
+bool worker_pool::pass(worker& w) {
+    for (uint32_t i = 0; i <= _stages.size(); i++) {
+        const uint32_t s = i == 0 ? w.home : i - 1;
+        if (i > 0 && s == w.home) continue;
+
+        const uint64_t begin = steady_ns();
+        if (_stages[s].step(w.index)) {
+            w.busy_ns += steady_ns() - begin;
+            w.steps++;
+            if (s != w.home) w.stolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void worker_pool::run(worker& w) {
+    if (w.cpu >= 0) pin_current_thread({w.cpu});
+
+    while (true) {
+        if (pass(w)) continue;
+        if (_stopping) break;
+
+        // producer 가 notify 하지만, 놓쳐도 오래 자지 않도록.
+        std::unique_lock<std::mutex> lock(_mtx);
+        _cv.wait_for(lock, std::chrono::milliseconds(10));
+    }
+
+    // 남은 버퍼를 내보내고, 그로 인해 생긴 일까지 비운다.
+    if (_exit_hook) _exit_hook(w.index);
+    while (pass(w)) {}
+}
+
+std::vector<worker_pool::worker_stats> worker_pool::stats() const {
+    std::vector<worker_stats> out;
+    const uint64_t elapsed = steady_ns() - _start_ns;
+    for (const auto& w : _workers) {
+        worker_stats s;
+        s.worker = w->index;
+        s.stage = _stages[w->home].name;
+        s.cpu = w->cpu;
+        s.busy_us = w->busy_ns / 1000;
+        s.elapsed_us = elapsed / 1000;
+        s.steps = w->steps;
+        s.stolen = w->stolen;
+        out.push_back(s);
+    }
+    return out;
+}
+
+std::vector<int> worker_pool::parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item.erase(std::remove_if(item.begin(), item.end(), ::isspace), item.end());
+        if (item.empty()) continue;
+        const auto dash = item.find('-');
+        const int first = std::stoi(item.substr(0, dash));
+        const int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+        for (int c = first; c <= last; c++) cpus.push_back(c);
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+std::vector<int> worker_pool::numa_node_cpus(const uint32_t node) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list;
+    if (!in || !std::getline(in, list)) return {};
+    return parse_cpu_list(list);
+}
+
+std::vector<int> worker_pool::online_cpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &set)) cpus.push_back(c);
+        }
+    }
+    return cpus;
+}
+
+bool worker_pool::pin_current_thread(const std::vector<int>& cpus) {
+    if (cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int c : cpus) {
+        if (c >= 0 && c < CPU_SETSIZE) CPU_SET(c, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+}
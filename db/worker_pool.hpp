@@ -0,0 +1,93 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace eosio {
+    // plugin 의 작업 thread 를 한 곳에서. stage 마다 thread 수를 정하고, 자기 stage 가 비면 다른 stage 일을 가져간다.
+    //
+    //  - stage 는 step(worker) 하나. 일을 했으면 true. 등록 순서가 우선순위.
+    //  - thread 는 cpu 집합 (명시, NUMA node, 예약 cpu 제외) 에 하나씩 고정할 수 있다.
+    //  - stop() 은 모든 stage 가 빌 때까지 처리한 뒤 끝낸다. 끝나기 직전 exit hook (남은 버퍼 flush 등) 을 부른다.
+    class worker_pool {
+        public:
+            using step_fn = std::function<bool(const uint32_t worker)>;
+            using exit_fn = std::function<void(const uint32_t worker)>;
+
+            struct worker_stats {
+                uint32_t worker = 0;
+                std::string stage;
+                int32_t  cpu = -1;
+                uint64_t busy_us = 0;
+                uint64_t elapsed_us = 0;
+                uint64_t steps = 0;
+                uint64_t stolen = 0;     // 자기 stage 가 아닌 일
+            };
+
+            worker_pool();
+            ~worker_pool();
+
+            void add_stage(const std::string& name, const uint32_t threads, step_fn step);
+            void set_exit_hook(exit_fn hook) { _exit_hook = std::move(hook); }
+
+            // 비어있으면 고정하지 않는다.
+            void set_cpus(const std::vector<int>& cpus) { _cpus = cpus; }
+
+            uint32_t worker_count() const;
+            void start();
+            void notify();
+            void stop();
+            // stop() 을 둘로. 종료 진행을 지켜보며 기다릴 때.
+            void request_stop();
+            void join();
+            // 아직 끝나지 않은 thread 수
+            uint32_t running() const { return _running; }
+
+            std::vector<worker_stats> stats() const;
+
+            // "0-3,8,10-11" 형식
+            static std::vector<int> parse_cpu_list(const std::string& list);
+            static std::vector<int> numa_node_cpus(const uint32_t node);
+            static std::vector<int> online_cpus();
+            static bool pin_current_thread(const std::vector<int>& cpus);
+
+        private:
+            struct stage {
+                std::string name;
+                uint32_t threads = 0;
+                step_fn step;
+            };
+            struct worker {
+                uint32_t index = 0;
+                uint32_t home = 0;
+                int32_t  cpu = -1;
+                std::thread thread;
+                std::atomic<uint64_t> busy_ns{0};
+                std::atomic<uint64_t> steps{0};
+                std::atomic<uint64_t> stolen{0};
+            };
+
+            void run(worker& w);
+            bool pass(worker& w);
+
+            std::vector<stage> _stages;
+            std::vector<std::unique_ptr<worker>> _workers;
+            std::vector<int> _cpus;
+            exit_fn _exit_hook;
+
+            std::mutex _mtx;
+            std::condition_variable _cv;
+            std::atomic<bool> _stopping{false};
+            std::atomic<uint32_t> _running{0};
+            uint64_t _start_ns = 0;
+    };
+}
+#endif
@@ -11,6 +11,156 @@ namespace eosio {
 
 using ledger_plugin_impl_ptr = std::shared_ptr<class ledger_plugin_impl>;
 
+namespace ledger_apis {
+   struct get_balances_params {
+      std::vector<chain::account_name> accounts;
+      chain::account_name              code;       // 비어있으면 전체 contract
+      std::string                      symbol;     // 비어있으면 전체 symbol
+   };
+
+   struct balance_row {
+      chain::account_name account;
+      chain::account_name code;
+      std::string         symbol;
+      uint8_t             precision = 0;
+      int64_t             amount = 0;
+   };
+
+   struct get_balances_result {
+      std::vector<balance_row> rows;
+   };
+
+   struct get_transfers_params {
+      chain::account_name account;
+      uint32_t            limit = 20;
+      uint64_t            before = 0;      // 이 action_id 보다 오래된 것부터 (다음 페이지). 0 이면 최신부터
+      uint32_t            before_block = 0;   // before 의 block. DB 조회를 이 block 이하로 자른다. 0 이면 제한 없음
+   };
+
+   struct transfer_row {
+      uint64_t                   action_id = 0;
+      uint32_t                   block_num = 0;
+      fc::time_point_sec         block_time;
+      chain::account_name        contract;
+      chain::account_name        from;
+      chain::account_name        to;
+      chain::asset               quantity;
+      chain::transaction_id_type transaction_id;
+   };
+
+   struct get_transfers_result {
+      std::vector<transfer_row> rows;      // 최신부터
+      uint64_t    next_before = 0;         // 다음 페이지의 before. 0 이면 더 없음
+      uint32_t    next_before_block = 0;   // 다음 페이지의 before_block
+      uint32_t    memory_rows = 0;
+      uint32_t    database_rows = 0;
+   };
+
+   struct worker_row {
+      uint32_t    worker = 0;
+      std::string stage;
+      int32_t     cpu = -1;            // -1 이면 고정 안 함
+      double      utilization = 0;     // 0 ~ 1
+      uint64_t    steps = 0;
+      uint64_t    stolen = 0;          // 다른 stage 에서 가져온 일
+      uint64_t    actions = 0;         // 이 worker 의 table 이 처리한 action
+      uint64_t    arena_bytes = 0;     // batch arena 크기
+      uint64_t    arena_peak = 0;      // batch 하나에서 가장 많이 쓴 byte
+      uint64_t    arena_growths = 0;      // arena 가 힙에서 chunk 를 받은 횟수
+      uint64_t    decode_fallbacks = 0;   // variant 로 푼 action
+      double      fallback_rate = 0;      // decode_fallbacks / actions
+   };
+
+   struct get_workers_result {
+      std::vector<worker_row> workers;
+      uint64_t    query_roundtrips = 0;    // pipeline 사용 시
+      uint64_t    query_statements = 0;
+      uint64_t    query_failed = 0;
+      uint32_t    async_connections = 0;   // 0 이면 blocking query thread
+      uint64_t    async_pending = 0;
+      uint64_t    async_completed = 0;
+      uint64_t    async_failed = 0;
+      uint64_t    tokens_failed = 0;       // 실패해 다시 시도한 tokens statement
+      uint64_t    tokens_half_applied = 0; // 그 중 반대쪽 shard 는 반영된 transfer
+   };
+
+   struct watermark {
+      uint32_t    block_num = 0;
+      int64_t     updated_at = 0;      // ms
+   };
+
+   struct memory_component {
+      std::string name;
+      uint64_t    bytes = 0;
+      uint64_t    peak = 0;
+   };
+
+   struct get_memory_result {
+      uint64_t    budget = 0;              // 0 이면 집계만
+      uint64_t    used = 0;
+      uint64_t    peak = 0;
+      std::string level;                   // normal, flush, spill, throttle
+      std::vector<memory_component> components;
+      uint64_t    trims = 0;               // flush 단계에서 table 버퍼를 비운 tick 수
+      uint64_t    overflow_statements = 0; // spill 단계에서 파일로 보낸 statement
+      uint64_t    overflow_pending = 0;    // 그 중 아직 다시 읽지 않은 것
+      uint64_t    throttled = 0;           // 메모리 때문에 chain thread 를 재운 횟수
+   };
+
+   struct verify_balances_params {
+      bool        resume = true;           // 지난번 resume 파일의 account 부터
+   };
+
+   struct verify_balances_result {
+      std::string state;                   // idle, waiting, running, done, stopped
+      uint32_t    snapshot_block = 0;
+      std::string start_account;
+      std::string resume_account;
+      uint64_t    balances = 0;
+      uint32_t    chunks = 0;
+      uint32_t    chunks_done = 0;
+      uint64_t    rows_compared = 0;
+      uint64_t    mismatched = 0;
+      uint64_t    missing = 0;             // chain 에만 있음
+      uint64_t    extra = 0;               // tokens 에만 있음
+      uint64_t    changed = 0;             // 기준 block 뒤에 바뀌어 건너뜀
+      uint64_t    corrections = 0;
+      uint64_t    failed_queries = 0;
+   };
+
+   struct get_lag_result {
+      watermark   applied;             // chain 에서 받은 block
+      watermark   extracted;           // trace 처리 완료
+      watermark   queued;              // row 가 모두 query queue 로
+      watermark   committed;           // DB 반영 완료
+      uint32_t    lag_blocks = 0;
+      int64_t     lag_ms = 0;
+      uint32_t    shed_level = 0;      // 0 정상, 1 aggregates 미룸, 2 bulk 확대, 3 actions_accounts 생략
+      bool        throttled = false;   // queue 가 차서 chain thread 를 재우는 중
+      uint64_t    skipped_accounts = 0;
+   };
+
+   struct shard_row {
+      uint32_t    shard = 0;
+      std::string host;
+      uint16_t    port = 0;
+      uint32_t    committed_block = 0; // 이 shard 로 가는 statement 가 모두 실행된 block
+      uint32_t    failed_block = 0;    // 버린 statement 중 가장 낮은 block. committed_block 은 이 아래에 머문다
+   };
+
+   // tokens, actions_accounts : shard_router::jump_hash(account, shards.size())
+   // ledger                   : (block_number / range_blocks) % shards.size()
+   struct get_shards_result {
+      uint32_t    range_blocks = 0;
+      std::vector<shard_row> shards;
+   };
+
+   struct dump_trace_result {
+      std::string file;
+      uint64_t    spans = 0;
+   };
+}
+
 class ledger_plugin : public plugin<ledger_plugin> {
 public:
    APPBASE_PLUGIN_REQUIRES((chain_plugin))
@@ -29,3 +179,24 @@ private:
 };
 
 }
+
+FC_REFLECT( eosio::ledger_apis::get_balances_params, (accounts)(code)(symbol) )
+FC_REFLECT( eosio::ledger_apis::balance_row, (account)(code)(symbol)(precision)(amount) )
+FC_REFLECT( eosio::ledger_apis::get_balances_result, (rows) )
+FC_REFLECT( eosio::ledger_apis::get_transfers_params, (account)(limit)(before)(before_block) )
+FC_REFLECT( eosio::ledger_apis::transfer_row, (action_id)(block_num)(block_time)(contract)(from)(to)(quantity)(transaction_id) )
+FC_REFLECT( eosio::ledger_apis::get_transfers_result, (rows)(next_before)(next_before_block)(memory_rows)(database_rows) )
+FC_REFLECT( eosio::ledger_apis::watermark, (block_num)(updated_at) )
+FC_REFLECT( eosio::ledger_apis::memory_component, (name)(bytes)(peak) )
+FC_REFLECT( eosio::ledger_apis::get_memory_result, (budget)(used)(peak)(level)(components)(trims)(overflow_statements)(overflow_pending)(throttled) )
+FC_REFLECT( eosio::ledger_apis::verify_balances_params, (resume) )
+FC_REFLECT( eosio::ledger_apis::verify_balances_result, (state)(snapshot_block)(start_account)(resume_account)(balances)(chunks)(chunks_done)
+            (rows_compared)(mismatched)(missing)(extra)(changed)(corrections)(failed_queries) )
+FC_REFLECT( eosio::ledger_apis::get_lag_result, (applied)(extracted)(queued)(committed)(lag_blocks)(lag_ms)(shed_level)(throttled)(skipped_accounts) )
+FC_REFLECT( eosio::ledger_apis::shard_row, (shard)(host)(port)(committed_block)(failed_block) )
+FC_REFLECT( eosio::ledger_apis::get_shards_result, (range_blocks)(shards) )
+FC_REFLECT( eosio::ledger_apis::dump_trace_result, (file)(spans) )
+FC_REFLECT( eosio::ledger_apis::worker_row, (worker)(stage)(cpu)(utilization)(steps)(stolen)
+            (actions)(arena_bytes)(arena_peak)(arena_growths)(decode_fallbacks)(fallback_rate) )
+FC_REFLECT( eosio::ledger_apis::get_workers_result, (workers)(query_roundtrips)(query_statements)(query_failed)(async_connections)(async_pending)(async_completed)(async_failed)
+            (tokens_failed)(tokens_half_applied) )
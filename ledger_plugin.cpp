@@ -3,6 +3,9 @@
  *  @copyright defined in eos/LICENSE.txt
  */
 #include <eosio/ledger_plugin/ledger_plugin.hpp>
+#include <eosio/http_plugin/http_plugin.hpp>
+#include <eosio/chain/account_object.hpp>
+#include <eosio/chain/block_state.hpp>
 #include <eosio/chain/eosio_contract.hpp>
 #include <eosio/chain/config.hpp>
 #include <eosio/chain/exceptions.hpp>
@@ -14,17 +17,40 @@
 #include <fc/variant.hpp>
 
 #include <boost/chrono.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/signals2/connection.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
 
+#include <mysqld_error.h>
+
+#include <algorithm>
+#include <limits>
 #include <queue>
 #include <sstream>
+#include <tuple>
 
 #include <future>
 
+#include "balance_file.hpp"
+#include "balance_store.hpp"
+#include "balance_verifier.hpp"
+#include "dedup_filter.hpp"
+#include "event_stream.hpp"
+#include "extraction_rules.hpp"
+#include "ingest_watermarks.hpp"
+#include "ledger_segment.hpp"
 #include "ledger_table.hpp"
+#include "memory_governor.hpp"
+#include "recent_history.hpp"
+#include "shard_router.hpp"
+#include "span_tracer.hpp"
+#include "spill_file.hpp"
+#include "token_aggregates.hpp"
+#include "token_bootstrap.hpp"
+#include "worker_pool.hpp"
 
 namespace fc { class variant; }
 
@@ -49,44 +75,133 @@ const int64_t get_now_tick() {
 class ledger_plugin_impl;
 static ledger_plugin_impl* static_ledger_plugin_impl = nullptr; 
 
+void post_query_str_to_queue(const std::string query_str, const uint32_t block_num = 0, const uint32_t shard = 0);
+
+static fc::optional<chain::abi_def> chain_abi_resolver( const chain::account_name& account ) {
+   chain_plugin* chain_plug = app().find_plugin<chain_plugin>();
+   EOS_ASSERT( chain_plug, chain::missing_chain_plugin_exception, ""  );
+   const auto* account_obj = chain_plug->chain().db().find<chain::account_object, chain::by_name>( account );
+   if( !account_obj || account_obj->abi.size() == 0 ) return fc::optional<chain::abi_def>();
+   return account_obj->get_abi();
+}
+
+static uint64_t chain_abi_sequence( const chain::account_name& account ) {
+   chain_plugin* chain_plug = app().find_plugin<chain_plugin>();
+   EOS_ASSERT( chain_plug, chain::missing_chain_plugin_exception, ""  );
+   const auto* seq_obj = chain_plug->chain().db().find<chain::account_sequence_object, chain::by_name>( account );
+   return seq_obj ? seq_obj->abi_sequence : 0;
+}
+
 class ledger_plugin_impl : public std::enable_shared_from_this<ledger_plugin_impl>{
    public:
       ledger_plugin_impl(boost::asio::io_service& io);
       ~ledger_plugin_impl();
 
       fc::optional<boost::signals2::scoped_connection> applied_transaction_connection;
+      fc::optional<boost::signals2::scoped_connection> accepted_block_connection;
       
-      void consume_query_process();
-      void consume_applied_transactions();
-
+      bool query_step( const uint32_t worker );
+      bool pipeline_step();
+      bool spill_step();
+      void start_spill();
+      bool spill_statement( const std::string& sql, const uint32_t block_num, const uint32_t shard );
+      void drain();
+      void replay_spill( const std::string& path );
+      bool overflow( const std::string& sql, const uint32_t block_num, const uint32_t shard );
+      void refill_from_overflow();
+      void update_memory();
+      ledger_apis::get_memory_result get_memory() const;
+      ledger_apis::verify_balances_result start_verify( const ledger_apis::verify_balances_params& params );
+      ledger_apis::verify_balances_result get_verify() const;
+      bool trace_step( const uint32_t worker );
+      void start_workers( const variables_map& options );
+      ledger_apis::get_workers_result get_workers() const;
+      ledger_apis::get_lag_result get_lag() const;
+      void update_admission( const int64_t tick );
+      void update_shard_checkpoints();
+      void record_live_start();
+      void statement_committed( const uint32_t shard, const uint32_t block_num );
+      // 실행도 spill 도 못 하고 버린 statement. 그 shard 의 checkpoint 가 이 block 을 넘지 않는다.
+      void statement_failed( const uint32_t shard, const uint32_t block_num );
+      ledger_apis::get_shards_result get_shards() const;
+
+      // chain thread. trace 는 block 이 accept 될 때까지 모아 두었다가 그 block 의 receipt 순서로 queue 에 넣는다.
       void applied_transaction(const chain::transaction_trace_ptr&);
+      void accepted_block(const chain::block_state_ptr&);
+      void queue_trace(const chain::transaction_trace_ptr&);
       void process_applied_transaction(std::unique_ptr<ledger_table>& t_ledger_table, const chain::transaction_trace_ptr&);
 
-      void process_add_ledger( std::unique_ptr<ledger_table>& t_ledger_table, const chain::action_trace& atrace );
+      void process_add_ledger( std::unique_ptr<ledger_table>& t_ledger_table, const chain::action_trace& atrace, 
+         uint32_t& action_index, uint64_t& max_global_sequence );
+      void write_final_checkpoints();
+      void commit_balance_file();
 
       void init(const std::string host, const std::string user, const std::string passwd, const std::string database, 
          const uint16_t port, const uint16_t max_conn, bool do_close_on_unlock, uint32_t block_num_start, const variables_map& options);
       void wipe_database();
+      void bootstrap_tokens();
+      void load_balances();
+      void register_api();
+
+      std::unique_ptr<ledger_table> make_ledger_table();
+
+      ledger_apis::get_balances_result get_balances( const ledger_apis::get_balances_params& params ) const;
+      ledger_apis::get_transfers_result get_transfers( const ledger_apis::get_transfers_params& params );
+      void query_transfers( const uint64_t account, const uint64_t before, const uint32_t before_block, const uint32_t limit, 
+         std::vector<ledger_apis::transfer_row>& rows );
+      // http handler 에서. MySQL 을 읽는 요청은 transfer_query_thread 에서 실행하고 응답은 main thread 로 돌려 보낸다.
+      void post_transfer_query( std::function<void()> job );
+      void run_transfer_queries();
+      void stop_transfer_queries();
 
       void tick_loop_process(); 
 
-      template<typename Queue, typename Entry> void queue(boost::mutex& mtx, Queue& queue, const Entry& e);
+      template<typename Queue, typename Entry> void queue(boost::mutex& mtx, Queue& queue, const Entry& e, const size_t limit, const bool throttle);
 
       bool configured{false};
       bool wipe_database_on_startup{false};
+      bool bootstrap_tokens_on_startup{false};
+      uint32_t bootstrap_batch_rows = 1000;
       uint32_t start_block_num = 0;
       uint32_t end_block_num = 0;
       bool start_block_reached = false;
+      // shard checkpoint 중 가장 낮은 block. 이하의 trace 는 이미 모든 shard 에 커밋되어 있다. (chain thread)
+      uint32_t resume_block = 0;
+      uint64_t resume_skipped = 0;
+      bool end_block_reached = false;
       bool is_producer = false;
 
-      std::deque<std::string> query_queue; 
+      // enqueued_ns 는 tracing 중일 때만 채운다. (queue_wait span)
+      struct queued_query {
+         std::string sql;
+         uint64_t enqueued_ns = 0;
+         uint32_t block_num = 0;      // 담긴 row 의 가장 낮은 block. 0 이면 watermark 에 안 잡힌다.
+         uint32_t shard = 0;
+      };
+
+      std::deque<queued_query> query_queue; 
       std::deque<chain::transaction_trace_ptr> transaction_trace_queue;
 
       boost::mutex mtx_query;
       boost::mutex mtx_applied_trans;
-      boost::condition_variable condition;
-      std::vector<boost::thread> consume_query_threads;
-      std::vector<boost::thread> consume_applied_trans_threads;
+      std::unique_ptr<worker_pool> m_workers;
+      std::vector<std::unique_ptr<ledger_table>> m_worker_tables;   // worker 마다 하나
+      boost::thread balance_commit_thread;
+
+      std::deque<std::function<void()>> transfer_queries;
+      boost::mutex mtx_transfer_queries;
+      boost::condition_variable cond_transfer_queries;
+      bool transfer_queries_stop = false;
+      boost::thread transfer_query_thread;
+
+      // trace thread 는 snapshot 을 가져와 처리를 마칠 때까지 shared 로 잡는다.
+      // exclusive 로 잡으면 처리 중인 snapshot 이 없으므로 applied_global_sequence 이하가 모두 반영된 상태.
+      boost::shared_mutex mtx_trace_barrier;
+      boost::atomic<uint64_t> applied_global_sequence{0};
+      // 이번 실행에서 처음 queue 에 넣은 trace 의 block (chain thread 가 한 번 쓴다).
+      // 모든 실행 중 가장 낮은 것을 ledger_state 의 live_start_block 으로. ledger_ingest 는 그 앞만 채운다.
+      boost::atomic<uint32_t> first_applied_block{0};
+      uint32_t live_start_block = 0;
       // boost::thread consume_thread_applied_trans;
 
       boost::atomic<bool> done{false};
@@ -97,8 +212,63 @@ class ledger_plugin_impl : public std::enable_shared_from_this<ledger_plugin_imp
       /**
        * database connection
        */
-      std::shared_ptr<connection_pool> m_connection_pool;
+      std::shared_ptr<connection_pool> m_connection_pool;     // primary (shard 0)
+      std::shared_ptr<shard_router> m_router;
+      std::vector<uint32_t> shard_checkpoints;                 // shard 마다 마지막으로 기록한 committed block
+      uint32_t shard_checkpoint_ticks = 0;
+      std::vector<uint32_t> pruned_blocks;                     // shard 마다 tokens_applied 를 이 block 까지 지웠다
+      std::unique_ptr<MysqlAsyncEngine> m_async;      // 설정 시 query 는 여기로
+      boost::atomic<uint64_t> async_completed{0};
+      boost::atomic<uint64_t> async_failed{0};
+
+      // 0 이 아니면 blocking query thread 가 queue 에서 이 크기까지 모아 한 번의 왕복으로 보낸다.
+      size_t pipeline_bytes = 0;
+      boost::atomic<uint64_t> query_roundtrips{0};
+      boost::atomic<uint64_t> query_statements{0};
+      boost::atomic<uint64_t> query_failed{0};
+
+      // 종료 시한. 지나면 남은 statement 는 DB 대신 spill 파일로, 다음 시작 때 먼저 실행한다.
+      uint32_t shutdown_deadline_ms = 30000;
+      uint32_t db_timeout_sec = 60;
+      std::string spill_path;
+      std::unique_ptr<spill_file> m_spill;
+      boost::atomic<bool> spilling{false};
+
+      // plugin 버퍼 전체의 byte 예산. spill 단계부터 새 statement 는 overflow 파일로, query_queue 가 비면 조금씩 다시 읽는다.
+      std::shared_ptr<memory_governor> m_memory;
+      std::string overflow_path;
+      std::unique_ptr<spill_file> m_overflow;
+      uint64_t overflow_offset = 0;          // 여기까지 다시 읽었다. <overflow>.offset 에도. mtx_query
+      boost::atomic<uint64_t> overflow_pending{0};   // 파일에 있고 아직 안 읽은 statement. 바꾸는 것은 mtx_query 를 잡고
+      size_t overflow_chunk_bytes = 4 << 20;
+      uint32_t memory_level = 0;             // 마지막으로 알린 단계. tick 에서만
+      boost::atomic<uint64_t> memory_trims{0};
+      boost::atomic<uint64_t> overflow_statements{0};
+      boost::atomic<uint64_t> memory_throttled{0};
       std::shared_ptr<ledger_table> m_ledger_table;
+      std::unique_ptr<dedup_filter> m_dedup;
+      // 다음 accept 될 block 의 trace (chain thread 만). 같은 transaction 은 나중 것 (block 을 적용할 때의 것) 이 남는다.
+      std::map<chain::transaction_id_type, chain::transaction_trace_ptr> cached_traces;
+      chain::transaction_trace_ptr onblock_trace;
+      std::shared_ptr<const extraction_rules> m_rules;
+      std::shared_ptr<balance_store> m_balances;
+      std::shared_ptr<balance_file> m_balance_file;
+      std::shared_ptr<event_stream> m_event_stream;
+      std::shared_ptr<ledger_segment_writer> m_segments;
+      std::shared_ptr<token_aggregates> m_aggregates;
+      std::shared_ptr<recent_history> m_history;
+      std::shared_ptr<balance_verifier> m_verifier;
+      bool verify_on_startup = false;
+      std::vector<int> chain_thread_cpus;    // plugin_startup 뒤 main thread 를 여기에 고정. 비어 있으면 안 함
+      std::string transfer_actions_sql;      // transfer 규칙의 action 이름. get_transfers 의 DB 조회용
+      std::vector<std::shared_ptr<ledger_event_sink>> m_sinks;   // 모든 ledger_table 이 공유
+
+      // lag 이 target 을 넘으면 단계적으로 덜 중요한 일을 줄인다. 마지막은 기존처럼 queue() 에서 chain thread 를 재운다.
+      ingest_watermarks watermarks;
+      uint32_t lag_target_ms = 5000;
+      boost::atomic<uint32_t> shed_level{0};
+      uint32_t shed_calm_ticks = 0;
+      uint32_t balance_commit_ms = 1000;
       std::string system_account;
 
       uint32_t m_block_num_start;
@@ -109,21 +279,28 @@ class ledger_plugin_impl : public std::enable_shared_from_this<ledger_plugin_imp
 
       uint32_t ledger_raw_ag_count = 10;
       uint32_t ledger_acc_ag_count = 12;
+      uint32_t partition_blocks = 10000000;
+      uint32_t dedup_window = 100000;
+      uint32_t max_balance_query_accounts = 1000;
+      uint32_t max_transfer_query_rows = 1000;
+      std::string trace_file;
+
 
       boost::asio::deadline_timer  _timer;
 
 };
 
 template<typename Queue, typename Entry>
-void ledger_plugin_impl::queue(boost::mutex& mtx, Queue& queue, const Entry& e ) {
+void ledger_plugin_impl::queue(boost::mutex& mtx, Queue& queue, const Entry& e, const size_t limit, const bool throttle ) {
    boost::mutex::scoped_lock lock( mtx );
    auto queue_size = queue.size();
-   if( queue_size > max_queue_size ) {
+   if( queue_size > limit || throttle ) {
       lock.unlock();
-      condition.notify_one();
+      if( m_workers ) m_workers->notify();
+      if( throttle ) memory_throttled++;
       queue_sleep_time += 10;
       if( queue_sleep_time > 1000 )
-         wlog("queue size: ${q}", ("q", queue_size));
+         wlog("queue size: ${q}, memory ${m} bytes", ("q", queue_size)("m", m_memory->get_usage().total));
       boost::this_thread::sleep_for( boost::chrono::milliseconds( queue_sleep_time ));
       lock.lock();
    } else {
@@ -132,75 +309,151 @@ void ledger_plugin_impl::queue(boost::mutex& mtx, Queue& queue, const Entry& e )
    }
    queue.emplace_back( e );
    lock.unlock();
-   condition.notify_one();
+   if( m_workers ) m_workers->notify();
+}
+
+// 대략. trace 구조체와 action data 만 센다. (trace 는 바뀌지 않으므로 놓을 때 다시 세도 같다)
+static uint64_t trace_bytes( const std::vector<chain::action_trace>& traces ) {
+   uint64_t bytes = 0;
+   for( const auto& a : traces ) {
+      bytes += sizeof(a) + a.act.data.size() + a.console.size() +
+               a.act.authorization.size() * sizeof(chain::permission_level) + trace_bytes( a.inline_traces );
+   }
+   return bytes;
+}
+
+static uint64_t trace_bytes( const chain::transaction_trace_ptr& t ) {
+   return sizeof(*t) + trace_bytes( t->action_traces );
+}
+
+static bool is_onblock( const chain::transaction_trace& t ) {
+   if( t.action_traces.size() != 1 ) return false;
+   const auto& act = t.action_traces[0].act;
+   return act.account == chain::config::system_account_name && act.name == N(onblock);
 }
 
+// speculative 실행이나 pending block 의 trace 도 여기로 온다. block_num / global_sequence 는 그 block 이 
+// 버려지면 다른 action 에 다시 쓰이므로, 실제로 accept 된 block 에 들어간 것만 받는다.
 void ledger_plugin_impl::applied_transaction( const chain::transaction_trace_ptr& t ) {
+   if( !t->receipt ) return;
+   if( is_onblock( *t )) onblock_trace = t;
+   else if( t->failed_dtrx_trace ) cached_traces[t->failed_dtrx_trace->id] = t;
+   else cached_traces[t->id] = t;
+}
+
+void ledger_plugin_impl::accepted_block( const chain::block_state_ptr& bsp ) {
+   try {
+      auto accept = [&]( const chain::transaction_trace_ptr& t ) {
+         // fork 전환으로 같은 block 이 다시 accept 되면 한 번만
+         if( m_dedup->is_duplicate( t->id.data(), bsp->id.data() )) return;
+         queue_trace( t );
+      };
+      if( onblock_trace ) accept( onblock_trace );
+      for( const auto& r : bsp->block->transactions ) {
+         const auto id = r.trx.contains<chain::transaction_id_type>() ? r.trx.get<chain::transaction_id_type>() 
+                                                                      : r.trx.get<chain::packed_transaction>().id();
+         auto itr = cached_traces.find( id );
+         if( itr != cached_traces.end() ) accept( itr->second );
+      }
+   } catch (fc::exception& e) {
+      elog("FC Exception while accepted_block ${e}", ("e", e.to_string()));
+   } catch (std::exception& e) {
+      elog("STD Exception while accepted_block ${e}", ("e", e.what()));
+   } catch (...) {
+      elog("Unknown exception while accepted_block");
+   }
+   cached_traces.clear();
+   onblock_trace.reset();
+   // 그 block 의 trace 는 모두 queue 에 들어갔다. extracted 는 여기까지만.
+   watermarks.accepted( bsp->block_num );
+}
+
+void ledger_plugin_impl::queue_trace( const chain::transaction_trace_ptr& t ) {
    try {
       if( !start_block_reached ) {
          if( t->block_num >= start_block_num ) {
             start_block_reached = true;
          }
       }
+      if( end_block_num > 0 && t->block_num > end_block_num ) {
+         if( !end_block_reached ) {
+            end_block_reached = true;
+            ilog("ledger end block ${b} reached, stop collecting", ("b", end_block_num));
+         }
+         return;
+      }
+      if( t->block_num > 0 && t->block_num <= resume_block ) {
+         if( !resume_skipped++ ) ilog("skipping traces up to committed block ${b}", ("b", resume_block));
+         return;
+      }
       if(t->block_num > 0 && start_block_reached){
-         queue( mtx_applied_trans, transaction_trace_queue, t );
+         if( !first_applied_block ) first_applied_block = t->block_num;
+         watermarks.applied( t->block_num, get_now_tick() );
+         watermarks.extract_begin( t->block_num );
+         m_memory->reserve( memory_governor::component::trace_queue, trace_bytes( t ));
+         queue( mtx_applied_trans, transaction_trace_queue, t, max_trace_size,
+            m_memory->at_least( memory_governor::level::throttle ));
       }
    } catch (fc::exception& e) {
-      elog("FC Exception while applied_transaction ${e}", ("e", e.to_string()));
+      elog("FC Exception while queue_trace ${e}", ("e", e.to_string()));
    } catch (std::exception& e) {
-      elog("STD Exception while applied_transaction ${e}", ("e", e.what()));
+      elog("STD Exception while queue_trace ${e}", ("e", e.what()));
    } catch (...) {
-      elog("Unknown exception while applied_transaction");
+      elog("Unknown exception while queue_trace");
    }
 }
 
-void ledger_plugin_impl::consume_applied_transactions() {
+// trace batch 하나. 자기 table 로 처리하므로 어느 worker 가 가져가도 된다.
+bool ledger_plugin_impl::trace_step( const uint32_t worker ) {
+   auto& t_ledger_table = m_worker_tables[worker];
    std::deque<chain::transaction_trace_ptr> transaction_trace_process_queue;
-   std::unique_ptr<ledger_table> t_ledger_table = std::make_unique<ledger_table>(m_connection_pool, ledger_raw_ag_count, ledger_acc_ag_count);
 
    try {
-      while (true) {
-         boost::mutex::scoped_lock lock(mtx_applied_trans);
-         while ( transaction_trace_queue.empty() &&
-                 !done ) {
-            condition.wait(lock);
-         }
+      boost::mutex::scoped_lock lock(mtx_applied_trans);
+      if( transaction_trace_queue.empty() ) {
+         lock.unlock();
+         // 쌓아둔 row 는 한동안 새 trace 가 없어도 내보낸다.
+         t_ledger_table->tick( get_now_tick() );
+         return false;
+      }
+      lock.unlock();
 
-         // capture for processing
-         size_t transaction_trace_size = transaction_trace_queue.size();
-         if (transaction_trace_size > 0) {
-            transaction_trace_process_queue = move(transaction_trace_queue);
-            transaction_trace_queue.clear();
-         }
+      boost::shared_lock<boost::shared_mutex> barrier(mtx_trace_barrier);
+      lock.lock();
 
-         lock.unlock();
+      // capture for processing
+      size_t transaction_trace_size = transaction_trace_queue.size();
+      if (transaction_trace_size > 0) {
+         transaction_trace_process_queue = move(transaction_trace_queue);
+         transaction_trace_queue.clear();
+      }
 
-         // warn if queue size greater than 75%
-         if( transaction_trace_size > (max_queue_size * 0.75)) {
-            wlog("queue size: ${q}", ("q", transaction_trace_size));
-         } else if (done) {
-            ilog("draining queue, size: ${q}", ("q", transaction_trace_size));
-         }
+      lock.unlock();
 
-         // process transactions
-         auto start_time = fc::time_point::now();
-         auto size = transaction_trace_process_queue.size();
-         while (!transaction_trace_process_queue.empty()) {
-            const auto& t = transaction_trace_process_queue.front();
-            process_applied_transaction(t_ledger_table, t);
-            transaction_trace_process_queue.pop_front();
-         }
-         auto time = fc::time_point::now() - start_time;
-         auto per = size > 0 ? time.count()/size : 0;
-         if( time > fc::microseconds(500000) ) // reduce logging, .5 secs
-            ilog( "process_applied_transaction, time per: ${p}, size: ${s}, time: ${t}", ("s", size)( "t", time )( "p", per ));
+      if( transaction_trace_size == 0 ) return false;
 
-         if( transaction_trace_size == 0 &&
-             done ) {
-            break;
-         }
+      // warn if queue size greater than 75%
+      if( transaction_trace_size > (max_trace_size * 0.75)) {
+         wlog("queue size: ${q}", ("q", transaction_trace_size));
+      } else if (done) {
+         ilog("draining queue, size: ${q}", ("q", transaction_trace_size));
       }
-      ilog("mysql_db_plugin consume thread shutdown gracefully");
+
+      // process transactions
+      auto start_time = fc::time_point::now();
+      auto size = transaction_trace_process_queue.size();
+      while (!transaction_trace_process_queue.empty()) {
+         const auto& t = transaction_trace_process_queue.front();
+         process_applied_transaction(t_ledger_table, t);
+         watermarks.extract_end( t->block_num );
+         m_memory->release( memory_governor::component::trace_queue, trace_bytes( t ));
+         transaction_trace_process_queue.pop_front();
+      }
+      barrier.unlock();
+      auto time = fc::time_point::now() - start_time;
+      auto per = size > 0 ? time.count()/size : 0;
+      if( time > fc::microseconds(500000) ) // reduce logging, .5 secs
+         ilog( "process_applied_transaction, time per: ${p}, size: ${s}, time: ${t}", ("s", size)( "t", time )( "p", per ));
    } catch (fc::exception& e) {
       elog("FC Exception while consuming block ${e}", ("e", e.to_string()));
    } catch (std::exception& e) {
@@ -208,83 +461,406 @@ void ledger_plugin_impl::consume_applied_transactions() {
    } catch (...) {
       elog("Unknown exception while consuming block");
    }
+   // 예외로 끝나도 batch 는 닫는다. 안 그러면 arena 가 다음 batch 까지 이어져 계속 커진다.
+   try {
+      t_ledger_table->end_batch();
+   } catch (...) {
+      elog("Unknown exception while ending trace batch");
+   }
+   // 예외로 남은 trace 도 watermark 에서는 지나간 것으로.
+   for( const auto& t : transaction_trace_process_queue ) {
+      watermarks.extract_end( t->block_num );
+      m_memory->release( memory_governor::component::trace_queue, trace_bytes( t ));
+   }
+   return true;
+}
+
+bool ledger_plugin_impl::query_step( const uint32_t ) {
+   try {
+      // 커넥션마다 두 개까지만 쌓는다. 나머지는 query_queue 에 남겨 queue() 의 backpressure 가 걸리도록.
+      if( spilling ) return spill_step();
+      if( m_async && m_async->pending() >= 2 * m_async->connectionCount() ) return false;
+      if( !m_async && pipeline_bytes ) return pipeline_step();
+
+      boost::mutex::scoped_lock lock(mtx_query);
+      if( query_queue.empty() ) refill_from_overflow();
+      if( query_queue.empty() ) return false;
+
+      // capture for processing
+      m_memory->release( memory_governor::component::query_queue, query_queue.front().sql.size() );
+      std::string query_str = std::move(query_queue.front().sql); 
+      const uint64_t enqueued_ns = query_queue.front().enqueued_ns;
+      const uint32_t block_num = query_queue.front().block_num;
+      const uint32_t shard = query_queue.front().shard;
+      query_queue.pop_front(); 
+
+      lock.unlock();
+
+      span_tracer::sample_scope sample( 0 );
+      if( sample.sampled() && enqueued_ns ) 
+         span_tracer::scope::record( "queue_wait", enqueued_ns, span_tracer::now_ns() );
+
+      if( m_async ) {
+         const std::string sql = query_str;
+         m_async->submit( std::move(query_str), [this, sql, block_num, shard]( const bool ok, const my_ulonglong, const std::string& error ) {
+            if( ok ) {
+               statement_committed( shard, block_num );
+               async_completed++;
+            } else {
+               statement_failed( shard, block_num );
+               async_failed++;
+               elog("async query failed: ${e}", ("e", error));
+               ilog("sql = ${s}",("s",sql));
+            }
+            if( m_workers ) m_workers->notify();
+         });
+         return true;
+      }
+
+      const auto& pool = m_router->pool( shard );
+      shared_ptr<MysqlConnection> con = pool->get_connection();
+      assert(con);
+      bool ok = false;
+      try{
+         span_tracer::scope span( "mysql_roundtrip" );
+         ok = con->execute(query_str, true);
+         pool->release_connection(*con);
+      } catch (...) {
+         ilog("sql = ${s}",("s",query_str));
+         pool->release_connection(*con);
+      }
+      // 시한이 지나 DB 를 더 기다리지 않게 된 뒤 실패한 것은 다음 시작 때 실행하도록.
+      if( ok || ( spilling && spill_statement( query_str, block_num, shard )))
+         statement_committed( shard, block_num );
+      else
+         statement_failed( shard, block_num );
+   } catch (...) {
+      elog("Unknown exception while consuming query");
+   }
+   return true;
 }
 
-void ledger_plugin_impl::consume_query_process() {
+// statement 들을 한 packet 으로. 실패한 statement 는 기록하고 버리며 (한 개씩 보낼 때와 같게), 
+// 그 뒤로 실행되지 않은 statement 는 다시 보낸다. 한 packet 은 같은 shard 로 가는 연속된 statement 만.
+bool ledger_plugin_impl::pipeline_step() {
+   std::vector<std::string> statements;
+   std::vector<uint32_t> blocks;
+   uint64_t enqueued_ns = 0;
+   uint32_t shard = 0;
+   {
+      boost::mutex::scoped_lock lock(mtx_query);
+      if( query_queue.empty() ) refill_from_overflow();
+      if( query_queue.empty() ) return false;
+
+      enqueued_ns = query_queue.front().enqueued_ns;
+      shard = query_queue.front().shard;
+      size_t bytes = 0;
+      while( !query_queue.empty() ) {
+         auto& q = query_queue.front();
+         if( q.shard != shard ) break;
+         if( !statements.empty() && bytes + q.sql.size() + 1 > pipeline_bytes ) break;
+         bytes += q.sql.size() + 1;
+         blocks.push_back( q.block_num );
+         statements.push_back( std::move(q.sql) );
+         query_queue.pop_front();
+      }
+      m_memory->release( memory_governor::component::query_queue, bytes - statements.size() );
+   }
+
    try {
-      while (true) {
-         boost::mutex::scoped_lock lock(mtx_query);
-         while ( query_queue.empty() && !done ) {
-            condition.wait(lock);
+      span_tracer::sample_scope sample( 0 );
+      if( sample.sampled() && enqueued_ns ) 
+         span_tracer::scope::record( "queue_wait", enqueued_ns, span_tracer::now_ns() );
+
+      const auto& pool = m_router->pool( shard );
+      shared_ptr<MysqlConnection> con = pool->get_connection();
+      assert(con);
+      size_t next = 0;
+      while( next < statements.size() ) {
+         size_t done = 0;
+         {
+            span_tracer::scope span( "mysql_roundtrip" );
+            done = con->execPipeline( statements, next );
          }
-         
-         // capture for processing
-         size_t query_queue_count = query_queue.size(); 
-         std::string query_str = "";
-         if (query_queue_count > 0) {
-            query_str = query_queue.front(); 
-            query_queue.pop_front(); 
+         query_roundtrips++;
+         query_statements += done;
+         for( size_t i = next; i < next + done; i++ ) statement_committed( shard, blocks[i] );
+         next += done;
+
+         if( next < statements.size() ) {
+            elog("pipelined query failed: ${e}", ("e", con->lastError()));
+            ilog("sql = ${s}",("s",statements[next]));
+            query_failed++;
+            if( spilling && spill_statement( statements[next], blocks[next], shard ))
+               statement_committed( shard, blocks[next] );
+            else
+               statement_failed( shard, blocks[next] );
+            next++;
          }
+      }
+      pool->release_connection(*con);
+   } catch (...) {
+      elog("Unknown exception while consuming query");
+   }
+   return true;
+}
 
-         lock.unlock();
+// 시한이 지난 뒤의 query stage. 순서대로 파일에 붙이기만 하므로 DB 상태와 상관없이 바로 끝난다.
+bool ledger_plugin_impl::spill_step() {
+   std::deque<queued_query> pending;
+   {
+      boost::mutex::scoped_lock lock(mtx_query);
+      if( query_queue.empty() ) refill_from_overflow();
+      if( query_queue.empty() ) return false;
+      pending = std::move(query_queue);
+      query_queue.clear();
+   }
+   for( const auto& q : pending ) {
+      m_memory->release( memory_governor::component::query_queue, q.sql.size() );
+      if( spill_statement( q.sql, q.block_num, q.shard ))
+         statement_committed( q.shard, q.block_num );
+      else
+         statement_failed( q.shard, q.block_num );
+   }
+   return true;
+}
 
-         if (query_queue_count > 0) {
-            shared_ptr<MysqlConnection> con = m_connection_pool->get_connection();
-            assert(con);
-            try{
-               con->execute(query_str, true);
-               m_connection_pool->release_connection(*con);
-            } catch (...) {
-               ilog("sql = ${s}",("s",query_str));
-               m_connection_pool->release_connection(*con);
+bool ledger_plugin_impl::spill_statement( const std::string& sql, const uint32_t block_num, const uint32_t shard ) {
+   if( !m_spill->append( block_num, shard, sql.data(), sql.size() )) {
+      elog("unable to spill statement to ${p}", ("p", spill_path));
+      ilog("sql = ${s}",("s",sql));
+      return false;
+   }
+   return true;
+}
+
+// spill 단계이거나 overflow 파일에 아직 남은 것이 있으면 (순서대로 실행되도록) 파일 뒤에 붙인다.
+bool ledger_plugin_impl::overflow( const std::string& sql, const uint32_t block_num, const uint32_t shard ) {
+   if( !m_overflow ) return false;
+   boost::mutex::scoped_lock lock(mtx_query);
+   if( !overflow_pending && !m_memory->at_least( memory_governor::level::spill )) return false;
+   if( !m_overflow->append( block_num, shard, sql.data(), sql.size() )) {
+      elog("unable to write statement to ${p}", ("p", overflow_path));
+      return false;
+   }
+   overflow_pending++;
+   overflow_statements++;
+   return true;
+}
+
+// query_queue 가 비었을 때 (mtx_query 를 잡고) overflow 파일에서 다음 묶음을. 다 읽으면 파일을 지운다.
+void ledger_plugin_impl::refill_from_overflow() {
+   if( !overflow_pending ) return;
+   std::vector<spill_file::record> records;
+   if( m_overflow->flush() )
+      overflow_offset = spill_file::read_chunk( overflow_path, overflow_offset, overflow_chunk_bytes, records );
+   if( records.empty() ) {
+      elog("unable to read ${n} statements back from ${p}", ("n", overflow_pending)("p", overflow_path));
+      return;
+   }
+   // 시작 때 replay 가 이미 읽은 것을 다시 실행하지 않도록 실행 전에 남긴다. 읽고 실행 못 한 채 죽으면 
+   // 그 statement 의 block 은 checkpoint 위이므로 chain 에서 다시 만들어진다.
+   if( !spill_file::write_offset( overflow_path, overflow_offset )) 
+      wlog("unable to record overflow offset ${o} for ${p}", ("o", overflow_offset)("p", overflow_path));
+   for( auto& r : records ) {
+      m_memory->reserve( memory_governor::component::query_queue, r.sql.size() );
+      query_queue.push_back( queued_query{ std::move(r.sql), 0, r.block_num, r.shard } );
+   }
+   overflow_pending -= std::min<uint64_t>( overflow_pending.load(), records.size() );
+   if( !overflow_pending ) {
+      if( !m_overflow->reset() ) wlog("unable to remove ${p}", ("p", overflow_path));
+      overflow_offset = 0;
+   }
+}
+
+void ledger_plugin_impl::statement_committed( const uint32_t shard, const uint32_t block_num ) {
+   watermarks.statement_committed( block_num );
+   m_router->statement_committed( shard, block_num );
+}
+
+void ledger_plugin_impl::statement_failed( const uint32_t shard, const uint32_t block_num ) {
+   watermarks.statement_committed( block_num );
+   const uint32_t failed = m_router->failed_block( shard );
+   m_router->statement_failed( shard, block_num );
+   if( block_num && ( !failed || block_num < failed ))
+      wlog("shard ${s} checkpoint held below block ${b} until restart", ("s", shard)("b", block_num));
+}
+
+void ledger_plugin_impl::start_spill() {
+   for( const auto& t : m_worker_tables ) t->set_defer_tokens( true );
+   if( m_ledger_table ) m_ledger_table->set_defer_tokens( true );
+   // DB 가 없어 다시 연결하며 멈춰 있는 worker 도 빠져나오도록.
+   for( uint32_t shard = 0; shard < m_router->size(); shard++ ) m_router->pool( shard )->abort_reconnect();
+   spilling = true;
+   if( m_workers ) m_workers->notify();
+}
+
+// 모든 worker 가 동시에 남은 trace 와 statement 를 비운다. 시한이 지나면 trace 는 계속 처리하되 
+// (CPU 만 쓴다) statement 는 spill 파일로. worker 가 모두 끝난 뒤 남은 것도 spill 파일로.
+void ledger_plugin_impl::drain() {
+   const auto start_time = fc::time_point::now();
+   ilog("draining ledger buffers, deadline ${d} ms", ("d", shutdown_deadline_ms));
+
+   if( m_workers ) {
+      m_workers->request_stop();
+      int64_t reported_ms = 0;
+      while( m_workers->running() ) {
+         const int64_t elapsed_ms = (fc::time_point::now() - start_time).count() / 1000;
+         if( !spilling && shutdown_deadline_ms && elapsed_ms >= shutdown_deadline_ms ) {
+            wlog("shutdown deadline reached, spilling remaining statements to ${p}", ("p", spill_path));
+            start_spill();
+         }
+         if( elapsed_ms - reported_ms >= 1000 ) {
+            reported_ms = elapsed_ms;
+            size_t traces = 0, queries = 0;
+            {
+               boost::mutex::scoped_lock lock(mtx_applied_trans);
+               traces = transaction_trace_queue.size();
+            }
+            {
+               boost::mutex::scoped_lock lock(mtx_query);
+               queries = query_queue.size();
             }
+            ilog("draining: ${t} traces, ${q} statements, ${a} async pending, ${w} workers running, ${s} spilled",
+               ("t", traces)("q", queries)("a", m_async ? m_async->pending() : 0)("w", m_workers->running())("s", m_spill->count()));
          }
-      
-         if( query_queue_count == 0 && done ) {
-            break;
-         }      
+         boost::this_thread::sleep_for( boost::chrono::milliseconds( 50 ));
       }
+      m_workers->join();
+   }
+   if( m_async ) m_async->stop();
 
-      ilog("ledger_plugin consume query process thread shutdown gracefully");
-   } catch (...) {
-      elog("Unknown exception while consuming query");
+   // 집계는 처리된 이벤트까지 모두 합친 뒤에. 남은 statement 와 함께 spill 된다.
+   if( m_aggregates ) {
+      watermarks.update( 0, get_now_tick() );
+      m_aggregates->set_extracted( watermarks.get().extracted.block_num );
+      m_aggregates->flush();
+   }
+
+   // async 가 밀려 worker 가 먼저 끝났거나 worker 없이 들어온 것
+   bool left = false;
+   {
+      boost::mutex::scoped_lock lock(mtx_query);
+      left = !query_queue.empty() || overflow_pending;
+   }
+   if( left ) {
+      spilling = true;
+      while( spill_step() );
    }
 
+   write_final_checkpoints();
+
+   if( m_spill->count() ) {
+      if( !m_spill->sync() ) elog("unable to sync spill file ${p}", ("p", spill_path));
+      wlog("${n} statements spilled to ${p}, replayed on next start", ("n", m_spill->count())("p", spill_path));
+   }
+   ilog("drain finished in ${t}", ("t", fc::time_point::now() - start_time));
 }
 
-void ledger_plugin_impl::process_add_ledger( std::unique_ptr<ledger_table>& t_ledger_table, const chain::action_trace& atrace ) {
+// 지난 종료 때 남긴 statement 를 순서대로. 실패하면 남은 것을 파일에 두고 시작하지 않는다.
+// statement 마다 offset 을 기록하므로 중간에 죽어도 이미 실행한 것을 다시 실행하지 않는다.
+void ledger_plugin_impl::replay_spill( const std::string& path ) {
+   if( wipe_database_on_startup || !boost::filesystem::exists( path )) {
+      spill_file::remove( path );
+      return;
+   }
+
+   uint64_t offset = spill_file::read_offset( path );
+   ilog("replaying spilled statements from ${p} at offset ${o}", ("p", path)("o", offset));
+   auto start_time = fc::time_point::now();
+   uint64_t replayed = 0;
+   std::vector<spill_file::record> records;
+   while( true ) {
+      records.clear();
+      spill_file::read_chunk( path, offset, overflow_chunk_bytes, records );
+      if( records.empty() ) break;
+
+      for( const auto& r : records ) {
+         std::string error;
+         bool ok = false;
+         if( r.shard >= m_router->size() ) {
+            error = "shard " + std::to_string( r.shard ) + " is not configured";
+         } else {
+            const auto& pool = m_router->pool( r.shard );
+            shared_ptr<MysqlConnection> con = pool->get_connection();
+            assert(con);
+            // tokens statement 가 이미 반영되었으면 tokens_applied 의 duplicate key 로 rollback 된다. 
+            ok = con->execute( r.sql, true ) || con->lastErrno() == ER_DUP_ENTRY;
+            if( !ok ) error = con->lastError();
+            pool->release_connection(*con);
+         }
+         EOS_ASSERT( ok, chain::plugin_exception, 
+            "replaying spilled statement at offset ${o} (block ${b}) failed: ${e}; remaining statements kept in ${p}",
+            ("o", offset)("b", r.block_num)("e", error)("p", path) );
+
+         offset += spill_file::record_size( r );
+         if( !spill_file::write_offset( path, offset )) 
+            wlog("unable to record spill offset ${o} for ${p}", ("o", offset)("p", path));
+         replayed++;
+      }
+   }
+
+   if( !spill_file::remove( path )) wlog("unable to remove spill file ${p}", ("p", path));
+   ilog("replayed ${n} spilled statements in ${t}", ("n", replayed)("t", fc::time_point::now() - start_time));
+}
+
+void ledger_plugin_impl::process_add_ledger( std::unique_ptr<ledger_table>& t_ledger_table, const chain::action_trace& atrace, 
+   uint32_t& action_index, uint64_t& max_global_sequence ) {
 
    const auto block_number = atrace.block_num;
    if(block_number == 0) return;
+   const uint32_t index = action_index++;
 
    const auto action_id = atrace.receipt.global_sequence ; 
+   if( action_id > max_global_sequence ) max_global_sequence = action_id;
    const auto trx_id    = atrace.trx_id;
    const auto block_time = atrace.block_time;
    
-   if(atrace.act.name == N(transfer) || atrace.act.name == N(create)) {
+   const auto* rule = m_rules->find( atrace.act.account.value, atrace.act.name.value );
+   if( rule ) {
+      span_tracer::set_global_sequence( action_id );
       // ilog("action_id : ${a}",("a",action_id));
-      t_ledger_table->add_ledger(action_id, trx_id, block_number, block_time, atrace.receipt.receiver.to_string(), atrace.act);
+      t_ledger_table->add_ledger(action_id, index, trx_id, block_number, block_time, atrace.receipt.receiver, atrace.act, *rule);
    }
       
    for( const auto& inline_atrace : atrace.inline_traces ) {
-      process_add_ledger( t_ledger_table, inline_atrace );
+      process_add_ledger( t_ledger_table, inline_atrace, action_index, max_global_sequence );
    }
 }
 
 void ledger_plugin_impl::process_applied_transaction(std::unique_ptr<ledger_table>& t_ledger_table, const chain::transaction_trace_ptr& t) {
-   auto start_time = fc::time_point::now();
+   span_tracer::sample_scope sample( t->block_num );
+   span_tracer::scope span( "transaction" );
 
+   uint64_t max_global_sequence = 0;
+   uint32_t action_index = 0;
    for( const auto& atrace : t->action_traces ) {
       try {      
-         process_add_ledger( t_ledger_table, atrace );
+         process_add_ledger( t_ledger_table, atrace, action_index, max_global_sequence );
       } catch(...) {
          wlog("add action traces failed.");
       }
    }   
 
-   // auto time = fc::time_point::now() - start_time;
-   // if( time > fc::microseconds(500000) )
-   //    ilog( "process actions, trans_id: ${r}    time: ${t}", ("r",t->id.str())("t", time) );
+   uint64_t applied = applied_global_sequence.load();
+   while( max_global_sequence > applied && !applied_global_sequence.compare_exchange_weak( applied, max_global_sequence ) ) {}
+}
+
+// trace 처리를 잠깐 멈추고 값을 묶은 뒤, 파일 I/O 는 멈춤 없이. 
+void ledger_plugin_impl::commit_balance_file() {
+   try {
+      while( true ) {
+         boost::this_thread::sleep_for( boost::chrono::milliseconds( balance_commit_ms ));
+         {
+            boost::unique_lock<boost::shared_mutex> barrier( mtx_trace_barrier );
+            m_balance_file->checkpoint( applied_global_sequence );
+         }
+         m_balance_file->flush();
+      }
+   } catch( boost::thread_interrupted& ) {
+   } catch( std::exception& e ) {
+      elog( "balance file commit stopped: ${e}", ("e", e.what()));
+   }
 }
 
 ledger_plugin_impl::ledger_plugin_impl(boost::asio::io_service& io) : 
@@ -295,31 +871,31 @@ _timer(io)
 }
 
 ledger_plugin_impl::~ledger_plugin_impl() {
+   // 끝난 chunk 까지는 resume 파일에 있다.
+   if( m_verifier ) m_verifier->stop();
+   stop_transfer_queries();
    if (!startup) {
       try {
          m_ledger_table->finalize(); 
+         if( m_history ) {
+            const auto st = m_history->get_stats();
+            ilog("recent history: ${a} accounts, ${e} transfers, ${v} evictions, ${b} bytes",
+               ("a", st.accounts)("e", st.events)("v", st.evictions)("b", st.bytes));
+         }
+         if( !trace_file.empty() && span_tracer::enabled() ) span_tracer::dump( trace_file );
 
-         ilog( "shutdown in process please be patient this can take a few minutes" );
          done = true;
 
-         for (size_t i=0; i< consume_query_threads.size(); i++ ) {
-            condition.notify_one();
-         }
+         // 남은 trace / query 를 모두 처리하고 worker 별 table 을 finalize 한 뒤 끝난다.
+         drain();
 
-         for (size_t i=0; i< consume_query_threads.size(); i++ ) {
-            consume_query_threads[i].join(); 
-            
+         if( m_balance_file ) {
+            balance_commit_thread.interrupt();
+            balance_commit_thread.join();
+            m_balance_file->checkpoint( applied_global_sequence );
+            m_balance_file->flush();
          }
 
-         for (size_t i=0; i< consume_applied_trans_threads.size(); i++ ) {
-            condition.notify_one();
-         }
-
-         for (size_t i=0; i< consume_applied_trans_threads.size(); i++ ) {
-            consume_applied_trans_threads[i].join(); 
-            
-         }         
-
       } catch( std::exception& e ) {
          elog( "Exception on mysql_db_plugin shutdown of consume thread: ${e}", ("e", e.what()));
       }
@@ -346,27 +922,728 @@ void ledger_plugin_impl::tick_loop_process() {
         int64_t tick = get_now_tick();
 
         self->m_ledger_table->tick(tick);
+        self->m_ledger_table->request_partition(self->watermarks.get().applied.block_num);
+        self->update_admission(tick);
+        self->update_memory();
+        self->record_live_start();
+        self->update_shard_checkpoints();
+        if( self->m_aggregates ) self->m_aggregates->set_extracted( self->watermarks.get().extracted.block_num );
+        for( const auto& sink : self->m_sinks ) sink->tick(tick);
 
         self->tick_loop_process(); 
     });
 
 } 
 
+// 모든 shard 에. tokens_applied 를 지울 때 그 아래 (ledger_ingest 가 넣은 것) 는 남긴다.
+void ledger_plugin_impl::record_live_start() {
+   const uint32_t first = first_applied_block;
+   if( !first || ( live_start_block && live_start_block <= first )) return;
+   live_start_block = first;
+   for( uint32_t shard = 0; shard < m_router->size(); shard++ )
+      post_query_str_to_queue( ledger_table::state_sql( "live_start_block", first ), 0, shard );
+}
+
+// 10 초마다 shard 별 committed block 을 그 shard 의 ledger_state 에. queue 를 거치므로 다른 statement 와 같이 spill 된다.
+void ledger_plugin_impl::update_shard_checkpoints() {
+   if( ++shard_checkpoint_ticks < 10 ) return;
+   shard_checkpoint_ticks = 0;
+
+   // 재시작하면 shard 마다 그 checkpoint 이하는 다시 쓰지 않으므로 그 아래 tokens_applied 는 더 필요 없다.
+   // 이번에 보내는 checkpoint 는 아직 커밋 전일 수 있으므로 지난번 값으로 지운다.
+   const uint32_t queued = watermarks.get().queued.block_num;
+   for( uint32_t shard = 0; shard < m_router->size(); shard++ ) {
+      const uint32_t prune_upto = shard_checkpoints[shard];
+      const uint32_t committed = m_router->committed_block( shard, queued );
+      if( committed > shard_checkpoints[shard] ) {
+         shard_checkpoints[shard] = committed;
+         post_query_str_to_queue( ledger_table::state_sql( "committed_block", committed ), 0, shard );
+      }
+      if( prune_upto > pruned_blocks[shard] ) {
+         pruned_blocks[shard] = prune_upto;
+         post_query_str_to_queue( ledger_table::prune_tokens_applied_sql( prune_upto ), 0, shard );
+      }
+   }
+}
+
+// 다 비운 뒤. 다음 시작이 겹치지 않도록 마지막 checkpoint 를 남긴다. spill 한 것이 있으면 그 뒤에 붙여 함께 실행되게.
+void ledger_plugin_impl::write_final_checkpoints() {
+   watermarks.update( 0, get_now_tick() );
+   const uint32_t queued = watermarks.get().queued.block_num;
+   for( uint32_t shard = 0; shard < m_router->size(); shard++ ) {
+      const uint32_t committed = m_router->committed_block( shard, queued );
+      if( committed <= shard_checkpoints[shard] ) continue;
+      shard_checkpoints[shard] = committed;
+      if( m_spill->count() ) {
+         const auto sql = ledger_table::state_sql( "committed_block", committed );
+         if( !m_spill->append( 0, shard, sql.data(), sql.size() )) elog("unable to spill checkpoint to ${p}", ("p", spill_path));
+      } else if( !m_ledger_table->set_state( "committed_block", committed, shard )) {
+         wlog("unable to write shard ${s} checkpoint ${b}", ("s", shard)("b", committed));
+      }
+   }
+}
+
+ledger_apis::get_shards_result ledger_plugin_impl::get_shards() const {
+   ledger_apis::get_shards_result result;
+   result.range_blocks = m_router->range_blocks();
+   const uint32_t queued = watermarks.get().queued.block_num;
+   for( uint32_t shard = 0; shard < m_router->size(); shard++ ) {
+      ledger_apis::shard_row row;
+      row.shard = shard;
+      row.host = m_router->get( shard ).host;
+      row.port = m_router->get( shard ).port;
+      row.committed_block = m_router->committed_block( shard, queued );
+      row.failed_block = m_router->failed_block( shard );
+      result.shards.push_back( row );
+   }
+   return result;
+}
+
 void ledger_plugin_impl::wipe_database() {
-   ilog("wipe tables");
+   // start_block_num 은 bootstrap 중 trace 를 막는 값일 수 있으므로 옵션 값 (m_block_num_start) 으로 판단.
+   if( m_block_num_start > 0 ) {
+      // partial replay. 시작 블록 이후의 partition 만 비운다. 
+      ilog("wipe ledger from block ${b}", ("b", m_block_num_start));
+      m_ledger_table->create( partition_blocks );
+      m_ledger_table->truncate_from( m_block_num_start );
+   } else {
+      ilog("wipe tables");
 
-   // drop tables
-   // m_ledger_table->drop();   
-   // m_ledger_table->create(); 
+      // drop tables
+      m_ledger_table->drop();   
+      m_ledger_table->create( partition_blocks ); 
+   }
 
    ilog("create tables done");
 }
 
+void ledger_plugin_impl::bootstrap_tokens() {
+   const uint32_t bootstrap_block = static_cast<uint32_t>( m_ledger_table->get_state("bootstrap_block") );
+   uint32_t resume_block = bootstrap_block + 1;
+
+   if( bootstrap_block ) {
+      ilog("tokens already bootstrapped at block ${b}", ("b", bootstrap_block));
+   } else {
+      auto& chain = app().get_plugin<chain_plugin>().chain();
+      token_bootstrap loader( m_router, m_balances, query_thread_count, bootstrap_batch_rows );
+      const uint32_t block_num = loader.run( chain );
+      m_ledger_table->set_state( "bootstrap_block", block_num );
+      resume_block = block_num + 1;
+   }
+
+   // 스캔한 블록 이후부터 증분 반영. --ledger-db-block-start 가 더 뒤면 그것부터.
+   start_block_num = std::max( m_block_num_start, resume_block );
+   start_block_reached = false;
+   ilog("ledger resumes from block ${b}", ("b", start_block_num));
+}
+
+std::unique_ptr<ledger_table> ledger_plugin_impl::make_ledger_table() {
+   auto table = std::make_unique<ledger_table>(m_connection_pool, ledger_raw_ag_count, ledger_acc_ag_count);
+   table->set_router( m_router );
+   table->set_memory_governor( m_memory );
+   table->set_resume_blocks( shard_checkpoints );
+   table->set_abi_resolver( chain_abi_resolver );
+   table->set_abi_sequence_resolver( chain_abi_sequence );
+   for( const auto& sink : m_sinks ) table->add_sink( sink );
+   return table;
+}
+
+void ledger_plugin_impl::start_workers( const variables_map& options ) {
+   std::vector<int> cpus;
+   std::vector<int> reserved;
+   if( options.count( "ledger-reserve-cpus" )) {
+      reserved = worker_pool::parse_cpu_list( options.at( "ledger-reserve-cpus" ).as<std::string>() );
+   }
+   if( options.count( "ledger-worker-cpus" )) {
+      cpus = worker_pool::parse_cpu_list( options.at( "ledger-worker-cpus" ).as<std::string>() );
+   } else if( options.count( "ledger-worker-numa-node" )) {
+      cpus = worker_pool::numa_node_cpus( options.at( "ledger-worker-numa-node" ).as<uint32_t>() );
+   } else if( !reserved.empty() ) {
+      cpus = worker_pool::online_cpus();
+   }
+   const bool cpus_given = options.count( "ledger-worker-cpus" ) || options.count( "ledger-worker-numa-node" ) || !reserved.empty();
+   cpus.erase( std::remove_if( cpus.begin(), cpus.end(), [&]( int c ) {
+      return std::find( reserved.begin(), reserved.end(), c ) != reserved.end();
+   }), cpus.end() );
+   // 비어 있으면 worker 는 고정되지 않고 만든 thread 의 mask 를 물려받으므로 reserved cpu 로 갈 수 있다.
+   EOS_ASSERT( !cpus_given || !cpus.empty(), chain::plugin_config_exception,
+      "no cpus left for ledger workers after --ledger-reserve-cpus" );
+
+   // main thread 는 startup 때 고정한다. 여기서 하면 그 뒤에 만들어지는 thread (다른 plugin 포함) 가 mask 를 물려받는다.
+   EOS_ASSERT( !options.at( "ledger-pin-chain-thread" ).as<bool>() || !reserved.empty(), chain::plugin_config_exception,
+      "--ledger-pin-chain-thread needs --ledger-reserve-cpus" );
+   if( options.at( "ledger-pin-chain-thread" ).as<bool>() ) chain_thread_cpus = reserved;
+
+   m_workers = std::make_unique<worker_pool>();
+   m_workers->add_stage( "trace", trace_thread_count, [this]( const uint32_t w ) { return trace_step( w ); } );
+   m_workers->add_stage( "query", query_thread_count, [this]( const uint32_t w ) { return query_step( w ); } );
+   m_workers->set_exit_hook( [this]( const uint32_t w ) { m_worker_tables[w]->finalize(); } );
+   m_workers->set_cpus( cpus );
+
+   for( uint32_t i = 0; i < m_workers->worker_count(); i++ ) {
+      m_worker_tables.push_back( make_ledger_table() );
+   }
+   m_workers->start();
+   ilog("ledger workers: ${t} trace, ${q} query, ${c} cpus", ("t", trace_thread_count)("q", query_thread_count)("c", cpus.size()));
+}
+
+// 큰 쪽으로는 바로, 작은 쪽으로는 조용한 tick 이 이어질 때 한 단계씩.
+void ledger_plugin_impl::update_admission( const int64_t tick ) {
+   uint32_t buffered = m_ledger_table->buffered_block();
+   for( const auto& t : m_worker_tables ) {
+      const uint32_t b = t->buffered_block();
+      if( b && (!buffered || b < buffered) ) buffered = b;
+   }
+   watermarks.update( buffered, tick );
+   if( !lag_target_ms ) return;
+
+   const auto w = watermarks.get();
+   size_t query_size = 0, trace_size = 0;
+   {
+      boost::mutex::scoped_lock lock( mtx_query );
+      query_size = query_queue.size();
+   }
+   {
+      boost::mutex::scoped_lock lock( mtx_applied_trans );
+      trace_size = transaction_trace_queue.size();
+   }
+   const double fill = std::max( double(query_size) / max_queue_size, double(trace_size) / max_trace_size );
+
+   uint32_t want = 0;
+   if( w.lag_ms >= int64_t(lag_target_ms) * 4 || fill >= 0.75 ) want = 3;
+   else if( w.lag_ms >= int64_t(lag_target_ms) * 2 || fill >= 0.5 ) want = 2;
+   else if( w.lag_ms >= int64_t(lag_target_ms) || fill >= 0.25 ) want = 1;
+
+   uint32_t level = shed_level;
+   if( want > level ) {
+      level = want;
+      shed_calm_ticks = 0;
+   } else if( want < level && ++shed_calm_ticks >= 10 ) {
+      level--;
+      shed_calm_ticks = 0;
+   } else if( want == level ) {
+      shed_calm_ticks = 0;
+   }
+   if( level == shed_level ) return;
+
+   wlog("ledger shed level ${o} -> ${n}, lag ${l} ms (${b} blocks), queue ${q}, trace ${t}",
+      ("o", shed_level.load())("n", level)("l", w.lag_ms)("b", w.lag_blocks)("q", query_size)("t", trace_size));
+   shed_level = level;
+
+   if( m_aggregates ) m_aggregates->set_deferred( level >= 1 );
+   const uint32_t scale = level >= 2 ? 4 : 1;
+   m_ledger_table->set_batch_scale( scale );
+   m_ledger_table->set_skip_accounts( level >= 3 );
+   for( const auto& t : m_worker_tables ) {
+      t->set_batch_scale( scale );
+      t->set_skip_accounts( level >= 3 );
+   }
+}
+
+// flush 단계부터는 tick 마다 모든 table 이 버퍼를 비우고 capacity 와 ABI cache 를 놓는다.
+// spill, throttle 은 statement / trace 를 넣는 곳에서 단계를 보고 바로.
+void ledger_plugin_impl::update_memory() {
+   const auto level = m_memory->get_level();
+   // 단계가 올라갈 때 한 번. 같은 단계에 머무는 동안 매 tick 버퍼와 cache 를 다시 놓지 않는다.
+   if( level >= memory_governor::level::flush && static_cast<uint32_t>(level) > memory_level ) {
+      m_ledger_table->request_trim();
+      for( const auto& t : m_worker_tables ) t->request_trim();
+      memory_trims++;
+      if( m_workers ) m_workers->notify();
+   }
+   if( static_cast<uint32_t>(level) == memory_level ) return;
+
+   const auto u = m_memory->get_usage();
+   wlog("ledger memory ${o} -> ${n}, ${t} of ${b} bytes (trace ${tq}, query ${qq}, sql ${s}, abi ${a})",
+      ("o", memory_governor::level_name( static_cast<memory_governor::level>( memory_level )))
+      ("n", memory_governor::level_name( level ))("t", u.total)("b", u.budget)
+      ("tq", u.components[0].bytes)("qq", u.components[1].bytes)("s", u.components[2].bytes)("a", u.components[3].bytes));
+   memory_level = static_cast<uint32_t>(level);
+}
+
+ledger_apis::get_memory_result ledger_plugin_impl::get_memory() const {
+   const auto u = m_memory->get_usage();
+   ledger_apis::get_memory_result result;
+   result.budget = u.budget;
+   result.used = u.total;
+   result.peak = u.peak;
+   result.level = memory_governor::level_name( u.current );
+   for( size_t i = 0; i < static_cast<size_t>(memory_governor::component::count); i++ ) {
+      ledger_apis::memory_component c;
+      c.name = memory_governor::component_name( static_cast<memory_governor::component>(i) );
+      c.bytes = u.components[i].bytes;
+      c.peak = u.components[i].peak;
+      result.components.push_back( c );
+   }
+   result.trims = memory_trims;
+   result.overflow_statements = overflow_statements;
+   result.overflow_pending = overflow_pending;
+   result.throttled = memory_throttled;
+   return result;
+}
+
+static ledger_apis::verify_balances_result to_api( const balance_verifier::status& st ) {
+   ledger_apis::verify_balances_result r;
+   r.state = st.state;
+   r.snapshot_block = st.snapshot_block;
+   r.start_account = st.start_account;
+   r.resume_account = st.resume_account;
+   r.balances = st.balances;
+   r.chunks = st.chunks;
+   r.chunks_done = st.chunks_done;
+   r.rows_compared = st.rows_compared;
+   r.mismatched = st.mismatched;
+   r.missing = st.missing;
+   r.extra = st.extra;
+   r.changed = st.changed;
+   r.corrections = st.corrections;
+   r.failed_queries = st.failed_queries;
+   return r;
+}
+
+// http handler 와 plugin_startup 은 main thread 이므로 chainbase 를 그대로 읽는다.
+ledger_apis::verify_balances_result ledger_plugin_impl::start_verify( const ledger_apis::verify_balances_params& params ) {
+   const auto& chain = app().get_plugin<chain_plugin>().chain();
+   EOS_ASSERT( m_verifier->start( chain, params.resume ), chain::plugin_exception, "balance verification is already running" );
+   return get_verify();
+}
+
+ledger_apis::verify_balances_result ledger_plugin_impl::get_verify() const {
+   return to_api( m_verifier->get_status() );
+}
+
+ledger_apis::get_lag_result ledger_plugin_impl::get_lag() const {
+   const auto w = watermarks.get();
+   auto to_api = []( const ingest_watermarks::watermark& m ) {
+      ledger_apis::watermark r;
+      r.block_num = m.block_num;
+      r.updated_at = m.updated_ms;
+      return r;
+   };
+   ledger_apis::get_lag_result result;
+   result.applied = to_api( w.applied );
+   result.extracted = to_api( w.extracted );
+   result.queued = to_api( w.queued );
+   result.committed = to_api( w.committed );
+   result.lag_blocks = w.lag_blocks;
+   result.lag_ms = w.lag_ms;
+   result.shed_level = shed_level;
+   result.throttled = queue_sleep_time > 0;
+   result.skipped_accounts = m_ledger_table ? m_ledger_table->skipped_accounts() : 0;
+   for( const auto& t : m_worker_tables ) result.skipped_accounts += t->skipped_accounts();
+   return result;
+}
+
+ledger_apis::get_workers_result ledger_plugin_impl::get_workers() const {
+   ledger_apis::get_workers_result result;
+   result.query_roundtrips = query_roundtrips;
+   result.query_statements = query_statements;
+   result.query_failed = query_failed;
+   if( m_async ) {
+      result.async_connections = m_async->connectionCount();
+      result.async_pending = m_async->pending();
+      result.async_completed = async_completed;
+      result.async_failed = async_failed;
+   }
+   if( m_ledger_table ) {
+      result.tokens_failed = m_ledger_table->tokens_failed();
+      result.tokens_half_applied = m_ledger_table->tokens_half_applied();
+   }
+   for( const auto& t : m_worker_tables ) {
+      result.tokens_failed += t->tokens_failed();
+      result.tokens_half_applied += t->tokens_half_applied();
+   }
+   if( !m_workers ) return result;
+   for( const auto& s : m_workers->stats() ) {
+      ledger_apis::worker_row row;
+      row.worker = s.worker;
+      row.stage = s.stage;
+      row.cpu = s.cpu;
+      row.utilization = s.elapsed_us ? double(s.busy_us) / s.elapsed_us : 0;
+      row.steps = s.steps;
+      row.stolen = s.stolen;
+      if( s.worker < m_worker_tables.size() ) {
+         const auto u = m_worker_tables[s.worker]->get_arena_usage();
+         row.actions = u.actions;
+         row.arena_bytes = u.capacity;
+         row.arena_peak = u.peak;
+         row.arena_growths = u.arena_growths;
+         row.decode_fallbacks = u.decode_fallbacks;
+         row.fallback_rate = u.actions ? double(u.decode_fallbacks) / u.actions : 0;
+      }
+      result.workers.push_back( row );
+   }
+   return result;
+}
+
+// trace 처리가 시작되기 전에 tokens 전체를 메모리로 올린다. 
+void ledger_plugin_impl::load_balances() {
+   ilog("loading balances from tokens table");
+   auto start_time = fc::time_point::now();
+
+   // tokens 는 account 로 나뉘어 있으므로 shard 마다.
+   for( uint32_t shard = 0; shard < m_router->size(); shard++ ) {
+      const auto& pool = m_router->pool( shard );
+      shared_ptr<MysqlConnection> con = pool->get_connection();
+      assert(con);
+      try {
+         // 행이 많으므로 한 줄씩 받아 복사 없이 읽는다. 
+         con->scan("SELECT account, contract_owner, symbol, `precision`, amount FROM tokens", [&]( const MysqlRowView& row ) {
+            try {
+               const auto precision = static_cast<uint8_t>( row.get_uint(3) );
+               m_balances->set( chain::name(row.get_data(0)).value, chain::name(row.get_data(1)).value,
+                                chain::symbol(precision, row.get_data(2)).value(), row.get_int(4) );
+            } catch( ... ) {
+               wlog("skip invalid tokens row ${a} ${s}", ("a", row.get_value(0))("s", row.get_value(2)));
+            }
+            return true;
+         });
+      } catch( ... ) {
+         elog("loading balances from shard ${n} failed", ("n", shard));
+      }
+      pool->release_connection(*con);
+   }
+
+   ilog("loaded ${n} balances of ${a} accounts in ${t}", 
+      ("n", m_balances->balance_count())("a", m_balances->account_count())("t", fc::time_point::now() - start_time));
+}
+
+ledger_apis::get_balances_result ledger_plugin_impl::get_balances( const ledger_apis::get_balances_params& params ) const {
+   EOS_ASSERT( params.accounts.size() <= max_balance_query_accounts, chain::contract_table_query_exception,
+               "too many accounts, max ${m}", ("m", max_balance_query_accounts) );
+
+   std::vector<uint64_t> accounts;
+   accounts.reserve( params.accounts.size() );
+   for( const auto& a : params.accounts ) accounts.push_back( a.value );
+
+   const uint64_t symbol_code = params.symbol.empty() ? 0 : (chain::symbol(0, params.symbol.c_str()).value() >> 8);
+
+   std::vector<balance_store::result> balances;
+   m_balances->lookup( accounts, params.code.value, symbol_code, balances );
+
+   ledger_apis::get_balances_result result;
+   result.rows.reserve( balances.size() );
+   for( const auto& b : balances ) {
+      const chain::symbol sym( b.balance.symbol );
+      result.rows.push_back( ledger_apis::balance_row{ chain::name(b.account), chain::name(b.balance.contract), 
+                                                       sym.name(), sym.decimals(), b.balance.amount } );
+   }
+   return result;
+}
+
+// 메모리에서 먼저, 모자라면 메모리에 없는 더 오래된 것을 DB 에서 이어서.
+ledger_apis::get_transfers_result ledger_plugin_impl::get_transfers( const ledger_apis::get_transfers_params& params ) {
+   EOS_ASSERT( params.limit > 0 && params.limit <= max_transfer_query_rows, chain::contract_table_query_exception,
+               "limit must be between 1 and ${m}", ("m", max_transfer_query_rows) );
+   const uint64_t account = params.account.value;
+
+   ledger_apis::get_transfers_result result;
+   uint64_t db_before = params.before;
+   uint32_t db_before_block = params.before_block;
+   if( m_history ) {
+      std::vector<recent_history::entry> entries;
+      m_history->lookup( account, params.before, params.limit, entries, db_before );
+      for( const auto& e : entries ) {
+         ledger_apis::transfer_row row;
+         row.action_id = e.action_id;
+         row.block_num = e.block_num;
+         row.block_time = fc::time_point_sec( e.block_time );
+         row.contract = chain::name( e.contract );
+         row.from = chain::name( e.amount < 0 ? account : e.counterparty );
+         row.to = chain::name( e.amount < 0 ? e.counterparty : account );
+         row.quantity = chain::asset( e.amount < 0 ? -e.amount : e.amount, chain::symbol( e.symbol ));
+         row.transaction_id = chain::transaction_id_type( reinterpret_cast<const char*>( e.transaction_id ), sizeof( e.transaction_id ));
+         result.rows.push_back( row );
+      }
+      result.memory_rows = result.rows.size();
+      // db_before 는 메모리에서 준 마지막 row 보다 작으므로 그 block 이하.
+      if( !result.rows.empty() ) db_before_block = result.rows.back().block_num;
+   }
+   if( result.rows.size() < params.limit ) {
+      query_transfers( account, db_before, db_before_block, params.limit - result.rows.size(), result.rows );
+      result.database_rows = result.rows.size() - result.memory_rows;
+   }
+   if( result.rows.size() == params.limit ) {
+      result.next_before = result.rows.back().action_id;
+      result.next_before_block = result.rows.back().block_num;
+   }
+   return result;
+}
+
+// ledger 는 block 구간으로 shard 가 나뉘므로 shard 마다 limit 개를 받아 합친다.
+// idx_from_account / idx_to_account 는 (account, block_number) 뒤에 PK 의 action_id 가 붙으므로
+// block_number DESC, action_id DESC 순서로 읽으면 filesort 없이 before_block 부터 index 를 거꾸로 읽는다.
+void ledger_plugin_impl::query_transfers( const uint64_t account, const uint64_t before, const uint32_t before_block, 
+      const uint32_t limit, std::vector<ledger_apis::transfer_row>& rows ) {
+   if( transfer_actions_sql.empty() ) return;
+   const auto name = chain::name( account ).to_string();
+   std::string cond = "action_id < " + std::to_string( before ? before : std::numeric_limits<int64_t>::max() ) +
+      " AND action_name IN (" + transfer_actions_sql + ")";
+   if( before_block ) cond += " AND block_number <= " + std::to_string( before_block );
+   const std::string columns = "SELECT action_id, block_number, UNIX_TIMESTAMP(`timestamp`), contract_owner, from_account, "
+      "to_account, amount, `precision`, symbol, transaction_id FROM ledger WHERE ";
+   const std::string tail = " ORDER BY block_number DESC, action_id DESC LIMIT " + std::to_string( limit );
+   const std::string sql = 
+      "(" + columns + "from_account = '" + name + "' AND " + cond + tail + ") UNION ALL "
+      "(" + columns + "to_account = '" + name + "' AND from_account <> '" + name + "' AND " + cond + tail + ")" + tail;
+
+   std::vector<ledger_apis::transfer_row> found;
+   for( uint32_t shard = 0; shard < m_router->size(); shard++ ) {
+      const auto& pool = m_router->pool( shard );
+      shared_ptr<MysqlConnection> con = pool->get_connection();
+      assert(con);
+      try {
+         con->scan( sql, [&]( const MysqlRowView& row ) {
+            ledger_apis::transfer_row r;
+            r.action_id = row.get_uint(0);
+            r.block_num = static_cast<uint32_t>( row.get_uint(1) );
+            r.block_time = fc::time_point_sec( static_cast<uint32_t>( row.get_uint(2) ));
+            r.contract = chain::name( row.get_data(3) );
+            r.from = chain::name( row.get_data(4) );
+            r.to = chain::name( row.get_data(5) );
+            r.quantity = chain::asset( row.get_int(6), chain::symbol( static_cast<uint8_t>( row.get_uint(7) ), row.get_data(8) ));
+            r.transaction_id = chain::transaction_id_type( row.get_value(9) );
+            found.push_back( r );
+            return true;
+         }, MysqlData::Mode::Store );
+      } catch( ... ) {
+         pool->release_connection(*con);
+         throw;
+      }
+      pool->release_connection(*con);
+   }
+
+   std::sort( found.begin(), found.end(), []( const ledger_apis::transfer_row& a, const ledger_apis::transfer_row& b ) {
+      return a.action_id > b.action_id;
+   });
+   if( found.size() > limit ) found.resize( limit );
+   rows.insert( rows.end(), found.begin(), found.end() );
+}
+
+void ledger_plugin_impl::post_transfer_query( std::function<void()> job ) {
+   {
+      boost::lock_guard<boost::mutex> lock( mtx_transfer_queries );
+      if( transfer_queries_stop ) return;
+      transfer_queries.push_back( std::move( job ));
+      if( !transfer_query_thread.joinable() ) 
+         transfer_query_thread = boost::thread([this] { run_transfer_queries(); });
+   }
+   cond_transfer_queries.notify_one();
+}
+
+void ledger_plugin_impl::run_transfer_queries() {
+   boost::unique_lock<boost::mutex> lock( mtx_transfer_queries );
+   while( true ) {
+      while( !transfer_queries_stop && transfer_queries.empty() ) cond_transfer_queries.wait( lock );
+      if( transfer_queries_stop ) break;
+      auto job = std::move( transfer_queries.front() );
+      transfer_queries.pop_front();
+      lock.unlock();
+      job();
+      lock.lock();
+   }
+}
+
+// 남은 요청은 응답하지 않는다. (http_plugin 도 내려가는 중)
+void ledger_plugin_impl::stop_transfer_queries() {
+   {
+      boost::lock_guard<boost::mutex> lock( mtx_transfer_queries );
+      transfer_queries_stop = true;
+      transfer_queries.clear();
+   }
+   cond_transfer_queries.notify_all();
+   if( transfer_query_thread.joinable() ) transfer_query_thread.join();
+}
+
+// http_plugin 은 필수가 아니다. 켜져 있을 때만 (initialize 된 상태) API 를 붙인다.
+void ledger_plugin_impl::register_api() {
+   auto* http_ptr = app().find_plugin<http_plugin>();
+   if( !http_ptr || http_ptr->get_state() == appbase::abstract_plugin::registered ) {
+      ilog("http_plugin not enabled; /v1/ledger API not registered");
+      return;
+   }
+   auto& http = *http_ptr;
+   http.add_api({
+      {"/v1/ledger/get_workers", [this]( string, string body, url_response_callback cb ) mutable {
+         try {
+            cb( 200, fc::json::to_string( get_workers() ));
+         } catch (...) {
+            http_plugin::handle_exception("ledger", "get_workers", body, cb);
+         }
+      }}
+   });
+   http.add_api({
+      {"/v1/ledger/verify_balances", [this]( string, string body, url_response_callback cb ) mutable {
+         try {
+            if( body.empty() ) body = "{}";
+            auto result = start_verify( fc::json::from_string(body).as<ledger_apis::verify_balances_params>() );
+            cb( 200, fc::json::to_string(result) );
+         } catch (...) {
+            http_plugin::handle_exception("ledger", "verify_balances", body, cb);
+         }
+      }}
+   });
+   http.add_api({
+      {"/v1/ledger/get_verify", [this]( string, string body, url_response_callback cb ) mutable {
+         try {
+            cb( 200, fc::json::to_string( get_verify() ));
+         } catch (...) {
+            http_plugin::handle_exception("ledger", "get_verify", body, cb);
+         }
+      }}
+   });
+   http.add_api({
+      {"/v1/ledger/get_memory", [this]( string, string body, url_response_callback cb ) mutable {
+         try {
+            cb( 200, fc::json::to_string( get_memory() ));
+         } catch (...) {
+            http_plugin::handle_exception("ledger", "get_memory", body, cb);
+         }
+      }}
+   });
+   http.add_api({
+      {"/v1/ledger/get_lag", [this]( string, string body, url_response_callback cb ) mutable {
+         try {
+            cb( 200, fc::json::to_string( get_lag() ));
+         } catch (...) {
+            http_plugin::handle_exception("ledger", "get_lag", body, cb);
+         }
+      }}
+   });
+   http.add_api({
+      {"/v1/ledger/get_transfers", [this]( string, string body, url_response_callback cb ) mutable {
+         try {
+            if( body.empty() ) body = "{}";
+            auto params = fc::json::from_string(body).as<ledger_apis::get_transfers_params>();
+            // DB 를 읽을 수 있으므로 main thread 에서 실행하지 않는다. 응답 (cb) 은 main thread 에서.
+            post_transfer_query( [this, params, body, cb]() {
+               try {
+                  auto json = fc::json::to_string( get_transfers( params ));
+                  app().get_io_service().post( [cb, json]() { cb( 200, json ); });
+               } catch (...) {
+                  auto e = std::current_exception();
+                  app().get_io_service().post( [cb, body, e]() {
+                     try {
+                        std::rethrow_exception( e );
+                     } catch (...) {
+                        http_plugin::handle_exception("ledger", "get_transfers", body, cb);
+                     }
+                  });
+               }
+            });
+         } catch (...) {
+            http_plugin::handle_exception("ledger", "get_transfers", body, cb);
+         }
+      }}
+   });
+   http.add_api({
+      {"/v1/ledger/get_shards", [this]( string, string body, url_response_callback cb ) mutable {
+         try {
+            cb( 200, fc::json::to_string( get_shards() ));
+         } catch (...) {
+            http_plugin::handle_exception("ledger", "get_shards", body, cb);
+         }
+      }}
+   });
+   if( m_balances ) {
+      http.add_api({
+         {"/v1/ledger/get_balances", [this]( string, string body, url_response_callback cb ) mutable {
+            try {
+               if( body.empty() ) body = "{}";
+               auto result = get_balances( fc::json::from_string(body).as<ledger_apis::get_balances_params>() );
+               cb( 200, fc::json::to_string(result) );
+            } catch (...) {
+               http_plugin::handle_exception("ledger", "get_balances", body, cb);
+            }
+         }}
+      });
+   }
+   if( !trace_file.empty() ) {
+      // 파일 경로는 설정으로만. 요청으로 받지 않는다.
+      http.add_api({
+         {"/v1/ledger/dump_trace", [this]( string, string body, url_response_callback cb ) mutable {
+            try {
+               ledger_apis::dump_trace_result result;
+               result.file = trace_file;
+               result.spans = span_tracer::dump( trace_file );
+               cb( 200, fc::json::to_string(result) );
+            } catch (...) {
+               http_plugin::handle_exception("ledger", "dump_trace", body, cb);
+            }
+         }}
+      });
+   }
+}
+
 void ledger_plugin_impl::init(const std::string host, const std::string user, const std::string passwd, const std::string database, 
       const uint16_t port, const uint16_t max_conn, bool do_close_on_unlock, uint32_t block_num_start, const variables_map& options) 
 {
    m_connection_pool = std::make_shared<connection_pool>(host, user, passwd, database, port, max_conn, do_close_on_unlock);
 
+   if( options.count( "ledger-db-shard" )) {
+      std::vector<shard_router::shard> shards( 1 );
+      shards[0].host = host;
+      shards[0].port = port;
+      shards[0].pool = m_connection_pool;
+      for( const auto& target : options.at( "ledger-db-shard" ).as<std::vector<std::string>>() ) {
+         shard_router::shard s;
+         try {
+            std::tie( s.host, s.port ) = shard_router::parse_target( target, port );
+         } catch( const std::invalid_argument& e ) {
+            EOS_ASSERT( false, chain::plugin_config_exception, "${e}", ("e", e.what()) );
+         }
+         s.pool = std::make_shared<connection_pool>(s.host, user, passwd, database, s.port, max_conn, do_close_on_unlock);
+         shards.push_back( s );
+      }
+      m_router = std::make_shared<shard_router>( std::move(shards), options.at( "ledger-shard-range-blocks" ).as<uint32_t>() );
+      ilog(" ledger shards: ${n}, ledger range ${r} blocks", ("n", m_router->size())("r", m_router->range_blocks()));
+   } else {
+      m_router = std::make_shared<shard_router>( m_connection_pool );
+   }
+   shard_checkpoints.assign( m_router->size(), 0 );
+   pruned_blocks.assign( m_router->size(), 0 );
+   // 연결은 처음 쓸 때 만들어지므로 그 전에.
+   if( options.count( "ledger-db-timeout-sec" )) db_timeout_sec = options.at("ledger-db-timeout-sec").as<uint32_t>();
+   for( uint32_t shard = 0; shard < m_router->size(); shard++ ) m_router->pool( shard )->set_timeout( db_timeout_sec );
+
+   {
+      auto rules = extraction_rules::defaults();
+      if( options.count( "ledger-extract-rule" )) {
+         for( const auto& spec : options.at( "ledger-extract-rule" ).as<std::vector<std::string>>() ) {
+            try {
+               rules.push_back( extraction_rules::parse( spec ));
+            } catch( const std::invalid_argument& e ) {
+               EOS_ASSERT( false, chain::plugin_config_exception, "${e}", ("e", e.what()) );
+            }
+         }
+      }
+      m_rules = std::make_shared<const extraction_rules>( rules );
+      for( const auto& r : m_rules->rules() ) {
+         if( r.kind != extraction_kind::transfer ) continue;
+         const auto quoted = "'" + chain::name( r.action ).to_string() + "'";
+         if( transfer_actions_sql.find( quoted ) != std::string::npos ) continue;
+         if( !transfer_actions_sql.empty() ) transfer_actions_sql += ",";
+         transfer_actions_sql += quoted;
+      }
+      ilog(" extraction rules: ${n}", ("n", m_rules->rules().size()));
+   }
+
+   if( options.count( "ledger-db-async-connections" ) && options.at( "ledger-db-async-connections" ).as<uint32_t>() > 0 ) {
+      const auto count = options.at( "ledger-db-async-connections" ).as<uint32_t>();
+      EOS_ASSERT( m_router->size() == 1, chain::plugin_config_exception, "--ledger-db-async-connections does not support --ledger-db-shard" );
+      if( !MysqlAsyncEngine::supported() ) {
+         wlog("libmysqlclient has no nonblocking API, --ledger-db-async-connections ignored");
+      } else {
+         m_async = std::make_unique<MysqlAsyncEngine>( count, host, user, passwd, database, port );
+         if( m_async->start() ) {
+            ilog(" async mysql connections: ${n}", ("n", count));
+         } else {
+            wlog("unable to open async mysql connections, using blocking query threads");
+            m_async.reset();
+         }
+      }
+   }
+
    {
       if( options.count( "ledger-db-ag-raw" )) {
             ledger_raw_ag_count = options.at("ledger-db-ag-raw").as<uint32_t>();
@@ -374,9 +1651,98 @@ void ledger_plugin_impl::init(const std::string host, const std::string user, co
       if( options.count( "ledger-db-ag-acc" )) {
             ledger_acc_ag_count = options.at("ledger-db-ag-acc").as<uint32_t>();
       }
+      if( options.count( "ledger-balance-commit-ms" )) {
+            balance_commit_ms = options.at("ledger-balance-commit-ms").as<uint32_t>();
+      }
+      if( options.count( "ledger-dedup-window" )) {
+            dedup_window = options.at("ledger-dedup-window").as<uint32_t>();
+      }
+      if( options.count( "ledger-db-pipeline-bytes" )) {
+            pipeline_bytes = options.at("ledger-db-pipeline-bytes").as<uint32_t>();
+      }
+      if( options.count( "ledger-lag-target-ms" )) {
+            lag_target_ms = options.at("ledger-lag-target-ms").as<uint32_t>();
+      }
+      if( options.count( "ledger-shutdown-deadline-ms" )) {
+            shutdown_deadline_ms = options.at("ledger-shutdown-deadline-ms").as<uint32_t>();
+      }
+      {
+            boost::filesystem::path path = options.at("ledger-spill-file").as<std::string>();
+            if( path.is_relative() ) path = app().data_dir() / path;
+            spill_path = path.generic_string();
+            m_spill = std::make_unique<spill_file>( spill_path );
+            overflow_path = spill_path + ".overflow";
+      }
+      m_memory = std::make_shared<memory_governor>( uint64_t( options.at( "ledger-memory-budget-mb" ).as<uint32_t>() ) << 20 );
+      if( m_memory->budget() ) {
+            // 이전 실행이 남긴 파일은 replay_spill 에서 먼저 실행한다. 여기서는 새로 쓰기만.
+            m_overflow = std::make_unique<spill_file>( overflow_path );
+            ilog(" memory budget: ${b} MB", ("b", m_memory->budget() >> 20));
+      }
+      if( options.count( "ledger-db-partition-blocks" )) {
+            partition_blocks = options.at("ledger-db-partition-blocks").as<uint32_t>();
+      }
       ilog(" aggregate ledger raw: ${n}", ("n", ledger_raw_ag_count));
       ilog(" aggregate ledger acc: ${n}", ("n", ledger_acc_ag_count));
-      m_ledger_table = std::make_unique<ledger_table>(m_connection_pool, ledger_raw_ag_count, ledger_acc_ag_count);
+      if( options.at( "ledger-balance-store" ).as<bool>() ) {
+            m_balances = std::make_shared<balance_store>();
+      }
+      if( options.count( "ledger-event-stream" )) {
+            const auto name = options.at( "ledger-event-stream" ).as<std::string>();
+            const auto capacity = options.at( "ledger-event-stream-size" ).as<uint32_t>();
+            m_event_stream = std::make_shared<event_stream>( name, capacity );
+            ilog(" ledger event stream: ${n} (${c} records)", ("n", name)("c", capacity));
+      }
+      if( options.count( "ledger-segment-dir" )) {
+            const auto dir = options.at( "ledger-segment-dir" ).as<std::string>();
+            m_segments = std::make_shared<ledger_segment_writer>( dir,
+                  options.at( "ledger-segment-blocks" ).as<uint32_t>(), options.at( "ledger-segment-rows" ).as<uint32_t>() );
+            ilog(" ledger segments: ${d}", ("d", dir));
+      }
+      if( options.count( "ledger-trace-file" )) {
+            trace_file = options.at( "ledger-trace-file" ).as<std::string>();
+            span_tracer::configure( options.at( "ledger-trace-sample" ).as<uint32_t>(), options.at( "ledger-trace-ring" ).as<uint32_t>() );
+      }
+      if( options.at( "ledger-token-aggregates" ).as<bool>() ) {
+            m_aggregates = std::make_shared<token_aggregates>( m_connection_pool,
+                  options.at( "ledger-aggregate-bucket-sec" ).as<uint32_t>(), options.at( "ledger-aggregate-flush-sec" ).as<uint32_t>() );
+      }
+      if( m_balances ) m_sinks.push_back( m_balances );
+      if( m_event_stream ) m_sinks.push_back( m_event_stream );
+      if( m_segments ) m_sinks.push_back( m_segments );
+      if( options.at( "ledger-history-depth" ).as<uint32_t>() > 0 ) {
+            m_history = std::make_shared<recent_history>( options.at( "ledger-history-depth" ).as<uint32_t>(),
+                  uint64_t( options.at( "ledger-history-memory-mb" ).as<uint32_t>() ) << 20 );
+            ilog(" recent history: ${d} transfers per account, up to ${a} accounts", 
+                  ("d", m_history->depth())("a", m_history->get_stats().max_accounts));
+      }
+      {
+            balance_verifier::config c;
+            c.threads = options.at( "ledger-verify-threads" ).as<uint32_t>();
+            c.rows_per_sec = options.at( "ledger-verify-rows-per-sec" ).as<uint32_t>();
+            c.chunk_accounts = options.at( "ledger-verify-chunk-accounts" ).as<uint32_t>();
+            boost::filesystem::path path = options.at( "ledger-verify-file" ).as<std::string>();
+            if( path.is_relative() ) path = app().data_dir() / path;
+            c.resume_path = path.generic_string() + ".resume";
+            c.corrections_path = path.generic_string() + ".corrections.sql";
+            verify_on_startup = options.at( "ledger-verify-on-startup" ).as<bool>();
+
+            // 기준 block 까지의 trace 는 이미 queue 에 있다. queue 가 비고 처리 중인 batch 가 없으면 모두 반영된 것.
+            auto caught_up = [this]( const uint32_t block_num ) {
+               if( watermarks.get().extracted.block_num >= block_num ) return true;
+               boost::unique_lock<boost::shared_mutex> barrier( mtx_trace_barrier );
+               boost::mutex::scoped_lock lock( mtx_applied_trans );
+               return transaction_trace_queue.empty();
+            };
+            auto busy = [this]() { 
+               return shed_level > 0 || m_memory->at_least( memory_governor::level::flush ); 
+            };
+            m_verifier = std::make_shared<balance_verifier>( m_router, c, caught_up, busy );
+      }
+      if( m_aggregates ) m_sinks.push_back( m_aggregates );
+      if( m_history ) m_sinks.push_back( m_history );
+      if( m_verifier ) m_sinks.push_back( m_verifier );
+      m_ledger_table = make_ledger_table();
    }
    
    m_block_num_start = block_num_start;
@@ -384,21 +1750,90 @@ void ledger_plugin_impl::init(const std::string host, const std::string user, co
 
    if( wipe_database_on_startup ) {
       wipe_database();
-   } 
-   // else {
-   //    ilog("create tables");
-      
-   //    // create Tables
-   //    m_accounts_table->create();
-   //    m_blocks_table->create();
-   //    m_transactions_table->create();
-   //    m_actions_table->create();
-
-   //    m_accounts_table->create_index();
-   //    m_blocks_table->create_index();
-   //    m_transactions_table->create_index();
-   //    m_actions_table->create_index();
-   // }
+   } else {
+      ilog("create tables");
+      m_ledger_table->create( partition_blocks );
+   }
+
+   // jump hash 는 shard 수에 따라 달라진다. 다른 수로 쓰던 DB 에 이어 쓰면 tokens 잔액이 shard 사이에 갈라진다.
+   const uint64_t shard_count = m_ledger_table->get_state( "shard_count" );
+   EOS_ASSERT( !shard_count || shard_count == m_router->size(), chain::plugin_config_exception,
+      "ledger database was written with ${o} shards, ${n} configured; rebuild with --ledger-data-wipe to reshard",
+      ("o", shard_count)("n", m_router->size()) );
+   const uint64_t range_blocks = m_ledger_table->get_state( "shard_range_blocks" );
+   EOS_ASSERT( !range_blocks || m_router->size() == 1 || range_blocks == m_router->range_blocks(), chain::plugin_config_exception,
+      "ledger database was written with --ledger-shard-range-blocks ${o}", ("o", range_blocks) );
+   m_ledger_table->set_state( "shard_count", m_router->size() );
+   m_ledger_table->set_state( "shard_range_blocks", m_router->range_blocks() );
+   live_start_block = static_cast<uint32_t>( m_ledger_table->get_state( "live_start_block" ));
+   for( uint32_t shard = 0; shard < m_router->size(); shard++ ) {
+      shard_checkpoints[shard] = static_cast<uint32_t>( m_ledger_table->get_state( "committed_block", shard ));
+      // 시작 블록부터 비웠으면 거기부터 다시 받아야 한다.
+      if( wipe_database_on_startup && m_block_num_start > 0 && shard_checkpoints[shard] >= m_block_num_start ) {
+         shard_checkpoints[shard] = m_block_num_start - 1;
+         m_ledger_table->set_state( "committed_block", shard_checkpoints[shard], shard );
+      }
+      if( m_router->size() > 1 )
+         ilog("shard ${n} ${h}:${p} committed block ${b}", 
+            ("n", shard)("h", m_router->get(shard).host)("p", m_router->get(shard).port)("b", shard_checkpoints[shard]));
+   }
+   // 메모리가 모자라 내려두었던 statement 가 (비정상 종료로) 남았으면 그것이 먼저다.
+   replay_spill( overflow_path );
+   replay_spill( spill_path );
+
+   // 재시작 겹침. 모든 shard 에 커밋된 block (checkpoint 중 가장 낮은 것) 까지는 trace 를 받지 않는다.
+   // 그 위는 다시 처리하되 shard 마다 자기 checkpoint 이하로 가는 row 는 쓰지 않는다. (set_resume_blocks)
+   // 그 위는 ledger / actions_accounts 는 INSERT IGNORE, tokens 는 tokens_applied 로 한 번만 반영된다.
+   // 커밋 순서가 뒤섞일 수 있으므로 최대 action_id 가 아니라 연속으로 커밋된 지점 (checkpoint) 을 쓴다.
+   resume_block = *std::min_element( shard_checkpoints.begin(), shard_checkpoints.end() );
+   m_ledger_table->set_resume_blocks( shard_checkpoints );
+   if( !resume_block && !wipe_database_on_startup ) {
+      resume_block = m_ledger_table->get_max_block_number();
+      if( resume_block ) 
+         wlog("no shard checkpoint; resuming after the highest ledger block ${b}; tokens applied past it may be applied twice", ("b", resume_block));
+   }
+   // 집계는 aggregates_block 까지만 반영되어 있다. 그 위를 다시 받도록. (ledger / tokens 는 위와 같이 한 번만)
+   if( m_aggregates ) {
+      const uint32_t aggregates_block = static_cast<uint32_t>( m_ledger_table->get_state( "aggregates_block" ));
+      if( aggregates_block && aggregates_block < resume_block ) {
+         ilog("token aggregates committed up to block ${b}", ("b", aggregates_block));
+         resume_block = aggregates_block;
+      }
+   }
+   ilog("ledger resume block: ${b}", ("b", resume_block));
+   if( m_segments ) {
+      // 지난 실행에서 resume_block 위로 이미 파일에 쓴 row 는 다시 쓰지 않는다. (scan 이 두 번 세지 않도록)
+      m_segments->skip_written( resume_block );
+      if( m_segments->floor_block() )
+         ilog("ledger segments already hold rows up to block ${b}", ("b", m_segments->floor_block()));
+   }
+   m_dedup = std::make_unique<dedup_filter>( dedup_window );
+   const uint64_t high_water_mark = m_ledger_table->get_max_action_id();
+   applied_global_sequence = high_water_mark;
+
+   if( m_balances && options.count( "ledger-balance-file" )) {
+      const auto path = options.at( "ledger-balance-file" ).as<std::string>();
+      if( wipe_database_on_startup ) {
+         boost::filesystem::remove( path );
+      }
+      m_balance_file = std::make_shared<balance_file>( path, 1 << 20 );
+      m_balances->attach_file( m_balance_file );
+
+      // 파일이 DB 보다 뒤쳐져 있으면 그 사이 이벤트는 dedup 에 걸려 다시 오지 않으므로 tokens 에서 다시 읽는다. 
+      if( m_balance_file->size() > 0 && m_balance_file->global_sequence() >= high_water_mark ) {
+         auto start_time = fc::time_point::now();
+         m_balances->load_file();
+         ilog("mapped ${n} balances at global sequence ${g} in ${t}", 
+            ("n", m_balance_file->size())("g", m_balance_file->global_sequence())("t", fc::time_point::now() - start_time));
+      } else {
+         load_balances();
+         m_balance_file->checkpoint( high_water_mark );
+         m_balance_file->flush();
+      }
+      balance_commit_thread = boost::thread([this] { commit_balance_file(); });
+   } else if( m_balances ) {
+      load_balances();
+   }
 
 /*
    // get last action_id from actions table
@@ -412,13 +1847,7 @@ void ledger_plugin_impl::init(const std::string host, const std::string user, co
 
    ilog("starting ledger plugin thread");
 
-   for (size_t i=0; i<query_thread_count; i++) {
-      consume_query_threads.push_back( boost::thread([this] { consume_query_process(); }) );
-   }
-
-   for (size_t i=0; i<trace_thread_count; i++) {
-      consume_applied_trans_threads.push_back( boost::thread([this] { consume_applied_transactions(); }) );
-   }
+   start_workers( options );
    
    tick_loop_process(); 
 
@@ -454,7 +1883,7 @@ void ledger_plugin::set_program_options(options_description&, options_descriptio
          ("ledger-db-block-start", bpo::value<uint32_t>()->default_value(0),
          "If specified then only abi data pushed to ledger db until specified block is reached.")
          ("ledger-db-block-end", bpo::value<uint32_t>()->default_value(0),
-         "stop when reached end block number.")
+         "Stop collecting after the specified block number. 0 collects without limit.")
          ("ledger-db-close-on-unlock", bpo::bool_switch()->default_value(false),
          "Close connection from db when release lock.")
          
@@ -463,6 +1892,98 @@ void ledger_plugin::set_program_options(options_description&, options_descriptio
          "ledger raw db aggregation count")
          ("ledger-db-ag-acc", bpo::value<uint32_t>(),
          "ledger acc db aggregation count")
+         ("ledger-bootstrap-tokens", bpo::bool_switch()->default_value(false),
+         "Load tokens and tokenlist from the current chain state on startup and continue from that block "
+         "instead of replaying history.")
+         ("ledger-bootstrap-batch", bpo::value<uint32_t>()->default_value(1000),
+         "Rows per insert statement when bootstrapping tokens.")
+         ("ledger-verify-on-startup", bpo::bool_switch()->default_value(false),
+         "Compare tokens with the chain state accounts tables after startup, resuming an unfinished run. "
+         "Also started by /v1/ledger/verify_balances.")
+         ("ledger-verify-threads", bpo::value<uint32_t>()->default_value(2),
+         "Threads comparing account ranges during balance verification.")
+         ("ledger-verify-rows-per-sec", bpo::value<uint32_t>()->default_value(20000),
+         "Tokens rows read per second during balance verification. 0 is unlimited.")
+         ("ledger-verify-chunk-accounts", bpo::value<uint32_t>()->default_value(10000),
+         "Accounts per verification chunk. Progress is saved per chunk.")
+         ("ledger-verify-file", bpo::value<std::string>()->default_value("ledger-verify"),
+         "Balance verification writes <file>.resume and correction statements to <file>.corrections.sql (relative to data dir).")
+         ("ledger-balance-store", bpo::bool_switch()->default_value(false),
+         "Keep all token balances in memory and serve them on /v1/ledger/get_balances.")
+         ("ledger-balance-file", bpo::value<std::string>(),
+         "Memory-mapped file persisting the balance store and its last applied global sequence for instant restarts. "
+         "Requires --ledger-balance-store.")
+         ("ledger-balance-commit-ms", bpo::value<uint32_t>()->default_value(1000),
+         "Interval between balance file commits.")
+         ("ledger-dedup-window", bpo::value<uint32_t>()->default_value(100000),
+         "Recent transactions remembered to drop ones accepted again in the same block (fork switch back) before decoding. 0 disables.")
+         ("ledger-db-partition-blocks", bpo::value<uint32_t>()->default_value(10000000),
+         "Block range of each ledger table partition. 0 creates the ledger table without partitioning.")
+         ("ledger-event-stream", bpo::value<std::string>(),
+         "Shared memory name to publish ledger events on for local consumers (see db/event_stream.hpp).")
+         ("ledger-event-stream-size", bpo::value<uint32_t>()->default_value(1048576),
+         "Number of records kept in the ledger event stream ring.")
+         ("ledger-segment-dir", bpo::value<std::string>(),
+         "Directory to write ledger rows into as immutable columnar segment files for analytics.")
+         ("ledger-segment-blocks", bpo::value<uint32_t>()->default_value(100000),
+         "Block range of each ledger segment file.")
+         ("ledger-segment-rows", bpo::value<uint32_t>()->default_value(1000000),
+         "Rows buffered per segment before it is written out as a separate part.")
+         ("ledger-history-depth", bpo::value<uint32_t>()->default_value(0),
+         "Recent transfers kept in memory per account for /v1/ledger/get_transfers. 0 reads them from the database only.")
+         ("ledger-history-memory-mb", bpo::value<uint32_t>()->default_value(512),
+         "Memory cap of the recent transfer history. Least recently used accounts are evicted beyond it.")
+         ("ledger-token-aggregates", bpo::bool_switch()->default_value(false),
+         "Maintain per token volume, transfer count and unique senders per time bucket in the token_aggregates table.")
+         ("ledger-aggregate-bucket-sec", bpo::value<uint32_t>()->default_value(86400),
+         "Time bucket of token_aggregates in seconds.")
+         ("ledger-aggregate-flush-sec", bpo::value<uint32_t>()->default_value(10),
+         "Interval between token_aggregates upserts.")
+         ("ledger-trace-file", bpo::value<std::string>(),
+         "Chrome trace format JSON file written on /v1/ledger/dump_trace and at shutdown. Enables span tracing.")
+         ("ledger-trace-sample", bpo::value<uint32_t>()->default_value(100),
+         "Trace one of every N transactions (and queries). 0 records nothing.")
+         ("ledger-trace-ring", bpo::value<uint32_t>()->default_value(65536),
+         "Spans kept per thread for the trace dump.")
+         ("ledger-extract-rule", bpo::value<std::vector<std::string>>()->composing(),
+         "Additional action to capture, as '<contract|*> <action> <transfer|create|record> [from=f] [to=f] [quantity=f]'. "
+         "'* transfer transfer' and '* create create' are always present and can be overridden. May be specified multiple times.")
+         ("ledger-db-pipeline-bytes", bpo::value<uint32_t>()->default_value(0),
+         "Queued statements are sent together in one round trip up to this many bytes "
+         "(keep below the server max_allowed_packet). 0 sends one statement per round trip in its own transaction.")
+         ("ledger-lag-target-ms", bpo::value<uint32_t>()->default_value(5000),
+         "Ingest lag (chain to committed rows) above which optional work is shed: aggregates are deferred, "
+         "then batches widened, then actions_accounts skipped, before the chain thread is blocked. 0 disables shedding.")
+         ("ledger-db-timeout-sec", bpo::value<uint32_t>()->default_value(60),
+         "Connect, read and write timeout of each database connection, so a hung server cannot stall a query thread "
+         "past the shutdown deadline. 0 waits without limit.")
+         ("ledger-shutdown-deadline-ms", bpo::value<uint32_t>()->default_value(30000),
+         "Time allowed on shutdown for flushing buffered rows and queued statements to the database. "
+         "Statements not committed by then are written to --ledger-spill-file. 0 waits without limit.")
+         ("ledger-memory-budget-mb", bpo::value<uint32_t>()->default_value(0),
+         "Byte budget shared by the trace queue, query queue, SQL buffers and ABI caches. "
+         "From 60% buffers are flushed and caches trimmed, from 80% new statements go to <spill-file>.overflow, "
+         "from 95% the chain thread is throttled. 0 only reports usage (/v1/ledger/get_memory).")
+         ("ledger-spill-file", bpo::value<std::string>()->default_value("ledger-spill.bin"),
+         "File for statements left over at shutdown, replayed before anything else on the next start. "
+         "Relative paths are under the data directory.")
+         ("ledger-db-shard", bpo::value<std::vector<std::string>>()->composing(),
+         "Additional database as host[:port] (same user, password and database) to spread writes over. "
+         "--ledger-db-host is shard 0. tokens and actions_accounts rows go to the shard of their account, ledger rows "
+         "to the shard of their block range. May be specified multiple times; the count cannot change without a wipe.")
+         ("ledger-shard-range-blocks", bpo::value<uint32_t>()->default_value(1000000),
+         "Consecutive blocks whose ledger rows go to the same shard.")
+         ("ledger-db-async-connections", bpo::value<uint32_t>()->default_value(0),
+         "Connections driven by one event thread with the nonblocking libmysqlclient API (8.0.16+). "
+         "Query threads only hand queries over. 0 uses blocking query threads.")
+         ("ledger-worker-cpus", bpo::value<std::string>(),
+         "CPUs to pin worker threads to, one per thread (e.g. 4-7,12). Default is no pinning.")
+         ("ledger-worker-numa-node", bpo::value<uint32_t>(),
+         "Pin worker threads to the CPUs of this NUMA node when --ledger-worker-cpus is not given.")
+         ("ledger-reserve-cpus", bpo::value<std::string>(),
+         "CPUs never used by worker threads, e.g. for the chain thread.")
+         ("ledger-pin-chain-thread", bpo::bool_switch()->default_value(false),
+         "Pin the main (chain) thread to --ledger-reserve-cpus.")
          ;
 }
 
@@ -512,9 +2033,11 @@ void ledger_plugin::plugin_initialize(const variables_map& options) {
             my->trace_thread_count = options.at( "ledger-db-trace-thread" ).as<uint32_t>();
          }
          
+         uint32_t block_start = 0;
          if( options.count( "ledger-db-block-start" )) {
-            my->start_block_num = options.at( "ledger-db-block-start" ).as<uint32_t>();
+            block_start = options.at( "ledger-db-block-start" ).as<uint32_t>();
          }
+         my->start_block_num = block_start;
          if( options.count( "producer-name") ) {
             wlog( "Ledger plugin not recommended on producer node" );
             //my->is_producer = true;
@@ -528,6 +2051,16 @@ void ledger_plugin::plugin_initialize(const variables_map& options) {
             my->start_block_reached = true;
          }
 
+         if( options.at( "ledger-bootstrap-tokens" ).as<bool>() ) {
+            // plugin_startup 에서 스캔한 블록이 정해질 때까지 들어오는 trace 는 무시. 
+            my->bootstrap_tokens_on_startup = true;
+            my->start_block_reached = false;
+            my->start_block_num = std::numeric_limits<uint32_t>::max();
+            if( options.count( "ledger-bootstrap-batch" )) {
+               my->bootstrap_batch_rows = options.at( "ledger-bootstrap-batch" ).as<uint32_t>();
+            }
+         }
+
          uint16_t port = 3306;
          uint16_t max_conn = 5;
 
@@ -554,10 +2087,14 @@ void ledger_plugin::plugin_initialize(const variables_map& options) {
             chain.applied_transaction.connect( [&]( const chain::transaction_trace_ptr& t ) {
                my->applied_transaction( t );
             } ));
+         my->accepted_block_connection.emplace(
+            chain.accepted_block.connect( [&]( const chain::block_state_ptr& bsp ) {
+               my->accepted_block( bsp );
+            } ));
          
          ilog( "connect to ${h}:${p}. ${u}@${d} ", ("h", host_str)("p", port)("u", userid)("d", database));
          bool close_on_unlock = options.at("ledger-db-close-on-unlock").as<bool>();
-         my->init(host_str, userid, pwd, database, port, max_conn, close_on_unlock, my->start_block_num, options);
+         my->init(host_str, userid, pwd, database, port, max_conn, close_on_unlock, block_start, options);
          
       } else {
          wlog( "eosio::ledger_plugin configured, but no --ledger-db-uri specified." );
@@ -568,21 +2105,46 @@ void ledger_plugin::plugin_initialize(const variables_map& options) {
 
 void ledger_plugin::plugin_startup() {
    // Make the magic happen
+   if( my->configured && my->bootstrap_tokens_on_startup ) {
+      my->bootstrap_tokens();
+   }
+   if( my->configured ) {
+      my->register_api();
+   }
+   if( my->configured && my->verify_on_startup ) {
+      my->start_verify( ledger_apis::verify_balances_params() );
+   }
+   // 모든 plugin 이 thread 를 만든 뒤 main thread (chain) 에서 실행되도록 io_service 로.
+   if( my->configured && !my->chain_thread_cpus.empty() ) {
+      app().get_io_service().post( [cpus = my->chain_thread_cpus]() {
+         if( worker_pool::pin_current_thread( cpus ))
+            ilog("chain thread pinned to reserved cpus");
+         else
+            wlog("unable to pin chain thread");
+      });
+   }
 }
 
 void ledger_plugin::plugin_shutdown() {
    // OK, that's enough magic
    my->applied_transaction_connection.reset();
+   my->accepted_block_connection.reset();
    my.reset();
 }
 
-void post_query_str_to_queue(const std::string query_str) {
+void post_query_str_to_queue(const std::string query_str, const uint32_t block_num, const uint32_t shard) {
       if (!static_ledger_plugin_impl) return; 
 
       // ilog(query_str);
 
+      static_ledger_plugin_impl->watermarks.statement_queued( block_num );
+      static_ledger_plugin_impl->m_router->statement_queued( shard, block_num );
+      if( static_ledger_plugin_impl->overflow( query_str, block_num, shard )) return;
+      static_ledger_plugin_impl->m_memory->reserve( memory_governor::component::query_queue, query_str.size() );
       static_ledger_plugin_impl->queue(
-            static_ledger_plugin_impl->mtx_query, static_ledger_plugin_impl->query_queue, query_str
+            static_ledger_plugin_impl->mtx_query, static_ledger_plugin_impl->query_queue, 
+            ledger_plugin_impl::queued_query{ query_str, span_tracer::enabled() ? span_tracer::now_ns() : 0, block_num, shard },
+            static_ledger_plugin_impl->max_queue_size, false
       );
 }
 
@@ -1,5 +1,13 @@
 #include "mysqlconn.h"
 
+#include <algorithm>
+#include <cctype>
+
+#include <errmsg.h>
+#ifdef MYSQLCONN_HAS_NONBLOCKING
+#include <poll.h>
+#endif
+
 //----------------
 
 LockableObj::LockableObj() {
@@ -44,28 +52,25 @@ void MysqlRow::add_value(const string value) {
 
 //----------------
 
-MysqlData::MysqlData(): _conn(nullptr), _sqlResult(nullptr) {
+MysqlData::MysqlData(): _conn(nullptr), _sqlResult(nullptr), _mode(Mode::Use), _fieldCount(0) {
 
 } 
 
 MysqlData::~MysqlData() {
+    // Use 모드면 남은 줄을 서버에서 끝까지 읽어 버린 뒤 해제된다. 
     if (_sqlResult)
         mysql_free_result(_sqlResult);
 }
 
-bool MysqlData::store(MYSQL* conn) {
+bool MysqlData::store(MYSQL* conn, const Mode mode) {
     if (!conn) return false; 
 
-    _sqlResult = mysql_use_result(conn);
+    _sqlResult = mode == Mode::Store ? mysql_store_result(conn) : mysql_use_result(conn);
     if (!_sqlResult) return false; 
 
     _conn = conn; 
-
-    _columns.clear(); 
-    for ( unsigned int i=0; i< mysql_num_fields(_sqlResult); i++ ) {
-        MYSQL_FIELD* sqlField = mysql_fetch_field_direct(_sqlResult, i);
-        _columns.push_back( sqlField->name );
-    }
+    _mode = mode; 
+    _fieldCount = mysql_num_fields(_sqlResult); 
 
     return true; 
 }
@@ -76,33 +81,44 @@ bool MysqlData::is_valid() const {
 
 
 const size_t MysqlData::get_columnCount() const {
-    return _columns.size(); 
+    return _fieldCount; 
 }
 
 const string MysqlData::get_columnName(const size_t index) {
-  if ( index < _columns.size() ) 
-    return _columns[index];
+  if ( index < _fieldCount ) 
+    return mysql_fetch_field_direct(_sqlResult, index)->name;
   else
     return ""; 
 
 }
 
-shared_ptr<MysqlRow> MysqlData::next() {
+my_ulonglong MysqlData::get_rowCount() const {
+    return _sqlResult ? mysql_num_rows(_sqlResult) : 0; 
+}
+
+MysqlRowView MysqlData::fetch() {
+    if (!_sqlResult) return MysqlRowView(); 
+
     MYSQL_ROW sqlRow = mysql_fetch_row(_sqlResult);
-    if (!sqlRow) return nullptr; 
-    
+    if (!sqlRow) return MysqlRowView(); 
+
+    return MysqlRowView(sqlRow, mysql_fetch_lengths(_sqlResult), _fieldCount); 
+}
+
+shared_ptr<MysqlRow> MysqlData::next() {
+    const auto row = fetch(); 
+    if (!row) return nullptr; 
 
     shared_ptr<MysqlRow> retData( new MysqlRow ); 
-    unsigned long *lengths = mysql_fetch_lengths(_sqlResult);
-    for (size_t i=0; i<_columns.size(); i++) {
-        retData->add_value( string(sqlRow[i], lengths[i]) );
+    for (size_t i=0; i<row.size(); i++) {
+        retData->add_value( row.get_value(i) );
     }
 
     return retData; 
 } 
 
 bool MysqlData::more() {
-    _columns.clear(); 
+    _fieldCount = 0; 
 
     if (_sqlResult) {
         mysql_free_result(_sqlResult);
@@ -110,7 +126,7 @@ bool MysqlData::more() {
     }
 
     if (_conn && mysql_next_result(_conn) == 0) {
-        store(_conn); 
+        store(_conn, _mode); 
         return true; 
     }
 
@@ -141,6 +157,11 @@ bool MysqlConnection::connect(
     _mysql = mysql_init(nullptr);
     // 압축전송 사용.
     mysql_options(_mysql, MYSQL_OPT_COMPRESS, nullptr);
+    if (timeoutSec) {
+        mysql_options(_mysql, MYSQL_OPT_CONNECT_TIMEOUT, &timeoutSec);
+        mysql_options(_mysql, MYSQL_OPT_READ_TIMEOUT, &timeoutSec);
+        mysql_options(_mysql, MYSQL_OPT_WRITE_TIMEOUT, &timeoutSec);
+    }
 
     _conn =
         mysql_real_connect(
@@ -169,7 +190,47 @@ bool MysqlConnection::connect(
 
 }
 
+#ifdef MYSQLCONN_HAS_NONBLOCKING
+net_async_status MysqlConnection::connectNonblocking(
+    const string& host, 
+    const string& user, 
+    const string& passwd, 
+    const string& database,
+    unsigned int port
+) {
+    if (!_connecting) {
+        disconnect(); 
+        _mysql = mysql_init(nullptr);
+        mysql_options(_mysql, MYSQL_OPT_COMPRESS, nullptr);
+        if (timeoutSec) {
+            mysql_options(_mysql, MYSQL_OPT_CONNECT_TIMEOUT, &timeoutSec);
+            mysql_options(_mysql, MYSQL_OPT_READ_TIMEOUT, &timeoutSec);
+            mysql_options(_mysql, MYSQL_OPT_WRITE_TIMEOUT, &timeoutSec);
+        }
+        // connect() 의 SET NAMES / time_zone 을 연결 과정에 싣는다. (따로 blocking 쿼리를 보내지 않도록) 
+        mysql_options(_mysql, MYSQL_SET_CHARSET_NAME, "utf8mb4");
+        mysql_options(_mysql, MYSQL_INIT_COMMAND, "SET time_zone = '+00:00'");
+        _connecting = true; 
+    }
+
+    const auto status = mysql_real_connect_nonblocking(
+        _mysql, host.c_str(), user.c_str(), passwd.c_str(), database.c_str(), port, nullptr,
+        CLIENT_COMPRESS | CLIENT_MULTI_STATEMENTS | CLIENT_MULTI_RESULTS);
+    if (status == NET_ASYNC_NOT_READY) return status; 
+
+    _connecting = false; 
+    if (status == NET_ASYNC_ERROR) {
+        mysql_close(_mysql);
+        _mysql = nullptr;
+        return status; 
+    }
+    _conn = _mysql; 
+    return NET_ASYNC_COMPLETE; 
+}
+#endif
+
 bool MysqlConnection::disconnect() {
+    _connecting = false; 
     if (_mysql) {
         mysql_close(_mysql);
 
@@ -188,30 +249,50 @@ bool MysqlConnection::is_connected() const {
 }
 
 
-shared_ptr<MysqlData> MysqlConnection::open(const string query) const {
+shared_ptr<MysqlData> MysqlConnection::open(const string query, const MysqlData::Mode mode) const {
     shared_ptr<MysqlData> retData( new MysqlData ); 
 
     if (is_connected()) {
         int retVal = mysql_real_query(_conn, query.c_str(), query.size());
         if (retVal == 0) {
-            retData->store(_conn);
+            retData->store(_conn, mode);
         }
     }
 
     return retData; 
 }
 
+bool MysqlConnection::scan(const string query, const std::function<bool(const MysqlRowView&)>& callback, const MysqlData::Mode mode) const {
+    if (!is_connected()) return false; 
+    if (mysql_real_query(_conn, query.c_str(), query.size()) != 0) return false; 
+
+    MysqlData data; 
+    if (!data.store(_conn, mode)) return mysql_field_count(_conn) == 0; 
+
+    while (true) {
+        const auto row = data.fetch(); 
+        if (!row || !callback(row)) break; 
+    }
+    return true; 
+}
+
 // 커서 리턴없는 쿼리 전용. store/use 없이 단순히 mysql_next_result로 처리 가능. 
 // https://dev.mysql.com/doc/refman/8.0/en/c-api-multiple-queries.html
-bool MysqlConnection::exec(const string query, const bool multiline, my_ulonglong* affectRowsPtr) const {
+bool MysqlConnection::exec(const string& query, const bool multiline, my_ulonglong* affectRowsPtr) const {
+    return execText(query.data(), query.size(), multiline, affectRowsPtr); 
+}
+
+bool MysqlConnection::execText(const char* query, const size_t length, const bool multiline, my_ulonglong* affectRowsPtr) const {
+    if (!is_connected()) return false; 
 
-    if (mysql_real_query(_conn, query.c_str(), query.size()) == 0) {
+    if (mysql_real_query(_conn, query, length) == 0) {
         if (affectRowsPtr) 
             *affectRowsPtr = mysql_affected_rows(_mysql);
 
         if (multiline) {
             //MYSQL_RES* sqlResult = mysql_use_result(_conn);
-            while (mysql_next_result(_conn) == 0) {
+            int next; 
+            while ((next = mysql_next_result(_conn)) == 0) {
                 //mysql_free_result(sqlResult); 
 
                 if (affectRowsPtr) 
@@ -220,6 +301,8 @@ bool MysqlConnection::exec(const string query, const bool multiline, my_ulonglon
                 //sqlResult = mysql_use_result(_conn);
             }
             //mysql_free_result(sqlResult); 
+            // > 0 은 뒤쪽 statement 실패. 트랜잭션이면 앞의 것도 rollback 되어야 하므로 실패로. 
+            if (next > 0) return false; 
         }
         return true; 
     } else {
@@ -229,9 +312,14 @@ bool MysqlConnection::exec(const string query, const bool multiline, my_ulonglon
     //return mysql_real_query(_conn, query.c_str(), query.size()) == 0; 
 }
 
-bool MysqlConnection::execute(const string query, const bool multiline, my_ulonglong* affectRowsPtr) const {
+bool MysqlConnection::execute(const string& query, const bool multiline, my_ulonglong* affectRowsPtr) const {
+    return executeText(query.data(), query.size(), multiline, affectRowsPtr); 
+}
+
+bool MysqlConnection::executeText(const char* query, const size_t length, const bool multiline, my_ulonglong* affectRowsPtr) const {
     if (transactionOnExecute) transactionStart(); 
-    bool retVal = exec(query, multiline, affectRowsPtr); 
+    bool retVal = execText(query, length, multiline, affectRowsPtr); 
+    _lastErrno = retVal ? 0 : _mysql ? mysql_errno(_mysql) : CR_SERVER_GONE_ERROR; 
     if (retVal) {
         if (transactionOnExecute) transactionCommit(); 
     } else {
@@ -241,6 +329,83 @@ bool MysqlConnection::execute(const string query, const bool multiline, my_ulong
 }
 
 
+// ; 로 나뉜 statement 수. 문자열 / 식별자 안의 ; 는 세지 않는다. 
+static size_t count_statements(const char* query, const size_t length) {
+    size_t count = 1; 
+    char quote = 0; 
+    for (size_t i = 0; i < length; i++) {
+        const char c = query[i]; 
+        if (quote) {
+            if (c == '\\' && quote != '`') i++; 
+            else if (c == quote) quote = 0; 
+        } else if (c == '\'' || c == '"' || c == '`') {
+            quote = c; 
+        } else if (c == ';') {
+            count++; 
+        }
+    }
+    return count; 
+}
+
+size_t MysqlConnection::execPipeline(const std::vector<string>& queries, const size_t first, my_ulonglong* affectRowsPtr) const {
+    if (affectRowsPtr) *affectRowsPtr = 0; 
+    if (first >= queries.size() || !is_connected()) return 0; 
+
+    size_t bytes = 0; 
+    for (size_t i = first; i < queries.size(); i++) bytes += queries[i].size() + 32; 
+
+    // query 마다 서버가 돌려줄 결과 수. 여러 statement 인 query 는 transaction 으로 묶는다.
+    std::vector<size_t> results; 
+    results.reserve(queries.size() - first); 
+    string packet; 
+    packet.reserve(bytes); 
+    for (size_t i = first; i < queries.size(); i++) {
+        const auto& q = queries[i]; 
+        // 끝의 ; 는 빈 statement 가 되어 에러이므로 뗀다. 
+        size_t len = q.size(); 
+        while (len && (q[len - 1] == ';' || isspace(static_cast<unsigned char>(q[len - 1])))) len--; 
+        const size_t statements = count_statements(q.data(), len); 
+        if (!packet.empty()) packet += ';'; 
+        if (statements > 1) packet += "START TRANSACTION;"; 
+        packet.append(q, 0, len); 
+        if (statements > 1) packet += ";COMMIT"; 
+        results.push_back(statements > 1 ? statements + 2 : statements); 
+    }
+
+    if (mysql_real_query(_conn, packet.c_str(), packet.size()) != 0) return 0; 
+
+    size_t done = 0; 
+    bool failed = false; 
+    while (true) {
+        done++; 
+        // 결과 셋이 있으면 비워야 다음 statement 로 넘어간다. 
+        MYSQL_RES* sqlResult = mysql_store_result(_conn); 
+        if (sqlResult) mysql_free_result(sqlResult); 
+        if (affectRowsPtr) *affectRowsPtr += mysql_affected_rows(_conn); 
+
+        // 0 다음 결과 있음, -1 끝, > 0 다음 statement 실패
+        const int next = mysql_next_result(_conn); 
+        if (next != 0) {
+            failed = next > 0; 
+            break; 
+        }
+    }
+
+    // 끝까지 성공한 query 만 센다. 중간에 실패한 query 의 transaction 은 되돌린다.
+    size_t completed = 0; 
+    for (const auto n : results) {
+        if (n > done) break; 
+        done -= n; 
+        completed++; 
+    }
+    if (failed && completed < results.size() && results[completed] > 1) {
+        const int err = mysql_errno(_conn); 
+        exec("ROLLBACK"); 
+        _lastErrno = err; 
+    }
+    return completed; 
+}
+
 bool MysqlConnection::ping() const {
     return _conn && (mysql_ping(_conn) == 0);
 } 
@@ -250,27 +415,15 @@ my_ulonglong MysqlConnection::affectrows() const {
 }
 
 const char * MysqlConnection::lastError() const {
-    return mysql_error(_mysql);
+    return _mysql ? mysql_error(_mysql) : "not connected";
 }
 
-long long MysqlConnection::lastInsertID() const {
-    long long retVal = 0; 
-
-    auto data = open("SELECT LAST_INSERT_ID() AS ID");
-    if (data->is_valid()) {
-        auto rowObj = data->next(); 
-        if (rowObj) {
-            try {
-                retVal = std::stoll(rowObj->get_value(0));
-            }
-            //catch (const std::invalid_argument& is) {
-            catch (...) {
-                retVal = 0;
-            }
-        }
-    }
+unsigned int MysqlConnection::lastErrno() const {
+    return _lastErrno;
+}
 
-    return retVal; 
+long long MysqlConnection::lastInsertID() const {
+    return _conn ? static_cast<long long>(mysql_insert_id(_conn)) : 0; 
 } 
 
 void  MysqlConnection::unlock(bool do_disconnect) {
@@ -313,19 +466,26 @@ unsigned long MysqlConnection::escapeString( char *to, const char *from, unsigne
 }
 
 
+// 문장마다 string 임시객체가 생기지 않도록 
+static const string SQL_AUTOCOMMIT_OFF = "SET AUTOCOMMIT=0"; 
+static const string SQL_AUTOCOMMIT_ON  = "SET AUTOCOMMIT=1"; 
+static const string SQL_BEGIN    = "BEGIN"; 
+static const string SQL_COMMIT   = "COMMIT"; 
+static const string SQL_ROLLBACK = "ROLLBACK"; 
+
 void MysqlConnection::transactionStart() const {
-  exec("SET AUTOCOMMIT=0");
-  exec("BEGIN");
+  exec(SQL_AUTOCOMMIT_OFF);
+  exec(SQL_BEGIN);
 }
 
 void MysqlConnection::transactionCommit() const {
-  exec("COMMIT");
-  exec("SET AUTOCOMMIT=1");
+  exec(SQL_COMMIT);
+  exec(SQL_AUTOCOMMIT_ON);
 }
 
 void MysqlConnection::transactionRollback() const {
-  exec("ROLLBACK");
-  exec("SET AUTOCOMMIT=1");
+  exec(SQL_ROLLBACK);
+  exec(SQL_AUTOCOMMIT_ON);
 }
 
 
@@ -355,8 +515,14 @@ MysqlConnPool::~MysqlConnPool() {
     
 }
 
+void MysqlConnPool::setTimeout(const unsigned int sec) {
+    _timeoutSec = sec; 
+    for (auto& conn : _connList) conn->timeoutSec = sec; 
+}
+
 const bool MysqlConnPool::checkConnection() const {
     MysqlConnection conn; 
+    conn.timeoutSec = _timeoutSec; 
     return conn.connect(_host, _user, _passwd, _database, _port);
 }
 
@@ -388,6 +554,7 @@ shared_ptr<MysqlConnection> MysqlConnPool::lockConnection() {
 
     while ( !retConn->is_connected()  || !retConn->ping() ) {
         //std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (_abortReconnect) break; 
         
         retConn->connect(_host, _user, _passwd, _database, _port);
     }
@@ -411,3 +578,259 @@ shared_ptr<MysqlConnection> MysqlConnPool::lockConnection() {
     return retConn; 
 }
 
+//---------
+MysqlAsyncEngine::MysqlAsyncEngine(
+    const unsigned int connCount,
+    const string host, 
+    const string user, 
+    const string passwd, 
+    const string database,
+    unsigned int port
+
+): _connCount(connCount), _host(host), _user(user), _passwd(passwd), _database(database), _port(port) {
+
+}
+
+MysqlAsyncEngine::~MysqlAsyncEngine() {
+    stop(); 
+}
+
+bool MysqlAsyncEngine::supported() {
+#ifdef MYSQLCONN_HAS_NONBLOCKING
+    return true; 
+#else
+    return false; 
+#endif
+}
+
+bool MysqlAsyncEngine::start() {
+#ifdef MYSQLCONN_HAS_NONBLOCKING
+    if (_thread.joinable()) return true; 
+
+    _slots.resize(_connCount); 
+    for (auto& slot : _slots) {
+        slot.conn = shared_ptr<MysqlConnection>( new MysqlConnection ); 
+        if (!slot.conn->connect(_host, _user, _passwd, _database, _port)) return false; 
+    }
+
+    _stopping = false; 
+    _thread = std::thread([this] { run(); }); 
+    return true; 
+#else
+    return false; 
+#endif
+}
+
+void MysqlAsyncEngine::stop() {
+    _stopping = true; 
+    _cv.notify_all(); 
+    if (_thread.joinable()) _thread.join(); 
+}
+
+void MysqlAsyncEngine::submit(string query, Callback callback) {
+    {
+        std::lock_guard<std::mutex> lock(_mtx); 
+        Job job; 
+        job.query = std::move(query); 
+        job.callback = std::move(callback); 
+        _queue.push_back(std::move(job)); 
+    }
+    _cv.notify_one(); 
+}
+
+size_t MysqlAsyncEngine::pending() const {
+    std::lock_guard<std::mutex> lock(_mtx); 
+    return _queue.size() + _inflight; 
+}
+
+#ifdef MYSQLCONN_HAS_NONBLOCKING
+
+static const string ROLLBACK_STR = "ROLLBACK"; 
+
+void MysqlAsyncEngine::run() {
+    std::vector<pollfd> fds; 
+
+    while (true) {
+        // 빈 커넥션에 쿼리를 싣는다. 
+        {
+            std::unique_lock<std::mutex> lock(_mtx); 
+            if (_inflight == 0 && _queue.empty()) {
+                if (_stopping) break; 
+                _cv.wait_for(lock, std::chrono::milliseconds(100)); 
+                continue; 
+            }
+
+            for (auto& slot : _slots) {
+                if (_queue.empty()) break; 
+                if (slot.state != State::Idle || !slot.conn->is_connected()) continue; 
+
+                slot.job = std::move(_queue.front()); 
+                _queue.pop_front(); 
+                _inflight++; 
+
+                // 끝의 ; 는 빈 statement 가 되므로 뗀다. 
+                auto& q = slot.job.query; 
+                while (!q.empty() && (q.back() == ';' || isspace(static_cast<unsigned char>(q.back())))) q.pop_back(); 
+                slot.sql = "START TRANSACTION;" + q + ";COMMIT"; 
+
+                slot.affectRows = 0; 
+                slot.error.clear(); 
+                slot.state = State::Query; 
+            }
+        }
+
+        // 끊긴 커넥션은 쿼리를 싣지 않고 다시 연결한다. 멈추는 중인데 하나도 연결되지 않으면 남은 것은 실패. 
+        bool connected = false, failed = false; 
+        for (auto& slot : _slots) {
+            if (slot.state == State::Idle && !slot.conn->is_connected() && std::chrono::steady_clock::now() >= slot.retryAt) 
+                slot.state = State::Connect; 
+            if (slot.state == State::Connect && !reconnect(slot) && slot.state == State::Idle) failed = true; 
+            if (slot.conn->is_connected()) connected = true; 
+        }
+        if (_stopping && failed && !connected) failQueued("mysql connection unavailable"); 
+
+        // 각 커넥션을 진행. 진행이 없으면 socket 을 기다린다. 
+        bool progressed = false; 
+        fds.clear(); 
+        for (auto& slot : _slots) {
+            if (slot.state == State::Idle || slot.state == State::Connect) continue; 
+            while (advance(slot)) progressed = true; 
+            if (slot.state != State::Idle) {
+                pollfd p; 
+                p.fd = slot.conn->handle()->net.fd; 
+                p.events = POLLIN; 
+                p.revents = 0; 
+                fds.push_back(p); 
+            }
+        }
+        // 큰 쿼리를 보내는 중에는 쓰기 대기일 수 있어 짧게만 기다린다. 
+        if (!progressed && !fds.empty()) 
+            poll(fds.data(), fds.size(), 1); 
+        else if (!progressed) 
+            std::this_thread::sleep_for(std::chrono::milliseconds(1)); 
+    }
+}
+
+// 상태가 바뀌었으면 true. 
+bool MysqlAsyncEngine::advance(Slot& slot) {
+    MYSQL* m = slot.conn->handle(); 
+
+    auto afterResult = [&]() {
+        if (mysql_field_count(m) > 0) {
+            slot.state = State::Store; 
+            return true; 
+        }
+        const my_ulonglong rows = mysql_affected_rows(m); 
+        if (rows != static_cast<my_ulonglong>(-1)) slot.affectRows += rows; 
+
+        if (mysql_more_results(m)) slot.state = State::Next; 
+        else finish(slot, true); 
+        return true; 
+    };
+
+    switch (slot.state) {
+        case State::Query: {
+            const auto status = mysql_real_query_nonblocking(m, slot.sql.c_str(), slot.sql.size()); 
+            if (status == NET_ASYNC_NOT_READY) return false; 
+            if (status == NET_ASYNC_ERROR) { fail(slot); return true; }
+            return afterResult(); 
+        }
+        case State::Store: {
+            MYSQL_RES* result = nullptr; 
+            const auto status = mysql_store_result_nonblocking(m, &result); 
+            if (status == NET_ASYNC_NOT_READY) return false; 
+            if (result) mysql_free_result(result); 
+            if (status == NET_ASYNC_ERROR) { fail(slot); return true; }
+            if (mysql_more_results(m)) slot.state = State::Next; 
+            else finish(slot, true); 
+            return true; 
+        }
+        case State::Next: {
+            const auto status = mysql_next_result_nonblocking(m); 
+            if (status == NET_ASYNC_NOT_READY) return false; 
+            if (status == NET_ASYNC_ERROR) { fail(slot); return true; }
+            if (status == NET_ASYNC_COMPLETE_NO_MORE_RESULTS) { finish(slot, true); return true; }
+            return afterResult(); 
+        }
+        case State::Rollback: {
+            const auto status = mysql_real_query_nonblocking(m, ROLLBACK_STR.c_str(), ROLLBACK_STR.size()); 
+            if (status == NET_ASYNC_NOT_READY) return false; 
+            if (status == NET_ASYNC_ERROR) slot.conn->disconnect(); 
+            finish(slot, false); 
+            return true; 
+        }
+        default:
+            return false; 
+    }
+}
+
+void MysqlAsyncEngine::fail(Slot& slot) {
+    MYSQL* m = slot.conn->handle(); 
+    slot.error = mysql_error(m); 
+    const auto err = mysql_errno(m); 
+
+    if (err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST) {
+        // COMMIT 까지 서버에 닿았는지 알 수 없다. 다시 보내면 두 번 반영될 수 있으므로 실패로 알리기만. 
+        slot.error += " (commit state unknown)"; 
+        slot.conn->disconnect(); 
+        finish(slot, false); 
+        return; 
+    }
+
+    slot.state = State::Rollback; 
+}
+
+bool MysqlAsyncEngine::reconnect(Slot& slot) {
+    const auto status = slot.conn->connectNonblocking(_host, _user, _passwd, _database, _port); 
+    if (status == NET_ASYNC_NOT_READY) return false; 
+
+    slot.state = State::Idle; 
+    if (status == NET_ASYNC_COMPLETE) {
+        slot.backoffMs = 0; 
+        return true; 
+    }
+    slot.backoffMs = std::min(slot.backoffMs ? slot.backoffMs * 2 : 100u, 5000u); 
+    slot.retryAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(slot.backoffMs); 
+    return false; 
+}
+
+void MysqlAsyncEngine::failQueued(const string& error) {
+    std::deque<Job> jobs; 
+    {
+        std::lock_guard<std::mutex> lock(_mtx); 
+        jobs.swap(_queue); 
+    }
+    for (auto& job : jobs) {
+        if (!job.callback) continue; 
+        try {
+            job.callback(false, 0, error); 
+        } catch (...) {
+        }
+    }
+}
+
+void MysqlAsyncEngine::finish(Slot& slot, const bool ok) {
+    Job job = std::move(slot.job); 
+    slot.state = State::Idle; 
+
+    if (job.callback) {
+        try {
+            job.callback(ok, slot.affectRows, slot.error); 
+        } catch (...) {
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_mtx); 
+    _inflight--; 
+}
+
+#else
+
+void MysqlAsyncEngine::run() {}
+bool MysqlAsyncEngine::advance(Slot&) { return false; }
+void MysqlAsyncEngine::finish(Slot&, const bool) {}
+void MysqlAsyncEngine::fail(Slot&) {}
+bool MysqlAsyncEngine::reconnect(Slot&) { return false; }
+void MysqlAsyncEngine::failQueued(const string&) {}
+
+#endif
@@ -2,14 +2,25 @@
 
 //#include <cstdlib>
 #include <cassert>
+#include <cstdint>
 #include <vector>
 #include <iostream>
 #include <string>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
 #include <mysql.h>
 
+// libmysqlclient 8.0.16 부터 *_nonblocking API 제공. 
+#if defined(LIBMYSQL_VERSION_ID) && LIBMYSQL_VERSION_ID >= 80016
+#define MYSQLCONN_HAS_NONBLOCKING 1
+#endif
+
 using std::string; 
 using std::shared_ptr;
 
@@ -40,32 +51,87 @@ private:
     std::vector <string> _values;
 };
 
-// 한 줄씩 쿼리. 커서는 서버에
+// 현재 줄을 복사 없이 가리킨다. 다음 fetch 나 결과 해제 후에는 무효. 
+// 숫자는 문자열 임시객체 없이 바로 파싱. NULL 이나 숫자가 아니면 0. 
+class MysqlRowView {
+public:
+    MysqlRowView(): _row(nullptr), _lengths(nullptr), _count(0) {}
+    MysqlRowView(MYSQL_ROW row, unsigned long* lengths, size_t count): _row(row), _lengths(lengths), _count(count) {}
+
+    explicit operator bool() const { return _row; }
+    size_t size() const { return _count; }
+
+    bool is_null(const size_t index) const { return index >= _count || !_row[index]; }
+    // NUL 종료 보장 (text protocol). NULL 이면 "" 
+    const char* get_data(const size_t index) const { return is_null(index) ? "" : _row[index]; }
+    size_t get_length(const size_t index) const { return is_null(index) ? 0 : _lengths[index]; }
+    string get_value(const size_t index) const { return string(get_data(index), get_length(index)); }
+
+    uint64_t get_uint(const size_t index) const {
+        return parse_digits<uint64_t>(get_data(index), get_length(index)); 
+    }
+    int64_t get_int(const size_t index) const {
+        const char* p = get_data(index); 
+        const size_t len = get_length(index); 
+        if (len && *p == '-') return -static_cast<int64_t>(parse_digits<uint64_t>(p + 1, len - 1)); 
+        return static_cast<int64_t>(parse_digits<uint64_t>(p, len)); 
+    }
+    // DECIMAL(39,0) 
+    unsigned __int128 get_uint128(const size_t index) const {
+        return parse_digits<unsigned __int128>(get_data(index), get_length(index)); 
+    }
+
+private:
+    template<typename T>
+    static T parse_digits(const char* p, const size_t len) {
+        T v = 0; 
+        for (const char* end = p + len; p != end && *p >= '0' && *p <= '9'; p++) v = v * 10 + static_cast<unsigned>(*p - '0'); 
+        return v; 
+    }
+
+    MYSQL_ROW _row;
+    unsigned long* _lengths;
+    size_t _count;
+};
+
+// 결과 셋. 
+//  - Use   : 한 줄씩 서버에서 가져온다. 메모리 일정, 다 읽을 때까지 커넥션 점유. (큰 스캔)
+//  - Store : 한 번에 클라이언트로 받아 서버 쪽을 바로 놓는다. (작은 결과, row_count 필요할 때)
 class MysqlData {
 public:
+    enum class Mode { Use, Store };
+
     MysqlData(); 
     virtual ~MysqlData(); 
 
-    bool store(MYSQL* conn);
+    bool store(MYSQL* conn, const Mode mode = Mode::Use);
     bool is_valid() const; 
 
     const size_t get_columnCount() const; 
     const string get_columnName(const size_t index); 
+    // Store 모드에서만 의미 있음
+    my_ulonglong get_rowCount() const; 
 
+    // 할당 없이 다음 줄. 끝이면 빈 view
+    MysqlRowView fetch(); 
+    // 줄마다 복사본. 작은 결과에만 
     shared_ptr<MysqlRow> next(); 
     bool more(); 
 
 private:
     MYSQL* _conn;
     MYSQL_RES* _sqlResult;
-
-    std::vector<string> _columns; 
+    Mode _mode;
+    size_t _fieldCount;
 };
 
 
 class MysqlConnection: public LockableObj {
 public:
     bool transactionOnExecute = true; 
+    // 0 이 아니면 connect / read / write 각각의 시한 (초). 서버가 멈춰도 쿼리가 끝없이 기다리지 않도록. 
+    // connect 때 적용된다. (read 는 재시도 때문에 실제로는 최대 세 배) 
+    unsigned int timeoutSec = 0; 
 
     MysqlConnection(); 
     virtual ~MysqlConnection(); 
@@ -78,14 +144,36 @@ public:
         unsigned int port = 0 );
     bool disconnect();
     bool is_connected() const; 
+#ifdef MYSQLCONN_HAS_NONBLOCKING
+    // 기다리지 않는 connect. 끝날 때까지 같은 인자로 반복해서 부른다. 
+    // NET_ASYNC_COMPLETE 면 연결됨, NET_ASYNC_ERROR 면 실패 (다음 호출은 새로 시작), 그 외 진행 중. 
+    net_async_status connectNonblocking(
+        const string& host, 
+        const string& user, 
+        const string& passwd, 
+        const string& database,
+        unsigned int port = 0 );
+#endif
 
-    shared_ptr<MysqlData> open(const string query) const;
-    bool exec(const string query, const bool multiline = false, my_ulonglong* affectRowsPtr = nullptr) const;
-    bool execute(const string query, const bool multiline = false, my_ulonglong* affectRowsPtr = nullptr) const;
+    shared_ptr<MysqlData> open(const string query, const MysqlData::Mode mode = MysqlData::Mode::Use) const;
+    // 결과 줄마다 callback. false 를 리턴하면 나머지는 버린다. 쿼리 실패면 false 
+    bool scan(const string query, const std::function<bool(const MysqlRowView&)>& callback, const MysqlData::Mode mode = MysqlData::Mode::Use) const;
+    bool exec(const string& query, const bool multiline = false, my_ulonglong* affectRowsPtr = nullptr) const;
+    bool execute(const string& query, const bool multiline = false, my_ulonglong* affectRowsPtr = nullptr) const;
+    // std::string 이 아닌 버퍼 (arena 등) 를 복사 없이 
+    bool execText(const char* query, const size_t length, const bool multiline = false, my_ulonglong* affectRowsPtr = nullptr) const;
+    bool executeText(const char* query, const size_t length, const bool multiline = false, my_ulonglong* affectRowsPtr = nullptr) const;
+    // 여러 query 를 ; 로 이어 한 번의 왕복으로 보낸다. 한 statement 인 query 는 autocommit 으로 따로 반영되고
+    // 여러 statement 인 query 는 transaction 으로 묶인다. 
+    // queries[first] 부터 앞에서 연달아 성공한 query 개수를 리턴. 실패한 query 뒤로는 서버가 실행하지 않는다. 
+    size_t execPipeline(const std::vector<string>& queries, const size_t first = 0, my_ulonglong* affectRowsPtr = nullptr) const;
 
     bool ping() const; 
     my_ulonglong affectrows() const; 
     const char * lastError() const; 
+    // executeText 가 실패했을 때의 mysqld_error.h / errmsg.h 코드 (rollback 전). 성공이면 0 
+    unsigned int lastErrno() const; 
+    // 이 커넥션의 마지막 AUTO_INCREMENT 값. 서버 왕복 없음 
     long long lastInsertID() const; 
 
 
@@ -97,6 +185,8 @@ public:
     void transactionRollback() const; 
 
     void print() const; 
+
+    MYSQL* handle() const { return _conn; }
 public:
     void unlock(bool do_disconnect = false); 
 public:
@@ -106,6 +196,8 @@ public:
 private:
     MYSQL* _mysql;
     MYSQL* _conn;
+    mutable unsigned int _lastErrno = 0;
+    bool _connecting = false; 
 };
 
 class MysqlConnPool: public LockableObj {
@@ -122,6 +214,11 @@ public:
     const bool checkConnection() const; 
     shared_ptr<MysqlConnection> lockConnection(); 
 
+    // 이후 연결부터 적용. 
+    void setTimeout(const unsigned int sec); 
+    // 종료 중. 다시 연결이 안 되면 더 기다리지 않고 끊긴 커넥션을 돌려준다. (실행은 실패한다) 
+    void abortReconnect() { _abortReconnect = true; } 
+
 private:
     string _host;
     string _user;
@@ -131,5 +228,84 @@ private:
 
     size_t _connIndex; 
     std::vector<shared_ptr<MysqlConnection>> _connList;  
+    unsigned int _timeoutSec = 0; 
+    std::atomic<bool> _abortReconnect{false}; 
+
+};
 
-};
\ No newline at end of file
+
+// non-blocking API 로 thread 하나가 여러 커넥션을 동시에 돌린다. 
+// 쿼리는 "START TRANSACTION; <query>; COMMIT" 한 번의 왕복으로 보내고, 실패하면 ROLLBACK. 
+// 완료되면 event thread 에서 callback 을 부른다. (짧게 끝낼 것)
+// 
+// 실행 중에 커넥션이 끊기면 COMMIT 이 반영됐는지 알 수 없으므로 다시 보내지 않고 실패로 알린다. 
+// 끊긴 커넥션은 event thread 를 멈추지 않고 (nonblocking connect, 실패하면 간격을 늘려가며) 다시 연결한다. 
+// 멈추는 중에 어느 커넥션도 연결되지 않으면 남은 쿼리는 실패로 알린다.
+class MysqlAsyncEngine {
+public:
+    using Callback = std::function<void(const bool ok, const my_ulonglong affectRows, const string& error)>;
+
+    MysqlAsyncEngine(
+        const unsigned int connCount,
+        const string host, 
+        const string user, 
+        const string passwd, 
+        const string database,
+        unsigned int port = 0 );
+    virtual ~MysqlAsyncEngine();
+
+    static bool supported(); 
+
+    bool start(); 
+    // 남은 쿼리를 모두 끝내고 멈춘다. 
+    void stop(); 
+
+    void submit(string query, Callback callback); 
+
+    // 아직 커넥션에 실리지 않은 것 + 실행 중인 것
+    size_t pending() const; 
+    size_t connectionCount() const { return _connCount; }
+
+private:
+    enum class State { Idle, Connect, Query, Store, Next, Rollback };
+
+    struct Job {
+        string query; 
+        Callback callback; 
+    };
+
+    struct Slot {
+        shared_ptr<MysqlConnection> conn; 
+        State state = State::Idle; 
+        Job job; 
+        string sql;                 // 트랜잭션으로 감싼 실제 전송 문자열
+        my_ulonglong affectRows = 0; 
+        string error; 
+        std::chrono::steady_clock::time_point retryAt;     // 끊겼을 때 다음 connect 시도 
+        unsigned int backoffMs = 0; 
+    };
+
+    void run(); 
+    bool advance(Slot& slot); 
+    void finish(Slot& slot, const bool ok); 
+    void fail(Slot& slot); 
+    // 끊긴 커넥션을 한 단계 진행. 연결되었으면 true. 
+    bool reconnect(Slot& slot); 
+    void failQueued(const string& error); 
+
+    unsigned int _connCount; 
+    string _host;
+    string _user;
+    string _passwd;
+    string _database;
+    unsigned int _port;
+
+    std::vector<Slot> _slots; 
+    std::thread _thread; 
+
+    mutable std::mutex _mtx; 
+    std::condition_variable _cv; 
+    std::deque<Job> _queue; 
+    std::atomic<size_t> _inflight{0}; 
+    std::atomic<bool> _stopping{false}; 
+};
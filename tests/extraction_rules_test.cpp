@@ -0,0 +1,243 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  extraction_rules::parse 와 layout_for 를 표로 확인한다.
+ *  잘못된 설정 문자열, role 덮어쓰기, typedef / base struct 풀기, 가변 길이 필드 뒤의 필드 (fixed 가 아니어야 함).
+ *  실패하면 경우와 값을 출력하고 1 을 리턴.
+ */
+#include <eosio/chain/abi_def.hpp>
+#include <eosio/chain/name.hpp>
+
+#include <fc/io/json.hpp>
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "extraction_rules.hpp"
+
+using namespace eosio;
+
+static int failures = 0;
+
+static void expect(const bool ok, const std::string& what) {
+    if (ok) return;
+    failures++;
+    std::printf("%s\n", what.c_str());
+}
+
+static const char* kind_name(const extraction_kind k) {
+    switch (k) {
+        case extraction_kind::transfer: return "transfer";
+        case extraction_kind::create:   return "create";
+        default:                        return "record";
+    }
+}
+
+struct parse_case {
+    const char* spec;
+    bool valid;
+    const char* contract;       // "" 이면 * (0)
+    const char* action;
+    extraction_kind kind;
+    const char* from;
+    const char* to;
+    const char* quantity;
+};
+
+static const parse_case parse_cases[] = {
+    // 기본 필드
+    { "* transfer transfer",            true, "", "transfer", extraction_kind::transfer, "from", "to", "quantity" },
+    { "eosio.token create create",      true, "eosio.token", "create", extraction_kind::create, "", "issuer", "maximum_supply" },
+    { "* issue record",                 true, "", "issue", extraction_kind::record, "", "", "" },
+    // role 덮어쓰기. 순서와 무관하고 나머지는 기본값.
+    { "mytoken xfer transfer quantity=amount from=sender to=receiver",
+                                        true, "mytoken", "xfer", extraction_kind::transfer, "sender", "receiver", "amount" },
+    { "mytoken xfer transfer to=dest",  true, "mytoken", "xfer", extraction_kind::transfer, "from", "dest", "quantity" },
+    { "* issue record to=to quantity=quantity",
+                                        true, "", "issue", extraction_kind::record, "", "to", "quantity" },
+    { "  *   transfer   transfer  ",    true, "", "transfer", extraction_kind::transfer, "from", "to", "quantity" },
+    // 잘못된 설정
+    { "",                               false },
+    { "* transfer",                     false },
+    { "* transfer move",                false },    // 모르는 kind
+    { "waytoolongaccountname transfer transfer", false },
+    { "* Transfer transfer",            false },    // name 에 대문자
+    { "* transfer transfer sender",     false },    // = 없음
+    { "* transfer transfer memo=note",  false },    // 모르는 role
+    { "* transfer transfer from=",      false },    // transfer 에 from 이 비었다
+    { "* create create quantity=",      false },
+    { "* create create to=",            false },
+};
+
+static void check_parse(const parse_case& c) {
+    const std::string what = std::string("parse(\"") + c.spec + "\")";
+    extraction_rule r;
+    try {
+        r = extraction_rules::parse(c.spec);
+    } catch (const std::invalid_argument&) {
+        expect(!c.valid, what + ": unexpected std::invalid_argument");
+        return;
+    } catch (...) {
+        expect(false, what + ": threw something other than std::invalid_argument");
+        return;
+    }
+    if (!c.valid) {
+        expect(false, what + ": accepted");
+        return;
+    }
+    const uint64_t contract = *c.contract ? chain::name(c.contract).value : 0;
+    expect(r.contract == contract, what + ": contract " + chain::name(r.contract).to_string());
+    expect(r.action == chain::name(c.action).value, what + ": action " + chain::name(r.action).to_string());
+    expect(r.kind == c.kind, what + ": kind " + kind_name(r.kind));
+    expect(r.from_field == c.from, what + ": from '" + r.from_field + "'");
+    expect(r.to_field == c.to, what + ": to '" + r.to_field + "'");
+    expect(r.quantity_field == c.quantity, what + ": quantity '" + r.quantity_field + "'");
+}
+
+// 같은 key 는 뒤의 규칙이 이기고, 정확한 contract 가 * 보다 먼저.
+static void check_lookup() {
+    const extraction_rules rules({
+        extraction_rules::parse("* transfer transfer"),
+        extraction_rules::parse("mytoken transfer transfer from=sender"),
+        extraction_rules::parse("* transfer transfer to=dest"),
+        extraction_rules::parse("* issue record"),
+    });
+    expect(rules.rules().size() == 3, "rules: duplicate key not replaced");
+
+    const auto* any = rules.find(chain::name("eosio.token").value, chain::name("transfer").value);
+    expect(any && any->to_field == "dest" && any->from_field == "from", "find(eosio.token, transfer): expected the later * rule");
+    const auto* exact = rules.find(chain::name("mytoken").value, chain::name("transfer").value);
+    expect(exact && exact->from_field == "sender", "find(mytoken, transfer): expected the exact contract rule");
+    expect(!rules.find(chain::name("mytoken").value, chain::name("retire").value), "find(mytoken, retire): expected no rule");
+}
+
+// typedef 사슬 (acct2 -> account -> name), typedef 로 지정한 base, 가변 길이 필드.
+static const char* const test_abi = R"=====({
+   "version": "eosio::abi/1.1",
+   "types": [
+      { "new_type_name": "account", "type": "name" },
+      { "new_type_name": "acct2", "type": "account" },
+      { "new_type_name": "money", "type": "asset" },
+      { "new_type_name": "header_t", "type": "header" }
+   ],
+   "structs": [
+      { "name": "transfer", "base": "", "fields": [
+         { "name": "from", "type": "name" },
+         { "name": "to", "type": "name" },
+         { "name": "quantity", "type": "asset" },
+         { "name": "memo", "type": "string" } ] },
+      { "name": "xfer", "base": "", "fields": [
+         { "name": "sender", "type": "account" },
+         { "name": "receiver", "type": "acct2" },
+         { "name": "amount", "type": "money" } ] },
+      { "name": "header", "base": "", "fields": [
+         { "name": "from", "type": "name" } ] },
+      { "name": "based", "base": "header", "fields": [
+         { "name": "to", "type": "name" },
+         { "name": "quantity", "type": "asset" } ] },
+      { "name": "basedtd", "base": "header_t", "fields": [
+         { "name": "to", "type": "account" },
+         { "name": "quantity", "type": "money" } ] },
+      { "name": "padded", "base": "", "fields": [
+         { "name": "id", "type": "uint64" },
+         { "name": "flag", "type": "bool" },
+         { "name": "from", "type": "name" },
+         { "name": "to", "type": "name" },
+         { "name": "quantity", "type": "asset" } ] },
+      { "name": "varmid", "base": "", "fields": [
+         { "name": "from", "type": "name" },
+         { "name": "to", "type": "name" },
+         { "name": "tag", "type": "string" },
+         { "name": "quantity", "type": "asset" } ] },
+      { "name": "memofirst", "base": "", "fields": [
+         { "name": "memo", "type": "string" },
+         { "name": "from", "type": "name" },
+         { "name": "to", "type": "name" },
+         { "name": "quantity", "type": "asset" } ] },
+      { "name": "optfirst", "base": "", "fields": [
+         { "name": "ref", "type": "uint64?" },
+         { "name": "from", "type": "name" },
+         { "name": "to", "type": "name" },
+         { "name": "quantity", "type": "asset" } ] },
+      { "name": "wrongtype", "base": "", "fields": [
+         { "name": "from", "type": "uint64" },
+         { "name": "to", "type": "name" },
+         { "name": "quantity", "type": "asset" } ] },
+      { "name": "create", "base": "", "fields": [
+         { "name": "issuer", "type": "name" },
+         { "name": "maximum_supply", "type": "asset" } ] },
+      { "name": "badbase", "base": "missing", "fields": [
+         { "name": "from", "type": "name" } ] }
+   ],
+   "actions": [
+      { "name": "transfer", "type": "transfer", "ricardian_contract": "" },
+      { "name": "xfer", "type": "xfer", "ricardian_contract": "" },
+      { "name": "based", "type": "based", "ricardian_contract": "" },
+      { "name": "basedtd", "type": "basedtd", "ricardian_contract": "" },
+      { "name": "padded", "type": "padded", "ricardian_contract": "" },
+      { "name": "varmid", "type": "varmid", "ricardian_contract": "" },
+      { "name": "memofirst", "type": "memofirst", "ricardian_contract": "" },
+      { "name": "optfirst", "type": "optfirst", "ricardian_contract": "" },
+      { "name": "wrongtype", "type": "wrongtype", "ricardian_contract": "" },
+      { "name": "create", "type": "create", "ricardian_contract": "" },
+      { "name": "badbase", "type": "badbase", "ricardian_contract": "" }
+   ]
+})=====";
+
+struct layout_case {
+    const char* action;
+    const char* rule;
+    bool fixed;
+    int32_t from;
+    int32_t to;
+    int32_t quantity;
+    uint32_t min_size;
+};
+
+static const layout_case layout_cases[] = {
+    // 가변 길이 memo 는 필요한 필드 뒤라 상관없다.
+    { "transfer",  "* transfer transfer",                                         true,   0,  8, 16, 32 },
+    { "xfer",      "* xfer transfer from=sender to=receiver quantity=amount",     true,   0,  8, 16, 32 },
+    { "xfer",      "* xfer transfer",                                             false, -1, -1, -1,  0 },
+    { "based",     "* based transfer",                                            true,   0,  8, 16, 32 },
+    { "basedtd",   "* basedtd transfer",                                          true,   0,  8, 16, 32 },
+    { "padded",    "* padded transfer",                                           true,   9, 17, 25, 41 },
+    // 가변 길이 필드 뒤의 quantity 는 offset 을 알 수 없다. from / to 는 찾아도 fixed 가 아니다.
+    { "varmid",    "* varmid transfer",                                           false,  0,  8, -1, 16 },
+    { "varmid",    "* varmid record to=to",                                       true,  -1,  8, -1, 16 },
+    { "memofirst", "* memofirst transfer",                                        false, -1, -1, -1,  0 },
+    { "optfirst",  "* optfirst transfer",                                         false, -1, -1, -1,  0 },
+    // name 이 아닌 필드는 from 으로 쓰지 않는다.
+    { "wrongtype", "* wrongtype transfer",                                        false, -1,  8, 16, 32 },
+    { "create",    "* create create",                                             true,  -1,  0,  8, 24 },
+    { "badbase",   "* badbase record from=from",                                  false, -1, -1, -1,  0 },
+    { "missing",   "* missing transfer",                                          false, -1, -1, -1,  0 },
+    { "transfer",  "* transfer record",                                           true,  -1, -1, -1,  0 },
+};
+
+static void check_layout(const chain::abi_def& abi, const layout_case& c) {
+    const std::string what = std::string("layout_for(") + c.action + ", \"" + c.rule + "\")";
+    const auto rule = extraction_rules::parse(c.rule);
+    const auto layout = extraction_rules::layout_for(abi, chain::action_name(c.action), rule);
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), ": expected fixed=%d from=%d to=%d quantity=%d min_size=%u, "
+        "got fixed=%d from=%d to=%d quantity=%d min_size=%u",
+        c.fixed, c.from, c.to, c.quantity, c.min_size,
+        layout.fixed, layout.from, layout.to, layout.quantity, layout.min_size);
+    expect(layout.fixed == c.fixed && layout.from == c.from && layout.to == c.to &&
+           layout.quantity == c.quantity && layout.min_size == c.min_size, what + buf);
+}
+
+int main() {
+    for (const auto& c : parse_cases) check_parse(c);
+    check_lookup();
+
+    const auto abi = fc::json::from_string(test_abi).as<chain::abi_def>();
+    for (const auto& c : layout_cases) check_layout(abi, c);
+
+    if (failures) std::printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
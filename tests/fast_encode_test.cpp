@@ -0,0 +1,125 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  fast_encode 의 결과를 chain::name::to_string(), fc::to_hex(), std::to_string() 과 비교한다.
+ *  실패하면 값과 두 결과를 출력하고 1 을 리턴.
+ */
+#include <eosio/chain/name.hpp>
+
+#include <fc/crypto/hex.hpp>
+
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "fast_encode.hpp"
+
+using namespace eosio;
+
+static int failures = 0;
+
+static void expect_equal(const char* what, const std::string& value, const std::string& expected, const std::string& actual) {
+    if (expected == actual) return;
+    failures++;
+    std::printf("%s(%s): expected '%s', got '%s'\n", what, value.c_str(), expected.c_str(), actual.c_str());
+}
+
+static void check_name(const uint64_t value) {
+    std::string actual;
+    fast_encode::append_name(actual, value);
+    expect_equal("name", std::to_string(value), chain::name(value).to_string(), actual);
+}
+
+static void check_hex(const std::vector<char>& data) {
+    std::string actual;
+    fast_encode::append_hex(actual, data.data(), data.size());
+    expect_equal("hex", std::to_string(data.size()) + " bytes", fc::to_hex(data.data(), data.size()), actual);
+}
+
+static void check_uint(const uint64_t value) {
+    std::string actual;
+    fast_encode::append_uint(actual, value);
+    expect_equal("uint", std::to_string(value), std::to_string(value), actual);
+}
+
+static void check_int(const int64_t value) {
+    std::string actual;
+    fast_encode::append_int(actual, value);
+    expect_equal("int", std::to_string(value), std::to_string(value), actual);
+}
+
+static std::string u128_to_string(unsigned __int128 value) {
+    std::string s;
+    do {
+        s.insert(s.begin(), static_cast<char>('0' + static_cast<int>(value % 10)));
+        value /= 10;
+    } while (value);
+    return s;
+}
+
+static void check_u128(const unsigned __int128 value) {
+    std::string actual;
+    fast_encode::append_u128(actual, value);
+    const auto expected = u128_to_string(value);
+    expect_equal("u128", expected, expected, actual);
+}
+
+int main() {
+    std::mt19937_64 rng(20180601);
+
+    // 빈 name, '.' 이 섞이거나 끝나는 name, 13 번째 문자 (4 bit, '.' ~ 'j')
+    check_name(0);
+    for (const char* s : { "a", "eosio", "eosio.token", "a.b.c", "a....b", ".a", "..a", "zzzzzzzzzzzz", 
+                           "zzzzzzzzzzzzj", "aaaaaaaaaaaa1", "111111111111j", "eosio.......a", "............1" }) {
+        check_name(chain::name(s).value);
+    }
+    for (uint64_t c = 0; c < 16; c++) {
+        check_name(c);
+        check_name(chain::name("abcdefghijkl").value | c);
+    }
+    // 한 자리씩 모든 문자
+    for (uint32_t pos = 0; pos < 12; pos++) {
+        for (uint64_t c = 0; c < 32; c++) check_name(c << (64 - 5 * (pos + 1)));
+    }
+    check_name(std::numeric_limits<uint64_t>::max());
+    for (int i = 0; i < 1000000; i++) check_name(rng());
+
+    // SIMD 경계 (16, 32 byte) 앞뒤 길이와 정렬되지 않은 시작 위치
+    for (size_t n = 0; n <= 130; n++) {
+        std::vector<char> data(n);
+        for (auto& c : data) c = static_cast<char>(rng());
+        check_hex(data);
+    }
+    for (size_t offset = 1; offset < 32; offset++) {
+        std::vector<char> data(64 + offset);
+        for (auto& c : data) c = static_cast<char>(rng());
+        std::string actual;
+        fast_encode::append_hex(actual, data.data() + offset, 64);
+        expect_equal("hex", "offset " + std::to_string(offset), fc::to_hex(data.data() + offset, 64), actual);
+    }
+    check_hex(std::vector<char>(32, static_cast<char>(0xff)));
+    check_hex(std::vector<char>(32, 0));
+
+    for (const uint64_t v : { uint64_t(0), uint64_t(9), uint64_t(10), uint64_t(99), uint64_t(100), 
+                              std::numeric_limits<uint64_t>::max() }) check_uint(v);
+    for (const int64_t v : { int64_t(0), int64_t(-1), int64_t(1), std::numeric_limits<int64_t>::min(),
+                             std::numeric_limits<int64_t>::max() }) check_int(v);
+    for (int i = 0; i < 100000; i++) {
+        check_uint(rng() >> (rng() % 64));
+        check_int(static_cast<int64_t>(rng()) >> (rng() % 64));
+    }
+
+    check_u128(0);
+    check_u128(~static_cast<unsigned __int128>(0));
+    for (int i = 0; i < 10000; i++) check_u128((static_cast<unsigned __int128>(rng()) << 64) | rng());
+
+    if (failures) {
+        std::printf("%d failures\n", failures);
+        return 1;
+    }
+    std::printf("fast_encode ok\n");
+    return 0;
+}
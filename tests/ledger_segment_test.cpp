@@ -0,0 +1,167 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  ledger_segment_writer 로 쓴 파일을 ledger_segment_reader 로 읽어 원래 row 와 비교한다.
+ *  delta (action_id, block_num, block_time), dictionary (name, symbol), zigzag (amount) column 과 min/max 통계,
+ *  그리고 재시작 뒤 같은 row 를 다시 받아도 파일에 두 번 쓰지 않는지.
+ *  실패하면 내용을 출력하고 1 을 리턴.
+ */
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ledger_segment.hpp"
+
+using namespace eosio;
+using namespace eosio::ledger_segment_format;
+namespace bfs = boost::filesystem;
+
+static int failures = 0;
+
+static void expect(const bool ok, const std::string& what) {
+    if (ok) return;
+    failures++;
+    std::printf("%s\n", what.c_str());
+}
+
+template <typename T>
+static void expect_equal(const std::string& what, const T expected, const T actual) {
+    expect(expected == actual, what + ": expected " + std::to_string(expected) + ", got " + std::to_string(actual));
+}
+
+// block 마다 몇 개씩, 같은 name / symbol 이 반복되고 amount 는 음수와 큰 값을 섞는다.
+static std::vector<ledger_event> make_rows(const uint64_t first_action_id, const uint32_t first_block, const uint32_t blocks) {
+    static const uint64_t names[] = { 1, 0x5530ea033482a600ull, 0x3232eda800000000ull, 0xffffffffffffffffull, 42 };
+    static const int64_t amounts[] = { 1, -1, 0, 4611686018427387903ll, -4611686018427387904ll, 123456789 };
+    std::vector<ledger_event> rows;
+    uint64_t action_id = first_action_id;
+    for (uint32_t b = first_block; b < first_block + blocks; b++) {
+        for (uint32_t i = 0; i < 1 + b % 3; i++) {
+            ledger_event e;
+            e.action_id  = action_id;
+            action_id += 1 + i * 1000;
+            e.block_num  = b;
+            e.block_time = 1500000000 + b / 2;
+            e.contract   = names[b % 5];
+            e.action     = names[(b + 1) % 5];
+            e.from       = names[(b + i) % 5];
+            e.to         = names[(b + i + 2) % 5];
+            e.receiver   = names[i % 5];
+            e.amount     = amounts[(b + i) % 6];
+            e.symbol     = (0x534f45ull << 8) | (b % 2 ? 4 : 8);
+            for (uint32_t k = 0; k < sizeof(e.transaction_id); k++) e.transaction_id[k] = static_cast<uint8_t>(action_id * 31 + k);
+            rows.push_back(e);
+        }
+    }
+    return rows;
+}
+
+static bool same(const ledger_event& a, const ledger_event& b) {
+    return a.action_id == b.action_id && a.block_num == b.block_num && a.block_time == b.block_time
+        && a.contract == b.contract && a.action == b.action && a.from == b.from && a.to == b.to
+        && a.receiver == b.receiver && a.amount == b.amount && a.symbol == b.symbol
+        && !std::memcmp(a.transaction_id, b.transaction_id, sizeof(a.transaction_id));
+}
+
+// dir 의 모든 segment 를 읽어 action_id -> row. 두 번 나온 row 는 센다.
+static std::map<uint64_t, ledger_event> read_all(const std::string& dir, uint64_t& duplicates) {
+    std::map<uint64_t, ledger_event> found;
+    duplicates = 0;
+    for (const auto& path : ledger_segment_reader::list(dir, 0, std::numeric_limits<uint32_t>::max())) {
+        ledger_segment_reader seg(path);
+        const auto& h = seg.header();
+
+        // 통계는 파일 안의 row 와 맞아야 한다.
+        uint32_t min_block = std::numeric_limits<uint32_t>::max(), max_block = 0;
+        uint32_t min_time = std::numeric_limits<uint32_t>::max(), max_time = 0;
+        int64_t min_amount = std::numeric_limits<int64_t>::max(), max_amount = std::numeric_limits<int64_t>::min();
+        uint64_t min_id = std::numeric_limits<uint64_t>::max(), max_id = 0, rows = 0;
+        seg.for_each([&](const ledger_event& e) {
+            min_block = std::min(min_block, e.block_num);
+            max_block = std::max(max_block, e.block_num);
+            min_time = std::min(min_time, e.block_time);
+            max_time = std::max(max_time, e.block_time);
+            min_amount = std::min(min_amount, e.amount);
+            max_amount = std::max(max_amount, e.amount);
+            min_id = std::min(min_id, e.action_id);
+            max_id = std::max(max_id, e.action_id);
+            expect(e.block_num >= h.block_start && e.block_num < h.block_end, path + ": row outside the block range");
+            expect(seg.has_value(e.from) && seg.has_value(e.symbol), path + ": dictionary misses a value");
+            if (!found.emplace(e.action_id, e).second) duplicates++;
+            rows++;
+        });
+        expect_equal(path + " rows", h.row_count, rows);
+        expect_equal(path + " min_block", h.min_block, min_block);
+        expect_equal(path + " max_block", h.max_block, max_block);
+        expect_equal(path + " min_time", h.min_time, min_time);
+        expect_equal(path + " max_time", h.max_time, max_time);
+        expect_equal(path + " min_amount", h.min_amount, min_amount);
+        expect_equal(path + " max_amount", h.max_amount, max_amount);
+        expect_equal(path + " min_action_id", h.min_action_id, min_id);
+        expect_equal(path + " max_action_id", h.max_action_id, max_id);
+        expect(seg.overlaps_blocks(h.min_block, h.min_block + 1) && !seg.overlaps_blocks(h.max_block + 1, h.max_block + 10),
+            path + ": overlaps_blocks disagrees with the statistics");
+
+        // column 단위로 읽은 것과 for_each 가 같은지. dictionary index 는 dictionary 안이어야 한다.
+        std::vector<uint32_t> index;
+        seg.read_dictionary_index(col_to, index);
+        for (const auto i : index) expect(i < seg.dictionary_size(), path + ": dictionary index out of range");
+        std::vector<int64_t> amounts;
+        seg.read_amounts(amounts);
+        expect_equal(path + " amounts", h.row_count, static_cast<uint64_t>(amounts.size()));
+    }
+    return found;
+}
+
+static void check(const std::vector<ledger_event>& expected, const std::string& dir, const std::string& what) {
+    uint64_t duplicates = 0;
+    const auto found = read_all(dir, duplicates);
+    expect_equal(what + " duplicates", uint64_t(0), duplicates);
+    expect_equal(what + " rows", static_cast<uint64_t>(expected.size()), static_cast<uint64_t>(found.size()));
+    for (const auto& e : expected) {
+        auto itr = found.find(e.action_id);
+        expect(itr != found.end() && same(e, itr->second), what + ": row " + std::to_string(e.action_id) + " differs");
+    }
+}
+
+int main() {
+    const auto dir = (bfs::temp_directory_path() / bfs::unique_path("ledger-segment-test-%%%%%%%%")).string();
+
+    // 구간 두 개에 걸치고, 작은 max_rows 로 같은 구간에 part 가 여러 개 생기도록.
+    const auto first = make_rows(1000, 95, 20);
+    {
+        ledger_segment_writer writer(dir, 100, 7);
+        // worker 마다 순서 없이 오는 것처럼 거꾸로 넣는다.
+        for (auto it = first.rbegin(); it != first.rend(); ++it) writer.on_ledger_event(*it);
+        writer.seal_all();
+        expect_equal("first run failed segments", uint64_t(0), writer.failed_count());
+    }
+    check(first, dir, "first run");
+
+    // 재시작: checkpoint (block 100) 다음부터 다시 받는다. 이미 쓴 row 는 버리고 새 block 만 쓴다.
+    const auto second = make_rows(1000, 95, 30);
+    {
+        ledger_segment_writer writer(dir, 100, 7);
+        writer.skip_written(100);
+        expect_equal("floor block", uint32_t(114), writer.floor_block());
+        for (const auto& e : second) {
+            if (e.block_num > 100) writer.on_ledger_event(e);
+        }
+        writer.seal_all();
+        uint64_t rewritten = 0;
+        for (const auto& e : first) if (e.block_num > 100) rewritten++;
+        expect_equal("skipped rows", rewritten, writer.skipped_count());
+    }
+    check(second, dir, "after restart");
+
+    bfs::remove_all(dir);
+    if (failures) std::printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,78 @@
+#include "offline_queries.hpp"
+#include "mysqlconn.h"
+
+#include <fc/log/logger.hpp>
+#include <fc/time.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+namespace eosio {
+
+static std::mutex query_mtx;
+static std::condition_variable query_cond;
+static std::deque<std::string> query_queue;
+static size_t max_queue_size = 1000;
+static bool writers_done = false;
+static std::atomic<uint64_t> failed_count{0};
+
+const int64_t get_now_tick() {
+    return fc::time_point::now().time_since_epoch().count()/1000;
+}
+
+void post_query_str_to_queue(const std::string query_str, const uint32_t, const uint32_t) {
+    std::unique_lock<std::mutex> lock(query_mtx);
+    query_cond.wait(lock, [] { return query_queue.size() < max_queue_size; });
+    query_queue.emplace_back(query_str);
+    lock.unlock();
+    query_cond.notify_all();
+}
+
+void set_max_queue_size(const size_t size) {
+    std::lock_guard<std::mutex> lock(query_mtx);
+    max_queue_size = size;
+}
+
+void consume_queries(std::shared_ptr<connection_pool> pool) {
+    while (true) {
+        std::unique_lock<std::mutex> lock(query_mtx);
+        query_cond.wait(lock, [] { return !query_queue.empty() || writers_done; });
+        if (query_queue.empty()) break;
+
+        std::string query_str = std::move(query_queue.front());
+        query_queue.pop_front();
+        lock.unlock();
+        query_cond.notify_all();
+
+        shared_ptr<MysqlConnection> con = pool->get_connection();
+        assert(con);
+        if (!con->execute(query_str, true)) {
+            elog("query failed: ${e}", ("e", con->lastError()));
+            failed_count++;
+        }
+        pool->release_connection(*con);
+    }
+}
+
+void finish_queries() {
+    {
+        std::lock_guard<std::mutex> lock(query_mtx);
+        writers_done = true;
+    }
+    query_cond.notify_all();
+}
+
+size_t query_queue_size() {
+    std::lock_guard<std::mutex> lock(query_mtx);
+    return query_queue.size();
+}
+
+uint64_t failed_queries() {
+    return failed_count;
+}
+
+}
@@ -0,0 +1,25 @@
+#ifndef OFFLINE_QUERIES_H
+#define OFFLINE_QUERIES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "connection_pool.h"
+
+namespace eosio {
+    // ledger_table 이 부르는 plugin 쪽 함수 (get_now_tick, post_query_str_to_queue) 의 오프라인 구현.
+    // 오프라인 도구들 (ledger_ingest, ledger_stress) 이 같이 쓴다.
+    // 단일 DB 만 쓴다. (ledger_table 에 router 를 주지 않으므로 shard 는 항상 0)
+    // post_query_str_to_queue 는 queue 가 가득 차면 기다린다.
+    void set_max_queue_size(const size_t size);
+
+    // writer thread 에서. finish_queries() 뒤 queue 가 비면 돌아온다.
+    void consume_queries(std::shared_ptr<connection_pool> pool);
+    // 모든 producer 가 끝난 뒤에.
+    void finish_queries();
+
+    size_t query_queue_size();
+    uint64_t failed_queries();
+}
+#endif
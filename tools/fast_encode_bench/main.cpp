@@ -0,0 +1,75 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  fast_encode_bench: fast_encode 와 기존 변환 (chain::name::to_string, fc::to_hex, std::to_string) 의 
+ *  호출당 시간을 비교한다. 인자는 반복 횟수 (기본 10,000,000).
+ */
+#include <eosio/chain/name.hpp>
+
+#include <fc/crypto/hex.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "fast_encode.hpp"
+
+using namespace eosio;
+
+template<typename F>
+static void measure(const char* label, const size_t iterations, F&& f) {
+    size_t sink = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) sink += f(i);
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-28s %8.2f ns/op  (%zu)\n", label, double(ns) / iterations, sink);
+}
+
+int main(int argc, char** argv) {
+    const size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+
+    // 입력은 미리 만들어 둔다. 분기 예측이 한 값에 고정되지 않도록 4096 개를 돌려 쓴다.
+    std::mt19937_64 rng(20180601);
+    std::vector<uint64_t> names(4096);
+    std::vector<std::vector<char>> ids(4096, std::vector<char>(32));
+    for (size_t i = 0; i < names.size(); i++) {
+        names[i] = rng();
+        for (auto& c : ids[i]) c = static_cast<char>(rng());
+    }
+    const size_t mask = names.size() - 1;
+
+    std::string out;
+    out.reserve(128);
+
+    measure("chain::name::to_string", iterations, [&](size_t i) { 
+        return chain::name(names[i & mask]).to_string().size(); 
+    });
+    measure("fast_encode::append_name", iterations, [&](size_t i) { 
+        out.clear(); 
+        fast_encode::append_name(out, names[i & mask]); 
+        return out.size(); 
+    });
+
+    measure("fc::to_hex (32 bytes)", iterations, [&](size_t i) { 
+        return fc::to_hex(ids[i & mask].data(), 32).size(); 
+    });
+    measure("fast_encode::append_hex", iterations, [&](size_t i) { 
+        out.clear(); 
+        fast_encode::append_hex(out, ids[i & mask].data(), 32); 
+        return out.size(); 
+    });
+
+    measure("std::to_string (int64)", iterations, [&](size_t i) { 
+        return std::to_string(static_cast<int64_t>(names[i & mask])).size(); 
+    });
+    measure("fast_encode::append_int", iterations, [&](size_t i) { 
+        out.clear(); 
+        fast_encode::append_int(out, static_cast<int64_t>(names[i & mask])); 
+        return out.size(); 
+    });
+    return 0;
+}
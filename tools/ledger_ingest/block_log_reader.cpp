@@ -0,0 +1,56 @@
+#include "block_log_reader.hpp"
+
+#include <eosio/chain/exceptions.hpp>
+
+namespace eosio {
+
+// blocks.log 는 version 1 이면 block 1 부터, 그 뒤로는 version 다음 uint32 가 첫 block.
+// (최상위 bit 는 pruned 표시로 쓰이는 version 이 있어 뺀다)
+block_log_reader::block_log_reader(const fc::path& dir) {
+    const auto log_path = dir / "blocks.log";
+    const auto index_path = dir / "blocks.index";
+
+    _log.open(log_path.generic_string(), std::ios::in | std::ios::binary);
+    _index.open(index_path.generic_string(), std::ios::in | std::ios::binary);
+    EOS_ASSERT( _log.is_open() && _index.is_open(), chain::plugin_exception, 
+        "unable to open block log in ${d}", ("d", dir.generic_string()) );
+
+    uint32_t version = 0;
+    _log.read((char*)&version, sizeof(version));
+    if (!_log) return;
+    version &= 0x7fffffff;
+    _begin_block = 1;
+    if (version > 1) {
+        _log.read((char*)&_begin_block, sizeof(_begin_block));
+        EOS_ASSERT( _log, chain::plugin_exception, "truncated block log header in ${d}", ("d", dir.generic_string()) );
+    }
+
+    _index.seekg(0, std::ios::end);
+    _end_block = _begin_block + static_cast<uint32_t>(_index.tellg() / sizeof(uint64_t));
+}
+
+block_log_reader::~block_log_reader()
+{
+
+}
+
+// signed_block 은 block_header 로 시작하고 그 첫 field 가 timestamp 이다.
+bool block_log_reader::read_timestamp(const uint32_t block_num, chain::block_timestamp_type& timestamp) {
+    if (block_num < _begin_block || block_num >= _end_block) return false;
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    uint64_t pos = 0;
+    _index.clear();
+    _index.seekg(uint64_t(block_num - _begin_block) * sizeof(uint64_t));
+    _index.read((char*)&pos, sizeof(pos));
+
+    uint32_t slot = 0;
+    _log.clear();
+    _log.seekg(pos);
+    _log.read((char*)&slot, sizeof(slot));
+    if (!_index || !_log) return false;
+    timestamp = chain::block_timestamp_type(slot);
+    return true;
+}
+
+}
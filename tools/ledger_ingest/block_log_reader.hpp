@@ -0,0 +1,35 @@
+#ifndef BLOCK_LOG_READER_H
+#define BLOCK_LOG_READER_H
+
+#include <eosio/chain/block_timestamp.hpp>
+
+#include <fc/filesystem.hpp>
+
+#include <fstream>
+#include <mutex>
+
+namespace eosio {
+    // blocks.log / blocks.index 에서 block timestamp 만 읽는다. 모든 worker 가 하나를 같이 쓴다.
+    // chain::block_log 는 파일을 쓰기로 열고 index 가 맞지 않으면 다시 만들므로 nodeos 가 쓰는 중인 디렉토리에 쓸 수 없다.
+    class block_log_reader {
+        public:
+            explicit block_log_reader(const fc::path& dir);
+            ~block_log_reader();
+
+            // [begin_block, end_block)
+            uint32_t begin_block() const { return _begin_block; }
+            uint32_t end_block() const { return _end_block; }
+
+            // log 에 없으면 false
+            bool read_timestamp(const uint32_t block_num, chain::block_timestamp_type& timestamp);
+
+        private:
+            std::mutex _mtx;
+            std::ifstream _log;
+            std::ifstream _index;
+
+            uint32_t _begin_block = 0;
+            uint32_t _end_block = 0;
+    };
+}
+#endif
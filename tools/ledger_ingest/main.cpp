@@ -0,0 +1,343 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  ledger_ingest: state_history 의 trace 로그에서 ledger 테이블을 오프라인으로 채운다. 
+ *  nodeos 없이 ledger_table 의 추출 코드를 그대로 사용하며, 블록 구간을 worker 들이 나눠서 처리한다.
+ *  ledger 는 INSERT IGNORE 이므로 처리 순서와 무관하다. tokens 는 누적 upsert 라 순서와는 무관하지만
+ *  같은 action 이 두번 더해지지 않도록 plugin 과 같은 tokens_applied guard 를 거친다.
+ *  plugin 이 쓰기 시작한 block (live_start_block) 이후, bootstrap 으로 이미 채운 tokens,
+ *  이미 끝낸 구간 (ledger_state 의 ingest:<시작>-<끝>) 과 겹치는 구간은 받지 않는다.
+ */
+#include <eosio/chain/abi_serializer.hpp>
+#include <eosio/chain/exceptions.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/log/logger.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "block_log_reader.hpp"
+#include "ledger_table.hpp"
+#include "offline_queries.hpp"
+#include "trace_history_log.hpp"
+
+// state_history_plugin_abi.cpp
+extern const char* const state_history_plugin_abi;
+
+namespace bpo = boost::program_options;
+
+namespace eosio {
+
+static const char* const token_abi_json = R"=====({
+   "version": "eosio::abi/1.0",
+   "structs": [
+      { "name": "transfer", "base": "", "fields": [
+         { "name": "from", "type": "name" },
+         { "name": "to", "type": "name" },
+         { "name": "quantity", "type": "asset" },
+         { "name": "memo", "type": "string" } ] },
+      { "name": "create", "base": "", "fields": [
+         { "name": "issuer", "type": "name" },
+         { "name": "maximum_supply", "type": "asset" } ] }
+   ],
+   "actions": [
+      { "name": "transfer", "type": "transfer", "ricardian_contract": "" },
+      { "name": "create", "type": "create", "ricardian_contract": "" }
+   ]
+})=====";
+
+static const fc::microseconds abi_serializer_max_time(1000000);
+
+class ingest_worker {
+    public:
+        ingest_worker(const bpo::variables_map& options, std::shared_ptr<connection_pool> pool, abi_resolver resolver,
+                std::shared_ptr<const extraction_rules> rules, std::shared_ptr<block_log_reader> blocks) :
+        _rules(rules),
+        _log(options.at("trace-dir").as<std::string>()),
+        _blocks(blocks),
+        _table(pool, options.at("ledger-db-ag-raw").as<uint32_t>(), options.at("ledger-db-ag-acc").as<uint32_t>()),
+        _ship_abis(fc::json::from_string(state_history_plugin_abi).as<chain::abi_def>(), abi_serializer_max_time)
+        {
+            _table.set_abi_resolver(resolver);
+            _table.set_skip_tokens(options.at("skip-tokens").as<bool>());
+        }
+
+        void process_block(const uint32_t block_num) {
+            chain::block_id_type block_id;
+            if (!_log.read_traces(block_num, block_id, _traces) || _traces.empty()) return;
+
+            chain::block_timestamp_type block_time;
+            EOS_ASSERT( _blocks->read_timestamp(block_num, block_time), chain::plugin_exception, 
+                "block ${b} not found in block log", ("b", block_num) );
+
+            // 실패한 block 도 batch 는 닫는다.
+            try {
+                const auto traces = _ship_abis.binary_to_variant("transaction_trace[]", _traces, abi_serializer_max_time);
+                for (const auto& trace_variant : traces.get_array()) {
+                    // variant 타입은 [type_name, value]
+                    const auto& trace = trace_variant.get_array()[1].get_object();
+                    if (trace["status"].as_uint64() != 0) continue;   // executed 만
+
+                    const auto trx_id = trace["id"].as<chain::transaction_id_type>();
+                    uint32_t action_index = 0;
+                    for (const auto& atrace : trace["action_traces"].get_array()) {
+                        process_action(trx_id, action_index, block_num, block_time, atrace);
+                    }
+                }
+            } catch (...) {
+                _table.end_batch();
+                throw;
+            }
+            _table.end_batch();
+        }
+
+        void finalize() {
+            _table.finalize();
+        }
+
+    private:
+        void process_action(const chain::transaction_id_type& trx_id, uint32_t& action_index, const uint32_t block_num, 
+                const chain::block_timestamp_type& block_time, const fc::variant& atrace_variant) {
+            const auto& atrace = atrace_variant.get_array()[1].get_object();
+            // v1.8 로그는 receipt 가 optional 이고 inline_traces 없이 평탄화되어 있다. 
+            if (atrace["receipt"].is_null()) return;
+            const uint32_t index = action_index++;
+            const auto& receipt = atrace["receipt"].get_array()[1].get_object();
+
+            const auto act = atrace["act"].as<chain::action>();
+            if (const auto* rule = _rules->find(act.account.value, act.name.value)) {
+                const auto receiver = receipt["receiver"].as<chain::account_name>();
+                const auto action_id = receipt["global_sequence"].as_uint64();
+                _table.add_ledger(action_id, index, trx_id, block_num, block_time, receiver, act, *rule);
+            }
+
+            auto inline_itr = atrace.find("inline_traces");
+            if (inline_itr == atrace.end()) return;
+            for (const auto& inline_atrace : inline_itr->value().get_array()) {
+                process_action(trx_id, action_index, block_num, block_time, inline_atrace);
+            }
+        }
+
+        std::shared_ptr<const extraction_rules> _rules;
+        trace_history_log _log;
+        std::shared_ptr<block_log_reader> _blocks;
+        ledger_table _table;
+        chain::abi_serializer _ship_abis;
+        std::vector<char> _traces;
+};
+
+// --abi-dir 의 <account>.abi 파일들. 없으면 표준 token ABI 로 간주.
+static abi_resolver make_abi_resolver(const bpo::variables_map& options) {
+    auto abis = std::make_shared<std::map<chain::account_name, chain::abi_def>>();
+    if (options.count("abi-dir")) {
+        const fc::path abi_dir = options.at("abi-dir").as<std::string>();
+        for (fc::directory_iterator itr(abi_dir); itr != fc::directory_iterator(); ++itr) {
+            if ((*itr).extension() != ".abi") continue;
+            const auto account = chain::account_name((*itr).stem().generic_string());
+            (*abis)[account] = fc::json::from_file(*itr).as<chain::abi_def>();
+        }
+        ilog("loaded ${n} abi files", ("n", abis->size()));
+    }
+
+    fc::optional<chain::abi_def> token_abi;
+    if (options.at("assume-token-abi").as<bool>()) 
+        token_abi = fc::json::from_string(token_abi_json).as<chain::abi_def>();
+
+    return [abis, token_abi](const chain::account_name& account) -> fc::optional<chain::abi_def> {
+        auto itr = abis->find(account);
+        if (itr != abis->end()) return itr->second;
+        return token_abi;
+    };
+}
+
+static int run(const bpo::variables_map& options) {
+    set_max_queue_size(options.at("ledger-queue-size").as<uint32_t>());
+
+    auto pool = std::make_shared<connection_pool>(
+        options.at("ledger-db-host").as<std::string>(),
+        options.at("ledger-db-user").as<std::string>(),
+        options.at("ledger-db-passwd").as<std::string>(),
+        options.at("ledger-db-database").as<std::string>(),
+        options.at("ledger-db-port").as<uint16_t>(),
+        options.at("ledger-db-max-connection").as<uint16_t>(),
+        false);
+
+    uint32_t block_start;
+    uint32_t block_end;
+    {
+        trace_history_log log(options.at("trace-dir").as<std::string>());
+        block_start = std::max(options.at("block-start").as<uint32_t>(), log.begin_block());
+        block_end = options.at("block-end").as<uint32_t>();
+        if (!block_end || block_end > log.end_block()) block_end = log.end_block();
+    }
+    EOS_ASSERT( block_start < block_end, chain::plugin_config_exception, "empty block range" );
+    const bool skip_tokens = options.at("skip-tokens").as<bool>();
+
+    // 구간 끝까지 partition 을 먼저 만들어 둔다. 없으면 모두 pmax 로 들어간다.
+    ledger_table schema(pool, 1, 1);
+    schema.create(options.at("ledger-db-partition-blocks").as<uint32_t>());
+
+    // plugin 이 받은 block 부터는 plugin 의 것. tokens_applied 도 그 아래만 남아 있으므로 겹치면 두번 더해진다.
+    const uint64_t live_start = schema.get_state("live_start_block");
+    EOS_ASSERT( !live_start || block_end <= live_start, chain::plugin_config_exception, 
+        "blocks from ${l} are written by the plugin; use --block-end ${l}", ("l", live_start) );
+    // bootstrap 은 그 block 까지의 잔액을 chainbase 에서 채운다. 그 아래 transfer 를 다시 더하면 안 된다.
+    const uint64_t bootstrap = schema.get_state("bootstrap_block");
+    if (bootstrap) {
+        EOS_ASSERT( block_start > bootstrap || block_end <= bootstrap + 1, chain::plugin_config_exception, 
+            "block range straddles bootstrap block ${b}; split it at ${n}", ("b", bootstrap)("n", bootstrap + 1) );
+        EOS_ASSERT( block_start > bootstrap || skip_tokens, chain::plugin_config_exception, 
+            "tokens up to bootstrap block ${b} are already loaded; use --skip-tokens", ("b", bootstrap) );
+    }
+    for (const auto& state : schema.get_states("ingest:")) {
+        uint32_t first = 0, last = 0;
+        if (std::sscanf(state.first.c_str(), "ingest:%u-%u", &first, &last) != 2) continue;
+        EOS_ASSERT( block_end <= first || last <= block_start, chain::plugin_config_exception, 
+            "blocks [${f}, ${l}) are already ingested", ("f", first)("l", last) );
+    }
+    schema.ensure_partition(block_end, 0);
+
+    // 모든 worker 가 같이 읽는다. (읽기 전용)
+    auto blocks = std::make_shared<block_log_reader>(options.at("blocks-dir").as<std::string>());
+    EOS_ASSERT( blocks->begin_block() <= block_start && block_end <= blocks->end_block(), chain::plugin_config_exception, 
+        "block log holds [${b}, ${e}) only", ("b", blocks->begin_block())("e", blocks->end_block()) );
+
+    const auto resolver = make_abi_resolver(options);
+    auto rule_list = extraction_rules::defaults();
+    if (options.count("ledger-extract-rule")) {
+        for (const auto& spec : options.at("ledger-extract-rule").as<std::vector<std::string>>()) 
+            rule_list.push_back(extraction_rules::parse(spec));
+    }
+    const auto rules = std::make_shared<const extraction_rules>(rule_list);
+    const uint32_t chunk_blocks = std::max<uint32_t>(options.at("chunk-blocks").as<uint32_t>(), 1);
+    const uint32_t thread_count = std::max<uint32_t>(options.at("threads").as<uint32_t>(), 1);
+    const uint32_t query_thread_count = std::max<uint32_t>(options.at("ledger-db-query-thread").as<uint32_t>(), 1);
+    ilog("ingest blocks [${s}, ${e}) with ${t} threads", ("s", block_start)("e", block_end)("t", thread_count));
+
+    std::vector<std::thread> writers;
+    for (uint32_t i = 0; i < query_thread_count; i++) {
+        writers.emplace_back([pool] { consume_queries(pool); });
+    }
+
+    // worker 들은 chunk 단위로 다음 구간을 가져간다. 
+    std::atomic<uint32_t> next_block{block_start};
+    std::atomic<uint64_t> done_blocks{0};
+    std::atomic<uint64_t> failed_blocks{0};
+    std::vector<std::unique_ptr<ingest_worker>> workers;
+    for (uint32_t i = 0; i < thread_count; i++) {
+        workers.emplace_back(std::make_unique<ingest_worker>(options, pool, resolver, rules, blocks));
+    }
+
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) {
+        threads.emplace_back([&, w = worker.get()] {
+            while (true) {
+                const uint32_t first = next_block.fetch_add(chunk_blocks);
+                if (first >= block_end) break;
+                const uint32_t last = std::min(first + chunk_blocks, block_end);
+                for (uint32_t b = first; b < last; b++) {
+                    try {
+                        w->process_block(b);
+                    } catch (fc::exception& e) {
+                        elog("block ${b} failed: ${e}", ("b", b)("e", e.to_string()));
+                        failed_blocks++;
+                    } catch (std::exception& e) {
+                        elog("block ${b} failed: ${e}", ("b", b)("e", e.what()));
+                        failed_blocks++;
+                    }
+                }
+                done_blocks += last - first;
+            }
+            w->finalize();
+        });
+    }
+
+    const auto start_time = fc::time_point::now();
+    const uint64_t total_blocks = block_end - block_start;
+    while (done_blocks < total_blocks) {
+        std::this_thread::sleep_for(std::chrono::seconds(10));
+        const auto elapsed = (fc::time_point::now() - start_time).count() / 1000000;
+        ilog("ingested ${d}/${t} blocks, ${r} blocks/sec", 
+            ("d", done_blocks.load())("t", total_blocks)("r", elapsed > 0 ? done_blocks / elapsed : 0));
+    }
+    for (auto& t : threads) t.join();
+
+    finish_queries();
+    for (auto& t : writers) t.join();
+
+    ilog("ingest done. failed blocks: ${b}, failed queries: ${q}", ("b", failed_blocks.load())("q", failed_queries()));
+    if (failed_blocks || failed_queries()) {
+        // guard 를 남겨 두므로 같은 구간을 다시 돌려도 tokens 는 두번 더해지지 않는다.
+        wlog("blocks [${s}, ${e}) are not marked as ingested; rerun the same range", ("s", block_start)("e", block_end));
+        return 1;
+    }
+
+    // 끝난 구간을 기록하고 이 구간의 tokens_applied guard 를 지운다. (plugin 의 prune 은 live_start_block 아래를 남긴다)
+    const auto range = "ingest:" + std::to_string(block_start) + "-" + std::to_string(block_end);
+    EOS_ASSERT( schema.set_state(range, block_end), chain::plugin_exception, "failed to record ${r}", ("r", range) );
+    shared_ptr<MysqlConnection> con = pool->get_connection();
+    assert(con);
+    if (!con->execute("DELETE FROM tokens_applied WHERE block_number >= " + std::to_string(block_start) + 
+            " AND block_number < " + std::to_string(block_end), true)) {
+        wlog("failed to prune tokens_applied: ${e}", ("e", con->lastError()));
+    }
+    pool->release_connection(*con);
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    bpo::options_description desc("ledger_ingest options");
+    desc.add_options()
+        ("help,h", "Print this help message and exit.")
+        ("trace-dir", bpo::value<std::string>()->required(), "Directory holding trace_history.log and trace_history.index.")
+        ("blocks-dir", bpo::value<std::string>()->required(), "Directory holding blocks.log, used for block timestamps.")
+        ("block-start", bpo::value<uint32_t>()->default_value(0), "First block to ingest.")
+        ("block-end", bpo::value<uint32_t>()->default_value(0), "Stop before this block. 0 ingests to the end of the log.")
+        ("threads", bpo::value<uint32_t>()->default_value(std::thread::hardware_concurrency()), "Decode worker thread count.")
+        ("chunk-blocks", bpo::value<uint32_t>()->default_value(1000), "Blocks handed to a worker at a time.")
+        ("abi-dir", bpo::value<std::string>(), "Directory of <account>.abi JSON files.")
+        ("skip-tokens", bpo::bool_switch()->default_value(false), 
+            "Do not write tokens and tokenlist. Required for blocks at or below the plugin's bootstrap block.")
+        ("assume-token-abi", bpo::value<bool>()->default_value(true), "Use the eosio.token ABI for accounts without an abi file.")
+        ("ledger-extract-rule", bpo::value<std::vector<std::string>>()->composing(), 
+            "Additional action to capture, same format as the plugin option. May be specified multiple times.")
+        ("ledger-queue-size", bpo::value<uint32_t>()->default_value(1000), "Query queue size.")
+        ("ledger-db-query-thread", bpo::value<uint32_t>()->default_value(4), "Query work thread count.")
+        ("ledger-db-host", bpo::value<std::string>()->required(), "ledger DB host address string")
+        ("ledger-db-port", bpo::value<uint16_t>()->default_value(3306), "ledger DB port integer")
+        ("ledger-db-user", bpo::value<std::string>()->required(), "ledger DB user id string")
+        ("ledger-db-passwd", bpo::value<std::string>()->required(), "ledger DB user password string")
+        ("ledger-db-database", bpo::value<std::string>()->required(), "ledger DB database name string")
+        ("ledger-db-max-connection", bpo::value<uint16_t>()->default_value(8), "ledger DB max connection.")
+        ("ledger-db-ag-raw", bpo::value<uint32_t>()->default_value(1000), "ledger raw db aggregation count")
+        ("ledger-db-ag-acc", bpo::value<uint32_t>()->default_value(1000), "ledger acc db aggregation count")
+        ("ledger-db-partition-blocks", bpo::value<uint32_t>()->default_value(10000000), "Block range of each ledger table partition.")
+        ;
+
+    try {
+        bpo::variables_map options;
+        bpo::store(bpo::parse_command_line(argc, argv, desc), options);
+        if (options.count("help")) {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        bpo::notify(options);
+        return eosio::run(options);
+    } catch (fc::exception& e) {
+        elog("${e}", ("e", e.to_detail_string()));
+    } catch (std::exception& e) {
+        elog("${e}", ("e", e.what()));
+    }
+    return 1;
+}
@@ -0,0 +1,102 @@
+#include "trace_history_log.hpp"
+
+#include <eosio/chain/block_header.hpp>
+#include <eosio/chain/exceptions.hpp>
+
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+namespace eosio {
+
+namespace bio = boost::iostreams;
+
+static bool is_ship_magic(const uint64_t magic) {
+    return (magic & 0xffff'ffff'0000'0000ull) == N(ship);
+}
+
+static std::vector<char> zlib_decompress(const std::vector<char>& in) {
+    std::vector<char> out;
+    bio::filtering_ostream decomp;
+    decomp.push(bio::zlib_decompressor());
+    decomp.push(bio::back_inserter(out));
+    bio::write(decomp, in.data(), in.size());
+    bio::close(decomp);
+    return out;
+}
+
+trace_history_log::trace_history_log(const fc::path& dir) {
+    const auto log_path = dir / "trace_history.log";
+    const auto index_path = dir / "trace_history.index";
+
+    _log.open(log_path.generic_string(), std::ios::in | std::ios::binary);
+    _index.open(index_path.generic_string(), std::ios::in | std::ios::binary);
+    EOS_ASSERT( _log.is_open() && _index.is_open(), chain::plugin_exception, 
+        "unable to open trace history log in ${d}", ("d", dir.generic_string()) );
+
+    _log.seekg(0, std::ios::end);
+    if (_log.tellg() == 0) return;
+
+    uint64_t magic = 0;
+    _log.seekg(0);
+    _log.read((char*)&magic, sizeof(magic));
+    _has_magic = is_ship_magic(magic);
+
+    chain::block_id_type block_id;
+    uint64_t payload_size = 0;
+    _log.seekg(0);
+    read_header(block_id, payload_size);
+    _begin_block = chain::block_header::num_from_id(block_id);
+
+    _index.seekg(0, std::ios::end);
+    _end_block = _begin_block + static_cast<uint32_t>(_index.tellg() / sizeof(uint64_t));
+}
+
+trace_history_log::~trace_history_log()
+{
+
+}
+
+uint64_t trace_history_log::read_position(const uint32_t block_num) {
+    uint64_t pos = 0;
+    _index.seekg(uint64_t(block_num - _begin_block) * sizeof(uint64_t));
+    _index.read((char*)&pos, sizeof(pos));
+    return pos;
+}
+
+void trace_history_log::read_header(chain::block_id_type& block_id, uint64_t& payload_size) {
+    if (_has_magic) {
+        uint64_t magic = 0;
+        _log.read((char*)&magic, sizeof(magic));
+    }
+    _log.read(block_id.data(), block_id.data_size());
+    _log.read((char*)&payload_size, sizeof(payload_size));
+}
+
+bool trace_history_log::read_traces(const uint32_t block_num, chain::block_id_type& block_id, std::vector<char>& traces) {
+    traces.clear();
+    if (block_num < _begin_block || block_num >= _end_block) return false;
+
+    _log.clear();
+    _index.clear();
+    _log.seekg(read_position(block_num));
+
+    uint64_t payload_size = 0;
+    read_header(block_id, payload_size);
+    EOS_ASSERT( _log && chain::block_header::num_from_id(block_id) == block_num, chain::plugin_exception,
+        "trace history log corrupted at block ${b}", ("b", block_num) );
+
+    // payload: uint32 압축 크기 + zlib 데이터
+    uint32_t compressed_size = 0;
+    _log.read((char*)&compressed_size, sizeof(compressed_size));
+    if (!compressed_size) return true;
+
+    std::vector<char> compressed(compressed_size);
+    _log.read(compressed.data(), compressed.size());
+    EOS_ASSERT( _log, chain::plugin_exception, "trace history log truncated at block ${b}", ("b", block_num) );
+
+    traces = zlib_decompress(compressed);
+    return true;
+}
+
+}
@@ -0,0 +1,39 @@
+#ifndef TRACE_HISTORY_LOG_H
+#define TRACE_HISTORY_LOG_H
+
+#include <eosio/chain/types.hpp>
+
+#include <fc/filesystem.hpp>
+
+#include <fstream>
+#include <vector>
+
+namespace eosio {
+    // state_history_plugin 의 trace_history.log / trace_history.index 읽기 전용 접근.
+    // 쓰레드마다 별도 인스턴스를 열어서 사용한다.
+    class trace_history_log {
+        public:
+            explicit trace_history_log(const fc::path& dir);
+            ~trace_history_log();
+
+            // [begin_block, end_block)
+            uint32_t begin_block() const { return _begin_block; }
+            uint32_t end_block() const { return _end_block; }
+
+            // block_num 의 packed transaction_trace[] (압축 해제된 상태). 
+            bool read_traces(const uint32_t block_num, chain::block_id_type& block_id, std::vector<char>& traces);
+
+        private:
+            uint64_t read_position(const uint32_t block_num);
+            void read_header(chain::block_id_type& block_id, uint64_t& payload_size);
+
+            std::ifstream _log;
+            std::ifstream _index;
+
+            // v1.8 부터 header 앞에 magic 이 붙는다. 
+            bool _has_magic = false;
+            uint32_t _begin_block = 0;
+            uint32_t _end_block = 0;
+    };
+}
+#endif
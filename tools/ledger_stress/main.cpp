@@ -0,0 +1,282 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  ledger_stress: synthetic eosio.token trace 를 ledger_table 에 넣어 ingest 처리량을 잰다.
+ *  nodeos 나 바쁜 네트워크 없이 plugin 과 같은 추출 / SQL 코드를 돌린다.
+ *  row 는 지정한 DB 에 실제로 쓰이므로 plugin 이 쓰는 DB 에는 돌리지 않는다. (committed_block 이 있으면 거부)
+ *
+ *  ledger_plugin_impl 은 chain controller 와 appbase 에 묶여 있어 여기서는 돌릴 수 없다.
+ *  그래서 plugin 의 trace 경로 중 ledger_table 부터 아래 (추출, SQL 생성, bulk, tokens) 만 같은 코드로 재고,
+ *  statement 실행은 ledger_ingest 와 같은 단순 queue (tools/common/offline_queries) 를 쓴다.
+ *  다음은 재지 않는다: accepted_block 에서의 trace 정렬과 dedup, worker_pool 의 stage / work stealing,
+ *  shard 라우팅, watermark / checkpoint, admission control 과 memory governor, pipelining 과 async 연결, sink.
+ */
+#include <eosio/chain/exceptions.hpp>
+
+#include <fc/log/logger.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include "ledger_table.hpp"
+#include "offline_queries.hpp"
+#include "synthetic_workload.hpp"
+
+namespace bpo = boost::program_options;
+
+namespace eosio {
+
+static std::mutex trace_mtx;
+static std::condition_variable trace_cond;
+static std::deque<chain::transaction_trace_ptr> trace_queue;
+static size_t max_trace_queue_size = 1000;
+static bool producer_done = false;
+
+static uint64_t resident_kb() {
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// plugin 의 process_add_ledger 와 같은 순서로 action_index 를 매긴다.
+class stress_worker {
+    public:
+        stress_worker(const bpo::variables_map& options, std::shared_ptr<connection_pool> pool,
+                std::shared_ptr<const extraction_rules> rules) :
+        _rules(rules),
+        _table(pool, options.at("ledger-db-ag-raw").as<uint32_t>(), options.at("ledger-db-ag-acc").as<uint32_t>())
+        {
+            // synthetic contract 는 chain 에 없다. 모두 같은 token ABI.
+            const fc::optional<chain::abi_def> abi = synthetic_workload::token_abi();
+            _table.set_abi_resolver([abi](const chain::account_name&) { return abi; });
+        }
+
+        void process(const chain::transaction_trace_ptr& t) {
+            uint32_t action_index = 0;
+            for (const auto& atrace : t->action_traces) process_action(atrace, action_index);
+        }
+
+        void end_batch(const int64_t tick) {
+            _table.end_batch();
+            _table.tick(tick);
+        }
+
+        void finalize() {
+            _table.finalize();
+        }
+
+    private:
+        void process_action(const chain::action_trace& atrace, uint32_t& action_index) {
+            const uint32_t index = action_index++;
+            if (const auto* rule = _rules->find(atrace.act.account.value, atrace.act.name.value)) {
+                _table.add_ledger(atrace.receipt.global_sequence, index, atrace.trx_id, atrace.block_num, atrace.block_time,
+                    atrace.receipt.receiver, atrace.act, *rule);
+            }
+            for (const auto& inline_atrace : atrace.inline_traces) process_action(inline_atrace, action_index);
+        }
+
+        std::shared_ptr<const extraction_rules> _rules;
+        ledger_table _table;
+};
+
+static int run(const bpo::variables_map& options) {
+    synthetic_workload::config config;
+    try {
+        config = synthetic_workload::parse(options.at("workload").as<std::string>());
+    } catch (const std::invalid_argument& e) {
+        EOS_ASSERT( false, chain::plugin_config_exception, "${e}", ("e", e.what()) );
+    }
+    set_max_queue_size(options.at("ledger-queue-size").as<uint32_t>());
+    max_trace_queue_size = options.at("ledger-trace-size").as<uint32_t>();
+
+    auto pool = std::make_shared<connection_pool>(
+        options.at("ledger-db-host").as<std::string>(),
+        options.at("ledger-db-user").as<std::string>(),
+        options.at("ledger-db-passwd").as<std::string>(),
+        options.at("ledger-db-database").as<std::string>(),
+        options.at("ledger-db-port").as<uint16_t>(),
+        options.at("ledger-db-max-connection").as<uint16_t>(),
+        false);
+
+    uint64_t first_global_sequence;
+    uint32_t first_block;
+    {
+        // plugin 이 쓰는 DB 면 wipe 전에 거부한다.
+        ledger_table schema(pool, 1, 1);
+        const uint32_t partition_blocks = options.at("ledger-db-partition-blocks").as<uint32_t>();
+        schema.create(partition_blocks);
+        EOS_ASSERT( !schema.get_state("committed_block") && !schema.get_state("bootstrap_block"), chain::plugin_config_exception,
+            "database holds ledger_plugin checkpoints; point ledger_stress at a scratch database" );
+        if (options.at("ledger-data-wipe").as<bool>()) {
+            schema.drop();
+            schema.create(partition_blocks);
+        }
+        // 다시 돌리면 앞의 row 뒤에 이어서.
+        first_global_sequence = schema.get_max_action_id() + 1;
+        first_block = schema.get_max_block_number() + 1;
+        schema.ensure_partition(first_block + config.transactions / std::max<uint32_t>(config.block_trx, 1) + 1, 0);
+    }
+
+    const auto rules = std::make_shared<const extraction_rules>(extraction_rules::defaults());
+    const uint32_t thread_count = std::max<uint32_t>(options.at("threads").as<uint32_t>(), 1);
+    const uint32_t query_thread_count = std::max<uint32_t>(options.at("ledger-db-query-thread").as<uint32_t>(), 1);
+
+    synthetic_workload workload(config, first_global_sequence, first_block);
+    ilog("stress ${s}: ${n} transactions from global sequence ${g}, block ${b}",
+        ("s", synthetic_workload::scenario_name(config.kind))("n", config.transactions)("g", first_global_sequence)("b", first_block));
+
+    std::vector<std::thread> writers;
+    for (uint32_t i = 0; i < query_thread_count; i++) {
+        writers.emplace_back([pool] { consume_queries(pool); });
+    }
+
+    std::atomic<uint64_t> processed{0};
+    std::vector<std::unique_ptr<stress_worker>> workers;
+    for (uint32_t i = 0; i < thread_count; i++) {
+        workers.emplace_back(std::make_unique<stress_worker>(options, pool, rules));
+    }
+
+    // plugin 처럼 trace queue 에서 한 번에 가져갈 수 있는 만큼 묶어 처리한다.
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) {
+        threads.emplace_back([&, w = worker.get()] {
+            std::deque<chain::transaction_trace_ptr> batch;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(trace_mtx);
+                    trace_cond.wait(lock, [] { return !trace_queue.empty() || producer_done; });
+                    if (trace_queue.empty()) break;
+                    const size_t n = std::max<size_t>(1, trace_queue.size() / workers.size());
+                    for (size_t i = 0; i < n && !trace_queue.empty(); i++) {
+                        batch.push_back(std::move(trace_queue.front()));
+                        trace_queue.pop_front();
+                    }
+                }
+                trace_cond.notify_all();
+                for (const auto& t : batch) {
+                    try {
+                        w->process(t);
+                    } catch (fc::exception& e) {
+                        elog("trace failed: ${e}", ("e", e.to_string()));
+                    } catch (std::exception& e) {
+                        elog("trace failed: ${e}", ("e", e.what()));
+                    }
+                }
+                processed += batch.size();
+                batch.clear();
+                w->end_batch(get_now_tick());
+            }
+            w->finalize();
+        });
+    }
+
+    const auto start_time = fc::time_point::now();
+    auto last_time = start_time;
+    uint64_t last_trx = 0, last_actions = 0;
+    size_t peak_trace = 0, peak_query = 0;
+
+    auto report = [&](const fc::time_point& now) {
+        size_t trace_size = 0, query_size = 0;
+        {
+            std::lock_guard<std::mutex> lock(trace_mtx);
+            trace_size = trace_queue.size();
+        }
+        query_size = query_queue_size();
+        peak_trace = std::max(peak_trace, trace_size);
+        peak_query = std::max(peak_query, query_size);
+        const double sec = std::max<int64_t>((now - last_time).count(), 1) / 1e6;
+        ilog("stress: ${t} trx/s, ${a} actions/s, trace queue ${tq}, query queue ${qq}, processed ${p}, rss ${r} KB",
+            ("t", uint64_t((workload.transactions() - last_trx) / sec))("a", uint64_t((workload.actions() - last_actions) / sec))
+            ("tq", trace_size)("qq", query_size)("p", processed.load())("r", resident_kb()));
+        last_time = now;
+        last_trx = workload.transactions();
+        last_actions = workload.actions();
+    };
+
+    // 생성 속도는 trace queue 크기에 묶이므로 처리량과 같다.
+    while (!workload.done()) {
+        auto t = workload.next();
+        {
+            std::unique_lock<std::mutex> lock(trace_mtx);
+            trace_cond.wait(lock, [] { return trace_queue.size() < max_trace_queue_size; });
+            trace_queue.push_back(std::move(t));
+        }
+        trace_cond.notify_all();
+        if ((workload.transactions() & 1023) == 0) {
+            const auto now = fc::time_point::now();
+            if (now - last_time >= fc::seconds(1)) report(now);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(trace_mtx);
+        producer_done = true;
+    }
+    trace_cond.notify_all();
+    for (auto& t : threads) t.join();
+
+    finish_queries();
+    for (auto& t : writers) t.join();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    const auto elapsed = fc::time_point::now() - start_time;
+    ilog("stress done: ${n} transactions, ${a} actions in ${t}, ${r} trx/s, peak trace queue ${tq}, peak query queue ${qq}, peak rss ${m} KB, failed queries ${f}",
+        ("n", workload.transactions())("a", workload.actions())("t", elapsed)
+        ("r", uint64_t(workload.transactions() * 1e6 / std::max<int64_t>(elapsed.count(), 1)))
+        ("tq", peak_trace)("qq", peak_query)("m", usage.ru_maxrss)("f", failed_queries()));
+    return failed_queries() ? 1 : 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    bpo::options_description desc("ledger_stress options");
+    desc.add_options()
+        ("help,h", "Print this help message and exit.")
+        ("workload", bpo::value<std::string>()->default_value("mixed"),
+            "'<airdrop|hot|inline|memo|spam|mixed> [transactions=N] [accounts=N] [contracts=N] [hot_share=F] "
+            "[inline_depth=N] [memo_bytes=N] [actions=N] [block_trx=N] [seed=N]'")
+        ("threads", bpo::value<uint32_t>()->default_value(4), "Trace worker thread count.")
+        ("ledger-trace-size", bpo::value<uint32_t>()->default_value(1000), "Trace queue size.")
+        ("ledger-queue-size", bpo::value<uint32_t>()->default_value(1000), "Query queue size.")
+        ("ledger-db-query-thread", bpo::value<uint32_t>()->default_value(4), "Query work thread count.")
+        ("ledger-db-host", bpo::value<std::string>()->required(), "ledger DB host address string")
+        ("ledger-db-port", bpo::value<uint16_t>()->default_value(3306), "ledger DB port integer")
+        ("ledger-db-user", bpo::value<std::string>()->required(), "ledger DB user id string")
+        ("ledger-db-passwd", bpo::value<std::string>()->required(), "ledger DB user password string")
+        ("ledger-db-database", bpo::value<std::string>()->required(), "ledger DB database name string (a scratch one)")
+        ("ledger-db-max-connection", bpo::value<uint16_t>()->default_value(8), "ledger DB max connection.")
+        ("ledger-db-ag-raw", bpo::value<uint32_t>()->default_value(1000), "ledger raw db aggregation count")
+        ("ledger-db-ag-acc", bpo::value<uint32_t>()->default_value(1000), "ledger acc db aggregation count")
+        ("ledger-db-partition-blocks", bpo::value<uint32_t>()->default_value(10000000), "Block range of each ledger table partition.")
+        ("ledger-data-wipe", bpo::bool_switch()->default_value(false), "Drop and recreate the ledger tables first.")
+        ;
+
+    try {
+        bpo::variables_map options;
+        bpo::store(bpo::parse_command_line(argc, argv, desc), options);
+        if (options.count("help")) {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        bpo::notify(options);
+        return eosio::run(options);
+    } catch (fc::exception& e) {
+        elog("${e}", ("e", e.to_detail_string()));
+    } catch (std::exception& e) {
+        elog("${e}", ("e", e.what()));
+    }
+    return 1;
+}
@@ -0,0 +1,250 @@
+#include "synthetic_workload.hpp"
+
+#include <fc/crypto/sha256.hpp>
+#include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
+
+#include <sstream>
+#include <stdexcept>
+
+namespace eosio {
+
+static const char* const token_abi_json = R"=====({
+   "version": "eosio::abi/1.0",
+   "structs": [
+      { "name": "transfer", "base": "", "fields": [
+         { "name": "from", "type": "name" },
+         { "name": "to", "type": "name" },
+         { "name": "quantity", "type": "asset" },
+         { "name": "memo", "type": "string" } ] },
+      { "name": "create", "base": "", "fields": [
+         { "name": "issuer", "type": "name" },
+         { "name": "maximum_supply", "type": "asset" } ] }
+   ],
+   "actions": [
+      { "name": "transfer", "type": "transfer", "ricardian_contract": "" },
+      { "name": "create", "type": "create", "ricardian_contract": "" }
+   ]
+})=====";
+
+static const chain::account_name token_contract = N(eosio.token);
+static const chain::account_name airdropper = N(airdropper);
+static const chain::account_name exchange = N(exchange);
+static const chain::account_name spam_issuer = N(spammer);
+
+static const synthetic_workload::scenario rotation[] = {
+    synthetic_workload::scenario::airdrop,
+    synthetic_workload::scenario::hot,
+    synthetic_workload::scenario::inline_tree,
+    synthetic_workload::scenario::memo,
+    synthetic_workload::scenario::spam,
+};
+
+// 12 자 name : prefix 4 자 + index 를 base-26 (a-z) 8 자로
+static std::string indexed_name(const char* prefix, uint64_t index, const bool upper = false, const size_t digits = 8) {
+    std::string s(prefix);
+    std::string tail(digits, upper ? 'A' : 'a');
+    for (size_t i = digits; i-- > 0 && index; index /= 26) tail[i] += static_cast<char>(index % 26);
+    return s + tail;
+}
+
+template<typename T>
+static T parse_number(const std::string& key, const std::string& value, const std::string& spec) {
+    try {
+        size_t used = 0;
+        const double v = std::stod(value, &used);
+        if (used == value.size() && v >= 0) return static_cast<T>(v);
+    } catch (const std::exception&) {
+    }
+    throw std::invalid_argument("invalid value '" + value + "' for " + key + " in stress spec: " + spec);
+}
+
+synthetic_workload::config synthetic_workload::parse(const std::string& spec) {
+    std::istringstream in(spec);
+    std::string kind;
+    if (!(in >> kind)) throw std::invalid_argument("stress spec needs <scenario>: " + spec);
+
+    config c;
+    if (kind == "airdrop") c.kind = scenario::airdrop;
+    else if (kind == "hot") c.kind = scenario::hot;
+    else if (kind == "inline") c.kind = scenario::inline_tree;
+    else if (kind == "memo") {
+        c.kind = scenario::memo;
+        c.memo_bytes = 64 * 1024;
+    }
+    else if (kind == "spam") c.kind = scenario::spam;
+    else if (kind == "mixed") c.kind = scenario::mixed;
+    else throw std::invalid_argument("unknown stress scenario '" + kind + "': " + spec);
+
+    std::string option;
+    while (in >> option) {
+        const auto eq = option.find('=');
+        if (eq == std::string::npos) throw std::invalid_argument("expected <key>=<value>: " + spec);
+        const auto key = option.substr(0, eq);
+        const auto value = option.substr(eq + 1);
+        if (key == "transactions") c.transactions = parse_number<uint64_t>(key, value, spec);
+        else if (key == "accounts") c.accounts = parse_number<uint32_t>(key, value, spec);
+        else if (key == "contracts") c.contracts = parse_number<uint32_t>(key, value, spec);
+        else if (key == "hot_share") c.hot_share = parse_number<double>(key, value, spec);
+        else if (key == "inline_depth") c.inline_depth = parse_number<uint32_t>(key, value, spec);
+        else if (key == "memo_bytes") c.memo_bytes = parse_number<uint32_t>(key, value, spec);
+        else if (key == "actions") c.actions = parse_number<uint32_t>(key, value, spec);
+        else if (key == "block_trx") c.block_trx = parse_number<uint32_t>(key, value, spec);
+        else if (key == "seed") c.seed = parse_number<uint64_t>(key, value, spec);
+        else throw std::invalid_argument("unknown stress option '" + key + "': " + spec);
+    }
+
+    if (c.accounts < 2 || c.contracts == 0 || c.actions == 0 || c.block_trx == 0 || c.hot_share > 1)
+        throw std::invalid_argument("stress spec out of range: " + spec);
+    return c;
+}
+
+const char* synthetic_workload::scenario_name(const scenario kind) {
+    switch (kind) {
+        case scenario::airdrop: return "airdrop";
+        case scenario::hot: return "hot";
+        case scenario::inline_tree: return "inline";
+        case scenario::memo: return "memo";
+        case scenario::spam: return "spam";
+        case scenario::mixed: return "mixed";
+    }
+    return "unknown";
+}
+
+chain::abi_def synthetic_workload::token_abi() {
+    return fc::json::from_string(token_abi_json).as<chain::abi_def>();
+}
+
+synthetic_workload::synthetic_workload(const config& c, const uint64_t first_global_sequence, const uint32_t first_block) :
+_config(c),
+_rng(c.seed),
+_global_sequence(first_global_sequence),
+_block_num(first_block ? first_block : 1),
+_block_time(fc::time_point::now()),
+_created(c.contracts, false),
+_memo(c.memo_bytes, 'm')
+{
+
+}
+
+chain::account_name synthetic_workload::account(const uint64_t index) const {
+    return chain::name(indexed_name("acct", index));
+}
+
+chain::account_name synthetic_workload::random_account() {
+    return account(_rng() % _config.accounts);
+}
+
+chain::asset synthetic_workload::random_quantity(const chain::symbol& sym) {
+    return chain::asset(static_cast<int64_t>(_rng() % 1000000) + 1, sym);
+}
+
+chain::action_trace synthetic_workload::make_action(const chain::account_name& receiver, const chain::action& act) {
+    chain::action_trace atrace;
+    atrace.receipt.receiver = receiver;
+    atrace.receipt.global_sequence = _global_sequence++;
+    atrace.receipt.recv_sequence = atrace.receipt.global_sequence;
+    atrace.act = act;
+    atrace.trx_id = _trx_id;
+    atrace.block_num = _block_num;
+    atrace.block_time = _block_time;
+    _action_traces++;
+    return atrace;
+}
+
+// contract 의 trace 아래에 from, to 알림. depth 가 남으면 to 가 다음 account 로 다시 보낸다.
+void synthetic_workload::add_transfer(std::vector<chain::action_trace>& out, const chain::account_name& contract,
+                                      const chain::account_name& from, const chain::account_name& to,
+                                      const chain::asset& quantity, const uint32_t depth) {
+    chain::action act;
+    act.account = contract;
+    act.name = N(transfer);
+    act.authorization.push_back(chain::permission_level{ from, N(active) });
+    act.data.resize(fc::raw::pack_size(from) + fc::raw::pack_size(to) + fc::raw::pack_size(quantity) + fc::raw::pack_size(_memo));
+    fc::datastream<char*> ds(act.data.data(), act.data.size());
+    fc::raw::pack(ds, from);
+    fc::raw::pack(ds, to);
+    fc::raw::pack(ds, quantity);
+    fc::raw::pack(ds, _memo);
+
+    out.push_back(make_action(contract, act));
+    auto& root = out.back();
+    root.inline_traces.push_back(make_action(from, act));
+    root.inline_traces.push_back(make_action(to, act));
+
+    if (depth > 0) {
+        add_transfer(root.inline_traces.back().inline_traces, contract, to, random_account(), quantity, depth - 1);
+    }
+}
+
+void synthetic_workload::add_create(std::vector<chain::action_trace>& out, const chain::account_name& contract,
+                                    const chain::account_name& issuer, const chain::asset& maximum_supply) {
+    chain::action act;
+    act.account = contract;
+    act.name = N(create);
+    act.authorization.push_back(chain::permission_level{ contract, N(active) });
+    act.data.resize(fc::raw::pack_size(issuer) + fc::raw::pack_size(maximum_supply));
+    fc::datastream<char*> ds(act.data.data(), act.data.size());
+    fc::raw::pack(ds, issuer);
+    fc::raw::pack(ds, maximum_supply);
+    out.push_back(make_action(contract, act));
+}
+
+void synthetic_workload::fill(std::vector<chain::action_trace>& out, const scenario kind) {
+    static const chain::symbol eos(4, "EOS");
+
+    switch (kind) {
+        case scenario::airdrop:
+            add_transfer(out, token_contract, airdropper, account(_airdrop_next++ % _config.accounts), chain::asset(10000, eos), 0);
+            break;
+        case scenario::hot: {
+            auto from = random_account(), to = random_account();
+            if (std::generate_canonical<double, 32>(_rng) < _config.hot_share) {
+                if (_rng() & 1) from = exchange;
+                else to = exchange;
+            }
+            add_transfer(out, token_contract, from, to, random_quantity(eos), 0);
+            break;
+        }
+        case scenario::inline_tree:
+            add_transfer(out, token_contract, random_account(), random_account(), random_quantity(eos), _config.inline_depth);
+            break;
+        case scenario::memo:
+            add_transfer(out, token_contract, random_account(), random_account(), random_quantity(eos), 0);
+            break;
+        case scenario::spam: {
+            const uint64_t index = _rng() % _config.contracts;
+            const chain::account_name contract(indexed_name("tokn", index));
+            const chain::symbol sym(4, indexed_name("S", index, true, 6).c_str());
+            if (!_created[index]) {
+                _created[index] = true;
+                add_create(out, contract, spam_issuer, chain::asset(1000000000000ll, sym));
+            }
+            add_transfer(out, contract, spam_issuer, random_account(), random_quantity(sym), 0);
+            break;
+        }
+        case scenario::mixed:
+            fill(out, rotation[_produced % (sizeof(rotation) / sizeof(rotation[0]))]);
+            break;
+    }
+}
+
+chain::transaction_trace_ptr synthetic_workload::next() {
+    if (_produced && _produced % _config.block_trx == 0) {
+        _block_num++;
+        _block_time = _block_time.next();
+    }
+    // 다시 돌려도 tokens_applied 에 걸리지 않도록 이어지는 global sequence 로.
+    _trx_id = fc::sha256::hash(reinterpret_cast<const char*>(&_global_sequence), sizeof(_global_sequence));
+
+    auto t = std::make_shared<chain::transaction_trace>();
+    t->id = _trx_id;
+    t->block_num = _block_num;
+    t->block_time = _block_time;
+    for (uint32_t i = 0; i < _config.actions; i++) fill(t->action_traces, _config.kind);
+
+    _produced++;
+    return t;
+}
+
+}
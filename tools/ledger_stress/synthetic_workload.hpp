@@ -0,0 +1,86 @@
+#ifndef SYNTHETIC_WORKLOAD_H
+#define SYNTHETIC_WORKLOAD_H
+
+#include <eosio/chain/abi_def.hpp>
+#include <eosio/chain/asset.hpp>
+#include <eosio/chain/trace.hpp>
+#include <eosio/chain/types.hpp>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace eosio {
+    // 부하 시험용 transaction_trace 생성기. payload 는 eosio.token 과 같은 ABI 로 pack 한다.
+    //
+    //   "<scenario> [transactions=N] [accounts=N] [contracts=N] [hot_share=F] [inline_depth=N]
+    //               [memo_bytes=N] [actions=N] [block_trx=N] [seed=N]"
+    //
+    //  - airdrop : 한 account 가 accounts 개의 account 에 차례로 보낸다. (매번 새 tokens row)
+    //  - hot     : transfer 의 hot_share 만큼 한 exchange account 가 from 또는 to
+    //  - inline  : 받은 쪽이 다시 보내는 inline transfer 가 inline_depth 단계로 이어진다
+    //  - memo    : memo_bytes 크기의 memo (이 시나리오의 기본값은 64KB)
+    //  - spam    : contracts 개의 token contract. contract 마다 처음 한 번 create
+    //  - mixed   : 위 다섯 가지를 transaction 마다 번갈아
+    //
+    // transfer 는 실제 chain 처럼 contract, from, to 세 receiver 의 trace 로 만든다.
+    class synthetic_workload {
+        public:
+            enum class scenario { airdrop, hot, inline_tree, memo, spam, mixed };
+
+            struct config {
+                scenario kind = scenario::mixed;
+                uint64_t transactions = 100000;
+                uint32_t accounts = 100000;
+                uint32_t contracts = 1000;
+                double   hot_share = 0.8;
+                uint32_t inline_depth = 8;
+                uint32_t memo_bytes = 16;
+                uint32_t actions = 1;           // transaction 당 최상위 action
+                uint32_t block_trx = 100;       // block 당 transaction
+                uint64_t seed = 1;
+            };
+
+            // 잘못된 형식이면 std::invalid_argument
+            static config parse(const std::string& spec);
+            static const char* scenario_name(const scenario kind);
+            // 모든 synthetic contract 가 쓰는 ABI (transfer, create)
+            static chain::abi_def token_abi();
+
+            synthetic_workload(const config& c, const uint64_t first_global_sequence, const uint32_t first_block);
+
+            bool done() const { return _produced >= _config.transactions; }
+            chain::transaction_trace_ptr next();
+
+            uint64_t transactions() const { return _produced; }
+            uint64_t actions() const { return _action_traces; }
+            uint32_t block_num() const { return _block_num; }
+
+        private:
+            chain::action_trace make_action(const chain::account_name& receiver, const chain::action& act);
+            void add_transfer(std::vector<chain::action_trace>& out, const chain::account_name& contract,
+                              const chain::account_name& from, const chain::account_name& to,
+                              const chain::asset& quantity, const uint32_t depth);
+            void add_create(std::vector<chain::action_trace>& out, const chain::account_name& contract,
+                            const chain::account_name& issuer, const chain::asset& maximum_supply);
+            void fill(std::vector<chain::action_trace>& out, const scenario kind);
+
+            chain::account_name account(const uint64_t index) const;
+            chain::account_name random_account();
+            chain::asset random_quantity(const chain::symbol& sym);
+
+            config _config;
+            std::mt19937_64 _rng;
+            uint64_t _global_sequence;
+            uint32_t _block_num;
+            chain::block_timestamp_type _block_time;
+            chain::transaction_id_type _trx_id;
+            uint64_t _produced = 0;
+            uint64_t _action_traces = 0;
+            uint64_t _airdrop_next = 0;
+            std::vector<bool> _created;         // spam contract 별 create 여부
+            std::string _memo;
+    };
+}
+#endif